@@ -0,0 +1,291 @@
+/*
+ * NanoNIC egress descriptor
+ *
+ * An application built with -D NANONIC_META prepends one 64-byte descriptor
+ * (exactly one beat of the 512-bit open_nic bus) to the packets it emits. The
+ * descriptor carries what the pipeline computed about the packet, so that the
+ * egress logic in nanonic_pipeline_top and the host software that receives the
+ * packet over QDMA C2H do not have to parse headers or hash flows again.
+ *
+ * All multi-byte fields are big-endian and are written byte by byte, which
+ * keeps the code free of byte swap intrinsics in Nanotube.
+ *
+ *   0  magic 'N' 'T'          2  version           3  verdict (XDP_*)
+ *   4  flags (NANONIC_F_*)    5  class tag         6  event code
+ *   7  encap type             8  flow hash         12 real index
+ *   16 vip number             18 frame length (bytes after the descriptor)
+ *   20 .. 63 parameters of the egress engines (see below)
+ *
+ * The parameter area asks the checksum and encapsulation engine of the card
+ * (rtl/nanonic_encap.v) to finish the packet, so that the application does not
+ * grow the packet head or compute checksums in its own stages:
+ *
+ *   20 checksum ops (NANONIC_CSUM_*)  21 L4 checksum offset in the frame
+ *   22 rewritten field offset         23 rewritten field length (2..8, even)
+ *   24 .. 31 old value of the rewritten field
+ *   32 outer TOS / traffic class      33 outer TTL / hop limit
+ *   34 outer protocol / next header   36 outer source (IPv4, or the low 32
+ *                                        bits of an IPv6 source whose prefix
+ *                                        is a register of the engine)
+ *   40 outer destination (IPv4 in 40 .. 43, IPv6 in 40 .. 55)
+ *   56 IPv4 id (56 .. 57) / IPv6 flow label (low 20 bits of 56 .. 59)
+ *   60 inner length (IP packet carried by the outer header)
+ *
+ * A frame that reaches the card already starting with the magic and version
+ * is flagged by nanonic_pipeline_top in the tuser of the pipeline, and the
+ * egress blocks ignore whatever descriptor it carries when it leaves, so a
+ * sender cannot choose the verdict or the egress operations of its frames.
+ * nanonic_push_desc_ops() refuses such a frame, which the application then
+ * treats like any frame it could not push a descriptor on.
+ *
+ * Host code can include this header with NANONIC_DESC_HOST defined to get the
+ * layout and the parsing helpers without the XDP helper.
+ */
+#ifndef __NANONIC_DESC_H
+#define __NANONIC_DESC_H
+
+#include <linux/types.h>
+
+#define NANONIC_DESC_LEN        64
+#define NANONIC_DESC_MAGIC0     0x4E
+#define NANONIC_DESC_MAGIC1     0x54
+#define NANONIC_DESC_VERSION    1
+
+// Byte offsets inside the descriptor
+#define NANONIC_DESC_OFF_MAGIC      0
+#define NANONIC_DESC_OFF_VERSION    2
+#define NANONIC_DESC_OFF_VERDICT    3
+#define NANONIC_DESC_OFF_FLAGS      4
+#define NANONIC_DESC_OFF_CLASS      5
+#define NANONIC_DESC_OFF_EVENT      6
+#define NANONIC_DESC_OFF_ENCAP      7
+#define NANONIC_DESC_OFF_HASH       8
+#define NANONIC_DESC_OFF_REAL       12
+#define NANONIC_DESC_OFF_VIP        16
+#define NANONIC_DESC_OFF_LEN        18
+#define NANONIC_DESC_OFF_PARAMS     20
+#define NANONIC_DESC_OFF_CSUM_OPS   20
+#define NANONIC_DESC_OFF_L4_CSUM    21
+#define NANONIC_DESC_OFF_L4_FIELD   22
+#define NANONIC_DESC_OFF_L4_LEN     23
+#define NANONIC_DESC_OFF_L4_OLD     24
+#define NANONIC_DESC_OFF_OUTER_TOS  32
+#define NANONIC_DESC_OFF_OUTER_TTL  33
+#define NANONIC_DESC_OFF_OUTER_PROTO 34
+#define NANONIC_DESC_OFF_OUTER_SRC  36
+#define NANONIC_DESC_OFF_OUTER_DST  40
+#define NANONIC_DESC_OFF_OUTER_ID   56
+#define NANONIC_DESC_OFF_INNER_LEN  60
+
+// Event codes, Katran's introspection events (KATRAN_INTROSPECTION)
+#define NANONIC_EVENT_NONE                0
+#define NANONIC_EVENT_TCP_NONSYN_LRUMISS  1   // non-SYN TCP packet missed the LRU
+#define NANONIC_EVENT_QUIC_NO_REAL        2   // QUIC server id without a mapping
+#define NANONIC_EVENT_LRU_INSERT          3   // new LRU entry (NANONIC_WARM_RESTART)
+
+// Encapsulation types (descriptor byte 7)
+#define NANONIC_ENCAP_NONE  0
+#define NANONIC_ENCAP_IPIP  1   // outer IPv4 header, 20 bytes
+#define NANONIC_ENCAP_IP6   2   // outer IPv6 header, 40 bytes
+
+// Checksum operations
+#define NANONIC_CSUM_IP4    (1 << 0)  // recompute the IPv4 header checksum
+#define NANONIC_CSUM_L4     (1 << 1)  // incremental update for a rewritten field
+#define NANONIC_CSUM_L4_UDP (1 << 2)  // UDP rules: 0 stays 0, 0 becomes 0xFFFF
+
+// Flags: which of the optional fields are meaningful
+#define NANONIC_F_HASH      (1 << 0)
+#define NANONIC_F_REAL      (1 << 1)
+#define NANONIC_F_VIP       (1 << 2)
+#define NANONIC_F_CLASS     (1 << 3)
+// The packet pinned its connection to the real index in the LRU
+#define NANONIC_F_PINNED    (1 << 4)
+// Set by the event tap of the card on the copies it sends to the host
+#define NANONIC_F_SAMPLE    (1 << 7)
+
+// Class tags used by the Custom_applications
+#define NANONIC_CLASS_NONE          0
+#define NANONIC_CLASS_MONITOR       1   // ICMP from MONITOR_IP, counter updated
+#define NANONIC_CLASS_ICMP_LIMITED  2   // ICMP limiter, source below the threshold
+#define NANONIC_CLASS_LB_FORWARD    3   // Katran, packet encapsulated to a real
+#define NANONIC_CLASS_LB_QUIC       4   // Katran, real selected by QUIC CID
+#define NANONIC_CLASS_REFLECT       5   // swap_mac, frame sent back to the sender
+
+struct nanonic_desc_info {
+  __u8 verdict;
+  __u8 flags;
+  __u8 class_tag;
+  __u8 event;
+  __u32 flow_hash;
+  __u32 real_index;
+  __u16 vip_num;
+  __u16 frame_len;
+};
+
+// Work left to the egress engines, addresses in network byte order
+struct nanonic_egress_ops {
+  __u8 encap;
+  __u8 csum_ops;
+  __u8 l4_csum_off;   // checksum and field must end within frame byte 63,
+  __u8 l4_field_off;  // the engine ignores the fix-up otherwise
+  __u8 l4_field_len;  // at most 8
+  __u8 l4_old[8];
+  __u8 outer_tos;
+  __u8 outer_ttl;
+  __u8 outer_proto;
+  __u8 outer_src[4];
+  __u8 outer_dst[16];
+  __u32 outer_id;
+  __u16 inner_len;
+};
+
+static inline __u32 nanonic_get_be32(const __u8 *p) {
+  return ((__u32)p[0] << 24) | ((__u32)p[1] << 16) |
+         ((__u32)p[2] << 8) | (__u32)p[3];
+}
+
+static inline __u16 nanonic_get_be16(const __u8 *p) {
+  return (__u16)(((__u16)p[0] << 8) | (__u16)p[1]);
+}
+
+// Returns 1 and fills info if the buffer starts with a descriptor
+static inline int nanonic_desc_parse(const __u8 *p, __u32 len,
+                                     struct nanonic_desc_info *info) {
+  if (len < NANONIC_DESC_LEN ||
+      p[NANONIC_DESC_OFF_MAGIC] != NANONIC_DESC_MAGIC0 ||
+      p[NANONIC_DESC_OFF_MAGIC + 1] != NANONIC_DESC_MAGIC1 ||
+      p[NANONIC_DESC_OFF_VERSION] != NANONIC_DESC_VERSION) {
+    return 0;
+  }
+  info->verdict = p[NANONIC_DESC_OFF_VERDICT];
+  info->flags = p[NANONIC_DESC_OFF_FLAGS];
+  info->class_tag = p[NANONIC_DESC_OFF_CLASS];
+  info->event = p[NANONIC_DESC_OFF_EVENT];
+  info->flow_hash = nanonic_get_be32(p + NANONIC_DESC_OFF_HASH);
+  info->real_index = nanonic_get_be32(p + NANONIC_DESC_OFF_REAL);
+  info->vip_num = nanonic_get_be16(p + NANONIC_DESC_OFF_VIP);
+  info->frame_len = nanonic_get_be16(p + NANONIC_DESC_OFF_LEN);
+  return 1;
+}
+
+#ifndef NANONIC_DESC_HOST
+
+static inline void nanonic_put_be32(__u8 *p, __u32 v) {
+  p[0] = (v >> 24) & 0xFF;
+  p[1] = (v >> 16) & 0xFF;
+  p[2] = (v >> 8) & 0xFF;
+  p[3] = v & 0xFF;
+}
+
+static inline void nanonic_put_be16(__u8 *p, __u16 v) {
+  p[0] = (v >> 8) & 0xFF;
+  p[1] = v & 0xFF;
+}
+
+// True when the frame starts with the magic and version of a descriptor; the
+// card ignores the descriptor of such a frame, so none is pushed on it
+__attribute__((__always_inline__))
+static inline bool nanonic_desc_lookalike(void *data, void *data_end) {
+  __u8 *p = data;
+
+  return data + NANONIC_DESC_OFF_VERDICT <= data_end &&
+         p[NANONIC_DESC_OFF_MAGIC] == NANONIC_DESC_MAGIC0 &&
+         p[NANONIC_DESC_OFF_MAGIC + 1] == NANONIC_DESC_MAGIC1 &&
+         p[NANONIC_DESC_OFF_VERSION] == NANONIC_DESC_VERSION;
+}
+
+// Prepend the descriptor to the packet, with the parameters of the egress
+// engines when ops is not NULL. Must be the last packet access of the program,
+// right before returning the verdict stored in the descriptor. Returns false,
+// without touching the packet, when the frame itself starts like a descriptor.
+__attribute__((__always_inline__))
+static inline bool nanonic_push_desc_ops(struct xdp_md *xdp,
+                                         const struct nanonic_desc_info *info,
+                                         const struct nanonic_egress_ops *ops) {
+  void *data = (void *)(long)xdp->data;
+  void *data_end = (void *)(long)xdp->data_end;
+  __u16 frame_len = data_end - data;
+  __u8 *desc;
+
+  if (nanonic_desc_lookalike(data, data_end)) {
+    return false;
+  }
+  if (bpf_xdp_adjust_head(xdp, 0 - NANONIC_DESC_LEN)) {
+    return false;
+  }
+  data = (void *)(long)xdp->data;
+  data_end = (void *)(long)xdp->data_end;
+  if (data + NANONIC_DESC_LEN > data_end) {
+    return false;
+  }
+  desc = data;
+
+  #pragma unroll
+  for (int i = 0; i < NANONIC_DESC_LEN; i++) {
+    desc[i] = 0;
+  }
+  desc[NANONIC_DESC_OFF_MAGIC] = NANONIC_DESC_MAGIC0;
+  desc[NANONIC_DESC_OFF_MAGIC + 1] = NANONIC_DESC_MAGIC1;
+  desc[NANONIC_DESC_OFF_VERSION] = NANONIC_DESC_VERSION;
+  desc[NANONIC_DESC_OFF_VERDICT] = info->verdict;
+  desc[NANONIC_DESC_OFF_FLAGS] = info->flags;
+  desc[NANONIC_DESC_OFF_CLASS] = info->class_tag;
+  desc[NANONIC_DESC_OFF_EVENT] = info->event;
+  nanonic_put_be32(desc + NANONIC_DESC_OFF_HASH, info->flow_hash);
+  nanonic_put_be32(desc + NANONIC_DESC_OFF_REAL, info->real_index);
+  nanonic_put_be16(desc + NANONIC_DESC_OFF_VIP, info->vip_num);
+  nanonic_put_be16(desc + NANONIC_DESC_OFF_LEN, frame_len);
+  if (!ops) {
+    return true;
+  }
+
+  desc[NANONIC_DESC_OFF_ENCAP] = ops->encap;
+  desc[NANONIC_DESC_OFF_CSUM_OPS] = ops->csum_ops;
+  desc[NANONIC_DESC_OFF_L4_CSUM] = ops->l4_csum_off;
+  desc[NANONIC_DESC_OFF_L4_FIELD] = ops->l4_field_off;
+  desc[NANONIC_DESC_OFF_L4_LEN] = ops->l4_field_len;
+  #pragma unroll
+  for (int i = 0; i < 8; i++) {
+    desc[NANONIC_DESC_OFF_L4_OLD + i] = ops->l4_old[i];
+  }
+  desc[NANONIC_DESC_OFF_OUTER_TOS] = ops->outer_tos;
+  desc[NANONIC_DESC_OFF_OUTER_TTL] = ops->outer_ttl;
+  desc[NANONIC_DESC_OFF_OUTER_PROTO] = ops->outer_proto;
+  #pragma unroll
+  for (int i = 0; i < 4; i++) {
+    desc[NANONIC_DESC_OFF_OUTER_SRC + i] = ops->outer_src[i];
+  }
+  #pragma unroll
+  for (int i = 0; i < 16; i++) {
+    desc[NANONIC_DESC_OFF_OUTER_DST + i] = ops->outer_dst[i];
+  }
+  nanonic_put_be32(desc + NANONIC_DESC_OFF_OUTER_ID, ops->outer_id);
+  nanonic_put_be16(desc + NANONIC_DESC_OFF_INNER_LEN, ops->inner_len);
+  return true;
+}
+
+__attribute__((__always_inline__))
+static inline bool nanonic_push_desc(struct xdp_md *xdp,
+                                     const struct nanonic_desc_info *info) {
+  return nanonic_push_desc_ops(xdp, info, 0);
+}
+
+// Exit of a packet for the kernel: push a descriptor with the XDP_PASS verdict
+// and the class tag, and pass the packet even when no descriptor could be
+// pushed, since the egress reports a frame without one as XDP_PASS too
+__attribute__((__always_inline__))
+static inline int nanonic_pass(struct xdp_md *xdp, __u8 class_tag) {
+  struct nanonic_desc_info info = {};
+
+  info.verdict = XDP_PASS;
+  if (class_tag != NANONIC_CLASS_NONE) {
+    info.flags = NANONIC_F_CLASS;
+    info.class_tag = class_tag;
+  }
+  nanonic_push_desc(xdp, &info);
+  return XDP_PASS;
+}
+
+#endif // NANONIC_DESC_HOST
+
+#endif // __NANONIC_DESC_H
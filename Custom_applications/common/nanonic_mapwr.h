@@ -0,0 +1,90 @@
+/*
+ * NanoNIC map writer messages
+ *
+ * The maps of a Nanotube application live inside the stages and cannot be
+ * written by the host directly. The map writer of nanonic_pipeline_top
+ * (rtl/nanonic_map_writer.v) sends the updates the host writes over AXI-Lite
+ * into the pipeline as frames of NANONIC_MAPWR_LEN bytes, between packets and
+ * to every lane. An application built with -D NANONIC_MAP_WRITER recognises
+ * them first thing in its program, applies them to the map of the id they
+ * carry and drops them. The top drops the frames of this ethertype that come
+ * from the network, so only the host can send them.
+ *
+ *   0  .. 11  zero                     12 ethertype 0x88B6 (big-endian)
+ *   14 op (NANONIC_MAPWR_*)            15 map id (window of the writer)
+ *   16 .. 63  key, as the bytes of the key structure of the map
+ *   64 .. 127 value, as the bytes of the value structure of the map
+ *
+ * An array update carries the index as a little-endian __u32 key. Every
+ * update is applied on its own as it arrives, so the packets between two
+ * messages of a batch see the maps half written: the host orders a batch so
+ * that each step is consistent, the entries a key points to before the key
+ * (Katran: reals and ch_rings before the vip_map entry of a new VIP, the
+ * vip_map entry before them on a delete). A commit message follows a batch;
+ * it carries no key, switches nothing and an application may ignore it.
+ */
+#ifndef __NANONIC_MAPWR_H
+#define __NANONIC_MAPWR_H
+
+#include <linux/types.h>
+
+#define NANONIC_MAPWR_LEN        128
+#define NANONIC_MAPWR_ETYPE0     0x88
+#define NANONIC_MAPWR_ETYPE1     0xB6
+
+// Byte offsets inside the message
+#define NANONIC_MAPWR_OFF_ETYPE  12
+#define NANONIC_MAPWR_OFF_OP     14
+#define NANONIC_MAPWR_OFF_MAP    15
+#define NANONIC_MAPWR_OFF_KEY    16
+#define NANONIC_MAPWR_OFF_VALUE  64
+#define NANONIC_MAPWR_KEY_MAX    48
+#define NANONIC_MAPWR_VALUE_MAX  64
+
+// Operations
+#define NANONIC_MAPWR_UPDATE     1
+#define NANONIC_MAPWR_DELETE     2
+#define NANONIC_MAPWR_COMMIT     3
+
+// Returns the message at the start of the frame, or NULL for any other frame
+__attribute__((__always_inline__))
+static inline __u8 *nanonic_mapwr_msg(void *data, void *data_end) {
+  __u8 *p = data;
+
+  if (data + NANONIC_MAPWR_LEN > data_end ||
+      p[NANONIC_MAPWR_OFF_ETYPE] != NANONIC_MAPWR_ETYPE0 ||
+      p[NANONIC_MAPWR_OFF_ETYPE + 1] != NANONIC_MAPWR_ETYPE1) {
+    return 0;
+  }
+  return p;
+}
+
+// Apply an update or delete message to map, whose key and value have the
+// types key_type and value_type. The bytes are copied one by one, which
+// keeps the copy free of unaligned loads in Nanotube.
+#define NANONIC_MAPWR_APPLY(msg, map, key_type, value_type)                   \
+  do {                                                                        \
+    _Static_assert(sizeof(key_type) <= NANONIC_MAPWR_KEY_MAX,                 \
+                   "key does not fit a map writer message");                  \
+    _Static_assert(sizeof(value_type) <= NANONIC_MAPWR_VALUE_MAX,             \
+                   "value does not fit a map writer message");                \
+    key_type mapwr_key;                                                       \
+    value_type mapwr_value;                                                   \
+    __u8 *mapwr_k = (__u8 *)&mapwr_key;                                       \
+    __u8 *mapwr_v = (__u8 *)&mapwr_value;                                     \
+    _Pragma("unroll")                                                         \
+    for (int i = 0; i < sizeof(key_type); i++) {                              \
+      mapwr_k[i] = (msg)[NANONIC_MAPWR_OFF_KEY + i];                          \
+    }                                                                         \
+    _Pragma("unroll")                                                         \
+    for (int i = 0; i < sizeof(value_type); i++) {                            \
+      mapwr_v[i] = (msg)[NANONIC_MAPWR_OFF_VALUE + i];                        \
+    }                                                                         \
+    if ((msg)[NANONIC_MAPWR_OFF_OP] == NANONIC_MAPWR_UPDATE) {                \
+      bpf_map_update_elem(&(map), &mapwr_key, &mapwr_value, BPF_ANY);         \
+    } else if ((msg)[NANONIC_MAPWR_OFF_OP] == NANONIC_MAPWR_DELETE) {         \
+      bpf_map_delete_elem(&(map), &mapwr_key);                                \
+    }                                                                         \
+  } while (0)
+
+#endif // __NANONIC_MAPWR_H
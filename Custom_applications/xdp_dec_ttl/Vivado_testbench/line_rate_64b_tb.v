@@ -0,0 +1,203 @@
+`timescale 1ns / 1ps
+
+// Minimum-size line-rate benchmark for xdp_dec_ttl.
+//
+// Streams NUM_PKTS back-to-back 60-byte UDP frames (64 bytes on the wire with
+// the FCS the CMAC strips) into nanonic_pipeline_top, one beat per packet, with
+// a different destination address per packet. Every frame must come out with
+// its TTL decremented and its IPv4 checksum updated. The top spreads the
+// packets over LANES copies of the pipeline (LANES_BY_FLOW selects the flow
+// hash instead of round-robin).
+//
+// A 100G port carries at most 148.8 Mpps of 64-byte frames; the testbench
+// reports the rate accepted at the ingress and the rate leaving on port1, 250
+// Mpps being one packet per cycle, and fails below line rate. Run it with
+// LANES = 1 to see the rate of a single pipeline.
+
+module Nanotube_line_rate_64b_tb;
+
+  parameter LANES         = 2;
+  parameter LANES_BY_FLOW = 0;
+  parameter NUM_PKTS      = 4000;
+
+  reg ap_clk_0;
+  reg ap_rst_n_0;
+  reg [511:0] port0_0_tdata;
+  reg [63:0] port0_0_tkeep;
+  reg port0_0_tlast;
+  reg [47:0] port0_0_tuser;
+  reg port0_0_tvalid;
+  wire port0_0_tready;
+  wire [511:0] port1_0_tdata;
+  wire [63:0] port1_0_tkeep;
+  wire port1_0_tlast;
+  reg port1_0_tready;
+  wire [47:0] port1_0_tuser;
+  wire port1_0_tvalid;
+
+  integer start_time, end_time, out_first, out_last;
+  integer cycle;
+  integer in_pkts, out_pkts, bad;
+  integer i, k;
+
+  reg [7:0] pkt [0:63];
+
+  nanonic_pipeline_top #(
+    .LANES         (LANES),
+    .LANES_BY_FLOW (LANES_BY_FLOW)
+  ) uut (
+    .ap_clk_0(ap_clk_0),
+    .ap_rst_n_0(ap_rst_n_0),
+    .port0_0_tdata(port0_0_tdata),
+    .port0_0_tkeep(port0_0_tkeep),
+    .port0_0_tlast(port0_0_tlast),
+    .port0_0_tready(port0_0_tready),
+    .port0_0_tuser(port0_0_tuser),
+    .port0_0_tvalid(port0_0_tvalid),
+    .port1_0_tdata(port1_0_tdata),
+    .port1_0_tkeep(port1_0_tkeep),
+    .port1_0_tlast(port1_0_tlast),
+    .port1_0_tready(port1_0_tready),
+    .port1_0_tuser(port1_0_tuser),
+    .port1_0_tvalid(port1_0_tvalid),
+    .hairpin_tdata(),
+    .hairpin_tkeep(),
+    .hairpin_tlast(),
+    .hairpin_tready(1'b1),
+    .hairpin_tuser(),
+    .hairpin_tvalid(),
+    .s_axil_awvalid(1'b0),
+    .s_axil_awaddr(32'd0),
+    .s_axil_awready(),
+    .s_axil_wvalid(1'b0),
+    .s_axil_wdata(32'd0),
+    .s_axil_wready(),
+    .s_axil_bvalid(),
+    .s_axil_bresp(),
+    .s_axil_bready(1'b1),
+    .s_axil_arvalid(1'b0),
+    .s_axil_araddr(32'd0),
+    .s_axil_arready(),
+    .s_axil_rvalid(),
+    .s_axil_rdata(),
+    .s_axil_rresp(),
+    .s_axil_rready(1'b1),
+    .early_drop_count()
+  );
+
+  // Clock generation (250 MHz = 4 ns period)
+  always #2 ap_clk_0 = ~ap_clk_0;
+
+  // Handshake happens between master and slave
+  wire port0_handshake;
+  assign port0_handshake = port0_0_tvalid & port0_0_tready;
+
+  wire port1_handshake;
+  assign port1_handshake = port1_0_tvalid & port1_0_tready;
+
+  always @(posedge ap_clk_0) begin
+    if (!ap_rst_n_0) begin
+      cycle = 0;
+      in_pkts = 0;
+      out_pkts = 0;
+      bad = 0;
+    end
+    else begin
+      cycle = cycle + 1;
+      if (port0_handshake && port0_0_tlast)
+        in_pkts = in_pkts + 1;
+      if (port1_handshake && port1_0_tlast) begin
+        if (out_pkts == 0)
+          out_first = cycle;
+        out_last = cycle;
+        out_pkts = out_pkts + 1;
+        // TTL 64 -> 63, checksum 0x0000 -> 0x0100
+        if (port1_0_tdata[8*22 +: 8] != 8'h3f || port1_0_tdata[8*24 +: 16] != 16'h0001)
+          bad = bad + 1;
+      end
+    end
+  end
+
+  // 60-byte Ethernet/IPv4 UDP frame from 192.168.1.1 to 10.0.x.y, TTL 64
+  task build_packet(input [15:0] id);
+    begin
+      for (i = 0; i < 64; i = i + 1)
+        pkt[i] = (i < 60) ? i[7:0] : 8'd0;
+      {pkt[0], pkt[1], pkt[2], pkt[3], pkt[4], pkt[5]}     = 48'h020000000103;
+      {pkt[6], pkt[7], pkt[8], pkt[9], pkt[10], pkt[11]}   = 48'h020000000101;
+      {pkt[12], pkt[13]}                                   = 16'h0800;
+      {pkt[14], pkt[15], pkt[16], pkt[17]}                 = 32'h4500002e;
+      {pkt[18], pkt[19], pkt[20], pkt[21]}                 = 32'hf1cb4000;
+      pkt[22] = 8'h40;
+      pkt[23] = 8'h11;
+      {pkt[24], pkt[25]}                                   = 16'h0000;
+      {pkt[26], pkt[27], pkt[28], pkt[29]}                 = 32'hc0a80101;
+      {pkt[30], pkt[31], pkt[32], pkt[33]}                 = {16'h0a00, id};
+    end
+  endtask
+
+  task send_beat(input [511:0] data, input [63:0] keep, input last);
+    begin
+      port0_0_tdata = data;
+      port0_0_tkeep = keep;
+      port0_0_tlast = last;
+      port0_0_tuser = 48'h00000000003c;
+      port0_0_tvalid = 1;
+      @(posedge ap_clk_0);
+      while (!port0_0_tready)
+        @(posedge ap_clk_0);
+      #1;
+    end
+  endtask
+
+  reg [511:0] beat0;
+  real mpps;
+
+  initial begin
+      ap_clk_0 = 0;
+      ap_rst_n_0 = 0;
+      port0_0_tdata = 0;
+      port0_0_tkeep = 0;
+      port0_0_tlast = 0;
+      port0_0_tuser = 0;
+      port0_0_tvalid = 0;
+      port1_0_tready = 1;
+
+      #20;
+      ap_rst_n_0 = 1;
+
+      wait(port0_0_tready);
+      @(posedge ap_clk_0);
+      #1;
+
+      start_time = cycle;
+      for (k = 0; k < NUM_PKTS; k = k + 1) begin
+        build_packet(k[15:0]);
+        for (i = 0; i < 64; i = i + 1)
+          beat0[8*i +: 8] = pkt[i];
+        send_beat(beat0, 64'h0FFFFFFFFFFFFFFF, 1);
+      end
+      end_time = cycle;
+
+      // Deassert valid after all packets sent
+      port0_0_tvalid = 0;
+
+      // Let the pipeline drain
+      #2000;
+
+      mpps = in_pkts * 250.0 / (end_time - start_time);
+      $display("Lanes: %0d (%0s)", LANES, LANES_BY_FLOW ? "flow hash" : "round-robin");
+      $display("Packets offered: %0d in %0d cycles", in_pkts, end_time - start_time);
+      $display("Ingress rate: %0.2f Mpps (line rate 148.81 Mpps)", mpps);
+      $display("Packets out: %0d (expected %0d), %0d not rewritten", out_pkts, NUM_PKTS, bad);
+      if (out_pkts > 1)
+        $display("Egress rate: %0.2f Mpps", (out_pkts - 1) * 250.0 / (out_last - out_first));
+      if (mpps < 148.81 || bad != 0 || out_pkts != NUM_PKTS)
+        $display("FAIL");
+      else
+        $display("PASS");
+
+      $finish;
+    end
+
+endmodule
@@ -0,0 +1,292 @@
+`timescale 1ns / 1ps
+
+// Lookup rate of the cuckoo hash map (rtl/nanonic_cuckoo.v) with the geometry
+// of icmp_count_map: 32-bit keys (source address), 64-bit counters, 2 ways of
+// 4 slots and 64 buckets per way (512 entries) plus a stash of 4.
+//
+// The testbench writes NUM_KEYS keys through the register interface, each in
+// the first free slot of its two buckets (the control plane,
+// scripts/nanonic_cuckoo.py, also moves entries; keys that find both buckets
+// full are skipped here and must miss). It then issues a lookup every cycle
+// for every key and for as many absent keys, checks hit and value of every
+// answer, updates one counter from the datapath and queues a missed key for
+// the control plane. It reports the lookup rate, one per cycle being
+// 250 Mlookups/s, and fails below one lookup per cycle.
+
+module Nanotube_cuckoo_map_tb;
+
+  parameter ADDR_W   = 6;
+  parameter NUM_KEYS = 440;
+
+  localparam WAYS    = 2;
+  localparam SLOTS   = 4;
+  localparam LATENCY = 3;
+  localparam NUM_LK  = 2 * NUM_KEYS;
+
+  reg clk;
+  reg rst_n;
+
+  reg         lk_en;
+  reg  [31:0] lk_key;
+  wire        lk_valid;
+  wire        lk_hit;
+  wire [63:0] lk_value;
+  wire [31:0] lk_loc;
+
+  reg         up_en;
+  reg  [31:0] up_loc;
+  reg  [31:0] up_key;
+  reg  [63:0] up_value;
+
+  reg         ins_en;
+  reg  [31:0] ins_key;
+  reg  [63:0] ins_value;
+
+  reg         wr_en;
+  reg  [11:0] wr_addr;
+  reg  [31:0] wr_data;
+  reg  [11:0] rd_addr;
+  wire [31:0] rd_data;
+
+  nanonic_cuckoo #(
+    .WAYS   (WAYS),
+    .SLOTS  (SLOTS),
+    .STASH  (4),
+    .ADDR_W (ADDR_W),
+    .KEY_W  (32),
+    .VAL_W  (64)
+  ) uut (
+    .clk(clk),
+    .rst_n(rst_n),
+    .lk_en(lk_en),
+    .lk_key(lk_key),
+    .lk_valid(lk_valid),
+    .lk_hit(lk_hit),
+    .lk_value(lk_value),
+    .lk_loc(lk_loc),
+    .up_en(up_en),
+    .up_loc(up_loc),
+    .up_key(up_key),
+    .up_value(up_value),
+    .ins_en(ins_en),
+    .ins_key(ins_key),
+    .ins_value(ins_value),
+    .wr_en(wr_en),
+    .wr_addr(wr_addr),
+    .wr_data(wr_data),
+    .rd_addr(rd_addr),
+    .rd_data(rd_data)
+  );
+
+  // Clock generation (250 MHz = 4 ns period)
+  always #2 clk = ~clk;
+
+  // Keys in the table and the slots taken in every bucket
+  reg [31:0] keys   [0:NUM_KEYS-1];
+  reg        stored [0:NUM_KEYS-1];
+  reg [3:0]  used   [0:WAYS*(1<<ADDR_W)-1];
+
+  // Expected answers, in lookup order
+  reg        exp_hit   [0:NUM_LK-1];
+  reg [63:0] exp_value [0:NUM_LK-1];
+
+  integer cycle;
+  integer issued, answered, bad, misses;
+  integer first_answer, last_answer, stream_answered;
+  integer i, w, b, n_stored;
+  reg [31:0] h;
+  reg [ADDR_W-1:0] idx [0:WAYS-1];
+  reg placed;
+  reg [31:0] hit_loc;
+  real rate;
+
+  always @(posedge clk) begin
+    if (!rst_n)
+      cycle <= 0;
+    else
+      cycle <= cycle + 1;
+  end
+
+  // Check the answers as they come out
+  always @(posedge clk) begin
+    if (rst_n && lk_valid && answered < NUM_LK) begin
+      if (lk_hit != exp_hit[answered] || (lk_hit && lk_value != exp_value[answered])) begin
+        bad = bad + 1;
+        if (bad <= 4)
+          $display("Lookup %0d: hit %0d value %0h, expected %0d %0h", answered, lk_hit,
+                   lk_value, exp_hit[answered], exp_value[answered]);
+      end
+      if (!lk_hit)
+        misses = misses + 1;
+      if (answered == 0) begin
+        hit_loc = lk_loc;
+        first_answer = cycle;
+      end
+      answered = answered + 1;
+      last_answer = cycle;
+    end
+  end
+
+  task reg_write(input [11:0] addr, input [31:0] data);
+    begin
+      wr_en   = 1;
+      wr_addr = addr;
+      wr_data = data;
+      @(posedge clk);
+      #1;
+      wr_en = 0;
+    end
+  endtask
+
+  task reg_read(input [11:0] addr, output [31:0] data);
+    begin
+      rd_addr = addr;
+      @(posedge clk);
+      @(posedge clk);
+      #1;
+      data = rd_data;
+    end
+  endtask
+
+  // Bucket index of key k in way w, with the hash of the block
+  task hash(input integer way, input [31:0] k, output [ADDR_W-1:0] index);
+    begin
+      h = 32'd0;
+      for (b = 0; b < 32; b = b + 1)
+        if (k[b])
+          h = h ^ uut.h3_row(way, b);
+      index = h[ADDR_W-1:0];
+    end
+  endtask
+
+  reg [31:0] status;
+
+  initial begin
+      clk = 0;
+      rst_n = 0;
+      lk_en = 0;
+      lk_key = 0;
+      up_en = 0;
+      up_loc = 0;
+      up_key = 0;
+      up_value = 0;
+      ins_en = 0;
+      ins_key = 0;
+      ins_value = 0;
+      wr_en = 0;
+      wr_addr = 0;
+      wr_data = 0;
+      rd_addr = 0;
+      issued = 0;
+      answered = 0;
+      bad = 0;
+      misses = 0;
+      n_stored = 0;
+      for (i = 0; i < WAYS * (1 << ADDR_W); i = i + 1)
+        used[i] = 0;
+
+      #20;
+      rst_n = 1;
+      @(posedge clk);
+      #1;
+
+      // Control plane: each key in the first free slot of its buckets
+      for (i = 0; i < NUM_KEYS; i = i + 1) begin
+        keys[i] = 32'h0a000000 + i * 32'h01010101 + (i << 20);
+        stored[i] = 0;
+        placed = 0;
+        for (w = 0; w < WAYS; w = w + 1) begin
+          hash(w, keys[i], idx[w]);
+          if (!placed && used[w * (1 << ADDR_W) + idx[w]] < SLOTS) begin
+            reg_write(12'h040, keys[i]);
+            reg_write(12'h080, i);
+            reg_write(12'h084, 32'hc0de0000);
+            reg_write(12'h010, 1);
+            reg_write(12'h00C, (1 << 31) | (w << 28) | (used[w * (1 << ADDR_W) + idx[w]] << 24) | idx[w]);
+            used[w * (1 << ADDR_W) + idx[w]] = used[w * (1 << ADDR_W) + idx[w]] + 1;
+            placed = 1;
+            stored[i] = 1;
+            n_stored = n_stored + 1;
+          end
+        end
+      end
+      reg_read(12'h000, status);
+
+      // Datapath: a lookup every cycle, the stored keys then absent ones
+      @(posedge clk);
+      #1;
+      for (i = 0; i < NUM_LK; i = i + 1) begin
+        lk_en = 1;
+        if (i < NUM_KEYS) begin
+          lk_key = keys[i];
+          exp_hit[i] = stored[i];
+          exp_value[i] = {32'hc0de0000, i[31:0]};
+        end
+        else begin
+          lk_key = 32'hac100000 + i;
+          exp_hit[i] = 0;
+          exp_value[i] = 0;
+        end
+        issued = issued + 1;
+        @(posedge clk);
+        #1;
+      end
+      lk_en = 0;
+      repeat (LATENCY + 2) @(posedge clk);
+      #1;
+      stream_answered = answered;
+      rate = stream_answered * 250.0 / (last_answer - first_answer + 1);
+
+      // Datapath update of the first key, and an insert request for a miss
+      up_en = 1;
+      up_loc = hit_loc;
+      up_key = keys[0];
+      up_value = 64'd21;
+      ins_en = 1;
+      ins_key = 32'hac100001;
+      ins_value = 64'd1;
+      @(posedge clk);
+      #1;
+      up_en = 0;
+      ins_en = 0;
+      lk_en = 1;
+      lk_key = keys[0];
+      @(posedge clk);
+      #1;
+      lk_en = 0;
+      while (!lk_valid) begin
+        @(posedge clk);
+        #1;
+      end
+      if (!lk_hit || lk_value != 64'd21) begin
+        $display("Update of key 0 not seen: hit %0d value %0h", lk_hit, lk_value);
+        bad = bad + 1;
+      end
+      reg_read(12'h01C, status);
+      if (status != 1) begin
+        $display("Insert queue holds %0d requests, expected 1", status);
+        bad = bad + 1;
+      end
+      reg_write(12'h01C, 1);
+      reg_read(12'h040, status);
+      if (status != 32'hac100001) begin
+        $display("Popped key %0h, expected ac100001", status);
+        bad = bad + 1;
+      end
+
+      $display("Keys stored: %0d of %0d in %0d entries (%0.1f%% load, no moves)",
+               n_stored, NUM_KEYS, WAYS * SLOTS * (1 << ADDR_W),
+               100.0 * n_stored / (WAYS * SLOTS * (1 << ADDR_W)));
+      $display("Lookups: %0d issued, %0d answered, %0d misses, %0d wrong",
+               issued, stream_answered, misses, bad);
+      $display("Lookup rate: %0.1f Mlookups/s (250 = one per cycle), latency %0d cycles",
+               rate, LATENCY);
+      if (bad != 0 || stream_answered != NUM_LK || rate < 249.0)
+        $display("FAIL");
+      else
+        $display("PASS");
+
+      $finish;
+    end
+
+endmodule
@@ -0,0 +1,203 @@
+`timescale 1ns / 1ps
+
+// Throughput benchmark for the ICMP limiter mirror of the early-drop fast path.
+//
+// Streams NUM_PKTS back-to-back 98-byte ICMP frames into nanonic_pipeline_top
+// from SOURCES sources in turn. xdp_drop_count_ICMP passes the first 20 packets
+// of every source and drops the rest, i.e. 90% of the packets with the default
+// parameters. Run it once with EARLY_DROP = 0 and once with EARLY_DROP = 1 and
+// compare the reported ingress rate and the number of beats that reached
+// stage_0; the packets out must be the same. The parameters of the top are the
+// ones printed by scripts/gen_early_drop.py --verilog for the application.
+
+module Nanotube_early_limit_bench_tb;
+
+  parameter EARLY_DROP = 1;
+  parameter NUM_PKTS   = 2000;
+  parameter SOURCES    = 10;     // 200 packets per source, 20 passed -> 90% drop rate
+  parameter THRESH     = 21;
+
+  reg ap_clk_0;
+  reg ap_rst_n_0;
+  reg [511:0] port0_0_tdata;
+  reg [63:0] port0_0_tkeep;
+  reg port0_0_tlast;
+  reg [47:0] port0_0_tuser;
+  reg port0_0_tvalid;
+  wire port0_0_tready;
+  wire [511:0] port1_0_tdata;
+  wire [63:0] port1_0_tkeep;
+  wire port1_0_tlast;
+  reg port1_0_tready;
+  wire [47:0] port1_0_tuser;
+  wire port1_0_tvalid;
+  wire [31:0] early_drop_count;
+
+  integer start_time, end_time;
+  integer cycle;
+  integer in_pkts, out_pkts, ppl_beats;
+  integer i, k;
+
+  reg [7:0] pkt [0:127];
+
+  // Instantiate the pipeline top with the rules of xdp_drop_count_ICMP
+  nanonic_pipeline_top #(
+    .EARLY_DROP_EN            (EARLY_DROP),
+    .EARLY_DROP_ETYPE_EN      (0),
+    .EARLY_DROP_KEEP_EN       (1),
+    .EARLY_DROP_KEEP_SADDR    (32'h6401A8C0),
+    .EARLY_DROP_KEEP_PROTO    (8'd1),
+    .EARLY_DROP_LIMIT_EN      (1),
+    .EARLY_DROP_LIMIT_THRESH  (THRESH),
+    .EARLY_DROP_LIMIT_ENTRIES (32'd1024),
+    .EARLY_DROP_LIMIT_ADDR_W  (10)
+  ) uut (
+    .ap_clk_0(ap_clk_0),
+    .ap_rst_n_0(ap_rst_n_0),
+    .port0_0_tdata(port0_0_tdata),
+    .port0_0_tkeep(port0_0_tkeep),
+    .port0_0_tlast(port0_0_tlast),
+    .port0_0_tready(port0_0_tready),
+    .port0_0_tuser(port0_0_tuser),
+    .port0_0_tvalid(port0_0_tvalid),
+    .port1_0_tdata(port1_0_tdata),
+    .port1_0_tkeep(port1_0_tkeep),
+    .port1_0_tlast(port1_0_tlast),
+    .port1_0_tready(port1_0_tready),
+    .port1_0_tuser(port1_0_tuser),
+    .port1_0_tvalid(port1_0_tvalid),
+    .hairpin_tdata(),
+    .hairpin_tkeep(),
+    .hairpin_tlast(),
+    .hairpin_tready(1'b1),
+    .hairpin_tuser(),
+    .hairpin_tvalid(),
+    .s_axil_awvalid(1'b0),
+    .s_axil_awaddr(32'd0),
+    .s_axil_awready(),
+    .s_axil_wvalid(1'b0),
+    .s_axil_wdata(32'd0),
+    .s_axil_wready(),
+    .s_axil_bvalid(),
+    .s_axil_bresp(),
+    .s_axil_bready(1'b1),
+    .s_axil_arvalid(1'b0),
+    .s_axil_araddr(32'd0),
+    .s_axil_arready(),
+    .s_axil_rvalid(),
+    .s_axil_rdata(),
+    .s_axil_rresp(),
+    .s_axil_rready(1'b1),
+    .early_drop_count(early_drop_count)
+  );
+
+  // Clock generation (250 MHz = 4 ns period)
+  always #2 ap_clk_0 = ~ap_clk_0;
+
+  // Handshake happens between master and slave
+  wire port0_handshake;
+  assign port0_handshake = port0_0_tvalid & port0_0_tready;
+
+  wire port1_handshake;
+  assign port1_handshake = port1_0_tvalid & port1_0_tready;
+
+  wire ppl_handshake;
+  assign ppl_handshake = uut.ppl_in_tvalid & uut.ppl_in_tready;
+
+  always @(posedge ap_clk_0) begin
+    if (!ap_rst_n_0) begin
+      cycle = 0;
+      in_pkts = 0;
+      out_pkts = 0;
+      ppl_beats = 0;
+    end
+    else begin
+      cycle = cycle + 1;
+      if (port0_handshake && port0_0_tlast)
+        in_pkts = in_pkts + 1;
+      if (port1_handshake && port1_0_tlast)
+        out_pkts = out_pkts + 1;
+      if (ppl_handshake)
+        ppl_beats = ppl_beats + 1;
+    end
+  end
+
+  // 98-byte Ethernet/IPv4 ICMP frame from 10.0.0.1 + src
+  task build_packet(input [7:0] src);
+    begin
+      for (i = 0; i < 128; i = i + 1)
+        pkt[i] = i[7:0];
+      {pkt[0], pkt[1], pkt[2], pkt[3], pkt[4], pkt[5]}     = 48'h020000000103;
+      {pkt[6], pkt[7], pkt[8], pkt[9], pkt[10], pkt[11]}   = 48'h020000000101;
+      {pkt[12], pkt[13]}                                   = 16'h0800;
+      {pkt[14], pkt[15], pkt[16], pkt[17]}                 = 32'h45000054;
+      {pkt[18], pkt[19], pkt[20], pkt[21]}                 = 32'hf1cb4000;
+      pkt[22] = 8'h40;
+      pkt[23] = 8'h01;
+      {pkt[24], pkt[25]}                                   = 16'h0000;
+      {pkt[26], pkt[27], pkt[28], pkt[29]}                 = 32'h0a000001 + src;
+      {pkt[30], pkt[31], pkt[32], pkt[33]}                 = 32'hc0a80103;
+    end
+  endtask
+
+  task send_beat(input [511:0] data, input [63:0] keep, input last);
+    begin
+      port0_0_tdata = data;
+      port0_0_tkeep = keep;
+      port0_0_tlast = last;
+      port0_0_tuser = 48'h000000000062;
+      port0_0_tvalid = 1;
+      @(posedge ap_clk_0);
+      while (!port0_0_tready)
+        @(posedge ap_clk_0);
+      #1;
+    end
+  endtask
+
+  reg [511:0] beat0, beat1;
+
+  initial begin
+      ap_clk_0 = 0;
+      ap_rst_n_0 = 0;
+      port0_0_tdata = 0;
+      port0_0_tkeep = 0;
+      port0_0_tlast = 0;
+      port0_0_tuser = 0;
+      port0_0_tvalid = 0;
+      port1_0_tready = 1;
+
+      #20;
+      ap_rst_n_0 = 1;
+
+      wait(port0_0_tready);
+      @(posedge ap_clk_0);
+      #1;
+
+      start_time = cycle;
+      for (k = 0; k < NUM_PKTS; k = k + 1) begin
+        build_packet(k % SOURCES);
+        for (i = 0; i < 64; i = i + 1) begin
+          beat0[8*i +: 8] = pkt[i];
+          beat1[8*i +: 8] = pkt[64 + i];
+        end
+        send_beat(beat0, 64'hFFFFFFFFFFFFFFFF, 0);
+        send_beat(beat1, 64'h00000003FFFFFFFF, 1);
+      end
+      end_time = cycle;
+
+      // Deassert valid after all packets sent
+      port0_0_tvalid = 0;
+
+      // Let the pipeline drain
+      #2000;
+
+      $display("Early limiter %0s", EARLY_DROP ? "enabled" : "disabled");
+      $display("Packets offered: %0d in %0d cycles", in_pkts, end_time - start_time);
+      $display("Ingress rate: %0.2f Mpps", in_pkts * 250.0 / (end_time - start_time));
+      $display("Beats entering stage_0: %0d (%0d dropped early)", ppl_beats, early_drop_count);
+      $display("Packets out: %0d (expected %0d)", out_pkts, SOURCES * (THRESH - 1));
+
+      $finish;
+    end
+
+endmodule
@@ -35,6 +35,12 @@ LLVM_LINK="${LOCATE_TOOL} --run llvm-link"
 CLANG="${LOCATE_TOOL} --run clang"
 INFILE="xdp_application.O3.bc"
 NAME_BUS="open_nic"
+# Extra NanoNIC build flags, e.g. NANONIC_FLAGS="-D NANONIC_META"
+NANONIC_FLAGS=${NANONIC_FLAGS:-}
+# Options of the packet access optimisation and control flow convergence
+# passes, swept by scripts/nanonic_dse.py
+NANONIC_OPTREQ_OPTS=${NANONIC_OPTREQ_OPTS:--mergereturn -optreq -enable-loop-unroll -always-inline -instsimplify -loop-unroll -simplifycfg}
+NANONIC_CONVERGE_OPTS=${NANONIC_CONVERGE_OPTS:--move-alloca -compact-geps -converge_mapa}
 
 # Build Katran packet kernel
 $CLANG  -O2 \
@@ -46,6 +52,7 @@ $CLANG  -O2 \
   -fno-builtin-bswap64 \
   -fno-builtin-bcmp -fno-builtin-memcmp -fno-builtin-memcpy -fno-builtin-memmove \
   -D NANOTUBE_SIMPLE \
+  -I ../common $NANONIC_FLAGS \
   $APPLICATION \
   -c -emit-llvm -o $INFILE
 
@@ -79,12 +86,12 @@ $NT_OPT -platform -always-inline -instsimplify $F -o $NEWF -bus=$NAME_BUS
 F=$NEWF
 NEWF=${F/.bc/.optreq.bc}
 echo "back-end: Optimising packet accesses; $F to $NEWF -bus=$NAME_BUS"
-$NT_OPT -mergereturn -optreq -enable-loop-unroll -always-inline -instsimplify -loop-unroll -simplifycfg $F -o $NEWF -bus=$NAME_BUS
+$NT_OPT $NANONIC_OPTREQ_OPTS $F -o $NEWF -bus=$NAME_BUS
 
 F=$NEWF
 NEWF=${F/.bc/.converge.bc}
 echo "back-end: Converging the control flow; $F to $NEWF -bus=$NAME_BUS"
-$NT_OPT -move-alloca -compact-geps -converge_mapa $F -o $NEWF -bus=$NAME_BUS
+$NT_OPT $NANONIC_CONVERGE_OPTS $F -o $NEWF -bus=$NAME_BUS
 
 F=$NEWF
 NEWF=${F/.bc/.pipeline.bc}
@@ -19,6 +19,14 @@
 #include "pckt_parsing.h"
 #include "handle_icmp.h"
 
+#ifdef NANONIC_META
+#include "nanonic_desc.h"
+#endif
+
+#if defined(NANONIC_CSUM_OFFLOAD) && !defined(NANONIC_META)
+#error "NANONIC_CSUM_OFFLOAD needs NANONIC_META"
+#endif
+
 struct bpf_map_def SEC("maps") icmp_count_map = {
     .type = BPF_MAP_TYPE_HASH,
     .key_size = sizeof(__u32),
@@ -43,13 +51,15 @@ int xdp_drop_icmp(struct xdp_md *ctx)
     void *data_end = (void *)(unsigned long)ctx->data_end;
     void *data = (void *)(unsigned long)ctx->data;
 
+    // Runt frames and non-IPv4 traffic go to the host
     struct ethhdr *eth = data;
-    if ((void *)(eth + 1) > data_end)
-        return XDP_PASS;
-
-    // Only handle IPv4
-    if (eth->h_proto != htons(ETH_P_IP))
+    if ((void *)(eth + 1) > data_end || eth->h_proto != htons(ETH_P_IP)) {
+#ifdef NANONIC_META
+        return nanonic_pass(ctx, NANONIC_CLASS_NONE);
+#else
         return XDP_PASS;
+#endif
+    }
 
     struct iphdr *ip = (struct iphdr *)(eth + 1);
 
@@ -106,34 +116,77 @@ int xdp_drop_icmp(struct xdp_md *ctx)
         payload[6] = (counter_low  >> 8)  & 0xFF;
         payload[7] = (counter_low  >> 0)  & 0xFF;
 
+#ifdef NANONIC_CSUM_OFFLOAD
+        // The egress engine (rtl/nanonic_encap.v) updates the checksum from the
+        // old payload bytes; with IP options the payload may not sit in the
+        // first 64 bytes of the frame and the update stays here, and so it does
+        // on a frame the descriptor is not pushed on
+        bool csum_offload = ihl_bytes == sizeof(struct iphdr) &&
+                            !nanonic_desc_lookalike(data, data_end);
+        struct nanonic_egress_ops ops = {};
+        ops.csum_ops = NANONIC_CSUM_L4;
+        ops.l4_csum_off = sizeof(*eth) + ihl_bytes + offsetof(struct icmphdr, checksum);
+        ops.l4_field_off = sizeof(*eth) + ihl_bytes + sizeof(*icmp);
+        ops.l4_field_len = 8;
+        #pragma unroll
+        for (int i = 0; i < 8; i++) {
+            ops.l4_old[i] = original_bytes[i];
+        }
+#else
+        bool csum_offload = false;
+#endif
+
         // === ICMP checksum incremental update ===
         // Convert original bytes back to 32-bit values (big-endian to host)
         __u32 old_high = (original_bytes[0] << 24) | (original_bytes[1] << 16) |
                         (original_bytes[2] << 8)  | (original_bytes[3]);
         __u32 old_low  = (original_bytes[4] << 24) | (original_bytes[5] << 16) |
                         (original_bytes[6] << 8)  | (original_bytes[7]);
-        
+
         // Start with current checksum
         __u32 checksum = icmp->checksum;
-        
+
         // Remove old values from checksum (treat each 32-bit word as two 16-bit words)
         checksum += (~old_high & 0xFFFF) + (~old_high >> 16);
         checksum += (~old_low  & 0xFFFF) + (~old_low  >> 16);
-        
+
         // Add new values to checksum
         checksum += (counter_high & 0xFFFF) + (counter_high >> 16);
         checksum += (counter_low  & 0xFFFF) + (counter_low  >> 16);
-        
+
         // Fold carries into 16-bit result
         checksum = (checksum & 0xFFFF) + (checksum >> 16);
         checksum = (checksum & 0xFFFF) + (checksum >> 16);
-        
-        // Update ICMP checksum
-        icmp->checksum = (__u16)checksum;
+
+        // Update ICMP checksum, unless the card is left the update
+        if (!csum_offload)
+            icmp->checksum = (__u16)checksum;
 
         // Update counter in map
         bpf_map_update_elem(&packet_count_map, &map_key, &new_count, BPF_ANY);
 
+#ifdef NANONIC_META
+        struct nanonic_desc_info meta = {};
+        meta.verdict = XDP_PASS;
+        meta.flags = NANONIC_F_HASH | NANONIC_F_CLASS;
+        meta.class_tag = NANONIC_CLASS_MONITOR;
+        meta.flow_hash = src_ip;
+        // Without a descriptor the packet still goes to the host; a failed
+        // push leaves the frame as it was, so the checksum the card was left
+        // is updated here after all
+#ifdef NANONIC_CSUM_OFFLOAD
+        if (!nanonic_push_desc_ops(ctx, &meta, csum_offload ? &ops : 0) && csum_offload) {
+            data = (void *)(unsigned long)ctx->data;
+            data_end = (void *)(unsigned long)ctx->data_end;
+            icmp = (struct icmphdr *)(data + sizeof(struct ethhdr) + sizeof(struct iphdr));
+            if ((void *)(icmp + 1) <= data_end)
+                icmp->checksum = (__u16)checksum;
+        }
+#else
+        nanonic_push_desc(ctx, &meta);
+#endif
+#endif
+
         return XDP_PASS;
     }
 
@@ -144,6 +197,16 @@ int xdp_drop_icmp(struct xdp_md *ctx)
     if (update_count >= 21)
         return XDP_DROP;
 
+#ifdef NANONIC_META
+    // Flow hash is the limiter key, the source address
+    struct nanonic_desc_info meta = {};
+    meta.verdict = XDP_PASS;
+    meta.flags = NANONIC_F_HASH | NANONIC_F_CLASS;
+    meta.class_tag = NANONIC_CLASS_ICMP_LIMITED;
+    meta.flow_hash = src_ip;
+    nanonic_push_desc(ctx, &meta);
+#endif
+
     return XDP_PASS;
 }
 
@@ -0,0 +1,199 @@
+`timescale 1ns / 1ps
+
+// End-to-end latency of the Katran pipeline on the packets of
+// pcap_test_files/test_xdp_katran.pcap.IN.
+//
+// Replays the test packets NUM_ROUNDS times through nanonic_pipeline_top with
+// the latency histogram enabled, leaving GAP idle cycles between packets so the
+// samples are not inflated by queueing, then reads count/min/max/sum back over
+// AXI-Lite. Run it once with the default build and once with the pipeline
+// built with NANONIC_FLAGS="-D NANONIC_PARALLEL_LOOKUP" to get the latency
+// saved by issuing the independent map lookups together.
+
+module Nanotube_katran_latency_tb;
+
+  parameter NUM_ROUNDS = 100;
+  parameter GAP        = 64;
+
+  localparam NUM_TEST_PKTS = 5;
+
+  reg ap_clk_0;
+  reg ap_rst_n_0;
+  reg [511:0] port0_0_tdata;
+  reg [63:0] port0_0_tkeep;
+  reg port0_0_tlast;
+  reg [47:0] port0_0_tuser;
+  reg port0_0_tvalid;
+  wire port0_0_tready;
+  wire [511:0] port1_0_tdata;
+  wire [63:0] port1_0_tkeep;
+  wire port1_0_tlast;
+  reg port1_0_tready;
+  wire [47:0] port1_0_tuser;
+  wire port1_0_tvalid;
+
+  reg s_axil_arvalid;
+  reg [31:0] s_axil_araddr;
+  wire s_axil_arready;
+  wire s_axil_rvalid;
+  wire [31:0] s_axil_rdata;
+
+  integer i, k, n;
+  integer pkt_len;
+  reg [8*128-1:0] bytes;
+  reg [7:0] pkt [0:127];
+  reg [31:0] rd;
+  integer lat_count, lat_min, lat_max;
+  reg [63:0] lat_sum;
+
+  // Instantiate the pipeline top with the latency histogram
+  nanonic_pipeline_top #(
+    .LATENCY_EN    (1),
+    .CLK_PERIOD_PS (4000)
+  ) uut (
+    .ap_clk_0(ap_clk_0),
+    .ap_rst_n_0(ap_rst_n_0),
+    .port0_0_tdata(port0_0_tdata),
+    .port0_0_tkeep(port0_0_tkeep),
+    .port0_0_tlast(port0_0_tlast),
+    .port0_0_tready(port0_0_tready),
+    .port0_0_tuser(port0_0_tuser),
+    .port0_0_tvalid(port0_0_tvalid),
+    .port1_0_tdata(port1_0_tdata),
+    .port1_0_tkeep(port1_0_tkeep),
+    .port1_0_tlast(port1_0_tlast),
+    .port1_0_tready(port1_0_tready),
+    .port1_0_tuser(port1_0_tuser),
+    .port1_0_tvalid(port1_0_tvalid),
+    .hairpin_tdata(),
+    .hairpin_tkeep(),
+    .hairpin_tlast(),
+    .hairpin_tready(1'b1),
+    .hairpin_tuser(),
+    .hairpin_tvalid(),
+    .s_axil_awvalid(1'b0),
+    .s_axil_awaddr(32'd0),
+    .s_axil_awready(),
+    .s_axil_wvalid(1'b0),
+    .s_axil_wdata(32'd0),
+    .s_axil_wready(),
+    .s_axil_bvalid(),
+    .s_axil_bresp(),
+    .s_axil_bready(1'b1),
+    .s_axil_arvalid(s_axil_arvalid),
+    .s_axil_araddr(s_axil_araddr),
+    .s_axil_arready(s_axil_arready),
+    .s_axil_rvalid(s_axil_rvalid),
+    .s_axil_rdata(s_axil_rdata),
+    .s_axil_rresp(),
+    .s_axil_rready(1'b1),
+    .early_drop_count()
+  );
+
+  // Clock generation (250 MHz = 4 ns period)
+  always #2 ap_clk_0 = ~ap_clk_0;
+
+  // Packets of test_xdp_katran.pcap.IN, first byte in the top bits
+  task load_packet(input integer idx);
+    begin
+      bytes = 0;
+      case (idx)
+        0: begin pkt_len = 42; bytes = 336'h00010203040510111213141508060001080006040001101112131415c0a80101000000000000c0a80103; end
+        1: begin pkt_len = 42; bytes = 336'hffffffffffff10111213141508060001080006040001101112131415c0a80101000000000000c0a80103; end
+        2: begin pkt_len = 98; bytes = 784'h020000000103020000000101080045000054f1cb40004001c588c0a80101c0a801030800f44368520003e214516300000000a01b090000000000101112131415161718191a1b1c1d1e1f202122232425262728292a2b2c2d2e2f3031323334353637; end
+        3: begin pkt_len = 70; bytes = 560'h0060970769ea0000860580da86dd6000000000103a403ffe050700000001020086fffe0580da3ffe05010000100100000000000000028000a5727620000001c9e736d3390600; end
+        4: begin pkt_len = 22; bytes = 176'h00112233445566778899aabb88b5deadbeef00010203; end
+      endcase
+      for (i = 0; i < 128; i = i + 1)
+        pkt[i] = (i < pkt_len) ? bytes[8*(pkt_len-1-i) +: 8] : 8'h00;
+    end
+  endtask
+
+  task send_packet;
+    integer beat, b, left;
+    begin
+      left = pkt_len;
+      beat = 0;
+      while (left > 0) begin
+        for (b = 0; b < 64; b = b + 1) begin
+          port0_0_tdata[8*b +: 8] = pkt[64*beat + b];
+          port0_0_tkeep[b] = b < left;
+        end
+        port0_0_tlast = left <= 64;
+        port0_0_tuser = pkt_len;
+        port0_0_tvalid = 1;
+        @(posedge ap_clk_0);
+        while (!port0_0_tready)
+          @(posedge ap_clk_0);
+        #1;
+        left = left - 64;
+        beat = beat + 1;
+      end
+      port0_0_tvalid = 0;
+    end
+  endtask
+
+  task axil_read(input [31:0] addr, output [31:0] data);
+    begin
+      s_axil_araddr = addr;
+      s_axil_arvalid = 1;
+      @(posedge ap_clk_0);
+      while (!s_axil_arready)
+        @(posedge ap_clk_0);
+      #1;
+      s_axil_arvalid = 0;
+      while (!s_axil_rvalid)
+        @(posedge ap_clk_0);
+      data = s_axil_rdata;
+      @(posedge ap_clk_0);
+      #1;
+    end
+  endtask
+
+  initial begin
+      ap_clk_0 = 0;
+      ap_rst_n_0 = 0;
+      port0_0_tdata = 0;
+      port0_0_tkeep = 0;
+      port0_0_tlast = 0;
+      port0_0_tuser = 0;
+      port0_0_tvalid = 0;
+      port1_0_tready = 1;
+      s_axil_arvalid = 0;
+      s_axil_araddr = 0;
+
+      #20;
+      ap_rst_n_0 = 1;
+
+      wait(port0_0_tready);
+      @(posedge ap_clk_0);
+      #1;
+
+      for (k = 0; k < NUM_ROUNDS; k = k + 1) begin
+        for (n = 0; n < NUM_TEST_PKTS; n = n + 1) begin
+          load_packet(n);
+          send_packet;
+          repeat (GAP) @(posedge ap_clk_0);
+          #1;
+        end
+      end
+
+      // Let the pipeline drain
+      #2000;
+
+      axil_read(32'h1004, rd); lat_count = rd;
+      axil_read(32'h1008, rd); lat_min = rd;
+      axil_read(32'h100C, rd); lat_max = rd;
+      axil_read(32'h1014, rd); lat_sum[31:0] = rd;
+      axil_read(32'h1018, rd); lat_sum[63:32] = rd;
+
+      $display("Packets in: %0d, latency samples (packets out): %0d",
+               NUM_ROUNDS * NUM_TEST_PKTS, lat_count);
+      if (lat_count > 0)
+        $display("End-to-end latency: min %0d, avg %0.1f, max %0d cycles (avg %0.1f ns)",
+                 lat_min, lat_sum * 1.0 / lat_count, lat_max, lat_sum * 4.0 / lat_count);
+
+      $finish;
+    end
+
+endmodule
@@ -0,0 +1,443 @@
+`timescale 1ns / 1ps
+
+// Katran maps loaded from the host through the bulk transfer engine
+// (rtl/nanonic_map_dma.v) and the map writer of nanonic_pipeline_top.
+//
+// The pipeline must be built with NANONIC_FLAGS="-D NANONIC_MAP_WRITER". The
+// engine is connected to the AXI-Lite slave of the top, as in the shell. A UDP
+// packet to 10.200.2.2:53, a VIP the pipeline does not know, must first come
+// out unchanged (XDP_PASS). One command frame then writes the gateway MAC in
+// ctl_array, the VIP in vip_map (vip_num 1) and real 0 in reals, polling the
+// FIFO of the writer before every message, and reads the version and message
+// counters back once the writer is empty. The same packet must now come out
+// encapsulated in IPIP towards the real, addressed to the gateway MAC (the
+// ring of vip_num 1 is empty, so every flow lands on real 0). A map update
+// frame injected on port0 must be dropped at the ingress and leave the maps
+// alone. Deleting the VIP must bring back XDP_PASS.
+
+module Nanotube_katran_map_writer_tb;
+
+  localparam MAX_LEN = 512;
+
+  localparam [47:0] GW_MAC    = 48'h02AABBCCDDEE;
+  localparam [31:0] VIP       = 32'h0AC80202;  // 10.200.2.2
+  localparam [31:0] REAL      = 32'h0A00002A;  // 10.0.0.42
+
+  // Map windows of the writer (map ids of xdp_katran/nanonic_maps.json)
+  localparam [15:0] W_CTL     = 16'h8000;
+  localparam [15:0] W_VIP     = 16'h9000;
+  localparam [15:0] W_REALS   = 16'hC000;
+
+  reg ap_clk_0;
+  reg ap_rst_n_0;
+
+  reg  [511:0] port0_0_tdata;
+  reg  [63:0]  port0_0_tkeep;
+  reg          port0_0_tlast;
+  reg  [47:0]  port0_0_tuser;
+  reg          port0_0_tvalid;
+  wire         port0_0_tready;
+  wire [511:0] port1_0_tdata;
+  wire [63:0]  port1_0_tkeep;
+  wire         port1_0_tlast;
+  wire [47:0]  port1_0_tuser;
+  wire         port1_0_tvalid;
+
+  reg  [511:0] dma_tdata;
+  reg  [63:0]  dma_tkeep;
+  reg          dma_tlast;
+  reg  [47:0]  dma_tuser;
+  reg          dma_tvalid;
+  wire         dma_tready;
+  wire [511:0] rsp_tdata;
+  wire [63:0]  rsp_tkeep;
+  wire         rsp_tvalid;
+
+  wire        awvalid, wvalid, bvalid, bready, arvalid, arready, rvalid, rready;
+  wire        awready, wready;
+  wire [31:0] awaddr, wdata, araddr, rdata;
+  wire [1:0]  bresp, rresp;
+
+  nanonic_map_dma dma_inst (
+    .clk(ap_clk_0),
+    .rst_n(ap_rst_n_0),
+    .s_axis_tvalid(dma_tvalid),
+    .s_axis_tdata(dma_tdata),
+    .s_axis_tkeep(dma_tkeep),
+    .s_axis_tlast(dma_tlast),
+    .s_axis_tuser(dma_tuser),
+    .s_axis_tready(dma_tready),
+    .m_axis_tvalid(),
+    .m_axis_tdata(),
+    .m_axis_tkeep(),
+    .m_axis_tlast(),
+    .m_axis_tuser(),
+    .m_axis_tready(1'b1),
+    .m_rsp_tvalid(rsp_tvalid),
+    .m_rsp_tdata(rsp_tdata),
+    .m_rsp_tkeep(rsp_tkeep),
+    .m_rsp_tlast(),
+    .m_rsp_tuser(),
+    .m_rsp_tready(1'b1),
+    .s_axil_awvalid(1'b0),
+    .s_axil_awaddr(32'd0),
+    .s_axil_awready(),
+    .s_axil_wvalid(1'b0),
+    .s_axil_wdata(32'd0),
+    .s_axil_wready(),
+    .s_axil_bvalid(),
+    .s_axil_bresp(),
+    .s_axil_bready(1'b1),
+    .s_axil_arvalid(1'b0),
+    .s_axil_araddr(32'd0),
+    .s_axil_arready(),
+    .s_axil_rvalid(),
+    .s_axil_rdata(),
+    .s_axil_rresp(),
+    .s_axil_rready(1'b1),
+    .m_axil_awvalid(awvalid),
+    .m_axil_awaddr(awaddr),
+    .m_axil_awready(awready),
+    .m_axil_wvalid(wvalid),
+    .m_axil_wdata(wdata),
+    .m_axil_wready(wready),
+    .m_axil_bvalid(bvalid),
+    .m_axil_bresp(bresp),
+    .m_axil_bready(bready),
+    .m_axil_arvalid(arvalid),
+    .m_axil_araddr(araddr),
+    .m_axil_arready(arready),
+    .m_axil_rvalid(rvalid),
+    .m_axil_rdata(rdata),
+    .m_axil_rresp(rresp),
+    .m_axil_rready(rready),
+    .frames(),
+    .ops_done()
+  );
+
+  nanonic_pipeline_top #(
+    .MAPWR_EN (1)
+  ) uut (
+    .ap_clk_0(ap_clk_0),
+    .ap_rst_n_0(ap_rst_n_0),
+    .port0_0_tdata(port0_0_tdata),
+    .port0_0_tkeep(port0_0_tkeep),
+    .port0_0_tlast(port0_0_tlast),
+    .port0_0_tready(port0_0_tready),
+    .port0_0_tuser(port0_0_tuser),
+    .port0_0_tvalid(port0_0_tvalid),
+    .port1_0_tdata(port1_0_tdata),
+    .port1_0_tkeep(port1_0_tkeep),
+    .port1_0_tlast(port1_0_tlast),
+    .port1_0_tready(1'b1),
+    .port1_0_tuser(port1_0_tuser),
+    .port1_0_tvalid(port1_0_tvalid),
+    .hairpin_tdata(),
+    .hairpin_tkeep(),
+    .hairpin_tlast(),
+    .hairpin_tready(1'b1),
+    .hairpin_tuser(),
+    .hairpin_tvalid(),
+    .s_axil_awvalid(awvalid),
+    .s_axil_awaddr(awaddr),
+    .s_axil_awready(awready),
+    .s_axil_wvalid(wvalid),
+    .s_axil_wdata(wdata),
+    .s_axil_wready(wready),
+    .s_axil_bvalid(bvalid),
+    .s_axil_bresp(bresp),
+    .s_axil_bready(bready),
+    .s_axil_arvalid(arvalid),
+    .s_axil_araddr(araddr),
+    .s_axil_arready(arready),
+    .s_axil_rvalid(rvalid),
+    .s_axil_rdata(rdata),
+    .s_axil_rresp(rresp),
+    .s_axil_rready(rready),
+    .early_drop_count()
+  );
+
+  // Clock generation (250 MHz = 4 ns period)
+  always #2 ap_clk_0 = ~ap_clk_0;
+
+  reg [7:0] frame [0:MAX_LEN-1];
+  reg [7:0] rsp   [0:MAX_LEN-1];
+  reg [7:0] pkt   [0:127];
+  reg [7:0] out   [0:127];
+  integer len, n_ops, rsp_len, rsp_pos, out_pos, out_pkts;
+  integer i, k, bad, seen;
+  reg [31:0] word;
+
+  // Responses of the engine and the first two beats of every port1 packet
+  always @(posedge ap_clk_0) begin
+    if (!ap_rst_n_0) begin
+      rsp_pos = 0;
+      out_pos = 0;
+      out_pkts = 0;
+    end
+    else begin
+      if (rsp_tvalid)
+        for (i = 0; i < 64; i = i + 1)
+          if (rsp_tkeep[i] && rsp_pos < MAX_LEN) begin
+            rsp[rsp_pos] = rsp_tdata[8*i +: 8];
+            rsp_pos = rsp_pos + 1;
+          end
+      if (port1_0_tvalid) begin
+        for (i = 0; i < 64; i = i + 1)
+          if (out_pos + i < 128)
+            out[out_pos + i] = port1_0_tdata[8*i +: 8];
+        out_pos = port1_0_tlast ? 0 : out_pos + 64;
+        if (port1_0_tlast)
+          out_pkts = out_pkts + 1;
+      end
+    end
+  end
+
+  //----------------------------------------------------------------------------
+  // Command frames of the engine
+  //----------------------------------------------------------------------------
+  task header(input [15:0] results);
+    begin
+      for (i = 0; i < 6; i = i + 1) begin
+        frame[i] = 8'h02;
+        frame[6 + i] = (i == 5) ? 8'h01 : 8'h00;
+      end
+      frame[12] = 8'h88; frame[13] = 8'hB5; frame[14] = 8'h4D; frame[15] = 8'h01;
+      {frame[19], frame[18], frame[17], frame[16]} = 32'd9;
+      rsp_len = 24 + 4 * results + 8;
+      {frame[23], frame[22]} = rsp_len[15:0];
+      n_ops = 0;
+      len = 24;
+    end
+  endtask
+
+  task op(input [7:0] code, input [15:0] addr, input [31:0] data);
+    begin
+      frame[len] = code;
+      frame[len + 1] = 8'd0;
+      {frame[len + 3], frame[len + 2]} = addr;
+      {frame[len + 7], frame[len + 6], frame[len + 5], frame[len + 4]} = data;
+      len = len + 8;
+      n_ops = n_ops + 1;
+    end
+  endtask
+
+  // Wait until the writer has room for a message
+  task wait_room;
+    op(8'd3, W_CTL, {16'h0000, 16'h0002});
+  endtask
+
+  task send_frame;
+    begin
+      {frame[21], frame[20]} = n_ops[15:0];
+      rsp_pos = 0;
+      for (k = 0; k < len; k = k + 64) begin
+        for (i = 0; i < 64; i = i + 1) begin
+          dma_tdata[8*i +: 8] = (k + i < len) ? frame[k + i] : 8'd0;
+          dma_tkeep[i] = k + i < len;
+        end
+        dma_tlast = k + 64 >= len;
+        dma_tuser = len;
+        dma_tvalid = 1;
+        @(posedge ap_clk_0);
+        while (!dma_tready)
+          @(posedge ap_clk_0);
+        #1;
+      end
+      dma_tvalid = 0;
+      while (rsp_pos < rsp_len)
+        @(posedge ap_clk_0);
+      #1;
+      word = {rsp[rsp_len - 1], rsp[rsp_len - 2], rsp[rsp_len - 3], rsp[rsp_len - 4]};
+      if (rsp[rsp_len - 8] != 0 || word != n_ops) begin
+        $display("Engine status %0d, %0d of %0d ops", rsp[rsp_len - 8], word, n_ops);
+        bad = bad + 1;
+      end
+    end
+  endtask
+
+  function [31:0] result(input integer n);
+    result = {rsp[24 + 4*n + 3], rsp[24 + 4*n + 2], rsp[24 + 4*n + 1], rsp[24 + 4*n]};
+  endfunction
+
+  //----------------------------------------------------------------------------
+  // Packets
+  //----------------------------------------------------------------------------
+
+  // 60-byte UDP frame from 192.168.1.1:1234 to the VIP
+  task build_packet;
+    begin
+      for (i = 0; i < 128; i = i + 1)
+        pkt[i] = (i < 60) ? i[7:0] : 8'd0;
+      {pkt[0], pkt[1], pkt[2], pkt[3], pkt[4], pkt[5]}     = 48'h020000000103;
+      {pkt[6], pkt[7], pkt[8], pkt[9], pkt[10], pkt[11]}   = 48'h020000000101;
+      {pkt[12], pkt[13]}                                   = 16'h0800;
+      {pkt[14], pkt[15], pkt[16], pkt[17]}                 = 32'h4500002e;
+      {pkt[18], pkt[19], pkt[20], pkt[21]}                 = 32'hf1cb4000;
+      pkt[22] = 8'h40;
+      pkt[23] = 8'h11;
+      {pkt[24], pkt[25]}                                   = 16'h0000;
+      {pkt[26], pkt[27], pkt[28], pkt[29]}                 = 32'hc0a80101;
+      {pkt[30], pkt[31], pkt[32], pkt[33]}                 = VIP;
+      {pkt[34], pkt[35]}                                   = 16'd1234;
+      {pkt[36], pkt[37]}                                   = 16'd53;
+      {pkt[38], pkt[39]}                                   = 16'd26;
+      {pkt[40], pkt[41]}                                   = 16'h0000;
+    end
+  endtask
+
+  // Send pkt, len bytes, on port0 and wait for what comes out of port1
+  task send_packet(input integer bytes);
+    begin
+      seen = out_pkts;
+      for (k = 0; k < bytes; k = k + 64) begin
+        for (i = 0; i < 64; i = i + 1) begin
+          port0_0_tdata[8*i +: 8] = pkt[k + i];
+          port0_0_tkeep[i] = k + i < bytes;
+        end
+        port0_0_tlast = k + 64 >= bytes;
+        port0_0_tuser = bytes;
+        port0_0_tvalid = 1;
+        @(posedge ap_clk_0);
+        while (!port0_0_tready)
+          @(posedge ap_clk_0);
+        #1;
+      end
+      port0_0_tvalid = 0;
+      repeat (2000) @(posedge ap_clk_0);
+      #1;
+    end
+  endtask
+
+  task expect_pass(input [8*24-1:0] what);
+    begin
+      if (out_pkts != seen + 1 || out[23] != 8'h11 ||
+          {out[30], out[31], out[32], out[33]} != VIP) begin
+        $display("%0s: expected the packet unchanged (XDP_PASS)", what);
+        bad = bad + 1;
+      end
+    end
+  endtask
+
+  task expect_encap(input [8*24-1:0] what);
+    begin
+      if (out_pkts != seen + 1 || {out[12], out[13]} != 16'h0800 || out[23] != 8'h04 ||
+          {out[0], out[1], out[2], out[3], out[4], out[5]} != GW_MAC ||
+          {out[30], out[31], out[32], out[33]} != REAL) begin
+        $display("%0s: expected IPIP to %0h via %0h, got proto %0h to %0h via %0h", what,
+                 REAL, GW_MAC, out[23], {out[30], out[31], out[32], out[33]},
+                 {out[0], out[1], out[2], out[3], out[4], out[5]});
+        bad = bad + 1;
+      end
+    end
+  endtask
+
+  initial begin
+      ap_clk_0 = 0;
+      ap_rst_n_0 = 0;
+      port0_0_tdata = 0;
+      port0_0_tkeep = 0;
+      port0_0_tlast = 0;
+      port0_0_tuser = 0;
+      port0_0_tvalid = 0;
+      dma_tdata = 0;
+      dma_tkeep = 0;
+      dma_tlast = 0;
+      dma_tuser = 0;
+      dma_tvalid = 0;
+      bad = 0;
+
+      #20;
+      ap_rst_n_0 = 1;
+      wait(port0_0_tready);
+      @(posedge ap_clk_0);
+      #1;
+
+      // Unknown VIP
+      build_packet;
+      send_packet(60);
+      expect_pass("Before the load");
+
+      // Load ctl_array[0], vip_map and reals[0], then check the counters (the
+      // polls return a result each)
+      header(7);
+      wait_room;
+      op(8'd1, W_CTL + 16'h040, {GW_MAC[23:16], GW_MAC[31:24], GW_MAC[39:32], GW_MAC[47:40]});
+      op(8'd1, W_CTL + 16'h044, {16'd0, GW_MAC[7:0], GW_MAC[15:8]});
+      op(8'd1, W_CTL + 16'h008, 32'd0);
+      wait_room;
+      // vip_definition: address, 12 zero bytes, port (network order), proto
+      op(8'd1, W_VIP + 16'h100, {VIP[7:0], VIP[15:8], VIP[23:16], VIP[31:24]});
+      op(8'd1, W_VIP + 16'h104, 32'd0);
+      op(8'd1, W_VIP + 16'h108, 32'd0);
+      op(8'd1, W_VIP + 16'h10C, 32'd0);
+      op(8'd1, W_VIP + 16'h110, {8'd0, 8'd17, 8'd53, 8'd0});
+      // vip_meta: flags 0, vip_num 1
+      op(8'd1, W_VIP + 16'h040, 32'd0);
+      op(8'd1, W_VIP + 16'h044, 32'd1);
+      op(8'd1, W_VIP + 16'h014, 32'd1);
+      wait_room;
+      op(8'd1, W_VIP + 16'h000, 32'd1);
+      wait_room;
+      // real_definition: address, 12 zero bytes, flags
+      op(8'd1, W_REALS + 16'h040, {REAL[7:0], REAL[15:8], REAL[23:16], REAL[31:24]});
+      op(8'd1, W_REALS + 16'h044, 32'd0);
+      op(8'd1, W_REALS + 16'h048, 32'd0);
+      op(8'd1, W_REALS + 16'h04C, 32'd0);
+      op(8'd1, W_REALS + 16'h050, 32'd0);
+      op(8'd1, W_REALS + 16'h008, 32'd0);
+      op(8'd3, W_CTL, {16'h0000, 16'h0001});
+      op(8'd2, W_VIP + 16'h004, 32'd0);
+      op(8'd2, W_CTL + 16'h018, 32'd0);
+      send_frame;
+      if (result(5) != 1 || result(6) != 4) begin
+        $display("Writer: version %0d, %0d messages sent, expected 1 and 4",
+                 result(5), result(6));
+        bad = bad + 1;
+      end
+
+      send_packet(60);
+      expect_encap("After the load");
+
+      // A map update from the network, setting another gateway MAC
+      for (i = 0; i < 128; i = i + 1)
+        pkt[i] = 8'd0;
+      pkt[12] = 8'h88; pkt[13] = 8'hB6; pkt[14] = 8'd1; pkt[15] = 8'd0;
+      for (i = 0; i < 6; i = i + 1)
+        pkt[64 + i] = 8'hFF;
+      send_packet(128);
+      if (out_pkts != seen) begin
+        $display("Map update from port0 left the pipeline");
+        bad = bad + 1;
+      end
+      header(1);
+      op(8'd2, 16'h0028, 32'd0);
+      send_frame;
+      if (result(0) != 1) begin
+        $display("Map updates dropped at the ingress: %0d, expected 1", result(0));
+        bad = bad + 1;
+      end
+      build_packet;
+      send_packet(60);
+      expect_encap("After port0 update");
+
+      // Delete the VIP, the staged key is still the one of the VIP
+      header(3);
+      wait_room;
+      op(8'd1, W_VIP + 16'h014, 32'd2);
+      wait_room;
+      op(8'd1, W_VIP + 16'h000, 32'd1);
+      op(8'd3, W_CTL, {16'h0000, 16'h0001});
+      send_frame;
+      send_packet(60);
+      expect_pass("After the delete");
+
+      if (bad != 0)
+        $display("FAIL");
+      else
+        $display("PASS");
+
+      $finish;
+    end
+
+endmodule
@@ -0,0 +1,211 @@
+`timescale 1ns / 1ps
+
+// Throughput benchmark for a QUIC-heavy Katran mix.
+//
+// Streams NUM_PKTS back-to-back frames into nanonic_pipeline_top, repeating a
+// 10-packet pattern taken from pcap_test_files/test_xdp_katran_quic.pcap.IN:
+// 6 short-header packets, 1 IPv6 short-header packet, 2 handshake packets
+// with a 20-byte DCID and 1 client initial. The pipeline runs the same stages
+// for every packet whatever the branch taken, so the ingress rate shows
+// whether the QUIC path keeps II=1; fill vip_map with an F_QUIC_VIP entry to
+// also have the packets routed on their connection id.
+
+module Nanotube_quic_bench_tb;
+
+  parameter NUM_PKTS = 1000;
+
+  localparam PATTERN_LEN = 10;
+
+  reg ap_clk_0;
+  reg ap_rst_n_0;
+  reg [511:0] port0_0_tdata;
+  reg [63:0] port0_0_tkeep;
+  reg port0_0_tlast;
+  reg [47:0] port0_0_tuser;
+  reg port0_0_tvalid;
+  wire port0_0_tready;
+  wire [511:0] port1_0_tdata;
+  wire [63:0] port1_0_tkeep;
+  wire port1_0_tlast;
+  reg port1_0_tready;
+  wire [47:0] port1_0_tuser;
+  wire port1_0_tvalid;
+
+  integer start_time, end_time, first_out, last_out;
+  integer cycle;
+  integer in_pkts, in_beats, in_bytes, out_pkts;
+  integer i, k;
+  integer pkt_len;
+  reg [8*128-1:0] bytes;
+  reg [7:0] pkt [0:127];
+  reg [3:0] pattern [0:PATTERN_LEN-1];
+
+  // Instantiate the pipeline top
+  nanonic_pipeline_top uut (
+    .ap_clk_0(ap_clk_0),
+    .ap_rst_n_0(ap_rst_n_0),
+    .port0_0_tdata(port0_0_tdata),
+    .port0_0_tkeep(port0_0_tkeep),
+    .port0_0_tlast(port0_0_tlast),
+    .port0_0_tready(port0_0_tready),
+    .port0_0_tuser(port0_0_tuser),
+    .port0_0_tvalid(port0_0_tvalid),
+    .port1_0_tdata(port1_0_tdata),
+    .port1_0_tkeep(port1_0_tkeep),
+    .port1_0_tlast(port1_0_tlast),
+    .port1_0_tready(port1_0_tready),
+    .port1_0_tuser(port1_0_tuser),
+    .port1_0_tvalid(port1_0_tvalid),
+    .hairpin_tdata(),
+    .hairpin_tkeep(),
+    .hairpin_tlast(),
+    .hairpin_tready(1'b1),
+    .hairpin_tuser(),
+    .hairpin_tvalid(),
+    .s_axil_awvalid(1'b0),
+    .s_axil_awaddr(32'd0),
+    .s_axil_awready(),
+    .s_axil_wvalid(1'b0),
+    .s_axil_wdata(32'd0),
+    .s_axil_wready(),
+    .s_axil_bvalid(),
+    .s_axil_bresp(),
+    .s_axil_bready(1'b1),
+    .s_axil_arvalid(1'b0),
+    .s_axil_araddr(32'd0),
+    .s_axil_arready(),
+    .s_axil_rvalid(),
+    .s_axil_rdata(),
+    .s_axil_rresp(),
+    .s_axil_rready(1'b1),
+    .early_drop_count()
+  );
+
+  // Clock generation (250 MHz = 4 ns period)
+  always #2 ap_clk_0 = ~ap_clk_0;
+
+  // Handshake happens between master and slave
+  wire port0_handshake;
+  assign port0_handshake = port0_0_tvalid & port0_0_tready;
+
+  wire port1_handshake;
+  assign port1_handshake = port1_0_tvalid & port1_0_tready;
+
+  always @(posedge ap_clk_0) begin
+    if (!ap_rst_n_0) begin
+      cycle = 0;
+      in_pkts = 0;
+      in_beats = 0;
+      out_pkts = 0;
+      first_out = -1;
+      last_out = 0;
+    end
+    else begin
+      cycle = cycle + 1;
+      if (port0_handshake)
+        in_beats = in_beats + 1;
+      if (port0_handshake && port0_0_tlast)
+        in_pkts = in_pkts + 1;
+      if (port1_handshake && port1_0_tlast) begin
+        out_pkts = out_pkts + 1;
+        if (first_out < 0)
+          first_out = cycle;
+        last_out = cycle;
+      end
+    end
+  end
+
+  // QUIC vectors, first byte in the top bits
+  task load_packet(input integer idx);
+    begin
+      bytes = 0;
+      case (idx)
+        // short header, host 5
+        0: begin pkt_len = 67; bytes = 536'h0200000001030200000001010800450000351234400040115b12c0a801010ac801019c4001bb0021000041400140a0a1a2a3a400000000000000000000000000000000; end
+        // short header, host 0xABCD
+        1: begin pkt_len = 67; bytes = 536'h0200000001030200000001010800450000351234400040115b12c0a801010ac801019c4001bb00210000416af340a0a1a2a3a400000000000000000000000000000000; end
+        // handshake, 20-byte DCID
+        2: begin pkt_len = 93; bytes = 744'h02000000010302000000010108004500004f1234400040115af8c0a801010ac801019c4001bb003b0000e00000000114448d00a0a1a2a3a4a5a6a7a8a9aaabacadaeafb008505152535455565700000000000000000000000000000000; end
+        // initial (hash fallback)
+        3: begin pkt_len = 81; bytes = 648'h0200000001030200000001010800450000431234400040115b04c0a801010ac801019c4001bb002f0000c000000001084000c0a0a1a2a3a408505152535455565700000000000000000000000000000000; end
+        // IPv6 short header
+        4: begin pkt_len = 87; bytes = 696'h02000000010302000000010186dd6000000000211140fc000000000000000000000000000001fc0000000000000000000000000001009c4001bb00210000414002c0a0a1a2a3a400000000000000000000000000000000; end
+      endcase
+      for (i = 0; i < 128; i = i + 1)
+        pkt[i] = (i < pkt_len) ? bytes[8*(pkt_len-1-i) +: 8] : 8'h00;
+    end
+  endtask
+
+  task send_packet;
+    integer beat, b, left;
+    begin
+      left = pkt_len;
+      beat = 0;
+      while (left > 0) begin
+        for (b = 0; b < 64; b = b + 1) begin
+          port0_0_tdata[8*b +: 8] = pkt[64*beat + b];
+          port0_0_tkeep[b] = b < left;
+        end
+        port0_0_tlast = left <= 64;
+        port0_0_tuser = pkt_len;
+        port0_0_tvalid = 1;
+        @(posedge ap_clk_0);
+        while (!port0_0_tready)
+          @(posedge ap_clk_0);
+        #1;
+        left = left - 64;
+        beat = beat + 1;
+      end
+    end
+  endtask
+
+  initial begin
+      ap_clk_0 = 0;
+      ap_rst_n_0 = 0;
+      port0_0_tdata = 0;
+      port0_0_tkeep = 0;
+      port0_0_tlast = 0;
+      port0_0_tuser = 0;
+      port0_0_tvalid = 0;
+      port1_0_tready = 1;
+      in_bytes = 0;
+
+      // 0/1: short header, 2: handshake, 3: initial, 4: IPv6 short header
+      pattern[0] = 0; pattern[1] = 1; pattern[2] = 2; pattern[3] = 0; pattern[4] = 4;
+      pattern[5] = 1; pattern[6] = 0; pattern[7] = 3; pattern[8] = 2; pattern[9] = 1;
+
+      #20;
+      ap_rst_n_0 = 1;
+
+      wait(port0_0_tready);
+      @(posedge ap_clk_0);
+      #1;
+
+      start_time = cycle;
+      for (k = 0; k < NUM_PKTS; k = k + 1) begin
+        load_packet(pattern[k % PATTERN_LEN]);
+        in_bytes = in_bytes + pkt_len;
+        send_packet;
+      end
+      end_time = cycle;
+
+      // Deassert valid after all packets sent
+      port0_0_tvalid = 0;
+
+      // Let the pipeline drain
+      #4000;
+
+      $display("QUIC mix: %0d packets, %0d bytes", in_pkts, in_bytes);
+      $display("Ingress rate: %0.2f Mpps, %0.2f Gb/s in %0d cycles",
+               in_pkts * 250.0 / (end_time - start_time),
+               in_bytes * 8 * 0.25 / (end_time - start_time), end_time - start_time);
+      if (out_pkts > 1)
+        $display("Egress rate: %0.2f Mpps (%0d packets out)",
+                 (out_pkts - 1) * 250.0 / (last_out - first_out), out_pkts);
+      $display("Cycles per packet: %0.2f for %0.2f beats per packet (II=1 when equal)",
+               (end_time - start_time) * 1.0 / in_pkts, in_beats * 1.0 / in_pkts);
+
+      $finish;
+    end
+
+endmodule
@@ -0,0 +1,321 @@
+`timescale 1ns / 1ps
+
+// Latency and rate of the Katran pipeline on a mix of 95% non-VIP traffic.
+//
+// Streams NUM_PKTS 60-byte UDP frames into nanonic_pipeline_top, one packet
+// out of VIP_EVERY to the VIP 10.200.1.1:443 and the others to addresses
+// 10.0.x.y that are not VIPs, with GAP idle cycles after each packet (0 for
+// back-to-back frames). It reports the ingress rate and reads the end-to-end
+// latency back from the histogram of the top.
+//
+// Run it with the pipeline built with NANONIC_FLAGS="-D NANONIC_VIP_FILTER
+// -D NANONIC_MAP_WRITER" and with "-D NANONIC_MAP_WRITER" alone. With
+// LOAD_MAPS the testbench first writes vip_filter (the words of
+// scripts/nanonic_vipfilter.py words 10.200.1.1/udp), the VIP in vip_map, real
+// 0 and the gateway MAC through the map writer of the top, so the VIP packets
+// take the full path and the others are filtered; the stock build ignores the
+// vip_filter messages. Without LOAD_MAPS every packet misses vip_map and is
+// passed. scripts/nanonic_vipfilter.py bench gives the map lookups per packet
+// and the map port utilization of the same mix.
+
+module Nanotube_katran_vip_filter_tb;
+
+  parameter NUM_PKTS  = 2000;
+  parameter VIP_EVERY = 20;
+  parameter GAP       = 0;
+  parameter LOAD_MAPS = 1;
+
+  // Map windows of the writer (map ids of xdp_katran/nanonic_maps.json)
+  localparam [31:0] W_CTL    = 32'h8000;
+  localparam [31:0] W_VIP    = 32'h9000;
+  localparam [31:0] W_FILTER = 32'hA000;
+  localparam [31:0] W_REALS  = 32'hC000;
+
+  // vip_filter word of 10.200.1.1/udp, every other word rejects all addresses
+  localparam        F_WORD   = 329;
+  localparam [63:0] F_VALUE  = 64'hBFFFFFFBFFF7FFFF;
+
+  reg ap_clk_0;
+  reg ap_rst_n_0;
+  reg [511:0] port0_0_tdata;
+  reg [63:0] port0_0_tkeep;
+  reg port0_0_tlast;
+  reg [47:0] port0_0_tuser;
+  reg port0_0_tvalid;
+  wire port0_0_tready;
+  wire [511:0] port1_0_tdata;
+  wire [63:0] port1_0_tkeep;
+  wire port1_0_tlast;
+  reg port1_0_tready;
+  wire [47:0] port1_0_tuser;
+  wire port1_0_tvalid;
+
+  reg s_axil_awvalid;
+  reg [31:0] s_axil_awaddr;
+  wire s_axil_awready;
+  reg s_axil_wvalid;
+  reg [31:0] s_axil_wdata;
+  wire s_axil_wready;
+  reg s_axil_arvalid;
+  reg [31:0] s_axil_araddr;
+  wire s_axil_arready;
+  wire s_axil_rvalid;
+  wire [31:0] s_axil_rdata;
+
+  integer start_time, end_time;
+  integer cycle;
+  integer in_pkts, out_pkts;
+  integer i, k;
+  reg [7:0] pkt [0:63];
+  reg [511:0] beat;
+  reg [31:0] rd;
+  integer lat_count, lat_min, lat_max;
+  reg [63:0] lat_sum;
+  real mpps;
+
+  nanonic_pipeline_top #(
+    .LATENCY_EN    (1),
+    .CLK_PERIOD_PS (4000),
+    .MAPWR_EN      (LOAD_MAPS)
+  ) uut (
+    .ap_clk_0(ap_clk_0),
+    .ap_rst_n_0(ap_rst_n_0),
+    .port0_0_tdata(port0_0_tdata),
+    .port0_0_tkeep(port0_0_tkeep),
+    .port0_0_tlast(port0_0_tlast),
+    .port0_0_tready(port0_0_tready),
+    .port0_0_tuser(port0_0_tuser),
+    .port0_0_tvalid(port0_0_tvalid),
+    .port1_0_tdata(port1_0_tdata),
+    .port1_0_tkeep(port1_0_tkeep),
+    .port1_0_tlast(port1_0_tlast),
+    .port1_0_tready(port1_0_tready),
+    .port1_0_tuser(port1_0_tuser),
+    .port1_0_tvalid(port1_0_tvalid),
+    .hairpin_tdata(),
+    .hairpin_tkeep(),
+    .hairpin_tlast(),
+    .hairpin_tready(1'b1),
+    .hairpin_tuser(),
+    .hairpin_tvalid(),
+    .s_axil_awvalid(s_axil_awvalid),
+    .s_axil_awaddr(s_axil_awaddr),
+    .s_axil_awready(s_axil_awready),
+    .s_axil_wvalid(s_axil_wvalid),
+    .s_axil_wdata(s_axil_wdata),
+    .s_axil_wready(s_axil_wready),
+    .s_axil_bvalid(),
+    .s_axil_bresp(),
+    .s_axil_bready(1'b1),
+    .s_axil_arvalid(s_axil_arvalid),
+    .s_axil_araddr(s_axil_araddr),
+    .s_axil_arready(s_axil_arready),
+    .s_axil_rvalid(s_axil_rvalid),
+    .s_axil_rdata(s_axil_rdata),
+    .s_axil_rresp(),
+    .s_axil_rready(1'b1),
+    .early_drop_count()
+  );
+
+  // Clock generation (250 MHz = 4 ns period)
+  always #2 ap_clk_0 = ~ap_clk_0;
+
+  always @(posedge ap_clk_0) begin
+    if (!ap_rst_n_0) begin
+      cycle = 0;
+      in_pkts = 0;
+      out_pkts = 0;
+    end
+    else begin
+      cycle = cycle + 1;
+      if (port0_0_tvalid && port0_0_tready && port0_0_tlast)
+        in_pkts = in_pkts + 1;
+      if (port1_0_tvalid && port1_0_tready && port1_0_tlast)
+        out_pkts = out_pkts + 1;
+    end
+  end
+
+  // 60-byte UDP frame from 192.168.1.1:1234 to the VIP or to 10.0.x.y
+  task build_packet(input vip, input [15:0] id);
+    begin
+      for (i = 0; i < 64; i = i + 1)
+        pkt[i] = (i < 60) ? i[7:0] : 8'd0;
+      {pkt[0], pkt[1], pkt[2], pkt[3], pkt[4], pkt[5]}     = 48'h020000000103;
+      {pkt[6], pkt[7], pkt[8], pkt[9], pkt[10], pkt[11]}   = 48'h020000000101;
+      {pkt[12], pkt[13]}                                   = 16'h0800;
+      {pkt[14], pkt[15], pkt[16], pkt[17]}                 = 32'h4500002e;
+      {pkt[18], pkt[19], pkt[20], pkt[21]}                 = 32'hf1cb4000;
+      pkt[22] = 8'h40;
+      pkt[23] = 8'h11;
+      {pkt[24], pkt[25]}                                   = 16'h0000;
+      {pkt[26], pkt[27], pkt[28], pkt[29]}                 = 32'hc0a80101;
+      {pkt[30], pkt[31], pkt[32], pkt[33]}                 = vip ? 32'h0ac80101 : {16'h0a00, id};
+      {pkt[34], pkt[35]}                                   = 16'd1234;
+      {pkt[36], pkt[37]}                                   = 16'd443;
+      {pkt[38], pkt[39]}                                   = 16'd26;
+      {pkt[40], pkt[41]}                                   = 16'h0000;
+    end
+  endtask
+
+  task send_beat(input [511:0] data, input [63:0] keep);
+    begin
+      port0_0_tdata = data;
+      port0_0_tkeep = keep;
+      port0_0_tlast = 1;
+      port0_0_tuser = 48'h00000000003c;
+      port0_0_tvalid = 1;
+      @(posedge ap_clk_0);
+      while (!port0_0_tready)
+        @(posedge ap_clk_0);
+      #1;
+    end
+  endtask
+
+  task axil_read(input [31:0] addr, output [31:0] data);
+    begin
+      s_axil_araddr = addr;
+      s_axil_arvalid = 1;
+      @(posedge ap_clk_0);
+      while (!s_axil_arready)
+        @(posedge ap_clk_0);
+      #1;
+      s_axil_arvalid = 0;
+      while (!s_axil_rvalid)
+        @(posedge ap_clk_0);
+      data = s_axil_rdata;
+      @(posedge ap_clk_0);
+      #1;
+    end
+  endtask
+
+  task axil_write(input [31:0] addr, input [31:0] data);
+    begin
+      s_axil_awaddr = addr;
+      s_axil_awvalid = 1;
+      s_axil_wdata = data;
+      s_axil_wvalid = 1;
+      @(posedge ap_clk_0);
+      while (s_axil_awvalid || s_axil_wvalid) begin
+        if (s_axil_awready)
+          s_axil_awvalid = 0;
+        if (s_axil_wready)
+          s_axil_wvalid = 0;
+        if (s_axil_awvalid || s_axil_wvalid)
+          @(posedge ap_clk_0);
+      end
+      #1;
+    end
+  endtask
+
+  // Wait until the map writer has room for a message, then send it
+  task map_write(input [31:0] addr, input [31:0] data);
+    begin
+      axil_read(W_CTL, rd);
+      while (rd[1])
+        axil_read(W_CTL, rd);
+      axil_write(addr, data);
+    end
+  endtask
+
+  task load_maps;
+    begin
+      // vip_filter: stage the all-ones word once, then the word of the VIP
+      axil_write(W_FILTER + 32'h040, 32'hFFFFFFFF);
+      axil_write(W_FILTER + 32'h044, 32'hFFFFFFFF);
+      for (k = 0; k < 512; k = k + 1)
+        if (k != F_WORD)
+          map_write(W_FILTER + 32'h008, k);
+      axil_write(W_FILTER + 32'h040, F_VALUE[31:0]);
+      axil_write(W_FILTER + 32'h044, F_VALUE[63:32]);
+      map_write(W_FILTER + 32'h008, F_WORD);
+      map_write(W_FILTER + 32'h000, 32'd1);
+      // ctl_array[0]: gateway MAC 02:aa:bb:cc:dd:ee
+      axil_write(W_CTL + 32'h040, 32'hCCBBAA02);
+      axil_write(W_CTL + 32'h044, 32'h0000EEDD);
+      map_write(W_CTL + 32'h008, 32'd0);
+      // vip_map: 10.200.1.1:443/udp -> vip_num 1, whose empty ring is real 0
+      axil_write(W_VIP + 32'h100, 32'h0101C80A);
+      axil_write(W_VIP + 32'h104, 32'd0);
+      axil_write(W_VIP + 32'h108, 32'd0);
+      axil_write(W_VIP + 32'h10C, 32'd0);
+      axil_write(W_VIP + 32'h110, {8'd0, 8'd17, 8'hBB, 8'h01});
+      axil_write(W_VIP + 32'h040, 32'd0);
+      axil_write(W_VIP + 32'h044, 32'd1);
+      map_write(W_VIP + 32'h014, 32'd1);
+      // reals[0]: 10.0.0.42
+      axil_write(W_REALS + 32'h040, 32'h2A00000A);
+      axil_write(W_REALS + 32'h044, 32'd0);
+      axil_write(W_REALS + 32'h048, 32'd0);
+      axil_write(W_REALS + 32'h04C, 32'd0);
+      axil_write(W_REALS + 32'h050, 32'd0);
+      map_write(W_REALS + 32'h008, 32'd0);
+      // Until the writer is empty
+      axil_read(W_CTL, rd);
+      while (rd[0])
+        axil_read(W_CTL, rd);
+      axil_read(W_CTL + 32'h018, rd);
+      $display("Maps loaded: %0d map writer messages", rd);
+    end
+  endtask
+
+  initial begin
+      ap_clk_0 = 0;
+      ap_rst_n_0 = 0;
+      port0_0_tdata = 0;
+      port0_0_tkeep = 0;
+      port0_0_tlast = 0;
+      port0_0_tuser = 0;
+      port0_0_tvalid = 0;
+      port1_0_tready = 1;
+      s_axil_awvalid = 0;
+      s_axil_awaddr = 0;
+      s_axil_wvalid = 0;
+      s_axil_wdata = 0;
+      s_axil_arvalid = 0;
+      s_axil_araddr = 0;
+
+      #20;
+      ap_rst_n_0 = 1;
+
+      wait(port0_0_tready);
+      @(posedge ap_clk_0);
+      #1;
+
+      if (LOAD_MAPS)
+        load_maps;
+
+      start_time = cycle;
+      for (k = 0; k < NUM_PKTS; k = k + 1) begin
+        build_packet((k % VIP_EVERY) == 0, k[15:0]);
+        for (i = 0; i < 64; i = i + 1)
+          beat[8*i +: 8] = pkt[i];
+        send_beat(beat, 64'h0FFFFFFFFFFFFFFF);
+        if (GAP > 0) begin
+          port0_0_tvalid = 0;
+          repeat (GAP) @(posedge ap_clk_0);
+          #1;
+        end
+      end
+      end_time = cycle;
+      port0_0_tvalid = 0;
+
+      // Let the pipeline drain
+      #4000;
+
+      axil_read(32'h1004, rd); lat_count = rd;
+      axil_read(32'h1008, rd); lat_min = rd;
+      axil_read(32'h100C, rd); lat_max = rd;
+      axil_read(32'h1014, rd); lat_sum[31:0] = rd;
+      axil_read(32'h1018, rd); lat_sum[63:32] = rd;
+
+      mpps = in_pkts * 250.0 / (end_time - start_time);
+      $display("Packets in: %0d (1 in %0d to the VIP), out: %0d", in_pkts, VIP_EVERY, out_pkts);
+      $display("Ingress rate: %0.2f Mpps over %0d cycles", mpps, end_time - start_time);
+      if (lat_count > 0)
+        $display("End-to-end latency: min %0d, avg %0.1f, max %0d cycles (avg %0.1f ns)",
+                 lat_min, lat_sum * 1.0 / lat_count, lat_max, lat_sum * 4.0 / lat_count);
+
+      $finish;
+    end
+
+endmodule
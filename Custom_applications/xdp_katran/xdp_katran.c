@@ -20,6 +20,77 @@
 #include "pckt_parsing.h"
 #include "handle_icmp.h"
 
+#ifdef NANONIC_META
+#include "nanonic_desc.h"
+#endif
+#ifdef NANONIC_MAP_WRITER
+#include "nanonic_mapwr.h"
+#endif
+
+#if defined(NANONIC_PARALLEL_LOOKUP) && defined(LPM_SRC_LOOKUP)
+#error "NANONIC_PARALLEL_LOOKUP does not support LPM_SRC_LOOKUP"
+#endif
+
+#if defined(NANONIC_ENCAP) && !defined(NANONIC_META)
+#error "NANONIC_ENCAP needs NANONIC_META"
+#endif
+
+#if defined(NANONIC_WARM_RESTART) && !defined(NANONIC_META)
+#error "NANONIC_WARM_RESTART needs NANONIC_META"
+#endif
+
+#ifdef NANONIC_VIP_FILTER
+// Bloom filter of the (address, protocol) pairs of vip_map, written by the
+// control plane (scripts/nanonic_vipfilter.py) before it adds a VIP. The words
+// hold the complement of the Bloom bits, so the all-zero filter of a pipeline
+// the host has not loaded yet lets every packet through to vip_map.
+#ifndef NANONIC_VIP_FILTER_WORDS
+#define NANONIC_VIP_FILTER_WORDS 512
+#endif
+struct bpf_map_def SEC("maps") vip_filter = {
+    .type = BPF_MAP_TYPE_ARRAY,
+    .key_size = sizeof(__u32),
+    .value_size = sizeof(__u64),
+    .max_entries = NANONIC_VIP_FILTER_WORDS,
+};
+BPF_ANNOTATE_KV_PAIR(vip_filter, __u32, __u64);
+#endif
+
+#ifdef NANONIC_WARM_RESTART
+// Connections saved by the host before the card was reloaded, keyed by the
+// flow of their headers and written back in bulk afterwards through the map
+// writer (scripts/nanonic_warmrestart.py). An LRU miss of a non-SYN packet
+// looks here before the ring and a hit pins the saved real in the LRU again.
+#ifndef NANONIC_LRU_RESTORE_ENTRIES
+#define NANONIC_LRU_RESTORE_ENTRIES 4096
+#endif
+// Entry of ctl_array that is non-zero while the host writes lru_restore
+#ifndef NANONIC_RESTORE_CTL_POS
+#define NANONIC_RESTORE_CTL_POS 15
+#endif
+struct bpf_map_def SEC("maps") lru_restore = {
+    .type = BPF_MAP_TYPE_HASH,
+    .key_size = sizeof(struct flow_key),
+    .value_size = sizeof(__u32),
+    .max_entries = NANONIC_LRU_RESTORE_ENTRIES,
+};
+BPF_ANNOTATE_KV_PAIR(lru_restore, struct flow_key, __u32);
+
+// pckt.flags: route on the ring without adding an LRU entry
+#define NANONIC_PCKT_NO_PIN (1 << 7)
+
+// Real saved for a connection, or NULL; *restoring is set while the host
+// has not written the whole table yet
+__attribute__((__always_inline__))
+static inline __u32 *restored_real(struct flow_key *conn, bool *restoring) {
+  __u32 ctl_key = NANONIC_RESTORE_CTL_POS;
+  struct ctl_value *state = bpf_map_lookup_elem(&ctl_array, &ctl_key);
+  *restoring = state && state->value;
+  return bpf_map_lookup_elem(&lru_restore, conn);
+}
+#else
+#define NANONIC_PCKT_NO_PIN 0
+#endif
 
 __attribute__((__always_inline__))
 static inline __u32 get_packet_hash(struct packet_description *pckt,
@@ -103,7 +174,8 @@ static inline bool get_packet_dst(struct real_definition **real,
   if (!(*real)) {
     return false;
   }
-  if (!(vip_info->flags & F_LRU_BYPASS) && !under_flood) {
+  if (!(vip_info->flags & F_LRU_BYPASS) && !under_flood &&
+      !(pckt->flags & NANONIC_PCKT_NO_PIN)) {
     if (pckt->flow.proto == IPPROTO_UDP) {
       new_dst_lru.atime = cur_time;
     }
@@ -138,6 +210,136 @@ static inline void connection_table_lookup(struct real_definition **real,
   return;
 }
 
+// QUIC connection-id schema v1: version in the two top bits of the first byte
+#define QUIC_NT_CONNID_V1 0x1
+// RFC 9000 limit on the length of a connection id
+#define QUIC_NT_MAX_CONNID_LEN 20
+
+__attribute__((__always_inline__))
+static inline int quic_server_id(__u8 *conn_id) {
+  if ((conn_id[0] >> 6) != QUIC_NT_CONNID_V1) {
+    return FURTHER_PROCESSING;
+  }
+  // the 16 bits after the version hold the host id
+  return ((conn_id[0] & 0x3F) << 10) | (conn_id[1] << 2) | (conn_id[2] >> 6);
+}
+
+__attribute__((__always_inline__))
+static inline int parse_quic_nt(void *data, __u64 off, void *data_end,
+                                bool is_ipv6) {
+  // Same decision as Katran's parse_quic, written for the Nanotube pipeline:
+  // the header is read once at a fixed offset and the connection ids of both
+  // header forms are decoded, then the form selects one of them. The long
+  // header DCID starts at byte 6 whatever its length and the short header
+  // DCID at byte 1, so no read depends on packet data.
+  __u8 hdr[sizeof(struct quic_short_header)];
+  __u8 *quic_data = data + off + sizeof(struct udphdr) +
+                    (is_ipv6 ? sizeof(struct ipv6hdr) : sizeof(struct iphdr));
+  if (quic_data + sizeof(hdr) > data_end) {
+    return FURTHER_PROCESSING;
+  }
+  memcpy(hdr, quic_data, sizeof(hdr));
+
+  bool long_fits = quic_data + sizeof(struct quic_long_header) <= data_end;
+  int long_id = quic_server_id(&hdr[6]);
+  int short_id = quic_server_id(&hdr[1]);
+
+  if ((hdr[0] & QUIC_LONG_HEADER) != QUIC_LONG_HEADER) {
+    return short_id;
+  }
+  // client initial and 0-RTT packets do not carry the server-chosen id yet,
+  // fall back to consistent hashing for them
+  if (!long_fits || (hdr[0] & QUIC_PACKET_TYPE_MASK) < QUIC_HANDSHAKE ||
+      hdr[5] < QUIC_MIN_CONNID_LEN || hdr[5] > QUIC_NT_MAX_CONNID_LEN) {
+    return FURTHER_PROCESSING;
+  }
+  return long_id;
+}
+
+#ifdef NANONIC_PARALLEL_LOOKUP
+__attribute__((__always_inline__))
+static inline __u32 get_ring_key(struct packet_description *pckt,
+                                 struct vip_meta *vip_info,
+                                 bool is_ipv6) {
+  // Same key as get_packet_dst, but computed on a copy of the packet so the
+  // ring probe does not change the flow used by the LRU probe next to it
+  struct packet_description probe = *pckt;
+  if (vip_info->flags & F_HASH_DPORT_ONLY) {
+    probe.flow.port16[0] = probe.flow.port16[1];
+    memset(probe.flow.srcv6, 0, 16);
+  }
+  return RING_SIZE * (vip_info->vip_num) +
+         get_packet_hash(&probe, is_ipv6) % RING_SIZE;
+}
+#endif // NANONIC_PARALLEL_LOOKUP
+
+#ifdef NANONIC_ENCAP
+__attribute__((__always_inline__))
+static inline bool fill_encap_ops(struct nanonic_egress_ops *ops,
+                                  struct packet_description *pckt,
+                                  struct real_definition *dst,
+                                  bool is_ipv6, __u16 pkt_bytes) {
+  // Same outer header as PCKT_ENCAP_V4/V6 of pckt_encap.h
+  __u32 saddr[4];
+  __u32 ip_src = is_ipv6 ? pckt->flow.srcv6[0] : pckt->flow.src;
+  __u8 *src = (__u8 *)saddr;
+  __u8 *daddr;
+
+  ops->outer_tos = pckt->tos;
+  ops->outer_ttl = DEFAULT_TTL;
+  ops->outer_proto = is_ipv6 ? IPPROTO_IPV6 : IPPROTO_IPIP;
+  ops->inner_len = is_ipv6 ? pkt_bytes + sizeof(struct ipv6hdr) : pkt_bytes;
+  if (dst->flags & F_IPV6) {
+    // The upper 96 bits of the source are the prefix register of the engine
+    create_encap_ipv6_src(pckt->flow.port16[0], ip_src, saddr);
+    src += 12;
+    daddr = (__u8 *)dst->dstv6;
+    ops->encap = NANONIC_ENCAP_IP6;
+    #pragma unroll
+    for (int i = 0; i < 16; i++) {
+      ops->outer_dst[i] = daddr[i];
+    }
+  } else {
+    if (is_ipv6) {
+      return false;
+    }
+    saddr[0] = create_encap_ipv4_src(pckt->flow.port16[0], ip_src);
+    daddr = (__u8 *)&dst->dst;
+    ops->encap = NANONIC_ENCAP_IPIP;
+    #pragma unroll
+    for (int i = 0; i < 4; i++) {
+      ops->outer_dst[i] = daddr[i];
+    }
+  }
+  #pragma unroll
+  for (int i = 0; i < 4; i++) {
+    ops->outer_src[i] = src[i];
+  }
+  return true;
+}
+#endif // NANONIC_ENCAP
+
+#ifdef NANONIC_VIP_FILTER
+__attribute__((__always_inline__))
+static inline bool vip_filter_may_match(struct packet_description *pckt,
+                                        bool is_ipv6) {
+  // One word of the filter per address, three bits set in it per VIP. The
+  // port is left out so the word covers both vip_map lookups.
+  __u32 h = is_ipv6 ? pckt->flow.dstv6[0] ^ pckt->flow.dstv6[1] ^
+                      pckt->flow.dstv6[2] ^ pckt->flow.dstv6[3]
+                    : pckt->flow.dst;
+  h = (h ^ pckt->flow.proto) * 0x9E3779B1;
+  h ^= h >> 16;
+  h *= 0x85EBCA6B;
+  h ^= h >> 13;
+  __u32 word = (h >> 18) & (NANONIC_VIP_FILTER_WORDS - 1);
+  __u64 mask = (1ULL << (h & 63)) | (1ULL << ((h >> 6) & 63)) |
+               (1ULL << ((h >> 12) & 63));
+  __u64 *bits = bpf_map_lookup_elem(&vip_filter, &word);
+  return !bits || (*bits & mask) == 0;
+}
+#endif // NANONIC_VIP_FILTER
+
 __attribute__((__always_inline__))
 static inline int process_l3_headers(struct packet_description *pckt,
                                      __u8 *protocol, __u64 off,
@@ -353,6 +555,13 @@ static inline int process_packet(void *data, __u64 off, void *data_end,
   __u32 vip_num;
   __u32 mac_addr_pos = 0;
   __u16 pkt_bytes;
+#ifdef NANONIC_META
+  __u8 class_tag = NANONIC_CLASS_LB_FORWARD;
+  __u8 event = NANONIC_EVENT_NONE;
+#endif
+#ifdef NANONIC_WARM_RESTART
+  bool pinned = false;
+#endif
   action = process_l3_headers(
     &pckt, &protocol, off, &pkt_bytes, data, data_end, is_ipv6);
   if (action >= 0) {
@@ -397,6 +606,20 @@ static inline int process_packet(void *data, __u64 off, void *data_end,
     return XDP_PASS;
   }
 
+#ifdef NANONIC_VIP_FILTER
+  // Traffic to an address that is not a VIP goes to the kernel here, without
+  // touching vip_map and the maps after it. Tunnels to decapsulate and
+  // malformed L4 headers were handled above, as without the filter.
+  if (!vip_filter_may_match(&pckt, is_ipv6)) {
+    return XDP_PASS;
+  }
+#endif
+
+#ifdef NANONIC_WARM_RESTART
+  // Key of lru_restore, before the VIP flags clear ports of pckt.flow
+  struct flow_key conn = pckt.flow;
+#endif
+
   if (is_ipv6) {
     memcpy(vip.vipv6, pckt.flow.dstv6, 16);
   } else {
@@ -405,6 +628,22 @@ static inline int process_packet(void *data, __u64 off, void *data_end,
 
   vip.port = pckt.flow.port16[1];
   vip.proto = pckt.flow.proto;
+#ifdef NANONIC_PARALLEL_LOOKUP
+  // The keys of both vip_map lookups and of ctl_array only depend on the
+  // headers: issue the three lookups together and select afterwards, so they
+  // share a pipeline stage instead of one stage each
+  struct vip_definition vip_any = vip;
+  vip_any.port = 0;
+  struct vip_meta *vip_port_info = bpf_map_lookup_elem(&vip_map, &vip);
+  struct vip_meta *vip_any_info = bpf_map_lookup_elem(&vip_map, &vip_any);
+  cval = bpf_map_lookup_elem(&ctl_array, &mac_addr_pos);
+  vip_info = vip_port_info;
+  if (!vip_info) {
+    vip_info = vip_any_info;
+    if (!vip_info) {
+      return XDP_PASS;
+    }
+#else
   vip_info = bpf_map_lookup_elem(&vip_map, &vip);
   if (!vip_info) {
     vip.port = 0;
@@ -412,6 +651,7 @@ static inline int process_packet(void *data, __u64 off, void *data_end,
     if (!vip_info) {
       return XDP_PASS;
     }
+#endif
 
     if (!(vip_info->flags & F_HASH_DPORT_ONLY)) {
       // VIP, which doesnt care about dst port (all packets to this VIP w/ diff
@@ -435,7 +675,7 @@ static inline int process_packet(void *data, __u64 off, void *data_end,
 
   if ((vip_info->flags & F_QUIC_VIP)) {
     int real_index;
-    real_index = parse_quic(data, data_end, is_ipv6, &pckt);
+    real_index = parse_quic_nt(data, off, data_end, is_ipv6);
     if (real_index > 0) {
       __u32 key = real_index;
       __u32 *real_pos = bpf_map_lookup_elem(&quic_mapping, &key);
@@ -446,7 +686,16 @@ static inline int process_packet(void *data, __u64 off, void *data_end,
         if (!dst) {
           return XDP_DROP;
         }
+#ifdef NANONIC_META
+        class_tag = NANONIC_CLASS_LB_QUIC;
+#endif
       }
+#if defined(KATRAN_INTROSPECTION) && defined(NANONIC_META)
+      else {
+        // server id without a mapping, the flow falls back to hashing
+        event = NANONIC_EVENT_QUIC_NO_REAL;
+      }
+#endif
     }
   }
 
@@ -475,9 +724,124 @@ static inline int process_packet(void *data, __u64 off, void *data_end,
       // Simplified: Remove LRU stats to avoid read-after-write issues
     }
 
+#ifdef NANONIC_PARALLEL_LOOKUP
+    // Probe the LRU and the ring together and pick one of them afterwards:
+    // reals is then looked up in one stage for both candidates, instead of
+    // after the LRU miss and again after the ring
+    __u64 cur_time = bpf_ktime_get_ns();
+    __u32 ring_key = get_ring_key(&pckt, vip_info, is_ipv6);
+    struct real_pos_lru *dst_lru = bpf_map_lookup_elem(lru_map, &pckt.flow);
+    __u32 *ring_pos = bpf_map_lookup_elem(&ch_rings, &ring_key);
+    bool lru_hit = dst_lru && !(pckt.flags & F_SYN_SET) &&
+                   !(vip_info->flags & F_LRU_BYPASS);
+    if (lru_hit && pckt.flow.proto == IPPROTO_UDP) {
+      if (cur_time - dst_lru->atime > LRU_UDP_TIMEOUT) {
+        lru_hit = false;
+      } else {
+        dst_lru->atime = cur_time;
+      }
+    }
+    // Connection to keep on its real: the LRU entry or, after a reload, the
+    // saved one
+    bool pref = lru_hit;
+    __u32 pref_key = lru_hit ? dst_lru->pos : 0;
+#ifdef NANONIC_WARM_RESTART
+    if (!lru_hit && !(pckt.flags & F_SYN_SET) &&
+        !(vip_info->flags & F_LRU_BYPASS)) {
+      // While the host is still writing the table, the connections without a
+      // saved real take the ring without an LRU entry
+      bool restoring;
+      __u32 *saved = restored_real(&conn, &restoring);
+      if (saved) {
+        pref = true;
+        pref_key = *saved;
+      } else if (restoring) {
+        pckt.flags |= NANONIC_PCKT_NO_PIN;
+      }
+    }
+#endif
+    // Both candidates are looked up in reals together. As in the sequential
+    // lookup, an entry whose real is gone falls back to the ring
+    __u32 ring_real = ring_pos ? *ring_pos : 0;
+    struct real_definition *pref_dst = bpf_map_lookup_elem(&reals, &pref_key);
+    struct real_definition *ring_dst = bpf_map_lookup_elem(&reals, &ring_real);
+    bool from_ring = !pref || !pref_dst;
+    if (from_ring) {
+      if (pckt.flow.proto == IPPROTO_TCP) {
+        __u32 lru_stats_key = MAX_VIPS + LRU_MISS_CNTR;
+        struct lb_stats *lru_stats = bpf_map_lookup_elem(
+          &stats, &lru_stats_key);
+        if (!lru_stats) {
+          return XDP_DROP;
+        }
+#ifdef KATRAN_INTROSPECTION
+        if (!(pckt.flags & F_SYN_SET)) {
+#ifdef NANONIC_META
+          event = NANONIC_EVENT_TCP_NONSYN_LRUMISS;
+#else
+          __u32 size = data_end - data;
+          submit_event(xdp, &event_pipe, TCP_NONSYN_LRUMISS, data, size);
+#endif
+        }
+#endif
+      }
+      if (!ring_pos) {
+        return XDP_DROP;
+      }
+      if (vip_info->flags & F_HASH_DPORT_ONLY) {
+        // the LRU entry and the encap source use the flow that was hashed,
+        // as get_packet_dst does
+        pckt.flow.port16[0] = pckt.flow.port16[1];
+        memset(pckt.flow.srcv6, 0, 16);
+      }
+    }
+    __u32 real_key = from_ring ? ring_real : pref_key;
+    pckt.real_index = real_key;
+    dst = from_ring ? ring_dst : pref_dst;
+    if (!dst) {
+      return XDP_DROP;
+    }
+    if ((from_ring || !lru_hit) && !(vip_info->flags & F_LRU_BYPASS) &&
+        !(pckt.flags & NANONIC_PCKT_NO_PIN)) {
+      struct real_pos_lru new_dst_lru = {};
+      if (pckt.flow.proto == IPPROTO_UDP) {
+        new_dst_lru.atime = cur_time;
+      }
+      new_dst_lru.pos = real_key;
+      bpf_map_update_elem(lru_map, &pckt.flow, &new_dst_lru, BPF_ANY);
+#ifdef NANONIC_WARM_RESTART
+      pinned = true;
+#endif
+    }
+#else
     if (!(pckt.flags & F_SYN_SET) &&
         !(vip_info->flags & F_LRU_BYPASS)) {
       connection_table_lookup(&dst, &pckt, lru_map);
+#ifdef NANONIC_WARM_RESTART
+      if (!dst) {
+        // A saved connection goes back into the LRU. While the host is still
+        // writing the table, the others take the ring without an LRU entry,
+        // so their saved real wins as soon as it is written
+        bool restoring;
+        __u32 *saved = restored_real(&conn, &restoring);
+        if (saved) {
+          __u32 key = *saved;
+          pckt.real_index = key;
+          dst = bpf_map_lookup_elem(&reals, &key);
+          if (dst) {
+            struct real_pos_lru new_dst_lru = {};
+            if (pckt.flow.proto == IPPROTO_UDP) {
+              new_dst_lru.atime = bpf_ktime_get_ns();
+            }
+            new_dst_lru.pos = key;
+            bpf_map_update_elem(lru_map, &pckt.flow, &new_dst_lru, BPF_ANY);
+            pinned = true;
+          }
+        } else if (restoring) {
+          pckt.flags |= NANONIC_PCKT_NO_PIN;
+        }
+      }
+#endif
     }
     if (!dst) {
       if (pckt.flow.proto == IPPROTO_TCP) {
@@ -495,8 +859,14 @@ static inline int process_packet(void *data, __u64 off, void *data_end,
           // or because another katran is restarting and all the sessions
           // have been reshuffled
 #ifdef KATRAN_INTROSPECTION
+#ifdef NANONIC_META
+          // No perf event array on the card, the event code goes out in the
+          // descriptor and the event tap samples it to the host
+          event = NANONIC_EVENT_TCP_NONSYN_LRUMISS;
+#else
           __u32 size = data_end - data;
           submit_event(xdp, &event_pipe, TCP_NONSYN_LRUMISS, data, size);
+#endif
 #endif
           // Simplified: Remove LRU stats to avoid read-after-write issues
         }
@@ -504,17 +874,32 @@ static inline int process_packet(void *data, __u64 off, void *data_end,
       if(!get_packet_dst(&dst, &pckt, vip_info, is_ipv6, lru_map)) {
         return XDP_DROP;
       }
+#ifdef NANONIC_WARM_RESTART
+      pinned = !(vip_info->flags & F_LRU_BYPASS) &&
+               !(pckt.flags & NANONIC_PCKT_NO_PIN);
+#endif
       // lru misses (either new connection or lru is full and starts to trash)
       // Simplified: Remove stats update to avoid read-after-write issues
     }
+#endif // NANONIC_PARALLEL_LOOKUP
   }
 
+#ifndef NANONIC_PARALLEL_LOOKUP
   cval = bpf_map_lookup_elem(&ctl_array, &mac_addr_pos);
+#endif
 
   if (!cval) {
     return XDP_DROP;
   }
 
+#ifdef NANONIC_ENCAP
+  // The outer header is prepended on the card by the encapsulation engine
+  // (rtl/nanonic_encap.v), the gateway MAC of ctl_array is one of its registers
+  struct nanonic_egress_ops ops = {};
+  if (!fill_encap_ops(&ops, &pckt, dst, is_ipv6, pkt_bytes)) {
+    return XDP_DROP;
+  }
+#else
   if (dst->flags & F_IPV6) {
     if(!PCKT_ENCAP_V6(xdp, cval, is_ipv6, &pckt, dst, pkt_bytes)) {
       return XDP_DROP;
@@ -524,14 +909,89 @@ static inline int process_packet(void *data, __u64 off, void *data_end,
       return XDP_DROP;
     }
   }
+#endif
   vip_num = vip_info->vip_num;
   // Simplified: Remove VIP statistics to avoid read-after-write issues
 
   // per real statistics - also simplified (removed to avoid read-after-write issues)
 
+#ifdef NANONIC_META
+  // export what we computed so the host does not have to re-parse and re-hash
+  struct nanonic_desc_info meta = {};
+  meta.verdict = XDP_TX;
+  meta.flags = NANONIC_F_HASH | NANONIC_F_REAL | NANONIC_F_VIP | NANONIC_F_CLASS;
+  meta.class_tag = class_tag;
+  meta.event = event;
+#ifdef NANONIC_WARM_RESTART
+  if (pinned) {
+    // The event tap copies the new LRU entries to the journal of the host
+    meta.flags |= NANONIC_F_PINNED;
+    if (event == NANONIC_EVENT_NONE) {
+      meta.event = NANONIC_EVENT_LRU_INSERT;
+    }
+  }
+#endif
+  meta.flow_hash = get_packet_hash(&pckt, is_ipv6);
+  meta.real_index = pckt.real_index;
+  meta.vip_num = vip_num;
+#ifdef NANONIC_ENCAP
+  if (!nanonic_push_desc_ops(xdp, &meta, &ops)) {
+    return XDP_DROP;
+  }
+#else
+  if (!nanonic_push_desc(xdp, &meta)) {
+    return XDP_DROP;
+  }
+#endif
+#endif
+
   return XDP_TX;
 }
 
+#ifdef NANONIC_MAP_WRITER
+// Map ids of the map writer, the window of a map is 0x8000 + 0x1000 * id
+// (see nanonic_maps.json)
+#define NANONIC_MAPWR_CTL_ARRAY     0
+#define NANONIC_MAPWR_VIP_MAP       1
+#define NANONIC_MAPWR_VIP_FILTER    2
+#define NANONIC_MAPWR_LRU_RESTORE   3
+#define NANONIC_MAPWR_REALS         4
+#define NANONIC_MAPWR_CH_RINGS      5
+#define NANONIC_MAPWR_QUIC_MAPPING  6
+
+// Apply a message of the map writer to the map it names
+__attribute__((__always_inline__))
+static inline void apply_map_write(__u8 *msg) {
+  switch (msg[NANONIC_MAPWR_OFF_MAP]) {
+    case NANONIC_MAPWR_CTL_ARRAY:
+      NANONIC_MAPWR_APPLY(msg, ctl_array, __u32, struct ctl_value);
+      break;
+    case NANONIC_MAPWR_VIP_MAP:
+      NANONIC_MAPWR_APPLY(msg, vip_map, struct vip_definition, struct vip_meta);
+      break;
+#ifdef NANONIC_VIP_FILTER
+    case NANONIC_MAPWR_VIP_FILTER:
+      NANONIC_MAPWR_APPLY(msg, vip_filter, __u32, __u64);
+      break;
+#endif
+#ifdef NANONIC_WARM_RESTART
+    case NANONIC_MAPWR_LRU_RESTORE:
+      NANONIC_MAPWR_APPLY(msg, lru_restore, struct flow_key, __u32);
+      break;
+#endif
+    case NANONIC_MAPWR_REALS:
+      NANONIC_MAPWR_APPLY(msg, reals, __u32, struct real_definition);
+      break;
+    case NANONIC_MAPWR_CH_RINGS:
+      NANONIC_MAPWR_APPLY(msg, ch_rings, __u32, __u32);
+      break;
+    case NANONIC_MAPWR_QUIC_MAPPING:
+      NANONIC_MAPWR_APPLY(msg, quic_mapping, __u32, __u32);
+      break;
+  }
+}
+#endif // NANONIC_MAP_WRITER
+
 // Specific IP to monitor (in network byte order)
 #define MONITOR_IP 0x6401A8C0  // 192.168.1.100
 
@@ -552,6 +1012,7 @@ int balancer_ingress(struct xdp_md *ctx) {
   struct eth_hdr *eth = data;
   __u32 eth_proto;
   __u32 nh_off;
+  int action;
   nh_off = sizeof(struct eth_hdr);
 
   struct iphdr *ip;
@@ -561,6 +1022,15 @@ int balancer_ingress(struct xdp_md *ctx) {
   __u64 new_count = 1;
 
   ip = (struct iphdr *)(eth + 1);
+
+#ifdef NANONIC_MAP_WRITER
+  // Map updates from the host never reach the rest of the program
+  __u8 *mapwr = nanonic_mapwr_msg(data, data_end);
+  if (mapwr) {
+    apply_map_write(mapwr);
+    return XDP_DROP;
+  }
+#endif
   
   // Only process ICMP packets from monitored IP
   if (ip->saddr == MONITOR_IP && ip->protocol == IPPROTO_ICMP) {
@@ -630,7 +1100,11 @@ int balancer_ingress(struct xdp_md *ctx) {
       // Update counter in map
       bpf_map_update_elem(&packet_count_map, &map_key, &new_count, BPF_ANY);
 
+#ifdef NANONIC_META
+      return nanonic_pass(ctx, NANONIC_CLASS_MONITOR);
+#else
       return XDP_PASS;
+#endif
   }
 
   if (data + nh_off > data_end) {
@@ -641,13 +1115,21 @@ int balancer_ingress(struct xdp_md *ctx) {
   eth_proto = eth->eth_proto;
 
   if (eth_proto == BE_ETH_P_IP) {
-    return process_packet(data, nh_off, data_end, false, ctx);
+    action = process_packet(data, nh_off, data_end, false, ctx);
   } else if (eth_proto == BE_ETH_P_IPV6) {
-    return process_packet(data, nh_off, data_end, true, ctx);
+    action = process_packet(data, nh_off, data_end, true, ctx);
   } else {
     // pass to tcp/ip stack
-    return XDP_PASS;
+    action = XDP_PASS;
   }
+#ifdef NANONIC_META
+  // The packets for the kernel carry a descriptor too, like the forwarded
+  // ones, so the egress and the host see the verdict of every packet
+  if (action == XDP_PASS) {
+    return nanonic_pass(ctx, NANONIC_CLASS_NONE);
+  }
+#endif
+  return action;
 }
 
 char _license[] SEC("license") = "GPL";
@@ -0,0 +1,242 @@
+`timescale 1ns / 1ps
+
+// Benchmark for the XDP_TX hairpin.
+//
+// Needs the swap_mac pipeline built with NANONIC_FLAGS="-D NANONIC_META", so
+// every reflected frame carries an XDP_TX descriptor. Streams NUM_PKTS 98-byte
+// ICMP frames into nanonic_pipeline_top and measures the latency from the first
+// beat entering the top to the first beat leaving it. With HAIRPIN = 1 the
+// frames leave on the hairpin output (CMAC TX); with HAIRPIN = 0 they leave on
+// port1 (QDMA C2H) and would still have to cross PCIe twice and be sent back by
+// host software. The report gives the PCIe traffic the hairpin keeps on the card.
+
+module Nanotube_hairpin_bench_tb;
+
+  parameter HAIRPIN  = 1;
+  parameter NUM_PKTS = 1000;
+
+  reg ap_clk_0;
+  reg ap_rst_n_0;
+  reg [511:0] port0_0_tdata;
+  reg [63:0] port0_0_tkeep;
+  reg port0_0_tlast;
+  reg [47:0] port0_0_tuser;
+  reg port0_0_tvalid;
+  wire port0_0_tready;
+  wire [511:0] port1_0_tdata;
+  wire [63:0] port1_0_tkeep;
+  wire port1_0_tlast;
+  reg port1_0_tready;
+  wire [47:0] port1_0_tuser;
+  wire port1_0_tvalid;
+  wire [511:0] hairpin_tdata;
+  wire [63:0] hairpin_tkeep;
+  wire hairpin_tlast;
+  reg hairpin_tready;
+  wire [47:0] hairpin_tuser;
+  wire hairpin_tvalid;
+
+  integer start_time, end_time;
+  integer cycle;
+  integer in_pkts, c2h_pkts, hp_pkts, hp_bytes;
+  integer out_idx, lat, lat_sum, lat_min, lat_max;
+  integer i, k;
+
+  integer ts [0:NUM_PKTS-1];
+  reg [7:0] pkt [0:127];
+
+  // Instantiate the pipeline top with the descriptor decoder and the hairpin
+  nanonic_pipeline_top #(
+    .META_EN    (1),
+    .META_STRIP (1),
+    .HAIRPIN_EN (HAIRPIN)
+  ) uut (
+    .ap_clk_0(ap_clk_0),
+    .ap_rst_n_0(ap_rst_n_0),
+    .port0_0_tdata(port0_0_tdata),
+    .port0_0_tkeep(port0_0_tkeep),
+    .port0_0_tlast(port0_0_tlast),
+    .port0_0_tready(port0_0_tready),
+    .port0_0_tuser(port0_0_tuser),
+    .port0_0_tvalid(port0_0_tvalid),
+    .port1_0_tdata(port1_0_tdata),
+    .port1_0_tkeep(port1_0_tkeep),
+    .port1_0_tlast(port1_0_tlast),
+    .port1_0_tready(port1_0_tready),
+    .port1_0_tuser(port1_0_tuser),
+    .port1_0_tvalid(port1_0_tvalid),
+    .hairpin_tdata(hairpin_tdata),
+    .hairpin_tkeep(hairpin_tkeep),
+    .hairpin_tlast(hairpin_tlast),
+    .hairpin_tready(hairpin_tready),
+    .hairpin_tuser(hairpin_tuser),
+    .hairpin_tvalid(hairpin_tvalid),
+    .s_axil_awvalid(1'b0),
+    .s_axil_awaddr(32'd0),
+    .s_axil_awready(),
+    .s_axil_wvalid(1'b0),
+    .s_axil_wdata(32'd0),
+    .s_axil_wready(),
+    .s_axil_bvalid(),
+    .s_axil_bresp(),
+    .s_axil_bready(1'b1),
+    .s_axil_arvalid(1'b0),
+    .s_axil_araddr(32'd0),
+    .s_axil_arready(),
+    .s_axil_rvalid(),
+    .s_axil_rdata(),
+    .s_axil_rresp(),
+    .s_axil_rready(1'b1),
+    .early_drop_count()
+  );
+
+  // Clock generation (250 MHz = 4 ns period)
+  always #2 ap_clk_0 = ~ap_clk_0;
+
+  // Handshake happens between master and slave
+  wire port0_handshake;
+  assign port0_handshake = port0_0_tvalid & port0_0_tready;
+
+  wire port1_handshake;
+  assign port1_handshake = port1_0_tvalid & port1_0_tready;
+
+  wire hairpin_handshake;
+  assign hairpin_handshake = hairpin_tvalid & hairpin_tready;
+
+  reg in_first, c2h_first, hp_first;
+
+  always @(posedge ap_clk_0) begin
+    if (!ap_rst_n_0) begin
+      cycle = 0;
+      in_pkts = 0;
+      c2h_pkts = 0;
+      hp_pkts = 0;
+      hp_bytes = 0;
+      out_idx = 0;
+      lat_sum = 0;
+      lat_min = 32'h7FFFFFFF;
+      lat_max = 0;
+      in_first = 1;
+      c2h_first = 1;
+      hp_first = 1;
+    end
+    else begin
+      cycle = cycle + 1;
+      if (port0_handshake) begin
+        if (in_first && in_pkts < NUM_PKTS)
+          ts[in_pkts] = cycle;
+        in_first = port0_0_tlast;
+        if (port0_0_tlast)
+          in_pkts = in_pkts + 1;
+      end
+      // Packets leave in order, on one output or the other
+      if ((hairpin_handshake && hp_first) || (port1_handshake && c2h_first)) begin
+        lat = cycle - ts[out_idx];
+        lat_sum = lat_sum + lat;
+        if (lat < lat_min)
+          lat_min = lat;
+        if (lat > lat_max)
+          lat_max = lat;
+        out_idx = out_idx + 1;
+      end
+      if (hairpin_handshake) begin
+        hp_first = hairpin_tlast;
+        if (hairpin_tlast) begin
+          hp_pkts = hp_pkts + 1;
+          hp_bytes = hp_bytes + hairpin_tuser[15:0];
+        end
+      end
+      if (port1_handshake) begin
+        c2h_first = port1_0_tlast;
+        if (port1_0_tlast)
+          c2h_pkts = c2h_pkts + 1;
+      end
+    end
+  end
+
+  // 98-byte ICMP echo request from 192.168.1.1
+  task build_packet;
+    begin
+      for (i = 0; i < 128; i = i + 1)
+        pkt[i] = i[7:0];
+      {pkt[0], pkt[1], pkt[2], pkt[3], pkt[4], pkt[5]}     = 48'h020000000103;
+      {pkt[6], pkt[7], pkt[8], pkt[9], pkt[10], pkt[11]}   = 48'h020000000101;
+      {pkt[12], pkt[13]}                                   = 16'h0800;
+      {pkt[14], pkt[15], pkt[16], pkt[17]}                 = 32'h45000054;
+      {pkt[18], pkt[19], pkt[20], pkt[21]}                 = 32'hf1cb4000;
+      pkt[22] = 8'h40;
+      pkt[23] = 8'h01;
+      {pkt[24], pkt[25]}                                   = 16'h0000;
+      {pkt[26], pkt[27], pkt[28], pkt[29]}                 = 32'hc0a80101;
+      {pkt[30], pkt[31], pkt[32], pkt[33]}                 = 32'hc0a80103;
+      {pkt[34], pkt[35], pkt[36], pkt[37]}                 = 32'h08000000;
+    end
+  endtask
+
+  task send_beat(input [511:0] data, input [63:0] keep, input last);
+    begin
+      port0_0_tdata = data;
+      port0_0_tkeep = keep;
+      port0_0_tlast = last;
+      port0_0_tuser = 48'h000000000062;
+      port0_0_tvalid = 1;
+      @(posedge ap_clk_0);
+      while (!port0_0_tready)
+        @(posedge ap_clk_0);
+      #1;
+    end
+  endtask
+
+  reg [511:0] beat0, beat1;
+
+  initial begin
+      ap_clk_0 = 0;
+      ap_rst_n_0 = 0;
+      port0_0_tdata = 0;
+      port0_0_tkeep = 0;
+      port0_0_tlast = 0;
+      port0_0_tuser = 0;
+      port0_0_tvalid = 0;
+      port1_0_tready = 1;
+      hairpin_tready = 1;
+
+      #20;
+      ap_rst_n_0 = 1;
+
+      wait(port0_0_tready);
+      @(posedge ap_clk_0);
+      #1;
+
+      build_packet;
+      for (i = 0; i < 64; i = i + 1) begin
+        beat0[8*i +: 8] = pkt[i];
+        beat1[8*i +: 8] = pkt[64 + i];
+      end
+
+      start_time = cycle;
+      for (k = 0; k < NUM_PKTS; k = k + 1) begin
+        send_beat(beat0, 64'hFFFFFFFFFFFFFFFF, 0);
+        send_beat(beat1, 64'h00000003FFFFFFFF, 1);
+      end
+      end_time = cycle;
+
+      // Deassert valid after all packets sent
+      port0_0_tvalid = 0;
+
+      // Let the pipeline drain
+      #2000;
+
+      $display("Hairpin %0s", HAIRPIN ? "enabled" : "disabled");
+      $display("Packets in: %0d in %0d cycles (%0.2f Mpps)", in_pkts, end_time - start_time,
+               in_pkts * 250.0 / (end_time - start_time));
+      $display("Packets out: %0d on hairpin, %0d on port1 (C2H)", hp_pkts, c2h_pkts);
+      if (out_idx > 0)
+        $display("On-card latency: min %0d, avg %0.1f, max %0d cycles (avg %0.1f ns)",
+                 lat_min, lat_sum * 1.0 / out_idx, lat_max, lat_sum * 4.0 / out_idx);
+      $display("PCIe traffic kept on the card: %0d bytes C2H + %0d bytes H2C (%0.2f Gb/s at this rate)",
+               hp_bytes, hp_bytes, 2.0 * hp_bytes * 8 * 0.25 / (end_time - start_time));
+
+      $finish;
+    end
+
+endmodule
@@ -19,6 +19,10 @@
 #include "pckt_parsing.h"
 #include "handle_icmp.h"
 
+#ifdef NANONIC_META
+#include "nanonic_desc.h"
+#endif
+
 #define SEC(NAME) __attribute__((section(NAME), used))
 
 // Specific IP to monitor (in network byte order)
@@ -211,7 +215,20 @@ int xdp_prog(struct xdp_md *ctx)
     for (int i = 0; i < ETH_ALEN; i++)
         eth->h_dest[i] = tmp_mac[i];
 
+#ifdef NANONIC_META
+    // The frame goes back to the sender: with the hairpin enabled in the
+    // pipeline top it is sent to the CMAC TX path without reaching the host
+    struct nanonic_desc_info meta = {};
+    meta.verdict = XDP_TX;
+    meta.flags = NANONIC_F_CLASS;
+    meta.class_tag = NANONIC_CLASS_REFLECT;
+    if (!nanonic_push_desc(ctx, &meta))
+        return XDP_DROP;
+
+    return XDP_TX;
+#else
     return XDP_PASS;
+#endif
 }
 
 char _license[] SEC("license") = "GPL";
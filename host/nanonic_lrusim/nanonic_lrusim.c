@@ -0,0 +1,1528 @@
+/*
+ * NanoNIC connection-table simulator
+ *
+ * Offline replay of packet traces through the connection table of
+ * xdp_katran (connection_table_lookup and get_packet_dst), to size
+ * single_lru_cache and fallback_lru_cache from real traffic instead of
+ * guessing. Every configuration of the sweep (table size, associativity,
+ * eviction policy, UDP timeout) sees the same packets:
+ *
+ *   - a SYN never looks the table up, it is hashed on the ring and pinned;
+ *   - any other packet looks its flow up, a UDP entry older than the UDP
+ *     timeout counts as a miss, and a miss is hashed on the ring and pinned
+ *     again (BPF_ANY update).
+ *
+ * The ring is the Maglev ring of --reals equal-weight reals with RING_SIZE
+ * positions, hashed with get_packet_hash (jhash of the source address and the
+ * ports). With --churn, reals are taken out of the ring in turn, which is
+ * what makes a miss harmful: a non-SYN packet that misses and lands on
+ * another real than the one its flow started on is a reshuffle, the
+ * connection is reset. --reload empties the table as a reload of the card
+ * does.
+ *
+ * Traces are classic pcaps (Ethernet or raw IP), text flow logs with one
+ * packet per line:
+ *   TIMESTAMP_S PROTO SRC SPORT DST DPORT [FLAGS]   (FLAGS with S for a SYN)
+ * or record files written by --save. Inputs are mmapped and parsed in
+ * parallel chunks into 24-byte records; a record file is used in place, so
+ * a day-long capture is parsed once and swept many times. The sweep runs one
+ * work item per configuration, split by sets of the table for the
+ * set-associative ones, on --threads threads.
+ *
+ *   nanonic_lrusim -e 1000,4000,16000 -w 0,4 -p lru,random day.pcap
+ *   nanonic_lrusim -s day.nlr day-*.pcap
+ *   nanonic_lrusim -e 250k,1M,4M -c 60 --csv sweep.csv day.nlr
+ */
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// balancer_consts.h of Katran
+#define RING_SIZE           65537
+#define MAX_VIPS            512
+#define MAX_REALS           4096
+#define INIT_JHASH_SEED     (MAX_VIPS * RING_SIZE)
+#define INIT_JHASH_SEED_V6  MAX_VIPS
+#define LRU_UDP_TIMEOUT_S   30
+#define DEFAULT_LRU_SIZE    1000
+
+#define MAX_THREADS   256
+#define MAX_INPUTS    256
+#define MAX_VIP_RULES 64
+#define MAX_LIST      32
+#define MAX_RELOADS   64
+// Records looked ahead to prefetch their set or their hash bucket, and half
+// as many for the first entry of the bucket
+#define PREFETCH      16
+#define NIL           UINT32_MAX
+
+#define REC_TCP    (1 << 0)
+#define REC_SYN    (1 << 1)
+// First packet of its flow in the trace
+#define REC_FIRST  (1 << 2)
+
+// One packet to a VIP
+struct lrusim_rec {
+  uint64_t flow;     // hash of the 5-tuple, the key of the table (never 0)
+  uint32_t ts_ms;    // since the first packet of the trace
+  uint32_t born_ms;  // first packet of the flow
+  uint32_t hash;     // get_packet_hash()
+  uint8_t flags;     // REC_*
+  uint8_t pad[3];
+};
+
+#define NLR_MAGIC "NLRSIM1"
+
+// Header of a record file (--save), followed by the records
+struct lrusim_hdr {
+  char magic[8];
+  uint64_t count;
+  uint64_t flows;
+  uint64_t start_ns;
+};
+
+enum policy { POL_LRU, POL_FIFO, POL_RANDOM };
+static const char *policy_names[] = { "lru", "fifo", "random" };
+
+struct config {
+  uint32_t entries;
+  uint32_t ways;       // 0: fully associative
+  enum policy policy;
+  uint32_t udp_timeout_ms;
+  uint32_t nsets;
+  uint32_t shards;     // work items, a power of two
+};
+
+struct sim_stats {
+  uint64_t pkts;
+  uint64_t tcp;
+  uint64_t nonsyn;       // TCP packets without SYN
+  uint64_t hits;
+  uint64_t syn;
+  uint64_t cold;         // first packet of a flow without SYN
+  uint64_t tcp_miss;     // non-SYN TCP miss of a known flow
+  uint64_t tcp_reshuffled;
+  uint64_t udp_expired;
+  uint64_t udp_miss;
+  uint64_t udp_reshuffled;
+  uint64_t evictions;
+};
+
+struct vip_rule {
+  int family;
+  uint8_t addr[16];
+  uint16_t port;       // network order, 0 for any
+  uint8_t proto;       // 0 for any
+};
+
+// A piece of an input parsed by one thread
+struct chunk {
+  const struct input *in;
+  size_t begin, end;   // byte offsets
+  size_t nrec;         // records at most
+  size_t out;          // first record
+  size_t nout;         // records written
+};
+
+struct input {
+  const char *path;
+  const uint8_t *map;
+  size_t size;
+  enum { IN_PCAP, IN_TEXT, IN_NLR } kind;
+  bool swap;           // pcap of the other byte order
+  bool nsec;
+  uint32_t linktype;
+  uint64_t first_ns;
+  bool has_first;
+};
+
+static unsigned nthreads;
+static struct vip_rule vips[MAX_VIP_RULES];
+static int nvips;
+static uint32_t nreals = 100;
+static uint32_t ring_size = RING_SIZE;
+static uint32_t churn_ms;
+static uint32_t churn_count = 1;
+static uint32_t reload_ms[MAX_RELOADS];
+static int nreloads;
+
+static struct lrusim_rec *recs;
+static size_t nrecs;
+static uint64_t nflows;
+static uint64_t start_ns;
+
+// rings[r * ring_size + pos] is the real at pos of ring r; ring 0 has all
+// the reals, ring r > 0 the ones left after the r-th turn of --churn
+static uint16_t *rings;
+static uint32_t nrings = 1;
+
+static double now_s(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void die(const char *fmt, const char *arg) {
+  fprintf(stderr, fmt, arg);
+  fputc('\n', stderr);
+  exit(EXIT_FAILURE);
+}
+
+typedef void (*item_fn)(void *ctx, size_t item);
+
+struct pfor {
+  item_fn fn;
+  void *ctx;
+  size_t n;
+  atomic_size_t next;
+};
+
+static void *pfor_worker(void *arg) {
+  struct pfor *pf = arg;
+  size_t i;
+
+  while ((i = atomic_fetch_add(&pf->next, 1)) < pf->n)
+    pf->fn(pf->ctx, i);
+  return NULL;
+}
+
+static void parallel_for(size_t n, item_fn fn, void *ctx) {
+  pthread_t th[MAX_THREADS];
+  struct pfor pf = { .fn = fn, .ctx = ctx, .n = n };
+  unsigned nt = n < nthreads ? (unsigned)n : nthreads;
+
+  atomic_init(&pf.next, 0);
+  for (unsigned t = 1; t < nt; t++)
+    if (pthread_create(&th[t], NULL, pfor_worker, &pf))
+      die("Cannot create a thread: %s", strerror(errno));
+  pfor_worker(&pf);
+  for (unsigned t = 1; t < nt; t++)
+    pthread_join(th[t], NULL);
+}
+
+static inline uint32_t rol32(uint32_t w, unsigned s) {
+  return (w << s) | (w >> (32 - s));
+}
+
+// jhash.h of Katran, the one of the Linux kernel
+#define JHASH_INITVAL 0xdeadbeef
+
+#define jhash_mix(a, b, c) do {                 \
+    a -= c; a ^= rol32(c, 4);  c += b;          \
+    b -= a; b ^= rol32(a, 6);  a += c;          \
+    c -= b; c ^= rol32(b, 8);  b += a;          \
+    a -= c; a ^= rol32(c, 16); c += b;          \
+    b -= a; b ^= rol32(a, 19); a += c;          \
+    c -= b; c ^= rol32(b, 4);  b += a;          \
+  } while (0)
+
+#define jhash_final(a, b, c) do {               \
+    c ^= b; c -= rol32(b, 14);                  \
+    a ^= c; a -= rol32(c, 11);                  \
+    b ^= a; b -= rol32(a, 25);                  \
+    c ^= b; c -= rol32(b, 16);                  \
+    a ^= c; a -= rol32(c, 4);                   \
+    b ^= a; b -= rol32(a, 14);                  \
+    c ^= b; c -= rol32(b, 24);                  \
+  } while (0)
+
+static inline uint32_t load32(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+// jhash() of the 16 bytes of an IPv6 address
+static uint32_t jhash16(const uint8_t *k, uint32_t initval) {
+  uint32_t a, b, c;
+
+  a = b = c = JHASH_INITVAL + 16 + initval;
+  a += load32(k);
+  b += load32(k + 4);
+  c += load32(k + 8);
+  jhash_mix(a, b, c);
+  a += (uint32_t)k[15] << 24 | (uint32_t)k[14] << 16 |
+       (uint32_t)k[13] << 8 | k[12];
+  jhash_final(a, b, c);
+  return c;
+}
+
+static uint32_t jhash_2words(uint32_t a, uint32_t b, uint32_t initval) {
+  uint32_t c = 0;
+
+  initval += JHASH_INITVAL + (2 << 2);
+  a += initval;
+  b += initval;
+  c += initval;
+  jhash_final(a, b, c);
+  return c;
+}
+
+// get_packet_hash(): the words are the bytes of the packet read in host
+// order, as the BPF program reads flow.src and flow.ports
+static uint32_t packet_hash(const uint8_t *src, bool v6, const uint8_t *ports) {
+  if (v6)
+    return jhash_2words(jhash16(src, INIT_JHASH_SEED_V6), load32(ports),
+                        INIT_JHASH_SEED);
+  return jhash_2words(load32(src), load32(ports), INIT_JHASH_SEED);
+}
+
+static inline uint64_t fmix64(uint64_t k) {
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+static inline uint64_t rotl64(uint64_t x, unsigned r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t flow_hash(const uint8_t *src, const uint8_t *dst, int alen,
+                          const uint8_t *ports, uint8_t proto) {
+  uint64_t h = fmix64(((uint64_t)load32(ports) << 8 | proto) ^
+                      (uint64_t)alen << 48);
+  uint64_t w;
+
+  for (int i = 0; i < alen; i += 4) {
+    w = (uint64_t)load32(src + i) << 32 | load32(dst + i);
+    h = fmix64(h ^ rotl64(w * 0x87c37b91114253d5ULL, 31));
+  }
+  return h ? h : 1;
+}
+
+// MurmurHash3_x64_64 of two words, for the Maglev permutations
+static uint64_t murmur64(uint64_t a, uint64_t b, uint32_t seed) {
+  const uint64_t c1 = 0x87c37b91114253d5ULL;
+  const uint64_t c2 = 0x4cf5ad432745937fULL;
+  uint64_t h1 = seed, h2 = seed;
+
+  a *= c1; a = rotl64(a, 31); a *= c2; h1 ^= a;
+  h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+  b *= c2; b = rotl64(b, 33); b *= c1; h2 ^= b;
+  h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+  h1 ^= 16; h2 ^= 16;
+  h1 += h2; h2 += h1;
+  h1 = fmix64(h1); h2 = fmix64(h2);
+  h1 += h2;
+  return h1;
+}
+
+static bool is_prime(uint32_t n) {
+  if (n < 2)
+    return false;
+  for (uint32_t d = 2; (uint64_t)d * d <= n; d++)
+    if (n % d == 0)
+      return false;
+  return true;
+}
+
+// Maglev ring of equal-weight reals, built like the Katran control plane
+// does: each real fills the next free position of its own permutation
+static void build_ring(void *ctx, size_t r) {
+  uint16_t *ring = rings + r * ring_size;
+  uint16_t reals[MAX_REALS];
+  uint32_t offset[MAX_REALS], skip[MAX_REALS], next[MAX_REALS];
+  uint32_t n = 0, filled = 0;
+
+  (void)ctx;
+  for (uint32_t i = 0; i < nreals; i++) {
+    // Ring r > 0 misses churn_count reals from (r - 1) * churn_count on
+    if (r > 0 && (i + nreals - (uint32_t)((r - 1) * churn_count) % nreals) %
+                 nreals < churn_count)
+      continue;
+    reals[n] = (uint16_t)i;
+    offset[n] = murmur64(i, 0, 42) % ring_size;
+    skip[n] = murmur64(i, 2307, 2718281828u) % (ring_size - 1) + 1;
+    next[n] = 0;
+    n++;
+  }
+  memset(ring, 0xff, ring_size * sizeof(*ring));
+  for (;;) {
+    for (uint32_t i = 0; i < n; i++) {
+      uint32_t c;
+      do {
+        c = (uint32_t)((offset[i] + (uint64_t)next[i]++ * skip[i]) % ring_size);
+      } while (ring[c] != 0xffff);
+      ring[c] = reals[i];
+      if (++filled == ring_size)
+        return;
+    }
+  }
+}
+
+static inline uint32_t ring_of(uint32_t ts_ms) {
+  uint32_t epoch;
+
+  if (!churn_ms)
+    return 0;
+  epoch = ts_ms / churn_ms;
+  return epoch ? (epoch - 1) % (nrings - 1) + 1 : 0;
+}
+
+static inline uint16_t ring_real(uint32_t ts_ms, uint32_t hash) {
+  return rings[(size_t)ring_of(ts_ms) * ring_size + hash % ring_size];
+}
+
+struct pkt_fields {
+  int alen;
+  const uint8_t *src, *dst, *ports;
+  uint8_t proto;
+  bool syn;
+};
+
+static bool vip_match(const struct pkt_fields *f) {
+  if (!nvips)
+    return true;
+  for (int i = 0; i < nvips; i++) {
+    const struct vip_rule *v = &vips[i];
+    if ((v->family == AF_INET6) != (f->alen == 16))
+      continue;
+    if (memcmp(v->addr, f->dst, f->alen))
+      continue;
+    if (v->proto && v->proto != f->proto)
+      continue;
+    if (v->port && memcmp(&v->port, f->ports + 2, 2))
+      continue;
+    return true;
+  }
+  return false;
+}
+
+static void make_rec(struct lrusim_rec *r, const struct pkt_fields *f,
+                     uint64_t ts_ns) {
+  memset(r, 0, sizeof(*r));
+  r->flow = flow_hash(f->src, f->dst, f->alen, f->ports, f->proto);
+  r->ts_ms = ts_ns > start_ns ? (uint32_t)((ts_ns - start_ns) / 1000000) : 0;
+  r->hash = packet_hash(f->src, f->alen == 16, f->ports);
+  if (f->proto == IPPROTO_TCP)
+    r->flags |= REC_TCP;
+  if (f->syn)
+    r->flags |= REC_SYN;
+}
+
+// TCP or UDP over IPv4 or IPv6, behind Ethernet and up to two VLAN tags or
+// raw IP; fragments after the first and IPv6 extension headers are skipped
+static bool parse_frame(const uint8_t *p, uint32_t len, uint32_t linktype,
+                        struct pkt_fields *f) {
+  const uint8_t *l4;
+  uint32_t off = 0, l4len;
+  uint16_t etype;
+
+  if (linktype == 1) {
+    if (len < 14)
+      return false;
+    etype = (uint16_t)(p[12] << 8 | p[13]);
+    off = 14;
+    for (int tags = 0; tags < 2 && (etype == 0x8100 || etype == 0x88a8); tags++) {
+      if (len < off + 4)
+        return false;
+      etype = (uint16_t)(p[off + 2] << 8 | p[off + 3]);
+      off += 4;
+    }
+  } else {
+    if (len < 1)
+      return false;
+    etype = (p[0] >> 4) == 6 ? 0x86dd : 0x0800;
+  }
+
+  if (etype == 0x0800) {
+    uint32_t ihl;
+    if (len < off + 20 || (p[off] >> 4) != 4)
+      return false;
+    ihl = (p[off] & 0xf) * 4u;
+    if ((((p[off + 6] << 8) | p[off + 7]) & 0x1fff) || ihl < 20)
+      return false;
+    f->alen = 4;
+    f->proto = p[off + 9];
+    f->src = p + off + 12;
+    f->dst = p + off + 16;
+    off += ihl;
+  } else if (etype == 0x86dd) {
+    if (len < off + 40)
+      return false;
+    f->alen = 16;
+    f->proto = p[off + 6];
+    f->src = p + off + 8;
+    f->dst = p + off + 24;
+    off += 40;
+  } else {
+    return false;
+  }
+  if (f->proto != IPPROTO_TCP && f->proto != IPPROTO_UDP)
+    return false;
+  l4 = p + off;
+  l4len = len > off ? len - off : 0;
+  if (l4len < (f->proto == IPPROTO_TCP ? 14u : 4u))
+    return false;
+  f->ports = l4;
+  f->syn = f->proto == IPPROTO_TCP && (l4[13] & 0x02);
+  return true;
+}
+
+static inline uint32_t pcap32(const struct input *in, const uint8_t *p) {
+  uint32_t v = load32(p);
+  return in->swap ? __builtin_bswap32(v) : v;
+}
+
+static inline uint64_t pcap_ts(const struct input *in, const uint8_t *rec) {
+  uint64_t frac = pcap32(in, rec + 4);
+  return pcap32(in, rec) * 1000000000ULL + (in->nsec ? frac : frac * 1000);
+}
+
+struct chunk_list {
+  struct chunk *c;
+  size_t n, cap;
+};
+
+static void push_chunk(struct chunk_list *l, const struct input *in,
+                       size_t begin, size_t end, size_t nrec) {
+  if (l->n == l->cap) {
+    l->cap = l->cap ? l->cap * 2 : 64;
+    l->c = realloc(l->c, l->cap * sizeof(*l->c));
+    if (!l->c)
+      die("%s", "Out of memory");
+  }
+  l->c[l->n++] = (struct chunk){ .in = in, .begin = begin, .end = end,
+                                 .nrec = nrec };
+}
+
+// Splits a pcap or a text log into chunks of about target bytes and returns
+// the number of packets or lines
+static size_t split_input(struct input *in, struct chunk_list *l,
+                          size_t target) {
+  size_t off, begin, nrec = 0, total = 0;
+
+  if (in->kind == IN_PCAP) {
+    off = begin = 24;
+    while (off + 16 <= in->size) {
+      uint32_t incl = pcap32(in, in->map + off + 8);
+      if (off + 16 + incl > in->size)
+        break;
+      if (!in->has_first) {
+        in->first_ns = pcap_ts(in, in->map + off);
+        in->has_first = true;
+      }
+      off += 16 + incl;
+      nrec++;
+      if (off - begin >= target) {
+        push_chunk(l, in, begin, off, nrec);
+        total += nrec;
+        begin = off;
+        nrec = 0;
+      }
+    }
+    if (off != in->size)
+      fprintf(stderr, "%s: truncated record at offset %zu\n", in->path, off);
+  } else {
+    const uint8_t *p = in->map, *end = in->map + in->size, *nl;
+    begin = 0;
+    while (p < end) {
+      nl = memchr(p, '\n', end - p);
+      p = nl ? nl + 1 : end;
+      nrec++;
+      if ((size_t)(p - in->map) - begin >= target) {
+        push_chunk(l, in, begin, (size_t)(p - in->map), nrec);
+        total += nrec;
+        begin = p - in->map;
+        nrec = 0;
+      }
+    }
+    off = in->size;
+  }
+  if (off > begin) {
+    push_chunk(l, in, begin, off, nrec);
+    total += nrec;
+  }
+  return total;
+}
+
+static bool parse_line(const char *line, struct pkt_fields *f,
+                       uint8_t *addrs, uint8_t *ports, uint64_t *ts_ns) {
+  char proto[16], src[64], dst[64], flags[16] = "";
+  double ts;
+  unsigned sport, dport;
+  int n;
+
+  n = sscanf(line, "%lf %15s %63s %u %63s %u %15s", &ts, proto, src, &sport,
+             dst, &dport, flags);
+  if (n < 6 || ts < 0 || sport > 65535 || dport > 65535)
+    return false;
+  if (!strcmp(proto, "tcp") || !strcmp(proto, "6"))
+    f->proto = IPPROTO_TCP;
+  else if (!strcmp(proto, "udp") || !strcmp(proto, "17"))
+    f->proto = IPPROTO_UDP;
+  else
+    return false;
+  if (inet_pton(AF_INET, src, addrs) == 1 &&
+      inet_pton(AF_INET, dst, addrs + 16) == 1)
+    f->alen = 4;
+  else if (inet_pton(AF_INET6, src, addrs) == 1 &&
+           inet_pton(AF_INET6, dst, addrs + 16) == 1)
+    f->alen = 16;
+  else
+    return false;
+  ports[0] = (uint8_t)(sport >> 8);
+  ports[1] = (uint8_t)sport;
+  ports[2] = (uint8_t)(dport >> 8);
+  ports[3] = (uint8_t)dport;
+  f->src = addrs;
+  f->dst = addrs + 16;
+  f->ports = ports;
+  f->syn = f->proto == IPPROTO_TCP && strchr(flags, 'S');
+  *ts_ns = (uint64_t)(ts * 1e9);
+  return true;
+}
+
+static void parse_chunk(void *ctx, size_t i) {
+  struct chunk *c = &((struct chunk *)ctx)[i];
+  const struct input *in = c->in;
+  struct lrusim_rec *out = recs + c->out;
+  struct pkt_fields f;
+  size_t n = 0;
+
+  if (in->kind == IN_PCAP) {
+    for (size_t off = c->begin; off < c->end;) {
+      const uint8_t *rec = in->map + off;
+      uint32_t incl = pcap32(in, rec + 8);
+      if (parse_frame(rec + 16, incl, in->linktype, &f) && vip_match(&f))
+        make_rec(&out[n++], &f, pcap_ts(in, rec));
+      off += 16 + incl;
+    }
+  } else {
+    const char *p = (const char *)in->map + c->begin;
+    const char *end = (const char *)in->map + c->end;
+    uint8_t addrs[32], ports[4];
+    char line[256];
+    uint64_t ts_ns;
+
+    while (p < end) {
+      const char *nl = memchr(p, '\n', end - p);
+      size_t l = (nl ? nl : end) - p;
+      if (l && l < sizeof(line) && *p != '#') {
+        memcpy(line, p, l);
+        line[l] = '\0';
+        if (parse_line(line, &f, addrs, ports, &ts_ns) && vip_match(&f))
+          make_rec(&out[n++], &f, ts_ns);
+      }
+      p = nl ? nl + 1 : end;
+    }
+  }
+  c->nout = n;
+}
+
+static void open_input(struct input *in, const char *path) {
+  struct stat st;
+  int fd;
+  uint32_t magic;
+
+  in->path = path;
+  fd = open(path, O_RDONLY);
+  if (fd < 0 || fstat(fd, &st))
+    die("Cannot open %s", path);
+  in->size = st.st_size;
+  in->map = in->size ? mmap(NULL, in->size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+  if (in->size && in->map == MAP_FAILED)
+    die("Cannot map %s", path);
+  close(fd);
+  if (in->size)
+    madvise((void *)in->map, in->size, MADV_SEQUENTIAL);
+
+  if (in->size >= sizeof(struct lrusim_hdr) &&
+      !memcmp(in->map, NLR_MAGIC, sizeof(NLR_MAGIC))) {
+    in->kind = IN_NLR;
+    return;
+  }
+  if (in->size >= 24) {
+    magic = load32(in->map);
+    if (magic == 0xa1b2c3d4 || magic == 0xa1b23c4d ||
+        magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1) {
+      in->kind = IN_PCAP;
+      in->swap = magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1;
+      in->nsec = magic == 0xa1b23c4d || magic == 0x4d3cb2a1;
+      in->linktype = pcap32(in, in->map + 20) & 0xffff;
+      if (in->linktype != 1 && in->linktype != 101)
+        die("%s: only Ethernet and raw IP captures are supported", path);
+      return;
+    }
+    if (magic == 0x0a0d0d0a)
+      die("%s: pcapng is not supported, convert it with editcap -F pcap", path);
+  }
+  in->kind = IN_TEXT;
+}
+
+// Timestamp of the first packet of a text log
+static void text_first(struct input *in) {
+  const char *p = (const char *)in->map, *end = p + in->size;
+  struct pkt_fields f;
+  uint8_t addrs[32], ports[4];
+  char line[256];
+
+  while (p < end && !in->has_first) {
+    const char *nl = memchr(p, '\n', end - p);
+    size_t l = (nl ? nl : end) - p;
+    if (l && l < sizeof(line) && *p != '#') {
+      memcpy(line, p, l);
+      line[l] = '\0';
+      in->has_first = parse_line(line, &f, addrs, ports, &in->first_ns);
+    }
+    p = nl ? nl + 1 : end;
+  }
+}
+
+// Birth of every flow: each shard of the flow space keeps the first packet
+// of its flows, then the records are labelled range by range
+struct flow_ent {
+  uint64_t flow;
+  uint64_t first;
+  uint32_t born_ms;
+  uint32_t pad;
+};
+
+struct flow_tab {
+  struct flow_ent *e;
+  uint64_t mask;
+  uint64_t used;
+  unsigned bits;
+};
+
+static struct flow_tab *flow_tabs;
+static unsigned nflow_tabs;
+
+static inline struct flow_ent *flow_slot(const struct flow_tab *t,
+                                         uint64_t flow) {
+  uint64_t i = (flow * 0x9e3779b97f4a7c15ULL) >> (64 - t->bits);
+
+  while (t->e[i].flow && t->e[i].flow != flow)
+    i = (i + 1) & t->mask;
+  return &t->e[i];
+}
+
+static void flow_tab_init(struct flow_tab *t, unsigned bits) {
+  t->bits = bits;
+  t->mask = (1ULL << bits) - 1;
+  t->used = 0;
+  t->e = calloc(t->mask + 1, sizeof(*t->e));
+  if (!t->e)
+    die("%s", "Out of memory");
+}
+
+static void flow_tab_grow(struct flow_tab *t) {
+  struct flow_tab old = *t;
+
+  flow_tab_init(t, old.bits + 1);
+  t->used = old.used;
+  for (uint64_t i = 0; i <= old.mask; i++)
+    if (old.e[i].flow)
+      *flow_slot(t, old.e[i].flow) = old.e[i];
+  free(old.e);
+}
+
+static void born_shard(void *ctx, size_t shard) {
+  struct flow_tab *t = &flow_tabs[shard];
+
+  (void)ctx;
+  flow_tab_init(t, 16);
+  for (size_t i = 0; i < nrecs; i++) {
+    uint64_t flow = recs[i].flow;
+    struct flow_ent *e;
+    if (flow % nflow_tabs != shard)
+      continue;
+    e = flow_slot(t, flow);
+    if (e->flow)
+      continue;
+    e->flow = flow;
+    e->first = i;
+    e->born_ms = recs[i].ts_ms;
+    if (++t->used * 2 > t->mask)
+      flow_tab_grow(t);
+  }
+}
+
+#define LABEL_RANGE (1 << 20)
+
+static void label_range(void *ctx, size_t r) {
+  size_t end = (r + 1) * LABEL_RANGE < nrecs ? (r + 1) * LABEL_RANGE : nrecs;
+
+  (void)ctx;
+  for (size_t i = r * LABEL_RANGE; i < end; i++) {
+    const struct flow_ent *e = flow_slot(&flow_tabs[recs[i].flow % nflow_tabs],
+                                         recs[i].flow);
+    recs[i].born_ms = e->born_ms;
+    if (e->first == i)
+      recs[i].flags |= REC_FIRST;
+  }
+}
+
+static void load_traces(char **paths, int npaths) {
+  static struct input inputs[MAX_INPUTS];
+  struct chunk_list chunks = { 0 };
+  size_t total = 0, target, bytes = 0;
+  bool have_start = false;
+
+  if (npaths > MAX_INPUTS)
+    die("%s", "Too many traces");
+  for (int i = 0; i < npaths; i++) {
+    open_input(&inputs[i], paths[i]);
+    bytes += inputs[i].size;
+  }
+
+  if (inputs[0].kind == IN_NLR) {
+    const struct lrusim_hdr *h = (const void *)inputs[0].map;
+    if (npaths > 1)
+      die("%s", "A record file is replayed alone");
+    if (nvips)
+      die("%s", "--vip selects the packets of pcaps and text logs, it was "
+          "applied when the record file was saved");
+    if (inputs[0].size != sizeof(*h) + h->count * sizeof(struct lrusim_rec))
+      die("%s: size does not match its header", paths[0]);
+    recs = (struct lrusim_rec *)(inputs[0].map + sizeof(*h));
+    nrecs = h->count;
+    nflows = h->flows;
+    start_ns = h->start_ns;
+    return;
+  }
+
+  // Enough chunks to keep every thread busy to the end
+  target = bytes / (nthreads * 8) + 1;
+  if (target < (1 << 20))
+    target = 1 << 20;
+  for (int i = 0; i < npaths; i++) {
+    struct input *in = &inputs[i];
+    if (in->kind == IN_NLR)
+      die("%s: a record file is replayed alone", in->path);
+    total += split_input(in, &chunks, target);
+    if (in->kind == IN_TEXT)
+      text_first(in);
+    if (in->has_first && (!have_start || in->first_ns < start_ns)) {
+      start_ns = in->first_ns;
+      have_start = true;
+    }
+  }
+
+  recs = malloc((total ? total : 1) * sizeof(*recs));
+  if (!recs)
+    die("%s", "Out of memory");
+  for (size_t c = 0, out = 0; c < chunks.n; c++) {
+    chunks.c[c].out = out;
+    out += chunks.c[c].nrec;
+  }
+  parallel_for(chunks.n, parse_chunk, chunks.c);
+  // Packets that are not to a VIP leave holes at the end of the chunks
+  for (size_t c = 0; c < chunks.n; c++) {
+    if (chunks.c[c].out != nrecs)
+      memmove(recs + nrecs, recs + chunks.c[c].out,
+              chunks.c[c].nout * sizeof(*recs));
+    nrecs += chunks.c[c].nout;
+  }
+  free(chunks.c);
+
+  nflow_tabs = nthreads;
+  flow_tabs = calloc(nflow_tabs, sizeof(*flow_tabs));
+  if (!flow_tabs)
+    die("%s", "Out of memory");
+  parallel_for(nflow_tabs, born_shard, NULL);
+  parallel_for((nrecs + LABEL_RANGE - 1) / LABEL_RANGE, label_range, NULL);
+  for (unsigned t = 0; t < nflow_tabs; t++) {
+    nflows += flow_tabs[t].used;
+    free(flow_tabs[t].e);
+  }
+  free(flow_tabs);
+  for (int i = 0; i < npaths; i++)
+    munmap((void *)inputs[i].map, inputs[i].size);
+}
+
+static void save_records(const char *path) {
+  struct lrusim_hdr h;
+  char tmp[4096];
+  FILE *f;
+
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, NLR_MAGIC, sizeof(NLR_MAGIC));
+  h.count = nrecs;
+  h.flows = nflows;
+  h.start_ns = start_ns;
+  snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+  f = fopen(tmp, "wb");
+  if (!f)
+    die("Cannot write %s", tmp);
+  if (fwrite(&h, sizeof(h), 1, f) != 1 ||
+      fwrite(recs, sizeof(*recs), nrecs, f) != nrecs || fclose(f))
+    die("Cannot write %s", tmp);
+  if (rename(tmp, path))
+    die("Cannot rename %s", tmp);
+}
+
+struct lru_val {
+  uint32_t real;
+  uint32_t atime;   // ms, UDP only
+};
+
+// Set-associative: nsets sets of ways slots, the stamp is the last use (LRU)
+// or the insertion (FIFO)
+struct sa_slot {
+  uint64_t flow;
+  uint64_t stamp;
+  struct lru_val v;
+};
+
+// Fully associative: a chained hash index over the entries, which are kept
+// in a list from the most recent (head) to the next victim (tail)
+struct fa_ent {
+  uint64_t flow;
+  struct lru_val v;
+  uint32_t prev, next, hnext, pad;
+};
+
+struct table {
+  const struct config *cfg;
+  uint64_t rng;
+  uint64_t clock;
+  uint64_t evictions;
+  // set-associative
+  struct sa_slot *slots;
+  // fully associative
+  struct fa_ent *e;
+  uint32_t *bucket;
+  uint32_t mask, used, head, tail;
+};
+
+static inline uint32_t set_of(const struct config *cfg, uint64_t flow) {
+  return (uint32_t)(((flow >> 32) * cfg->nsets) >> 32);
+}
+
+static inline uint64_t xorshift(uint64_t *s) {
+  *s ^= *s << 13;
+  *s ^= *s >> 7;
+  *s ^= *s << 17;
+  return *s;
+}
+
+static void table_clear(struct table *t) {
+  const struct config *cfg = t->cfg;
+
+  if (cfg->ways) {
+    memset(t->slots, 0, (size_t)cfg->nsets * cfg->ways * sizeof(*t->slots));
+  } else {
+    memset(t->bucket, 0xff, ((size_t)t->mask + 1) * sizeof(*t->bucket));
+    t->used = 0;
+    t->head = t->tail = NIL;
+  }
+}
+
+static void table_init(struct table *t, const struct config *cfg,
+                       uint64_t seed) {
+  memset(t, 0, sizeof(*t));
+  t->cfg = cfg;
+  t->rng = fmix64(seed) | 1;
+  if (cfg->ways) {
+    // A set of 8 ways is three whole cache lines
+    t->slots = aligned_alloc(64, ((size_t)cfg->nsets * cfg->ways *
+                                  sizeof(*t->slots) + 63) & ~(size_t)63);
+  } else {
+    uint32_t nb = 1;
+    while (nb < cfg->entries)
+      nb <<= 1;
+    t->mask = nb - 1;
+    t->e = malloc((size_t)cfg->entries * sizeof(*t->e));
+    t->bucket = malloc((size_t)nb * sizeof(*t->bucket));
+  }
+  if ((cfg->ways && !t->slots) || (!cfg->ways && (!t->e || !t->bucket)))
+    die("%s", "Out of memory for a table, use fewer --threads");
+  table_clear(t);
+}
+
+static void table_free(struct table *t) {
+  free(t->slots);
+  free(t->e);
+  free(t->bucket);
+}
+
+static inline void table_prefetch(const struct table *t, uint64_t flow) {
+  // The first line of a set only: the adjacent-line prefetcher brings the
+  // next one, and more prefetches per record stall on the fill buffers
+  if (t->cfg->ways)
+    __builtin_prefetch(&t->slots[(size_t)set_of(t->cfg, flow) * t->cfg->ways]);
+  else
+    __builtin_prefetch(&t->bucket[flow & t->mask]);
+}
+
+static inline void table_prefetch_entry(const struct table *t, uint64_t flow) {
+  uint32_t i;
+
+  if (t->cfg->ways)
+    return;
+  i = t->bucket[flow & t->mask];
+  if (i != NIL)
+    __builtin_prefetch(&t->e[i]);
+}
+
+static inline void fa_unlink(struct table *t, uint32_t i) {
+  struct fa_ent *e = &t->e[i];
+
+  if (e->prev != NIL)
+    t->e[e->prev].next = e->next;
+  else
+    t->head = e->next;
+  if (e->next != NIL)
+    t->e[e->next].prev = e->prev;
+  else
+    t->tail = e->prev;
+}
+
+static inline void fa_push_head(struct table *t, uint32_t i) {
+  struct fa_ent *e = &t->e[i];
+
+  e->prev = NIL;
+  e->next = t->head;
+  if (t->head != NIL)
+    t->e[t->head].prev = i;
+  else
+    t->tail = i;
+  t->head = i;
+}
+
+static inline uint32_t fa_find(const struct table *t, uint64_t flow) {
+  uint32_t i = t->bucket[flow & t->mask];
+
+  while (i != NIL && t->e[i].flow != flow)
+    i = t->e[i].hnext;
+  return i;
+}
+
+static void fa_unhash(struct table *t, uint32_t i) {
+  uint32_t *p = &t->bucket[t->e[i].flow & t->mask];
+
+  while (*p != i)
+    p = &t->e[*p].hnext;
+  *p = t->e[i].hnext;
+}
+
+// Lookup of connection_table_lookup: an LRU table moves the entry it finds
+static inline struct lru_val *table_find(struct table *t, uint64_t flow) {
+  const struct config *cfg = t->cfg;
+
+  if (cfg->ways) {
+    struct sa_slot *s = &t->slots[(size_t)set_of(cfg, flow) * cfg->ways];
+    for (uint32_t w = 0; w < cfg->ways; w++) {
+      if (s[w].flow == flow) {
+        if (cfg->policy == POL_LRU)
+          s[w].stamp = ++t->clock;
+        return &s[w].v;
+      }
+    }
+    return NULL;
+  }
+  uint32_t i = fa_find(t, flow);
+  if (i == NIL)
+    return NULL;
+  if (cfg->policy == POL_LRU && t->head != i) {
+    fa_unlink(t, i);
+    fa_push_head(t, i);
+  }
+  return &t->e[i].v;
+}
+
+// bpf_map_update_elem(BPF_ANY): an updated entry is a new one for LRU and
+// FIFO, and a new key takes a free slot or the victim of the policy
+static inline void table_update(struct table *t, uint64_t flow,
+                                struct lru_val v) {
+  const struct config *cfg = t->cfg;
+
+  if (cfg->ways) {
+    struct sa_slot *s = &t->slots[(size_t)set_of(cfg, flow) * cfg->ways];
+    struct sa_slot *empty = NULL, *oldest = NULL, *victim;
+    for (uint32_t w = 0; w < cfg->ways; w++) {
+      if (s[w].flow == flow) {
+        s[w].v = v;
+        if (cfg->policy != POL_RANDOM)
+          s[w].stamp = ++t->clock;
+        return;
+      }
+      if (!s[w].flow) {
+        if (!empty)
+          empty = &s[w];
+      } else if (!oldest || s[w].stamp < oldest->stamp) {
+        oldest = &s[w];
+      }
+    }
+    if (empty) {
+      victim = empty;
+    } else {
+      victim = cfg->policy == POL_RANDOM ? &s[xorshift(&t->rng) % cfg->ways]
+                                         : oldest;
+      t->evictions++;
+    }
+    victim->flow = flow;
+    victim->stamp = ++t->clock;
+    victim->v = v;
+    return;
+  }
+
+  uint32_t i = fa_find(t, flow);
+  if (i != NIL) {
+    t->e[i].v = v;
+    if (cfg->policy != POL_RANDOM && t->head != i) {
+      fa_unlink(t, i);
+      fa_push_head(t, i);
+    }
+    return;
+  }
+  if (t->used < cfg->entries) {
+    i = t->used++;
+  } else {
+    i = cfg->policy == POL_RANDOM ? (uint32_t)(xorshift(&t->rng) % cfg->entries)
+                                  : t->tail;
+    fa_unhash(t, i);
+    fa_unlink(t, i);
+    t->evictions++;
+  }
+  t->e[i].flow = flow;
+  t->e[i].v = v;
+  t->e[i].hnext = t->bucket[flow & t->mask];
+  t->bucket[flow & t->mask] = i;
+  fa_push_head(t, i);
+}
+
+struct work {
+  const struct config *cfg;
+  uint32_t shard;
+  struct sim_stats st;
+};
+
+static inline bool in_shard(const struct config *cfg, uint32_t shard,
+                            uint64_t flow) {
+  return cfg->shards == 1 || (set_of(cfg, flow) & (cfg->shards - 1)) == shard;
+}
+
+static void replay(void *ctx, size_t item) {
+  struct work *w = &((struct work *)ctx)[item];
+  const struct config *cfg = w->cfg;
+  struct sim_stats *st = &w->st;
+  struct table t;
+  int next_reload = 0;
+
+  table_init(&t, cfg, item + 1);
+  for (size_t i = 0; i < nrecs; i++) {
+    const struct lrusim_rec *r = &recs[i];
+    struct lru_val *v;
+    bool expired = false;
+    uint16_t real;
+
+    if (i + PREFETCH < nrecs && in_shard(cfg, w->shard, r[PREFETCH].flow))
+      table_prefetch(&t, r[PREFETCH].flow);
+    if (i + PREFETCH / 2 < nrecs &&
+        in_shard(cfg, w->shard, r[PREFETCH / 2].flow))
+      table_prefetch_entry(&t, r[PREFETCH / 2].flow);
+    if (!in_shard(cfg, w->shard, r->flow))
+      continue;
+    while (next_reload < nreloads && r->ts_ms >= reload_ms[next_reload]) {
+      table_clear(&t);
+      next_reload++;
+    }
+
+    st->pkts++;
+    if (r->flags & REC_TCP) {
+      st->tcp++;
+      if (r->flags & REC_SYN) {
+        // A new connection: get_packet_dst without any lookup
+        st->syn++;
+        table_update(&t, r->flow, (struct lru_val){
+          ring_real(r->ts_ms, r->hash), 0 });
+        continue;
+      }
+      st->nonsyn++;
+    }
+
+    v = table_find(&t, r->flow);
+    if (v) {
+      if (r->flags & REC_TCP) {
+        st->hits++;
+        continue;
+      }
+      if ((uint64_t)v->atime + cfg->udp_timeout_ms >= r->ts_ms) {
+        v->atime = r->ts_ms;
+        st->hits++;
+        continue;
+      }
+      expired = true;
+    }
+
+    real = ring_real(r->ts_ms, r->hash);
+    if (r->flags & REC_FIRST) {
+      st->cold++;
+    } else {
+      bool moved = real != ring_real(r->born_ms, r->hash);
+      if (r->flags & REC_TCP) {
+        st->tcp_miss++;
+        st->tcp_reshuffled += moved;
+      } else {
+        if (expired)
+          st->udp_expired++;
+        else
+          st->udp_miss++;
+        st->udp_reshuffled += moved;
+      }
+    }
+    table_update(&t, r->flow, (struct lru_val){
+      real, (r->flags & REC_TCP) ? 0 : r->ts_ms });
+  }
+  st->evictions = t.evictions;
+  table_free(&t);
+}
+
+static int parse_list(const char *arg, uint32_t *out, bool sizes, bool secs) {
+  char *copy = strdup(arg), *tok, *save = NULL;
+  int n = 0;
+
+  for (tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+    char *end;
+    double v = strtod(tok, &end);
+    if (sizes && (*end == 'k' || *end == 'K'))
+      v *= 1e3, end++;
+    else if (sizes && *end == 'M')
+      v *= 1e6, end++;
+    if (*end || v < 0 || v * (secs ? 1000 : 1) > UINT32_MAX || n == MAX_LIST)
+      die("Invalid list: %s", arg);
+    out[n++] = (uint32_t)(v * (secs ? 1000 : 1) + 0.5);
+  }
+  free(copy);
+  if (!n)
+    die("Invalid list: %s", arg);
+  return n;
+}
+
+static void parse_vip(const char *arg) {
+  struct vip_rule *v = &vips[nvips];
+  char buf[128], *addr = buf, *port = NULL, *proto;
+
+  if (nvips == MAX_VIP_RULES || strlen(arg) >= sizeof(buf))
+    die("Invalid VIP: %s", arg);
+  strcpy(buf, arg);
+  proto = strchr(buf, '/');
+  if (proto) {
+    *proto++ = '\0';
+    if (!strcmp(proto, "tcp"))
+      v->proto = IPPROTO_TCP;
+    else if (!strcmp(proto, "udp"))
+      v->proto = IPPROTO_UDP;
+    else
+      die("Invalid VIP: %s", arg);
+  }
+  if (*addr == '[') {
+    char *close = strchr(addr, ']');
+    if (!close)
+      die("Invalid VIP: %s", arg);
+    *close = '\0';
+    addr++;
+    if (close[1] == ':')
+      port = close + 2;
+  } else if (strchr(addr, ':') == strrchr(addr, ':') && strchr(addr, ':')) {
+    port = strchr(addr, ':');
+    *port++ = '\0';
+  }
+  if (inet_pton(AF_INET, addr, v->addr) == 1)
+    v->family = AF_INET;
+  else if (inet_pton(AF_INET6, addr, v->addr) == 1)
+    v->family = AF_INET6;
+  else
+    die("Invalid VIP: %s", arg);
+  if (port)
+    v->port = htons((uint16_t)atoi(port));
+  nvips++;
+}
+
+static double pct(uint64_t a, uint64_t b) {
+  return b ? 100.0 * a / b : 0.0;
+}
+
+static void usage(const char *prog) {
+  printf("%s [options] TRACE...\n"
+         "  TRACE                pcaps and text flow logs (TIMESTAMP_S PROTO SRC SPORT\n"
+         "                       DST DPORT [FLAGS]), or one record file of --save\n"
+         "  -e, --entries LIST   table sizes, k and M suffixes (default %d)\n"
+         "  -w, --ways LIST      ways of a set-associative table, 0 for a fully\n"
+         "                       associative one (default 0)\n"
+         "  -p, --policy LIST    lru, fifo or random (default lru)\n"
+         "  -u, --udp-timeout LIST  seconds (default %d)\n"
+         "  -r, --reals N        reals on the ring (default 100)\n"
+         "      --ring-size N    positions of the ring, a prime (default %d)\n"
+         "  -c, --churn S[:N]    take the next N reals (default 1) out of the ring\n"
+         "                       every S seconds of the trace, the previous ones\n"
+         "                       back in\n"
+         "      --reload LIST    empty the table at these seconds of the trace\n"
+         "      --vip ADDR[:PORT][/tcp|/udp]  replay the packets to this VIP only,\n"
+         "                       repeatable (default: every TCP and UDP packet)\n"
+         "  -j, --threads N      (default: online CPUs)\n"
+         "  -s, --save PATH      write the records of the traces to PATH\n"
+         "      --csv PATH       write the results to PATH\n"
+         "      --target PCT     print the smallest size with at most PCT%% of\n"
+         "                       non-SYN TCP misses\n",
+         prog, DEFAULT_LRU_SIZE, LRU_UDP_TIMEOUT_S, RING_SIZE);
+}
+
+int main(int argc, char **argv) {
+  static const struct option longopts[] = {
+    {"entries", required_argument, NULL, 'e'},
+    {"ways", required_argument, NULL, 'w'},
+    {"policy", required_argument, NULL, 'p'},
+    {"udp-timeout", required_argument, NULL, 'u'},
+    {"reals", required_argument, NULL, 'r'},
+    {"ring-size", required_argument, NULL, 'R'},
+    {"churn", required_argument, NULL, 'c'},
+    {"reload", required_argument, NULL, 'L'},
+    {"vip", required_argument, NULL, 'V'},
+    {"threads", required_argument, NULL, 'j'},
+    {"save", required_argument, NULL, 's'},
+    {"csv", required_argument, NULL, 'C'},
+    {"target", required_argument, NULL, 'T'},
+    {"help", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0},
+  };
+  uint32_t entries[MAX_LIST] = { DEFAULT_LRU_SIZE }, ways[MAX_LIST] = { 0 };
+  uint32_t policies[MAX_LIST] = { POL_LRU };
+  uint32_t timeouts[MAX_LIST] = { LRU_UDP_TIMEOUT_S * 1000 };
+  int nentries = 1, nways = 1, npolicies = 1, ntimeouts = 1;
+  const char *save_path = NULL, *csv_path = NULL;
+  double target = -1, t0, t1, t2;
+  struct config *cfgs;
+  struct work *work;
+  size_t ncfgs, nwork = 0;
+  int opt;
+
+  nthreads = (unsigned)sysconf(_SC_NPROCESSORS_ONLN);
+  while ((opt = getopt_long(argc, argv, "e:w:p:u:r:c:j:s:h", longopts,
+                            NULL)) != -1) {
+    switch (opt) {
+    case 'e':
+      nentries = parse_list(optarg, entries, true, false);
+      break;
+    case 'w':
+      nways = parse_list(optarg, ways, false, false);
+      break;
+    case 'p': {
+      char *copy = strdup(optarg), *tok, *save = NULL;
+      npolicies = 0;
+      for (tok = strtok_r(copy, ",", &save); tok;
+           tok = strtok_r(NULL, ",", &save)) {
+        int p;
+        for (p = 0; p < 3 && strcmp(tok, policy_names[p]); p++)
+          ;
+        if (p == 3 || npolicies == MAX_LIST)
+          die("Invalid policy: %s", tok);
+        policies[npolicies++] = p;
+      }
+      free(copy);
+      break;
+    }
+    case 'u':
+      ntimeouts = parse_list(optarg, timeouts, false, true);
+      break;
+    case 'r':
+      nreals = (uint32_t)atoi(optarg);
+      break;
+    case 'R':
+      ring_size = (uint32_t)atoi(optarg);
+      break;
+    case 'c': {
+      char *colon;
+      churn_ms = (uint32_t)(strtod(optarg, &colon) * 1000 + 0.5);
+      if (*colon == ':')
+        churn_count = (uint32_t)atoi(colon + 1);
+      break;
+    }
+    case 'L':
+      nreloads = parse_list(optarg, reload_ms, false, true);
+      break;
+    case 'V':
+      parse_vip(optarg);
+      break;
+    case 'j':
+      nthreads = (unsigned)atoi(optarg);
+      break;
+    case 's':
+      save_path = optarg;
+      break;
+    case 'C':
+      csv_path = optarg;
+      break;
+    case 'T':
+      target = atof(optarg);
+      break;
+    default:
+      usage(argv[0]);
+      return opt == 'h' ? 0 : 1;
+    }
+  }
+  if (optind == argc || nthreads == 0 || nthreads > MAX_THREADS ||
+      nreals == 0 || nreals > MAX_REALS || ring_size < nreals ||
+      !is_prime(ring_size) || churn_count == 0 ||
+      (churn_ms && churn_count >= nreals)) {
+    usage(argv[0]);
+    return 1;
+  }
+  for (int i = 1; i < nreloads; i++)
+    if (reload_ms[i] < reload_ms[i - 1])
+      die("%s", "--reload times must be in order");
+
+  t0 = now_s();
+  load_traces(argv + optind, argc - optind);
+  t1 = now_s();
+  if (save_path)
+    save_records(save_path);
+  if (!nrecs)
+    die("%s", "No TCP or UDP packet to a VIP in the traces");
+
+  if (churn_ms)
+    nrings = 1 + (nreals + churn_count - 1) / churn_count;
+  rings = malloc((size_t)nrings * ring_size * sizeof(*rings));
+  if (!rings)
+    die("%s", "Out of memory");
+  parallel_for(nrings, build_ring, NULL);
+
+  // Sizes vary fastest so that the rows of one table shape follow each other
+  ncfgs = (size_t)nways * npolicies * ntimeouts * nentries;
+  cfgs = calloc(ncfgs, sizeof(*cfgs));
+  if (!cfgs)
+    die("%s", "Out of memory");
+  for (size_t c = 0; c < ncfgs; c++) {
+    struct config *cfg = &cfgs[c];
+    size_t k = c;
+    cfg->entries = entries[k % nentries]; k /= nentries;
+    cfg->udp_timeout_ms = timeouts[k % ntimeouts]; k /= ntimeouts;
+    cfg->policy = policies[k % npolicies]; k /= npolicies;
+    cfg->ways = ways[k];
+    if (!cfg->entries)
+      die("%s", "A table needs one entry at least");
+    if (cfg->ways >= cfg->entries)
+      cfg->ways = 0;
+    cfg->nsets = cfg->ways ? (cfg->entries + cfg->ways - 1) / cfg->ways : 1;
+    // Split the sets when there are fewer configurations than threads
+    cfg->shards = 1;
+    while (cfg->shards * ncfgs < nthreads && cfg->shards * 2 <= cfg->nsets)
+      cfg->shards *= 2;
+  }
+  for (size_t c = 0; c < ncfgs; c++)
+    nwork += cfgs[c].shards;
+  work = calloc(nwork, sizeof(*work));
+  if (!work)
+    die("%s", "Out of memory");
+  nwork = 0;
+  // Fully associative tables, the longest items, are handed out first
+  for (int pass = 0; pass < 2; pass++)
+    for (size_t c = 0; c < ncfgs; c++)
+      if ((cfgs[c].ways == 0) == (pass == 0))
+        for (uint32_t s = 0; s < cfgs[c].shards; s++)
+          work[nwork++] = (struct work){ .cfg = &cfgs[c], .shard = s };
+
+  parallel_for(nwork, replay, work);
+  t2 = now_s();
+
+  {
+    uint64_t tcp = 0, syn = 0;
+    double span = nrecs ? recs[nrecs - 1].ts_ms / 1000.0 : 0;
+    for (size_t w = 0; w < nwork; w++) {
+      if (work[w].cfg != &cfgs[0])
+        continue;
+      tcp += work[w].st.tcp;
+      syn += work[w].st.syn;
+    }
+    printf("%zu packets to VIPs (%.1f%% TCP, %.2f%% SYN), %" PRIu64
+           " flows over %.1f s, %u reals, %u ring%s\n", nrecs,
+           pct(tcp, nrecs), pct(syn, nrecs), nflows, span, nreals, nrings,
+           nrings > 1 ? "s" : "");
+    printf("loaded in %.2f s, %zu configurations replayed in %.2f s: "
+           "%.1f Mpps on %u threads\n", t1 - t0, ncfgs, t2 - t1,
+           (double)nrecs * ncfgs / (t2 - t1) / 1e6, nthreads);
+  }
+
+  FILE *csv = NULL;
+  if (csv_path) {
+    csv = fopen(csv_path, "w");
+    if (!csv)
+      die("Cannot write %s", csv_path);
+    fprintf(csv, "entries,ways,policy,udp_timeout_s,packets,tcp,nonsyn,hits,syn,"
+            "cold,tcp_miss,tcp_reshuffled,udp_expired,udp_miss,"
+            "udp_reshuffled,evictions\n");
+  }
+  printf("%9s %5s %6s %5s %8s %12s %9s %12s %10s %12s %12s\n", "entries",
+         "ways", "policy", "udp_s", "hit%", "nonsyn_miss", "miss%", "reshuffled",
+         "resh%", "udp_miss", "evictions");
+  for (size_t c = 0; c < ncfgs; c++) {
+    struct sim_stats s = { 0 };
+    const struct config *cfg = &cfgs[c];
+    char ways_str[16];
+
+    for (size_t w = 0; w < nwork; w++) {
+      const struct sim_stats *p = &work[w].st;
+      if (work[w].cfg != cfg)
+        continue;
+      s.pkts += p->pkts; s.tcp += p->tcp; s.nonsyn += p->nonsyn;
+      s.hits += p->hits; s.syn += p->syn; s.cold += p->cold;
+      s.tcp_miss += p->tcp_miss; s.tcp_reshuffled += p->tcp_reshuffled;
+      s.udp_expired += p->udp_expired; s.udp_miss += p->udp_miss;
+      s.udp_reshuffled += p->udp_reshuffled; s.evictions += p->evictions;
+    }
+    // hit% over the lookups, miss% over the non-SYN TCP packets of known
+    // flows and resh% over all the packets
+    snprintf(ways_str, sizeof(ways_str), cfg->ways ? "%u" : "full", cfg->ways);
+    printf("%9u %5s %6s %5.0f %8.3f %12" PRIu64 " %9.4f %12" PRIu64
+           " %10.5f %12" PRIu64 " %12" PRIu64 "\n", cfg->entries, ways_str,
+           policy_names[cfg->policy], cfg->udp_timeout_ms / 1000.0,
+           pct(s.hits, s.pkts - s.syn), s.tcp_miss, pct(s.tcp_miss, s.nonsyn),
+           s.tcp_reshuffled + s.udp_reshuffled,
+           pct(s.tcp_reshuffled + s.udp_reshuffled, s.pkts),
+           s.udp_expired + s.udp_miss, s.evictions);
+    if (csv)
+      fprintf(csv, "%u,%u,%s,%.3f,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64
+              ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64
+              ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n", cfg->entries,
+              cfg->ways, policy_names[cfg->policy],
+              cfg->udp_timeout_ms / 1000.0, s.pkts, s.tcp, s.nonsyn, s.hits,
+              s.syn, s.cold, s.tcp_miss, s.tcp_reshuffled, s.udp_expired,
+              s.udp_miss, s.udp_reshuffled, s.evictions);
+
+    // Last size of a table shape: the smallest one that meets --target
+    if (target >= 0 && (c + 1) % nentries == 0) {
+      uint32_t best = 0;
+      for (size_t k = c + 1 - nentries; k <= c; k++) {
+        uint64_t miss = 0, nonsyn = 0;
+        for (size_t w = 0; w < nwork; w++) {
+          if (work[w].cfg != &cfgs[k])
+            continue;
+          miss += work[w].st.tcp_miss;
+          nonsyn += work[w].st.nonsyn;
+        }
+        if (pct(miss, nonsyn) <= target && (!best || cfgs[k].entries < best))
+          best = cfgs[k].entries;
+      }
+      if (best)
+        printf("  -> %u entries for at most %g%% non-SYN TCP misses\n", best,
+               target);
+      else
+        printf("  -> no size meets %g%% non-SYN TCP misses\n", target);
+    }
+  }
+  if (csv)
+    fclose(csv);
+  free(work);
+  free(cfgs);
+  free(rings);
+  return 0;
+}
@@ -0,0 +1,457 @@
+/*
+ * NanoNIC C2H receiver
+ *
+ * DPDK application that consumes the packets the pipeline delivers to the
+ * host over QDMA C2H. Every RX queue is polled by its own lcore (pinned by the
+ * EAL core list); the NanoNIC descriptor that a pipeline built with
+ * -D NANONIC_META prepends to each packet is read in place in the mbuf, the
+ * packet is accounted per verdict, per class and per real and freed without
+ * ever being copied. Event records of the event tap (NANONIC_F_SAMPLE set)
+ * are counted per event code apart from the traffic; scripts/nanonic_events.py
+ * reports their headers.
+ *
+ * The main lcore aggregates the per-queue counters every interval, prints the
+ * rates and, with --stats-file, rewrites a file with the totals in the
+ * Prometheus text format (node_exporter textfile collector or any scraper).
+ *
+ * On the card:
+ *   nanonic_rx -a 06:00.0 -d librte_net_qdma.so -l 4-8 -- -q 4
+ * Without the card, on a descriptor capture written by gen_meta_pcap.py:
+ *   nanonic_rx --no-pci --vdev 'net_pcap0,rx_pcap=c2h.pcap,infinite_rx=1' -l 0-1 -- -q 1
+ *   nanonic_rx --no-pci --vdev 'net_null0,size=128' -l 0-4 -- -q 4
+ */
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_eal.h>
+#include <rte_ethdev.h>
+#include <rte_launch.h>
+#include <rte_lcore.h>
+#include <rte_mbuf.h>
+
+#define NANONIC_DESC_HOST
+#include "nanonic_desc.h"
+
+// DPDK 20.11, used by setup_and_run_DPDK.sh, predates the RTE_ETH_ names
+#ifndef RTE_ETH_MQ_RX_RSS
+#define RTE_ETH_MQ_RX_RSS   ETH_MQ_RX_RSS
+#define RTE_ETH_MQ_RX_NONE  ETH_MQ_RX_NONE
+#define RTE_ETH_RSS_IP      ETH_RSS_IP
+#define RTE_ETH_RSS_UDP     ETH_RSS_UDP
+#define RTE_ETH_RSS_TCP     ETH_RSS_TCP
+#endif
+
+#define MAX_QUEUES      16
+#define BURST           32
+#define RX_DESC         1024
+#define MBUF_PER_QUEUE  4096
+#define MBUF_CACHE      256
+// Katran's reals array, larger indexes are counted together
+#define MAX_REALS       4096
+#define NUM_VERDICTS    5
+#define NUM_CLASSES     8
+#define NUM_EVENTS      5
+#define TOP_REALS       5
+
+static const char *verdict_names[NUM_VERDICTS] = {
+  "aborted", "drop", "pass", "tx", "redirect"
+};
+static const char *class_names[NUM_CLASSES] = {
+  "none", "monitor", "icmp_limited", "lb_forward", "lb_quic", "reflect",
+  "class6", "other"
+};
+static const char *event_names[NUM_EVENTS] = {
+  "none", "tcp_nonsyn_lrumiss", "quic_no_real", "lru_insert", "other"
+};
+
+// Written by the lcore of the queue only, read by the main lcore
+struct queue_stats {
+  uint64_t pkts;
+  uint64_t bytes;
+  uint64_t no_desc;
+  uint64_t bad_verdict;
+  uint64_t busy_cycles;
+  uint64_t verdict[NUM_VERDICTS];
+  uint64_t class_tag[NUM_CLASSES];
+  uint64_t event[NUM_EVENTS];
+  uint64_t real_other;
+  uint64_t real_pkts[MAX_REALS];
+  uint64_t real_bytes[MAX_REALS];
+} __rte_cache_aligned;
+
+struct totals {
+  uint64_t pkts;
+  uint64_t bytes;
+  uint64_t no_desc;
+  uint64_t bad_verdict;
+  uint64_t busy_cycles;
+  uint64_t verdict[NUM_VERDICTS];
+  uint64_t class_tag[NUM_CLASSES];
+  uint64_t event[NUM_EVENTS];
+  uint64_t real_other;
+  uint64_t real_pkts[MAX_REALS];
+  uint64_t real_bytes[MAX_REALS];
+};
+
+static struct queue_stats stats[MAX_QUEUES];
+static volatile bool quit;
+
+static uint16_t port_id;
+static uint16_t nb_queues = 1;
+static unsigned interval_s = 1;
+static unsigned duration_s;
+static const char *stats_file;
+
+static void on_signal(int sig) {
+  (void)sig;
+  quit = true;
+}
+
+static inline void account(struct queue_stats *st, const struct rte_mbuf *m) {
+  const uint8_t *p = rte_pktmbuf_mtod(m, const uint8_t *);
+  struct nanonic_desc_info info;
+  uint32_t len = m->pkt_len;
+
+  // The descriptor is one bus beat, always in the first segment
+  if (!nanonic_desc_parse(p, rte_pktmbuf_data_len(m), &info)) {
+    st->pkts++;
+    st->bytes += len;
+    st->no_desc++;
+    return;
+  }
+  if (info.flags & NANONIC_F_SAMPLE) {
+    st->event[info.event < NUM_EVENTS ? info.event : NUM_EVENTS - 1]++;
+    return;
+  }
+  st->pkts++;
+  st->bytes += len;
+  if (info.verdict < NUM_VERDICTS)
+    st->verdict[info.verdict]++;
+  else
+    st->bad_verdict++;
+  st->class_tag[info.class_tag < NUM_CLASSES ? info.class_tag : NUM_CLASSES - 1]++;
+  if (info.flags & NANONIC_F_REAL) {
+    if (info.real_index < MAX_REALS) {
+      st->real_pkts[info.real_index]++;
+      st->real_bytes[info.real_index] += info.frame_len;
+    } else {
+      st->real_other++;
+    }
+  }
+}
+
+static int rx_loop(void *arg) {
+  uint16_t queue = (uint16_t)(uintptr_t)arg;
+  struct queue_stats *st = &stats[queue];
+  struct rte_mbuf *pkts[BURST];
+
+  printf("lcore %u (socket %u) polls queue %u\n", rte_lcore_id(),
+         rte_socket_id(), queue);
+  while (!quit) {
+    uint16_t n = rte_eth_rx_burst(port_id, queue, pkts, BURST);
+    if (n == 0)
+      continue;
+    uint64_t start = rte_rdtsc();
+    for (uint16_t i = 0; i < n; i++) {
+      if (i + 1 < n)
+        rte_prefetch0(rte_pktmbuf_mtod(pkts[i + 1], void *));
+      account(st, pkts[i]);
+    }
+    rte_pktmbuf_free_bulk(pkts, n);
+    st->busy_cycles += rte_rdtsc() - start;
+  }
+  return 0;
+}
+
+static void collect(struct totals *t) {
+  memset(t, 0, sizeof(*t));
+  for (uint16_t q = 0; q < nb_queues; q++) {
+    const struct queue_stats *st = &stats[q];
+    t->pkts += st->pkts;
+    t->bytes += st->bytes;
+    t->no_desc += st->no_desc;
+    t->bad_verdict += st->bad_verdict;
+    t->busy_cycles += st->busy_cycles;
+    t->real_other += st->real_other;
+    for (int v = 0; v < NUM_VERDICTS; v++)
+      t->verdict[v] += st->verdict[v];
+    for (int c = 0; c < NUM_CLASSES; c++)
+      t->class_tag[c] += st->class_tag[c];
+    for (int e = 0; e < NUM_EVENTS; e++)
+      t->event[e] += st->event[e];
+    for (int r = 0; r < MAX_REALS; r++) {
+      t->real_pkts[r] += st->real_pkts[r];
+      t->real_bytes[r] += st->real_bytes[r];
+    }
+  }
+}
+
+static void print_rates(const struct totals *now, const struct totals *prev,
+                        double secs) {
+  uint64_t pkts = now->pkts - prev->pkts;
+  uint64_t busy = now->busy_cycles - prev->busy_cycles;
+  int top[TOP_REALS];
+  int ntop = 0;
+
+  printf("%.3f Mpps %.3f Gb/s (%" PRIu64 " without descriptor), %.1f cycles/pkt\n",
+         pkts / secs / 1e6, (now->bytes - prev->bytes) * 8 / secs / 1e9,
+         now->no_desc - prev->no_desc, pkts ? (double)busy / pkts : 0.0);
+  printf("  verdict:");
+  for (int v = 0; v < NUM_VERDICTS; v++)
+    printf(" %s %.3f", verdict_names[v],
+           (now->verdict[v] - prev->verdict[v]) / secs / 1e6);
+  printf(" Mpps\n");
+  printf("  event records:");
+  for (int e = 0; e < NUM_EVENTS; e++)
+    printf(" %s %" PRIu64, event_names[e], now->event[e] - prev->event[e]);
+  printf("\n");
+
+  // Busiest reals of the interval
+  for (int r = 0; r < MAX_REALS; r++) {
+    uint64_t d = now->real_pkts[r] - prev->real_pkts[r];
+    int pos;
+    if (d == 0)
+      continue;
+    for (pos = ntop; pos > 0; pos--) {
+      int o = top[pos - 1];
+      if (now->real_pkts[o] - prev->real_pkts[o] >= d)
+        break;
+      if (pos < TOP_REALS)
+        top[pos] = o;
+    }
+    if (pos < TOP_REALS) {
+      top[pos] = r;
+      if (ntop < TOP_REALS)
+        ntop++;
+    }
+  }
+  if (ntop) {
+    printf("  reals:");
+    for (int i = 0; i < ntop; i++)
+      printf(" %d=%.3f", top[i],
+             (now->real_pkts[top[i]] - prev->real_pkts[top[i]]) / secs / 1e6);
+    printf(" Mpps\n");
+  }
+}
+
+static void write_stats_file(const struct totals *t) {
+  char tmp[4096];
+  FILE *f;
+
+  snprintf(tmp, sizeof(tmp), "%s.tmp", stats_file);
+  f = fopen(tmp, "w");
+  if (!f) {
+    fprintf(stderr, "Cannot write %s: %s\n", tmp, strerror(errno));
+    return;
+  }
+  fprintf(f, "# TYPE nanonic_rx_packets_total counter\n");
+  fprintf(f, "nanonic_rx_packets_total %" PRIu64 "\n", t->pkts);
+  fprintf(f, "# TYPE nanonic_rx_bytes_total counter\n");
+  fprintf(f, "nanonic_rx_bytes_total %" PRIu64 "\n", t->bytes);
+  fprintf(f, "# TYPE nanonic_rx_no_descriptor_total counter\n");
+  fprintf(f, "nanonic_rx_no_descriptor_total %" PRIu64 "\n", t->no_desc);
+  fprintf(f, "# TYPE nanonic_rx_verdict_packets_total counter\n");
+  for (int v = 0; v < NUM_VERDICTS; v++)
+    fprintf(f, "nanonic_rx_verdict_packets_total{verdict=\"%s\"} %" PRIu64 "\n",
+            verdict_names[v], t->verdict[v]);
+  fprintf(f, "nanonic_rx_verdict_packets_total{verdict=\"unknown\"} %" PRIu64 "\n",
+          t->bad_verdict);
+  fprintf(f, "# TYPE nanonic_rx_class_packets_total counter\n");
+  for (int c = 0; c < NUM_CLASSES; c++)
+    fprintf(f, "nanonic_rx_class_packets_total{class=\"%s\"} %" PRIu64 "\n",
+            class_names[c], t->class_tag[c]);
+  fprintf(f, "# TYPE nanonic_rx_event_records_total counter\n");
+  for (int e = 0; e < NUM_EVENTS; e++)
+    fprintf(f, "nanonic_rx_event_records_total{event=\"%s\"} %" PRIu64 "\n",
+            event_names[e], t->event[e]);
+  fprintf(f, "# TYPE nanonic_rx_real_packets_total counter\n");
+  for (int r = 0; r < MAX_REALS; r++)
+    if (t->real_pkts[r])
+      fprintf(f, "nanonic_rx_real_packets_total{real=\"%d\"} %" PRIu64 "\n",
+              r, t->real_pkts[r]);
+  fprintf(f, "nanonic_rx_real_packets_total{real=\"other\"} %" PRIu64 "\n",
+          t->real_other);
+  fprintf(f, "# TYPE nanonic_rx_real_bytes_total counter\n");
+  for (int r = 0; r < MAX_REALS; r++)
+    if (t->real_pkts[r])
+      fprintf(f, "nanonic_rx_real_bytes_total{real=\"%d\"} %" PRIu64 "\n",
+              r, t->real_bytes[r]);
+  fclose(f);
+  // Readers see the previous file or the new one, never a partial write
+  if (rename(tmp, stats_file))
+    fprintf(stderr, "Cannot rename %s: %s\n", tmp, strerror(errno));
+}
+
+static int port_init(struct rte_mempool *pool) {
+  struct rte_eth_conf conf;
+  struct rte_eth_dev_info info;
+  int ret;
+
+  memset(&conf, 0, sizeof(conf));
+  ret = rte_eth_dev_info_get(port_id, &info);
+  if (ret)
+    return ret;
+  if (nb_queues > info.max_rx_queues) {
+    fprintf(stderr, "Port %u has %u RX queues at most\n", port_id,
+            info.max_rx_queues);
+    return -EINVAL;
+  }
+  conf.rxmode.mq_mode = RTE_ETH_MQ_RX_NONE;
+  if (nb_queues > 1 && info.flow_type_rss_offloads) {
+    conf.rxmode.mq_mode = RTE_ETH_MQ_RX_RSS;
+    conf.rx_adv_conf.rss_conf.rss_hf = info.flow_type_rss_offloads &
+      (RTE_ETH_RSS_IP | RTE_ETH_RSS_UDP | RTE_ETH_RSS_TCP);
+  }
+
+  // The TX queue is unused but some PMDs refuse to start without one
+  ret = rte_eth_dev_configure(port_id, nb_queues, 1, &conf);
+  if (ret)
+    return ret;
+  for (uint16_t q = 0; q < nb_queues; q++) {
+    ret = rte_eth_rx_queue_setup(port_id, q, RX_DESC,
+                                 rte_eth_dev_socket_id(port_id), NULL, pool);
+    if (ret)
+      return ret;
+  }
+  ret = rte_eth_tx_queue_setup(port_id, 0, RX_DESC,
+                               rte_eth_dev_socket_id(port_id), NULL);
+  if (ret)
+    return ret;
+  ret = rte_eth_dev_start(port_id);
+  if (ret)
+    return ret;
+  rte_eth_promiscuous_enable(port_id);
+  return 0;
+}
+
+static void usage(const char *prog) {
+  printf("%s [EAL options] -- [-p PORT] [-q QUEUES] [-i SECONDS] [-t SECONDS]"
+         " [--stats-file PATH]\n"
+         "  -p, --port        port id (default 0)\n"
+         "  -q, --queues      RX queues, one worker lcore each (default 1)\n"
+         "  -i, --interval    seconds between two reports (default 1)\n"
+         "  -t, --time        stop after this many seconds (default: on SIGINT)\n"
+         "  --stats-file      rewrite this file with the counters every interval\n",
+         prog);
+}
+
+static int parse_args(int argc, char **argv) {
+  static const struct option longopts[] = {
+    {"port", required_argument, NULL, 'p'},
+    {"queues", required_argument, NULL, 'q'},
+    {"interval", required_argument, NULL, 'i'},
+    {"time", required_argument, NULL, 't'},
+    {"stats-file", required_argument, NULL, 's'},
+    {"help", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0},
+  };
+  int opt;
+
+  while ((opt = getopt_long(argc, argv, "p:q:i:t:h", longopts, NULL)) != -1) {
+    switch (opt) {
+    case 'p':
+      port_id = (uint16_t)atoi(optarg);
+      break;
+    case 'q':
+      nb_queues = (uint16_t)atoi(optarg);
+      break;
+    case 'i':
+      interval_s = (unsigned)atoi(optarg);
+      break;
+    case 't':
+      duration_s = (unsigned)atoi(optarg);
+      break;
+    case 's':
+      stats_file = optarg;
+      break;
+    default:
+      usage(argv[0]);
+      return -1;
+    }
+  }
+  if (nb_queues == 0 || nb_queues > MAX_QUEUES || interval_s == 0) {
+    usage(argv[0]);
+    return -1;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  static struct totals prev, now;
+  struct rte_mempool *pool;
+  unsigned lcore;
+  uint16_t q = 0;
+  uint64_t hz, start, last;
+  int ret;
+
+  ret = rte_eal_init(argc, argv);
+  if (ret < 0)
+    rte_exit(EXIT_FAILURE, "Cannot initialise the EAL\n");
+  argc -= ret;
+  argv += ret;
+  if (parse_args(argc, argv))
+    rte_exit(EXIT_FAILURE, "Invalid arguments\n");
+
+  if (!rte_eth_dev_is_valid_port(port_id))
+    rte_exit(EXIT_FAILURE, "No port %u\n", port_id);
+  if (rte_lcore_count() < (unsigned)nb_queues + 1)
+    rte_exit(EXIT_FAILURE, "%u queues need %u lcores (one per queue and "
+             "the main one)\n", nb_queues, nb_queues + 1);
+
+  pool = rte_pktmbuf_pool_create("nanonic_rx", MBUF_PER_QUEUE * nb_queues,
+                                 MBUF_CACHE, 0, RTE_MBUF_DEFAULT_BUF_SIZE,
+                                 rte_eth_dev_socket_id(port_id));
+  if (!pool)
+    rte_exit(EXIT_FAILURE, "Cannot create the mbuf pool\n");
+  ret = port_init(pool);
+  if (ret)
+    rte_exit(EXIT_FAILURE, "Cannot start port %u: %s\n", port_id,
+             rte_strerror(-ret));
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+
+  // Queue q is polled by the q-th worker lcore only
+  RTE_LCORE_FOREACH_WORKER(lcore) {
+    if (q == nb_queues)
+      break;
+    rte_eal_remote_launch(rx_loop, (void *)(uintptr_t)q, lcore);
+    q++;
+  }
+
+  hz = rte_get_tsc_hz();
+  start = last = rte_rdtsc();
+  while (!quit) {
+    sleep(interval_s);
+    uint64_t t = rte_rdtsc();
+    collect(&now);
+    print_rates(&now, &prev, (double)(t - last) / hz);
+    if (stats_file)
+      write_stats_file(&now);
+    prev = now;
+    last = t;
+    if (duration_s && t - start >= duration_s * hz)
+      quit = true;
+  }
+
+  rte_eal_mp_wait_lcore();
+  collect(&now);
+  printf("Total: %" PRIu64 " packets, %" PRIu64 " bytes, %" PRIu64
+         " without descriptor\n", now.pkts, now.bytes, now.no_desc);
+  if (stats_file)
+    write_stats_file(&now);
+
+  rte_eth_dev_stop(port_id);
+  rte_eth_dev_close(port_id);
+  rte_eal_cleanup();
+  return 0;
+}
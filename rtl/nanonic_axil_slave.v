@@ -0,0 +1,109 @@
+//--------------------------------------------------------------------------------
+// NanoNIC AXI4-Lite slave
+//
+// Converts AXI4-Lite accesses into a simple register bus used by the NanoNIC
+// blocks. One transaction is handled at a time:
+//   - a write produces a one-cycle wr_en pulse with wr_addr/wr_data,
+//   - a read produces a one-cycle rd_en pulse; rd_addr is held until the read
+//     completes and rd_data is sampled RD_LATENCY cycles after rd_en, which lets
+//     blocks answer from registers or from a BRAM with one cycle of latency.
+//
+// The interface is synchronous to clk. In p2p_250mhz the shell AXI-Lite runs on
+// axil_aclk, so put an AXI clock converter between the shell and this slave.
+//--------------------------------------------------------------------------------
+`timescale 1 ps / 1 ps
+
+module nanonic_axil_slave #(
+    parameter ADDR_W     = 16,
+    parameter RD_LATENCY = 2
+  ) (
+    input                   clk,
+    input                   rst_n,
+
+    input                   s_axil_awvalid,
+    input  [31:0]           s_axil_awaddr,
+    output                  s_axil_awready,
+    input                   s_axil_wvalid,
+    input  [31:0]           s_axil_wdata,
+    output                  s_axil_wready,
+    output reg              s_axil_bvalid,
+    output [1:0]            s_axil_bresp,
+    input                   s_axil_bready,
+    input                   s_axil_arvalid,
+    input  [31:0]           s_axil_araddr,
+    output                  s_axil_arready,
+    output reg              s_axil_rvalid,
+    output reg [31:0]       s_axil_rdata,
+    output [1:0]            s_axil_rresp,
+    input                   s_axil_rready,
+
+    output reg              wr_en,
+    output reg [ADDR_W-1:0] wr_addr,
+    output reg [31:0]       wr_data,
+    output reg              rd_en,
+    output reg [ADDR_W-1:0] rd_addr,
+    input  [31:0]           rd_data
+  );
+
+  reg [3:0] rd_wait;
+  reg       rd_busy;
+
+  wire wr_go = s_axil_awvalid && s_axil_wvalid && !s_axil_bvalid;
+  wire rd_go = s_axil_arvalid && !rd_busy && !s_axil_rvalid;
+
+  assign s_axil_awready = wr_go;
+  assign s_axil_wready  = wr_go;
+  assign s_axil_arready = rd_go;
+  assign s_axil_bresp   = 2'b00;
+  assign s_axil_rresp   = 2'b00;
+
+  always @(posedge clk) begin
+    if (!rst_n) begin
+      s_axil_bvalid <= 1'b0;
+      s_axil_rvalid <= 1'b0;
+      s_axil_rdata  <= 32'd0;
+      wr_en         <= 1'b0;
+      wr_addr       <= {ADDR_W{1'b0}};
+      wr_data       <= 32'd0;
+      rd_en         <= 1'b0;
+      rd_addr       <= {ADDR_W{1'b0}};
+      rd_wait       <= 4'd0;
+      rd_busy       <= 1'b0;
+    end
+    else begin
+      wr_en <= 1'b0;
+      rd_en <= 1'b0;
+
+      if (wr_go) begin
+        wr_en         <= 1'b1;
+        wr_addr       <= s_axil_awaddr[ADDR_W-1:0];
+        wr_data       <= s_axil_wdata;
+        s_axil_bvalid <= 1'b1;
+      end
+      else if (s_axil_bvalid && s_axil_bready) begin
+        s_axil_bvalid <= 1'b0;
+      end
+
+      if (rd_go) begin
+        rd_en   <= 1'b1;
+        rd_addr <= s_axil_araddr[ADDR_W-1:0];
+        rd_busy <= 1'b1;
+        rd_wait <= RD_LATENCY;
+      end
+      else if (rd_busy) begin
+        if (rd_wait == 0) begin
+          s_axil_rdata  <= rd_data;
+          s_axil_rvalid <= 1'b1;
+          rd_busy       <= 1'b0;
+        end
+        else begin
+          rd_wait <= rd_wait - 1;
+        end
+      end
+      else if (s_axil_rvalid && s_axil_rready) begin
+        s_axil_rvalid <= 1'b0;
+      end
+    end
+  end
+
+endmodule
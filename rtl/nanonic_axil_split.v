@@ -0,0 +1,156 @@
+//--------------------------------------------------------------------------------
+// NanoNIC AXI4-Lite splitter
+//
+// Shares one AXI4-Lite master between NUM_OUT NanoNIC pipeline tops. Output i
+// answers to the addresses whose bits [WIN_LSB +: SEL_W] equal i; the address
+// is forwarded unchanged and the tops only decode their low 16 bits. Writes and
+// reads are independent and each direction has one transaction in flight, like
+// nanonic_axil_slave. Accesses to a window without a top get an OKAY response
+// (reads return 0).
+//
+// Outputs are packed vectors, output i uses the slices [i*W +: W].
+//--------------------------------------------------------------------------------
+`timescale 1 ps / 1 ps
+
+module nanonic_axil_split #(
+    parameter NUM_OUT = 2,
+    parameter WIN_LSB = 16
+  ) (
+    input                       clk,
+    input                       rst_n,
+
+    input                       s_axil_awvalid,
+    input  [31:0]               s_axil_awaddr,
+    output                      s_axil_awready,
+    input                       s_axil_wvalid,
+    input  [31:0]               s_axil_wdata,
+    output                      s_axil_wready,
+    output reg                  s_axil_bvalid,
+    output [1:0]                s_axil_bresp,
+    input                       s_axil_bready,
+    input                       s_axil_arvalid,
+    input  [31:0]               s_axil_araddr,
+    output                      s_axil_arready,
+    output reg                  s_axil_rvalid,
+    output reg [31:0]           s_axil_rdata,
+    output [1:0]                s_axil_rresp,
+    input                       s_axil_rready,
+
+    output [NUM_OUT-1:0]        m_axil_awvalid,
+    output [NUM_OUT*32-1:0]     m_axil_awaddr,
+    input  [NUM_OUT-1:0]        m_axil_awready,
+    output [NUM_OUT-1:0]        m_axil_wvalid,
+    output [NUM_OUT*32-1:0]     m_axil_wdata,
+    input  [NUM_OUT-1:0]        m_axil_wready,
+    input  [NUM_OUT-1:0]        m_axil_bvalid,
+    output [NUM_OUT-1:0]        m_axil_bready,
+    output [NUM_OUT-1:0]        m_axil_arvalid,
+    output [NUM_OUT*32-1:0]     m_axil_araddr,
+    input  [NUM_OUT-1:0]        m_axil_arready,
+    input  [NUM_OUT-1:0]        m_axil_rvalid,
+    input  [NUM_OUT*32-1:0]     m_axil_rdata,
+    output [NUM_OUT-1:0]        m_axil_rready
+  );
+
+  localparam SEL_W = (NUM_OUT > 1) ? $clog2(NUM_OUT) : 1;
+
+  // Write: forward AW and W together to the selected output, then wait for B
+  reg              wr_busy;
+  reg              wr_fwd;
+  reg [SEL_W-1:0]  wr_sel;
+  reg [31:0]       wr_addr;
+  reg [31:0]       wr_data;
+  reg              wr_hit;
+
+  // Read: forward AR to the selected output, then wait for R
+  reg              rd_busy;
+  reg              rd_fwd;
+  reg [SEL_W-1:0]  rd_sel;
+  reg [31:0]       rd_addr;
+  reg              rd_hit;
+
+  wire [31:0] aw_win = s_axil_awaddr >> WIN_LSB;
+  wire [31:0] ar_win = s_axil_araddr >> WIN_LSB;
+
+  wire wr_go = s_axil_awvalid && s_axil_wvalid && !wr_busy && !s_axil_bvalid;
+  wire rd_go = s_axil_arvalid && !rd_busy && !s_axil_rvalid;
+
+  assign s_axil_awready = wr_go;
+  assign s_axil_wready  = wr_go;
+  assign s_axil_arready = rd_go;
+  assign s_axil_bresp   = 2'b00;
+  assign s_axil_rresp   = 2'b00;
+
+  genvar g;
+  generate
+    for (g = 0; g < NUM_OUT; g = g + 1) begin : g_out
+      assign m_axil_awvalid[g]         = wr_fwd && wr_sel == g;
+      assign m_axil_awaddr[g*32 +: 32] = wr_addr;
+      assign m_axil_wvalid[g]          = wr_fwd && wr_sel == g;
+      assign m_axil_wdata[g*32 +: 32]  = wr_data;
+      assign m_axil_bready[g]          = wr_busy && !wr_fwd && wr_sel == g;
+      assign m_axil_arvalid[g]         = rd_fwd && rd_sel == g;
+      assign m_axil_araddr[g*32 +: 32] = rd_addr;
+      assign m_axil_rready[g]          = rd_busy && !rd_fwd && rd_sel == g;
+    end
+  endgenerate
+
+  always @(posedge clk) begin
+    if (!rst_n) begin
+      wr_busy       <= 1'b0;
+      wr_fwd        <= 1'b0;
+      wr_sel        <= {SEL_W{1'b0}};
+      wr_hit        <= 1'b0;
+      s_axil_bvalid <= 1'b0;
+      rd_busy       <= 1'b0;
+      rd_fwd        <= 1'b0;
+      rd_sel        <= {SEL_W{1'b0}};
+      rd_hit        <= 1'b0;
+      s_axil_rvalid <= 1'b0;
+      s_axil_rdata  <= 32'd0;
+    end
+    else begin
+      if (wr_go) begin
+        wr_hit  <= aw_win < NUM_OUT;
+        wr_sel  <= aw_win[SEL_W-1:0];
+        wr_addr <= s_axil_awaddr;
+        wr_data <= s_axil_wdata;
+        wr_busy <= 1'b1;
+        wr_fwd  <= aw_win < NUM_OUT;
+      end
+      else if (wr_busy) begin
+        // The NanoNIC slaves take AW and W in the same cycle
+        if (wr_fwd && m_axil_awready[wr_sel])
+          wr_fwd <= 1'b0;
+        else if (!wr_fwd && (!wr_hit || m_axil_bvalid[wr_sel])) begin
+          wr_busy       <= 1'b0;
+          s_axil_bvalid <= 1'b1;
+        end
+      end
+      else if (s_axil_bvalid && s_axil_bready) begin
+        s_axil_bvalid <= 1'b0;
+      end
+
+      if (rd_go) begin
+        rd_hit  <= ar_win < NUM_OUT;
+        rd_sel  <= ar_win[SEL_W-1:0];
+        rd_addr <= s_axil_araddr;
+        rd_busy <= 1'b1;
+        rd_fwd  <= ar_win < NUM_OUT;
+      end
+      else if (rd_busy) begin
+        if (rd_fwd && m_axil_arready[rd_sel])
+          rd_fwd <= 1'b0;
+        else if (!rd_fwd && (!rd_hit || m_axil_rvalid[rd_sel])) begin
+          rd_busy       <= 1'b0;
+          s_axil_rvalid <= 1'b1;
+          s_axil_rdata  <= rd_hit ? m_axil_rdata[rd_sel*32 +: 32] : 32'd0;
+        end
+      end
+      else if (s_axil_rvalid && s_axil_rready) begin
+        s_axil_rvalid <= 1'b0;
+      end
+    end
+  end
+
+endmodule
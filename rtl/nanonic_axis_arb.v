@@ -0,0 +1,91 @@
+//--------------------------------------------------------------------------------
+// NanoNIC AXI4-Stream packet arbiter
+//
+// Merges NUM_IN streams into one, switching only at packet boundaries. Inputs
+// are served round-robin starting after the last granted one, so a saturated
+// port cannot starve the others. The grant is decided combinationally on the
+// first beat; put a nanonic_axis_reg on the output to close timing.
+//
+// Inputs are packed vectors, input i uses the slices [i*W +: W].
+//--------------------------------------------------------------------------------
+`timescale 1 ps / 1 ps
+
+module nanonic_axis_arb #(
+    parameter NUM_IN = 2,
+    parameter USER_W = 48
+  ) (
+    input                      clk,
+    input                      rst_n,
+
+    input  [NUM_IN-1:0]        s_axis_tvalid,
+    input  [NUM_IN*512-1:0]    s_axis_tdata,
+    input  [NUM_IN*64-1:0]     s_axis_tkeep,
+    input  [NUM_IN-1:0]        s_axis_tlast,
+    input  [NUM_IN*USER_W-1:0] s_axis_tuser,
+    output [NUM_IN-1:0]        s_axis_tready,
+
+    output                     m_axis_tvalid,
+    output [511:0]             m_axis_tdata,
+    output [63:0]              m_axis_tkeep,
+    output                     m_axis_tlast,
+    output [USER_W-1:0]        m_axis_tuser,
+    input                      m_axis_tready
+  );
+
+  localparam SEL_W = (NUM_IN > 1) ? $clog2(NUM_IN) : 1;
+
+  reg             in_pkt;
+  reg [SEL_W-1:0] grant;
+  reg [SEL_W-1:0] last;
+  reg [SEL_W-1:0] pick;
+  reg             pick_valid;
+
+  // Round-robin pick among the valid inputs, starting after the last grant
+  integer i;
+  reg [SEL_W:0] cand;
+  always @(*) begin
+    pick       = last;
+    pick_valid = 1'b0;
+    for (i = NUM_IN; i >= 1; i = i - 1) begin
+      cand = last + i;
+      if (cand >= NUM_IN)
+        cand = cand - NUM_IN;
+      if (s_axis_tvalid[cand]) begin
+        pick       = cand[SEL_W-1:0];
+        pick_valid = 1'b1;
+      end
+    end
+  end
+
+  wire [SEL_W-1:0] sel = in_pkt ? grant : pick;
+  wire             act = in_pkt | pick_valid;
+
+  assign m_axis_tvalid = act & s_axis_tvalid[sel];
+  assign m_axis_tdata  = s_axis_tdata[sel*512 +: 512];
+  assign m_axis_tkeep  = s_axis_tkeep[sel*64 +: 64];
+  assign m_axis_tlast  = s_axis_tlast[sel];
+  assign m_axis_tuser  = s_axis_tuser[sel*USER_W +: USER_W];
+
+  genvar g;
+  generate
+    for (g = 0; g < NUM_IN; g = g + 1) begin : g_ready
+      assign s_axis_tready[g] = act && (sel == g) && m_axis_tready;
+    end
+  endgenerate
+
+  always @(posedge clk) begin
+    if (!rst_n) begin
+      in_pkt <= 1'b0;
+      grant  <= {SEL_W{1'b0}};
+      last   <= NUM_IN - 1;
+    end
+    else if (m_axis_tvalid && m_axis_tready) begin
+      in_pkt <= ~m_axis_tlast;
+      if (!in_pkt) begin
+        grant <= sel;
+        last  <= sel;
+      end
+    end
+  end
+
+endmodule
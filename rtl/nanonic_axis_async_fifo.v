@@ -0,0 +1,104 @@
+//--------------------------------------------------------------------------------
+// NanoNIC AXI4-Stream asynchronous FIFO
+//
+// Carries a stream between two clock domains, beat by beat. Pointers cross the
+// domains in Gray code through two-flop synchronisers, the storage is a
+// DEPTH-entry RAM written in the source domain and read first-word-fall-through
+// in the destination domain. DEPTH must be a power of two, at least 4; 16
+// entries hide the synchroniser round trip so the FIFO keeps one beat per
+// cycle of the slower clock. Both resets must be asserted together.
+//--------------------------------------------------------------------------------
+`timescale 1 ps / 1 ps
+
+module nanonic_axis_async_fifo #(
+    parameter DATA_W = 512,
+    parameter USER_W = 48,
+    parameter DEPTH  = 16
+  ) (
+    input                 s_clk,
+    input                 s_rst_n,
+    input                 s_axis_tvalid,
+    input  [DATA_W-1:0]   s_axis_tdata,
+    input  [DATA_W/8-1:0] s_axis_tkeep,
+    input                 s_axis_tlast,
+    input  [USER_W-1:0]   s_axis_tuser,
+    output                s_axis_tready,
+
+    input                 m_clk,
+    input                 m_rst_n,
+    output                m_axis_tvalid,
+    output [DATA_W-1:0]   m_axis_tdata,
+    output [DATA_W/8-1:0] m_axis_tkeep,
+    output                m_axis_tlast,
+    output [USER_W-1:0]   m_axis_tuser,
+    input                 m_axis_tready
+  );
+
+  localparam KEEP_W = DATA_W / 8;
+  localparam W      = USER_W + 1 + KEEP_W + DATA_W;
+  localparam AW     = $clog2(DEPTH);
+
+  (* ram_style = "distributed" *) reg [W-1:0] mem [0:DEPTH-1];
+
+  reg [AW:0] wr_bin, wr_gray;
+  reg [AW:0] rd_bin, rd_gray;
+  (* ASYNC_REG = "TRUE" *) reg [AW:0] rd_gray_s1, rd_gray_s2;
+  (* ASYNC_REG = "TRUE" *) reg [AW:0] wr_gray_s1, wr_gray_s2;
+
+  //----------------------------------------------------------------------------
+  // Source domain
+  //----------------------------------------------------------------------------
+  wire [AW:0] wr_bin_next  = wr_bin + 1;
+  wire        full = wr_gray == {~rd_gray_s2[AW:AW-1], rd_gray_s2[AW-2:0]};
+
+  assign s_axis_tready = !full;
+
+  always @(posedge s_clk) begin
+    if (s_axis_tvalid && !full)
+      mem[wr_bin[AW-1:0]] <= {s_axis_tuser, s_axis_tlast, s_axis_tkeep, s_axis_tdata};
+  end
+
+  always @(posedge s_clk) begin
+    if (!s_rst_n) begin
+      wr_bin     <= {(AW+1){1'b0}};
+      wr_gray    <= {(AW+1){1'b0}};
+      rd_gray_s1 <= {(AW+1){1'b0}};
+      rd_gray_s2 <= {(AW+1){1'b0}};
+    end
+    else begin
+      rd_gray_s1 <= rd_gray;
+      rd_gray_s2 <= rd_gray_s1;
+      if (s_axis_tvalid && !full) begin
+        wr_bin  <= wr_bin_next;
+        wr_gray <= wr_bin_next ^ (wr_bin_next >> 1);
+      end
+    end
+  end
+
+  //----------------------------------------------------------------------------
+  // Destination domain
+  //----------------------------------------------------------------------------
+  wire [AW:0] rd_bin_next = rd_bin + 1;
+  wire        empty = rd_gray == wr_gray_s2;
+
+  assign m_axis_tvalid = !empty;
+  assign {m_axis_tuser, m_axis_tlast, m_axis_tkeep, m_axis_tdata} = mem[rd_bin[AW-1:0]];
+
+  always @(posedge m_clk) begin
+    if (!m_rst_n) begin
+      rd_bin     <= {(AW+1){1'b0}};
+      rd_gray    <= {(AW+1){1'b0}};
+      wr_gray_s1 <= {(AW+1){1'b0}};
+      wr_gray_s2 <= {(AW+1){1'b0}};
+    end
+    else begin
+      wr_gray_s1 <= wr_gray;
+      wr_gray_s2 <= wr_gray_s1;
+      if (m_axis_tready && !empty) begin
+        rd_bin  <= rd_bin_next;
+        rd_gray <= rd_bin_next ^ (rd_bin_next >> 1);
+      end
+    end
+  end
+
+endmodule
@@ -0,0 +1,83 @@
+//--------------------------------------------------------------------------------
+// NanoNIC AXI4-Stream packet demultiplexer
+//
+// Sends every packet to one of NUM_OUT outputs, selected on the first beat by
+// comparing the 16-bit tuser field at KEY_LSB (16 = src, 32 = dst in the
+// OpenNIC tuser layout) with the per-output identifiers of PORT_IDS. A field
+// matches an output when it has any bit of its identifier set, which fits the
+// one-hot port encoding of the shell. Packets that match no output go to
+// output 0. The selection is held until tlast.
+//
+// PORT_IDS packs the identifier of output i in [i*16 +: 16].
+//--------------------------------------------------------------------------------
+`timescale 1 ps / 1 ps
+
+module nanonic_axis_demux #(
+    parameter                  NUM_OUT  = 2,
+    parameter                  USER_W   = 48,
+    parameter                  KEY_LSB  = 16,
+    parameter [NUM_OUT*16-1:0] PORT_IDS = {16'h0080, 16'h0040}
+  ) (
+    input                       clk,
+    input                       rst_n,
+
+    input                       s_axis_tvalid,
+    input  [511:0]              s_axis_tdata,
+    input  [63:0]               s_axis_tkeep,
+    input                       s_axis_tlast,
+    input  [USER_W-1:0]         s_axis_tuser,
+    output                      s_axis_tready,
+
+    output [NUM_OUT-1:0]        m_axis_tvalid,
+    output [NUM_OUT*512-1:0]    m_axis_tdata,
+    output [NUM_OUT*64-1:0]     m_axis_tkeep,
+    output [NUM_OUT-1:0]        m_axis_tlast,
+    output [NUM_OUT*USER_W-1:0] m_axis_tuser,
+    input  [NUM_OUT-1:0]        m_axis_tready
+  );
+
+  localparam SEL_W = (NUM_OUT > 1) ? $clog2(NUM_OUT) : 1;
+
+  reg             in_pkt;
+  reg [SEL_W-1:0] held;
+  reg [SEL_W-1:0] match;
+
+  wire [15:0] key = s_axis_tuser[KEY_LSB +: 16];
+
+  // Lowest output whose identifier overlaps the key
+  integer i;
+  always @(*) begin
+    match = {SEL_W{1'b0}};
+    for (i = NUM_OUT - 1; i >= 0; i = i - 1)
+      if (|(key & PORT_IDS[i*16 +: 16]))
+        match = i;
+  end
+
+  wire [SEL_W-1:0] sel = in_pkt ? held : match;
+
+  genvar g;
+  generate
+    for (g = 0; g < NUM_OUT; g = g + 1) begin : g_out
+      assign m_axis_tvalid[g]                  = s_axis_tvalid && (sel == g);
+      assign m_axis_tdata[g*512 +: 512]        = s_axis_tdata;
+      assign m_axis_tkeep[g*64 +: 64]          = s_axis_tkeep;
+      assign m_axis_tlast[g]                   = s_axis_tlast;
+      assign m_axis_tuser[g*USER_W +: USER_W]  = s_axis_tuser;
+    end
+  endgenerate
+
+  assign s_axis_tready = m_axis_tready[sel];
+
+  always @(posedge clk) begin
+    if (!rst_n) begin
+      in_pkt <= 1'b0;
+      held   <= {SEL_W{1'b0}};
+    end
+    else if (s_axis_tvalid && s_axis_tready) begin
+      in_pkt <= ~s_axis_tlast;
+      if (!in_pkt)
+        held <= match;
+    end
+  end
+
+endmodule
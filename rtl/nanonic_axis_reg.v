@@ -0,0 +1,81 @@
+//--------------------------------------------------------------------------------
+// NanoNIC AXI4-Stream register slice
+//
+// Full-throughput skid buffer: every output and tready are driven from flops, so
+// the slice cuts both the forward and the backward timing paths. Chain several
+// of them to cross long distances (e.g. between SLRs) at 250 MHz.
+//--------------------------------------------------------------------------------
+`timescale 1 ps / 1 ps
+
+module nanonic_axis_reg #(
+    parameter USER_W = 48
+  ) (
+    input               clk,
+    input               rst_n,
+
+    input               s_axis_tvalid,
+    input  [511:0]      s_axis_tdata,
+    input  [63:0]       s_axis_tkeep,
+    input               s_axis_tlast,
+    input  [USER_W-1:0] s_axis_tuser,
+    output reg          s_axis_tready,
+
+    output reg          m_axis_tvalid,
+    output reg [511:0]  m_axis_tdata,
+    output reg [63:0]   m_axis_tkeep,
+    output reg          m_axis_tlast,
+    output reg [USER_W-1:0] m_axis_tuser,
+    input               m_axis_tready
+  );
+
+  // Skid register, used when the output stalls while tready is still high
+  reg              skid_valid;
+  reg [511:0]      skid_tdata;
+  reg [63:0]       skid_tkeep;
+  reg              skid_tlast;
+  reg [USER_W-1:0] skid_tuser;
+
+  wire s_hs   = s_axis_tvalid && s_axis_tready;
+  wire m_free = !m_axis_tvalid || m_axis_tready;
+
+  // tready is low whenever the skid register holds a beat, so a beat can only
+  // land in it while the output is stalled and the register is empty
+  wire skid_next = m_free ? 1'b0 : (skid_valid || s_hs);
+
+  always @(posedge clk) begin
+    if (!rst_n) begin
+      s_axis_tready <= 1'b0;
+      m_axis_tvalid <= 1'b0;
+      skid_valid    <= 1'b0;
+    end
+    else begin
+      if (m_free) begin
+        if (skid_valid) begin
+          m_axis_tvalid <= 1'b1;
+          m_axis_tdata  <= skid_tdata;
+          m_axis_tkeep  <= skid_tkeep;
+          m_axis_tlast  <= skid_tlast;
+          m_axis_tuser  <= skid_tuser;
+          skid_valid    <= 1'b0;
+        end
+        else begin
+          m_axis_tvalid <= s_hs;
+          m_axis_tdata  <= s_axis_tdata;
+          m_axis_tkeep  <= s_axis_tkeep;
+          m_axis_tlast  <= s_axis_tlast;
+          m_axis_tuser  <= s_axis_tuser;
+        end
+      end
+      else if (s_hs) begin
+        skid_valid <= 1'b1;
+        skid_tdata <= s_axis_tdata;
+        skid_tkeep <= s_axis_tkeep;
+        skid_tlast <= s_axis_tlast;
+        skid_tuser <= s_axis_tuser;
+      end
+
+      s_axis_tready <= !skid_next;
+    end
+  end
+
+endmodule
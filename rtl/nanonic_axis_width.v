@@ -0,0 +1,114 @@
+//--------------------------------------------------------------------------------
+// NanoNIC AXI4-Stream width converters between the 1024-bit and the 512-bit bus
+//
+// nanonic_axis_downsize splits every 1024-bit beat into two 512-bit beats, the
+// lower half first (byte i of the wide beat stays byte i of the packet). The
+// upper half is skipped when none of its bytes is valid, so the last beat of a
+// packet is not followed by an empty one.
+//
+// nanonic_axis_upsize packs pairs of 512-bit beats into one 1024-bit beat. A
+// packet that ends on the lower half leaves with the upper half empty; tuser
+// is taken from the first beat of the pair. The output is registered.
+//--------------------------------------------------------------------------------
+`timescale 1 ps / 1 ps
+
+module nanonic_axis_downsize #(
+    parameter USER_W = 48
+  ) (
+    input               clk,
+    input               rst_n,
+
+    input               s_axis_tvalid,
+    input  [1023:0]     s_axis_tdata,
+    input  [127:0]      s_axis_tkeep,
+    input               s_axis_tlast,
+    input  [USER_W-1:0] s_axis_tuser,
+    output              s_axis_tready,
+
+    output              m_axis_tvalid,
+    output [511:0]      m_axis_tdata,
+    output [63:0]       m_axis_tkeep,
+    output              m_axis_tlast,
+    output [USER_W-1:0] m_axis_tuser,
+    input               m_axis_tready
+  );
+
+  reg upper;
+
+  wire has_upper = |s_axis_tkeep[127:64];
+  wire done      = upper || !has_upper;
+
+  assign m_axis_tvalid = s_axis_tvalid;
+  assign m_axis_tdata  = upper ? s_axis_tdata[1023:512] : s_axis_tdata[511:0];
+  assign m_axis_tkeep  = upper ? s_axis_tkeep[127:64]   : s_axis_tkeep[63:0];
+  assign m_axis_tlast  = s_axis_tlast && done;
+  assign m_axis_tuser  = s_axis_tuser;
+  assign s_axis_tready = m_axis_tready && done;
+
+  always @(posedge clk) begin
+    if (!rst_n)
+      upper <= 1'b0;
+    else if (m_axis_tvalid && m_axis_tready)
+      upper <= !done;
+  end
+
+endmodule
+
+module nanonic_axis_upsize #(
+    parameter USER_W = 48
+  ) (
+    input                   clk,
+    input                   rst_n,
+
+    input                   s_axis_tvalid,
+    input      [511:0]      s_axis_tdata,
+    input      [63:0]       s_axis_tkeep,
+    input                   s_axis_tlast,
+    input      [USER_W-1:0] s_axis_tuser,
+    output                  s_axis_tready,
+
+    output reg              m_axis_tvalid,
+    output reg [1023:0]     m_axis_tdata,
+    output reg [127:0]      m_axis_tkeep,
+    output reg              m_axis_tlast,
+    output reg [USER_W-1:0] m_axis_tuser,
+    input                   m_axis_tready
+  );
+
+  reg              have_low;
+  reg [511:0]      low_tdata;
+  reg [63:0]       low_tkeep;
+  reg [USER_W-1:0] low_tuser;
+
+  wire s_hs = s_axis_tvalid && s_axis_tready;
+
+  assign s_axis_tready = !m_axis_tvalid || m_axis_tready;
+
+  always @(posedge clk) begin
+    if (!rst_n) begin
+      have_low      <= 1'b0;
+      m_axis_tvalid <= 1'b0;
+    end
+    else begin
+      if (m_axis_tvalid && m_axis_tready)
+        m_axis_tvalid <= 1'b0;
+      if (s_hs) begin
+        if (!have_low && !s_axis_tlast) begin
+          have_low  <= 1'b1;
+          low_tdata <= s_axis_tdata;
+          low_tkeep <= s_axis_tkeep;
+          low_tuser <= s_axis_tuser;
+        end
+        else begin
+          have_low      <= 1'b0;
+          m_axis_tvalid <= 1'b1;
+          m_axis_tdata  <= have_low ? {s_axis_tdata, low_tdata} : {512'd0, s_axis_tdata};
+          m_axis_tkeep  <= have_low ? {s_axis_tkeep, low_tkeep} : {64'd0, s_axis_tkeep};
+          m_axis_tlast  <= s_axis_tlast;
+          m_axis_tuser  <= have_low ? low_tuser : s_axis_tuser;
+        end
+      end
+    end
+  end
+
+endmodule
@@ -0,0 +1,365 @@
+//--------------------------------------------------------------------------------
+// NanoNIC cuckoo hash map
+//
+// Hash map for BPF_MAP_TYPE_HASH maps that must be filled well beyond the load
+// a single-hash table tolerates. A key can live in one of SLOTS slots of its
+// bucket in each of WAYS tables (bucket index h_w(key) in table w) or in a
+// small fully associative stash of STASH entries. Every slot of every table is
+// a separate memory read with the same index, so a lookup probes all
+// WAYS * SLOTS candidate slots and the stash in parallel: one lookup per
+// cycle, lk_valid LATENCY cycles after lk_en. With 2 ways of 4 slots the
+// tables can be filled above 95%.
+//
+// h_w is an H3 hash: the XOR of a fixed pseudo-random row per set key bit,
+// rows generated by h3_row() (scripts/nanonic_cuckoo.py computes the same
+// hash). Insertions, with the moves of the entries they kick out, are done by
+// the control plane. It writes the entries of a move path from its free end
+// back to the new key, so every key stays in the table at all times (for one
+// write it is in two slots, both with the same value).
+//
+// The datapath can overwrite the value of an entry it found, using the lk_loc
+// of the hit (up_*). A key it did not find is queued with ins_en for the
+// control plane to insert; requests that find the queue full are counted and
+// dropped. Lookups in flight while their entry is written may return the old
+// value. INS_DEPTH must be a power of two.
+//
+// The block is standalone: nanonic_pipeline_top does not instantiate it, and a
+// design that does connects the lookup ports to its own datapath and maps the
+// registers where its AXI-Lite slave decodes them.
+//
+// Locations (lk_loc, up_loc, command register): [23:0] bucket index (stash
+// entry), [27:24] slot, [30:28] way, 7 for the stash.
+//
+// Registers (offsets inside the block window):
+//   0x00 status      R: bit 0 command pending, bit 1 insert queue not empty
+//   0x04 widths      {VAL_W[15:0], KEY_W[15:0]}
+//   0x08 geometry    {STASH[7:0], SLOTS[7:0], WAYS[7:0], ADDR_W[7:0]}
+//   0x0C command     W: location in [30:0]; bit 31 set writes the staged entry
+//                    to it, clear reads it into the staged registers
+//   0x10 valid       staged valid bit (bit 0), cleared to delete an entry
+//   0x14 lookups     number of lookups
+//   0x18 hits        number of lookups that found their key
+//   0x1C queued      W: pops the oldest insert request into the staged entry
+//                    R: insert requests waiting
+//   0x20 dropped     insert requests lost on a full queue
+//   0x40 + 4*w       staged key, bits [32*w +: 32]
+//   0x80 + 4*w       staged value, bits [32*w +: 32]
+//--------------------------------------------------------------------------------
+`timescale 1 ps / 1 ps
+
+module nanonic_cuckoo #(
+    parameter WAYS      = 2,
+    parameter SLOTS     = 4,
+    parameter STASH     = 4,
+    parameter ADDR_W    = 12,
+    parameter KEY_W     = 32,
+    parameter VAL_W     = 64,
+    parameter INS_DEPTH = 16,
+    parameter RAM_STYLE = "block"
+  ) (
+    input                   clk,
+    input                   rst_n,
+
+    input                   lk_en,
+    input  [KEY_W-1:0]      lk_key,
+    output reg              lk_valid,
+    output reg              lk_hit,
+    output reg [VAL_W-1:0]  lk_value,
+    output reg [31:0]       lk_loc,
+
+    input                   up_en,
+    input  [31:0]           up_loc,
+    input  [KEY_W-1:0]      up_key,
+    input  [VAL_W-1:0]      up_value,
+
+    input                   ins_en,
+    input  [KEY_W-1:0]      ins_key,
+    input  [VAL_W-1:0]      ins_value,
+
+    input                   wr_en,
+    input      [11:0]       wr_addr,
+    input      [31:0]       wr_data,
+    input      [11:0]       rd_addr,
+    output reg [31:0]       rd_data
+  );
+
+  localparam LATENCY = 3;
+  localparam DEPTH   = 1 << ADDR_W;
+  localparam ENTRY_W = 1 + KEY_W + VAL_W;
+  localparam KWORDS  = (KEY_W + 31) / 32;
+  localparam VWORDS  = (VAL_W + 31) / 32;
+  localparam NUM_MEM = WAYS * SLOTS;
+  localparam INS_W   = $clog2(INS_DEPTH);
+  localparam [31:0] WIDTHS   = (VAL_W << 16) | KEY_W;
+  localparam [31:0] GEOMETRY = (STASH << 24) | (SLOTS << 16) | (WAYS << 8) | ADDR_W;
+
+  // Row b of the H3 matrix of way w: the murmur3 finalizer of {w + 1, b}
+  function [31:0] h3_row(input integer w, input integer b);
+    reg [31:0] x;
+    begin
+      x = {w[7:0] + 8'd1, 8'd0, b[15:0]};
+      x = x ^ (x >> 16);
+      x = x * 32'h85EBCA6B;
+      x = x ^ (x >> 13);
+      x = x * 32'hC2B2AE35;
+      x = x ^ (x >> 16);
+      h3_row = x;
+    end
+  endfunction
+
+  // Stage 1: bucket index of every way
+  reg                   p1_en;
+  reg [KEY_W-1:0]       p1_key;
+  reg [WAYS*ADDR_W-1:0] p1_idx;
+  wire [WAYS*ADDR_W-1:0] lk_idx;
+
+  genvar g, s;
+  generate
+    for (g = 0; g < WAYS; g = g + 1) begin : g_hash
+      reg [31:0] h;
+      integer b;
+      always @(*) begin
+        h = 32'd0;
+        for (b = 0; b < KEY_W; b = b + 1)
+          if (lk_key[b])
+            h = h ^ h3_row(g, b);
+      end
+      assign lk_idx[g*ADDR_W +: ADDR_W] = h[ADDR_W-1:0];
+    end
+  endgenerate
+
+  always @(posedge clk) begin
+    p1_en  <= rst_n && lk_en;
+    p1_key <= lk_key;
+    p1_idx <= lk_idx;
+  end
+
+  // Host command and datapath update, both on the second port of the memories;
+  // an update takes the port first and the command waits
+  reg                 cmd_pend;
+  reg                 cmd_wr;
+  reg [30:0]          cmd_loc;
+  reg                 cmd_rd_wait;
+  reg                 staged_valid;
+  reg [KWORDS*32-1:0] staged_key;
+  reg [VWORDS*32-1:0] staged_value;
+
+  wire up_stash  = up_loc[30:28] == 3'd7;
+  wire cmd_stash = cmd_loc[30:28] == 3'd7;
+
+  wire b_up  = up_en && !up_stash;
+  wire b_cmd = cmd_pend && !cmd_rd_wait && !cmd_stash && !b_up;
+  wire [30:0] b_loc = b_up ? up_loc[30:0] : cmd_loc;
+  wire        b_we  = b_up || (b_cmd && cmd_wr);
+  wire [ENTRY_W-1:0] b_entry = b_up ? {1'b1, up_key, up_value}
+                                    : {staged_valid, staged_key[KEY_W-1:0], staged_value[VAL_W-1:0]};
+
+  // Stage 2: one memory per slot of every way
+  reg                   p2_en;
+  reg [KEY_W-1:0]       p2_key;
+  reg [WAYS*ADDR_W-1:0] p2_idx;
+  wire [NUM_MEM*ENTRY_W-1:0] qa;
+  wire [NUM_MEM*ENTRY_W-1:0] qb;
+
+  generate
+    for (g = 0; g < WAYS; g = g + 1) begin : g_way
+      for (s = 0; s < SLOTS; s = s + 1) begin : g_slot
+        (* ram_style = RAM_STYLE *) reg [ENTRY_W-1:0] mem [0:DEPTH-1];
+        reg [ENTRY_W-1:0] qa_r;
+        reg [ENTRY_W-1:0] qb_r;
+
+        integer i;
+        initial
+          for (i = 0; i < DEPTH; i = i + 1)
+            mem[i] = {ENTRY_W{1'b0}};
+
+        always @(posedge clk)
+          if (p1_en)
+            qa_r <= mem[p1_idx[g*ADDR_W +: ADDR_W]];
+
+        always @(posedge clk) begin
+          if ((b_up || b_cmd) && b_loc[30:28] == g && b_loc[27:24] == s) begin
+            if (b_we)
+              mem[b_loc[ADDR_W-1:0]] <= b_entry;
+            qb_r <= mem[b_loc[ADDR_W-1:0]];
+          end
+        end
+
+        assign qa[(g*SLOTS+s)*ENTRY_W +: ENTRY_W] = qa_r;
+        assign qb[(g*SLOTS+s)*ENTRY_W +: ENTRY_W] = qb_r;
+      end
+    end
+  endgenerate
+
+  reg [ENTRY_W-1:0] stash [0:STASH-1];
+
+  always @(posedge clk) begin
+    p2_en  <= rst_n && p1_en;
+    p2_key <= p1_key;
+    p2_idx <= p1_idx;
+  end
+
+  // Stage 3: compare the candidate slots and the stash
+  reg             hit;
+  reg [VAL_W-1:0] value;
+  reg [31:0]      loc;
+  integer w, k;
+  always @(*) begin
+    hit   = 1'b0;
+    value = {VAL_W{1'b0}};
+    loc   = 32'd0;
+    for (w = 0; w < WAYS; w = w + 1)
+      for (k = 0; k < SLOTS; k = k + 1)
+        if (!hit && qa[(w*SLOTS+k)*ENTRY_W + ENTRY_W - 1] &&
+            qa[(w*SLOTS+k)*ENTRY_W + VAL_W +: KEY_W] == p2_key) begin
+          hit   = 1'b1;
+          value = qa[(w*SLOTS+k)*ENTRY_W +: VAL_W];
+          loc   = (w << 28) | (k << 24) | p2_idx[w*ADDR_W +: ADDR_W];
+        end
+    for (k = 0; k < STASH; k = k + 1)
+      if (!hit && stash[k][ENTRY_W-1] && stash[k][VAL_W +: KEY_W] == p2_key) begin
+        hit   = 1'b1;
+        value = stash[k][VAL_W-1:0];
+        loc   = (7 << 28) | k;
+      end
+  end
+
+  always @(posedge clk) begin
+    lk_valid <= rst_n && p2_en;
+    lk_hit   <= hit;
+    lk_value <= value;
+    lk_loc   <= loc;
+  end
+
+  // Insert requests for the control plane
+  reg [KEY_W+VAL_W-1:0] ins_mem [0:INS_DEPTH-1];
+  reg [INS_W:0]         ins_wr;
+  reg [INS_W:0]         ins_rd;
+  reg [31:0]            ins_dropped;
+
+  wire ins_full  = (ins_wr - ins_rd) == INS_DEPTH;
+  wire ins_empty = ins_wr == ins_rd;
+  wire ins_pop   = wr_en && wr_addr == 12'h01C && !ins_empty;
+
+  always @(posedge clk) begin
+    if (!rst_n) begin
+      ins_wr      <= {INS_W+1{1'b0}};
+      ins_dropped <= 32'd0;
+    end
+    else if (ins_en) begin
+      if (ins_full)
+        ins_dropped <= ins_dropped + 1;
+      else begin
+        ins_mem[ins_wr[INS_W-1:0]] <= {ins_key, ins_value};
+        ins_wr <= ins_wr + 1;
+      end
+    end
+  end
+
+  // Host registers
+  wire wr_key   = wr_en && wr_addr >= 12'h040 && wr_addr < 12'h040 + 4*KWORDS;
+  wire wr_value = wr_en && wr_addr >= 12'h080 && wr_addr < 12'h080 + 4*VWORDS;
+  wire [11:0] key_word   = (wr_addr - 12'h040) >> 2;
+  wire [11:0] value_word = (wr_addr - 12'h080) >> 2;
+
+  wire [7:0] rd_sel = cmd_loc[30:28] * SLOTS + cmd_loc[27:24];
+  wire [ENTRY_W-1:0] cmd_entry = qb[rd_sel*ENTRY_W +: ENTRY_W];
+  wire [ENTRY_W-1:0] stash_entry = stash[cmd_loc[23:0] % STASH];
+
+  always @(posedge clk) begin
+    if (!rst_n) begin
+      cmd_pend     <= 1'b0;
+      cmd_rd_wait  <= 1'b0;
+      ins_rd       <= {INS_W+1{1'b0}};
+      staged_valid <= 1'b0;
+      staged_key   <= {KWORDS*32{1'b0}};
+      staged_value <= {VWORDS*32{1'b0}};
+    end
+    else begin
+      if (wr_en && wr_addr == 12'h00C && !cmd_pend) begin
+        cmd_pend <= 1'b1;
+        cmd_wr   <= wr_data[31];
+        cmd_loc  <= wr_data[30:0];
+      end
+      if (wr_en && wr_addr == 12'h010)
+        staged_valid <= wr_data[0];
+      if (wr_key)
+        staged_key[key_word*32 +: 32] <= wr_data;
+      if (wr_value)
+        staged_value[value_word*32 +: 32] <= wr_data;
+
+      if (ins_pop) begin
+        {staged_key[KEY_W-1:0], staged_value[VAL_W-1:0]} <= ins_mem[ins_rd[INS_W-1:0]];
+        staged_valid <= 1'b1;
+        ins_rd       <= ins_rd + 1;
+      end
+
+      if (b_cmd) begin
+        if (cmd_wr)
+          cmd_pend <= 1'b0;
+        else
+          cmd_rd_wait <= 1'b1;
+      end
+      if (cmd_rd_wait) begin
+        {staged_valid, staged_key[KEY_W-1:0], staged_value[VAL_W-1:0]} <= cmd_entry;
+        cmd_pend    <= 1'b0;
+        cmd_rd_wait <= 1'b0;
+      end
+      if (cmd_pend && cmd_stash && !(up_en && up_stash)) begin
+        if (!cmd_wr)
+          {staged_valid, staged_key[KEY_W-1:0], staged_value[VAL_W-1:0]} <= stash_entry;
+        cmd_pend <= 1'b0;
+      end
+    end
+  end
+
+  integer j;
+  always @(posedge clk) begin
+    if (!rst_n) begin
+      for (j = 0; j < STASH; j = j + 1)
+        stash[j] <= {ENTRY_W{1'b0}};
+    end
+    else if (up_en && up_stash)
+      stash[up_loc[23:0] % STASH] <= {1'b1, up_key, up_value};
+    else if (cmd_pend && cmd_stash && cmd_wr)
+      stash[cmd_loc[23:0] % STASH] <= {staged_valid, staged_key[KEY_W-1:0], staged_value[VAL_W-1:0]};
+  end
+
+  // Statistics
+  reg [31:0] lookups;
+  reg [31:0] hits;
+
+  always @(posedge clk) begin
+    if (!rst_n) begin
+      lookups <= 32'd0;
+      hits    <= 32'd0;
+    end
+    else if (lk_valid) begin
+      lookups <= lookups + 1;
+      if (lk_hit)
+        hits <= hits + 1;
+    end
+  end
+
+  always @(posedge clk) begin
+    case (rd_addr)
+      12'h000: rd_data <= {30'd0, !ins_empty, cmd_pend};
+      12'h004: rd_data <= WIDTHS;
+      12'h008: rd_data <= GEOMETRY;
+      12'h010: rd_data <= {31'd0, staged_valid};
+      12'h014: rd_data <= lookups;
+      12'h018: rd_data <= hits;
+      12'h01C: rd_data <= ins_wr - ins_rd;
+      12'h020: rd_data <= ins_dropped;
+      default: begin
+        if (rd_addr >= 12'h040 && rd_addr < 12'h040 + 4*KWORDS)
+          rd_data <= staged_key[((rd_addr - 12'h040) >> 2)*32 +: 32];
+        else if (rd_addr >= 12'h080 && rd_addr < 12'h080 + 4*VWORDS)
+          rd_data <= staged_value[((rd_addr - 12'h080) >> 2)*32 +: 32];
+        else
+          rd_data <= 32'd0;
+      end
+    endcase
+  end
+
+endmodule
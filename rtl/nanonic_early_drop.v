@@ -0,0 +1,155 @@
+//--------------------------------------------------------------------------------
+// NanoNIC early-drop filter
+//
+// Sits in front of stage_0 of the Nanotube pipeline and absorbs the packets
+// whose XDP_DROP verdict only depends on the first beat of the frame (ethertype,
+// IPv4 source address and protocol), or on a per-source packet count the block
+// keeps itself. Dropped packets are consumed at one beat per cycle and never
+// enter the pipeline, so they stop taking stage slots.
+//
+// The rules mirror the structure of the drop applications:
+//   keep  = KEEP_EN && saddr == KEEP_SADDR && protocol == KEEP_PROTO
+//   drop  = !keep && ((ETYPE_EN && (ethertype & ETYPE_MASK) == (ETYPE & ETYPE_MASK))
+//                     || (LIMIT_EN && ethertype == IPv4 && limited))
+//
+// xdp_drop_IPv4       : ETYPE = 16'h0800, ETYPE_MASK = 16'hFFFF
+// xdp_drop_all        : ETYPE_MASK = 16'h0000 (every non-kept frame is dropped)
+// xdp_drop_count_ICMP : ETYPE_EN = 0, LIMIT_EN = 1, LIMIT_THRESH = 21
+//
+// The limiter counts the IPv4 packets of every source that are not kept, like
+// icmp_count_map of xdp_drop_count_ICMP, and drops a packet whose count
+// (saturating at LIMIT_THRESH) reaches LIMIT_THRESH. Its table is direct-mapped
+// with 2**LIMIT_ADDR_W entries tagged with the full source address; a source
+// that takes the entry of another one starts again from zero, so the block may
+// count fewer packets than the application but never more. The map of the
+// application stops taking new sources once it holds LIMIT_ENTRIES of them,
+// so after LIMIT_ENTRIES allocations the block only counts the sources it
+// already tracks. It therefore only drops what the application would drop
+// anyway. scripts/gen_early_drop.py derives the parameters from the source of
+// an application.
+//
+// KEEP_SADDR uses the same constant as MONITOR_IP in the applications, i.e.
+// the address as a little-endian load of the network-order bytes.
+//--------------------------------------------------------------------------------
+`timescale 1 ps / 1 ps
+
+module nanonic_early_drop #(
+    parameter         ENABLE        = 0,
+    parameter         ETYPE_EN      = 1,
+    parameter [15:0]  ETYPE         = 16'h0800,
+    parameter [15:0]  ETYPE_MASK    = 16'hFFFF,
+    parameter         KEEP_EN       = 1,
+    parameter [31:0]  KEEP_SADDR    = 32'h6401A8C0,
+    parameter [7:0]   KEEP_PROTO    = 8'd1,
+    parameter         LIMIT_EN      = 0,
+    parameter [7:0]   LIMIT_THRESH  = 8'd21,
+    parameter         LIMIT_ADDR_W  = 10,
+    parameter [31:0]  LIMIT_ENTRIES = 32'd1024
+  ) (
+    input             clk,
+    input             rst_n,
+
+    input             s_axis_tvalid,
+    input      [511:0] s_axis_tdata,
+    input      [63:0] s_axis_tkeep,
+    input             s_axis_tlast,
+    input      [47:0] s_axis_tuser,
+    output            s_axis_tready,
+
+    output            m_axis_tvalid,
+    output     [511:0] m_axis_tdata,
+    output     [63:0] m_axis_tkeep,
+    output            m_axis_tlast,
+    output     [47:0] m_axis_tuser,
+    input             m_axis_tready,
+
+    output reg [31:0] drop_count
+  );
+
+  reg in_pkt;
+  reg dropping;
+
+  // Header fields of the first beat (byte i of the frame is tdata[8*i+7:8*i])
+  wire [15:0] etype = {s_axis_tdata[103:96], s_axis_tdata[111:104]};
+  wire [7:0]  proto = s_axis_tdata[191:184];
+  wire [31:0] saddr = s_axis_tdata[239:208];
+
+  wire keep_match  = KEEP_EN && (saddr == KEEP_SADDR) && (proto == KEEP_PROTO);
+  wire etype_match = ETYPE_EN && ((etype & ETYPE_MASK) == (ETYPE & ETYPE_MASK));
+  wire limit_count = ENABLE && LIMIT_EN && !keep_match && !etype_match && etype == 16'h0800;
+  wire limit_hit;
+  wire drop_match  = ENABLE && !keep_match && (etype_match || (limit_count && limit_hit));
+
+  // The verdict is taken on the first beat and held until tlast
+  wire drop_now = in_pkt ? dropping : drop_match;
+  wire first_hs = s_axis_tvalid && s_axis_tready && !in_pkt;
+
+  //----------------------------------------------------------------------------
+  // Per-source limiter, one read and one write per packet
+  //----------------------------------------------------------------------------
+  generate
+    if (LIMIT_EN) begin : g_limit
+      reg  [2**LIMIT_ADDR_W-1:0] lim_valid;
+      reg  [31:0] lim_tag   [0:2**LIMIT_ADDR_W-1];
+      reg  [7:0]  lim_count [0:2**LIMIT_ADDR_W-1];
+      reg  [31:0] lim_allocs;   // misses that took an entry, at most LIMIT_ENTRIES
+
+      wire [15:0]             fold    = saddr[31:16] ^ saddr[15:0];
+      wire [LIMIT_ADDR_W-1:0] idx     = fold[LIMIT_ADDR_W-1:0];
+      wire                    hit     = lim_valid[idx] && lim_tag[idx] == saddr;
+      wire                    alloc   = !hit && lim_allocs < LIMIT_ENTRIES;
+      wire [7:0]              updated = lim_count[idx] >= LIMIT_THRESH ? LIMIT_THRESH
+                                                                       : lim_count[idx] + 8'd1;
+
+      assign limit_hit = hit && updated >= LIMIT_THRESH;
+
+      always @(posedge clk) begin
+        if (!rst_n) begin
+          lim_valid  <= {2**LIMIT_ADDR_W{1'b0}};
+          lim_allocs <= 32'd0;
+        end
+        else if (first_hs && limit_count && alloc) begin
+          lim_valid[idx] <= 1'b1;
+          lim_allocs     <= lim_allocs + 1;
+        end
+      end
+
+      always @(posedge clk)
+        if (first_hs && limit_count) begin
+          if (alloc) begin
+            lim_tag[idx]   <= saddr;
+            lim_count[idx] <= 8'd1;
+          end
+          else if (hit)
+            lim_count[idx] <= updated;
+        end
+    end
+    else begin : g_no_limit
+      assign limit_hit = 1'b0;
+    end
+  endgenerate
+
+  assign m_axis_tvalid = s_axis_tvalid & ~drop_now;
+  assign m_axis_tdata  = s_axis_tdata;
+  assign m_axis_tkeep  = s_axis_tkeep;
+  assign m_axis_tlast  = s_axis_tlast;
+  assign m_axis_tuser  = s_axis_tuser;
+  assign s_axis_tready = drop_now | m_axis_tready;
+
+  always @(posedge clk) begin
+    if (!rst_n) begin
+      in_pkt     <= 1'b0;
+      dropping   <= 1'b0;
+      drop_count <= 32'd0;
+    end
+    else if (s_axis_tvalid && s_axis_tready) begin
+      in_pkt <= ~s_axis_tlast;
+      if (!in_pkt) begin
+        dropping <= drop_match;
+        if (drop_match)
+          drop_count <= drop_count + 1;
+      end
+    end
+  end
+
+endmodule
@@ -0,0 +1,181 @@
+//--------------------------------------------------------------------------------
+// NanoNIC egress descriptor decoder
+//
+// Looks at the first beat of every packet leaving the Nanotube pipeline. When
+// the application was built with NANONIC_META, that beat is the 64-byte NanoNIC
+// descriptor (see Custom_applications/common/nanonic_desc.h). The decoder
+//   - exposes the descriptor fields for the whole duration of the packet,
+//   - rewrites the size field of tuser (tuser[15:0]) from the frame length in
+//     the descriptor,
+//   - optionally strips the descriptor beat (STRIP_DESC = 1), otherwise the
+//     descriptor is delivered to the host in front of the frame,
+//   - with HAIRPIN_EN = 1, routes the packet on its verdict: XDP_TX packets
+//     leave on the hairpin output (towards the CMAC TX path) without their
+//     descriptor, XDP_DROP and XDP_ABORTED packets are discarded and every
+//     other verdict goes to the main output (towards QDMA C2H).
+//
+// Packets without a descriptor are forwarded untouched on the main output and
+// are reported with an XDP_PASS verdict. s_axis_desc_ok comes from the top and
+// is low for a frame that already started with the descriptor magic when it
+// entered the pipeline; such a frame is treated as one without a descriptor.
+//--------------------------------------------------------------------------------
+`timescale 1 ps / 1 ps
+
+module nanonic_egress #(
+    parameter ENABLE     = 0,
+    parameter STRIP_DESC = 0,
+    parameter HAIRPIN_EN = 0
+  ) (
+    input          clk,
+    input          rst_n,
+
+    input          s_axis_tvalid,
+    input  [511:0] s_axis_tdata,
+    input  [63:0]  s_axis_tkeep,
+    input          s_axis_tlast,
+    input  [47:0]  s_axis_tuser,
+    input          s_axis_desc_ok,
+    output         s_axis_tready,
+
+    output         m_axis_tvalid,
+    output [511:0] m_axis_tdata,
+    output [63:0]  m_axis_tkeep,
+    output         m_axis_tlast,
+    output [47:0]  m_axis_tuser,
+    input          m_axis_tready,
+
+    output         h_axis_tvalid,
+    output [511:0] h_axis_tdata,
+    output [63:0]  h_axis_tkeep,
+    output         h_axis_tlast,
+    output [47:0]  h_axis_tuser,
+    input          h_axis_tready,
+
+    // Descriptor of the packet currently on the input, valid while s_axis_tvalid
+    output         pkt_first,
+    output         pkt_has_desc,
+    output [7:0]   pkt_verdict,
+    output [7:0]   pkt_flags,
+    output [7:0]   pkt_class,
+    output [7:0]   pkt_event,
+    output [7:0]   pkt_encap,
+    output [31:0]  pkt_hash,
+    output [31:0]  pkt_real,
+    output [15:0]  pkt_vip
+  );
+
+  localparam [7:0] XDP_ABORTED = 8'd0;
+  localparam [7:0] XDP_DROP    = 8'd1;
+  localparam [7:0] XDP_PASS    = 8'd2;
+  localparam [7:0] XDP_TX      = 8'd3;
+
+  localparam [1:0] ROUTE_MAIN    = 2'd0;
+  localparam [1:0] ROUTE_HAIRPIN = 2'd1;
+  localparam [1:0] ROUTE_DROP    = 2'd2;
+
+  reg        in_pkt;
+  reg        has_desc_r;
+  reg [7:0]  verdict_r;
+  reg [7:0]  flags_r;
+  reg [7:0]  class_r;
+  reg [7:0]  event_r;
+  reg [7:0]  encap_r;
+  reg [31:0] hash_r;
+  reg [31:0] real_r;
+  reg [15:0] vip_r;
+  reg [15:0] size_r;
+  reg [1:0]  route_r;
+
+  wire [511:0] d = s_axis_tdata;
+
+  wire magic = (d[7:0] == 8'h4E) && (d[15:8] == 8'h54) && (d[23:16] == 8'd1) &&
+               s_axis_desc_ok;
+  wire desc_here = ENABLE && !in_pkt && magic;
+
+  // Fields of a descriptor beat (big-endian, byte i is d[8*i+7:8*i])
+  wire [7:0]  d_verdict = d[31:24];
+  wire [7:0]  d_flags   = d[39:32];
+  wire [7:0]  d_class   = d[47:40];
+  wire [7:0]  d_event   = d[55:48];
+  wire [7:0]  d_encap   = d[63:56];
+  wire [31:0] d_hash    = {d[71:64], d[79:72], d[87:80], d[95:88]};
+  wire [31:0] d_real    = {d[103:96], d[111:104], d[119:112], d[127:120]};
+  wire [15:0] d_vip     = {d[135:128], d[143:136]};
+  wire [15:0] d_len     = {d[151:144], d[159:152]};
+
+  wire d_drop = (d_verdict == XDP_DROP) || (d_verdict == XDP_ABORTED);
+
+  wire [1:0] d_route = !HAIRPIN_EN           ? ROUTE_MAIN    :
+                       (d_verdict == XDP_TX) ? ROUTE_HAIRPIN :
+                       d_drop                ? ROUTE_DROP    : ROUTE_MAIN;
+  wire [1:0] route   = in_pkt ? route_r : (desc_here ? d_route : ROUTE_MAIN);
+
+  // The descriptor never goes out on the wire
+  wire strip_desc = STRIP_DESC || d_route != ROUTE_MAIN;
+  wire strip_now  = desc_here && strip_desc;
+
+  wire [15:0] d_size = strip_desc ? d_len : d_len + 16'd64;
+
+  assign pkt_first    = !in_pkt;
+  assign pkt_has_desc = in_pkt ? has_desc_r : desc_here;
+  assign pkt_verdict  = in_pkt ? verdict_r  : (desc_here ? d_verdict : XDP_PASS);
+  assign pkt_flags    = in_pkt ? flags_r    : (desc_here ? d_flags   : 8'd0);
+  assign pkt_class    = in_pkt ? class_r    : (desc_here ? d_class   : 8'd0);
+  assign pkt_event    = in_pkt ? event_r    : (desc_here ? d_event   : 8'd0);
+  assign pkt_encap    = in_pkt ? encap_r    : (desc_here ? d_encap   : 8'd0);
+  assign pkt_hash     = in_pkt ? hash_r     : (desc_here ? d_hash    : 32'd0);
+  assign pkt_real     = in_pkt ? real_r     : (desc_here ? d_real    : 32'd0);
+  assign pkt_vip      = in_pkt ? vip_r      : (desc_here ? d_vip     : 16'd0);
+
+  wire [15:0] size_now = in_pkt ? size_r : (desc_here ? d_size : s_axis_tuser[15:0]);
+
+  assign m_axis_tvalid = s_axis_tvalid & ~strip_now & (route == ROUTE_MAIN);
+  assign m_axis_tdata  = s_axis_tdata;
+  assign m_axis_tkeep  = s_axis_tkeep;
+  assign m_axis_tlast  = s_axis_tlast;
+  assign m_axis_tuser  = {s_axis_tuser[47:16], size_now};
+
+  assign h_axis_tvalid = s_axis_tvalid & ~strip_now & (route == ROUTE_HAIRPIN);
+  assign h_axis_tdata  = s_axis_tdata;
+  assign h_axis_tkeep  = s_axis_tkeep;
+  assign h_axis_tlast  = s_axis_tlast;
+  assign h_axis_tuser  = {s_axis_tuser[47:16], size_now};
+
+  assign s_axis_tready = strip_now | (route == ROUTE_DROP) |
+                         (route == ROUTE_MAIN    && m_axis_tready) |
+                         (route == ROUTE_HAIRPIN && h_axis_tready);
+
+  always @(posedge clk) begin
+    if (!rst_n) begin
+      in_pkt     <= 1'b0;
+      has_desc_r <= 1'b0;
+      verdict_r  <= XDP_PASS;
+      flags_r    <= 8'd0;
+      class_r    <= 8'd0;
+      event_r    <= 8'd0;
+      encap_r    <= 8'd0;
+      hash_r     <= 32'd0;
+      real_r     <= 32'd0;
+      vip_r      <= 16'd0;
+      size_r     <= 16'd0;
+      route_r    <= ROUTE_MAIN;
+    end
+    else if (s_axis_tvalid && s_axis_tready) begin
+      in_pkt <= ~s_axis_tlast;
+      if (!in_pkt) begin
+        has_desc_r <= pkt_has_desc;
+        verdict_r  <= pkt_verdict;
+        flags_r    <= pkt_flags;
+        class_r    <= pkt_class;
+        event_r    <= pkt_event;
+        encap_r    <= pkt_encap;
+        hash_r     <= pkt_hash;
+        real_r     <= pkt_real;
+        vip_r      <= pkt_vip;
+        size_r     <= size_now;
+        route_r    <= route;
+      end
+    end
+  end
+
+endmodule
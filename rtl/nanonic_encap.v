@@ -0,0 +1,365 @@
+//--------------------------------------------------------------------------------
+// NanoNIC egress checksum and encapsulation engine
+//
+// Sits between the Nanotube pipeline and the egress decoder and applies the
+// operations requested in the parameter area of the NanoNIC descriptor (see
+// Custom_applications/common/nanonic_desc.h), so applications no longer grow
+// the packet head or do checksum arithmetic on packet bytes in their stages:
+//
+//   - encapsulation (descriptor encap type): the Ethernet header of the frame
+//     is replaced by a new one (destination: the gateway MAC register, source:
+//     the old destination MAC) followed by an outer IPv4 (IPIP, 20 bytes) or
+//     IPv6 (40 bytes) header built from the descriptor. The outer IPv4 header
+//     checksum is computed here. The frame is shifted on the fly with a
+//     one-beat carry, so head growth costs at most one extra beat at the end
+//     of the packet and no pass through the stages.
+//   - NANONIC_CSUM_IP4: recompute the checksum of the IPv4 header of the frame
+//     (IHL 5, no options).
+//   - NANONIC_CSUM_L4: incremental update (RFC 1624) of the checksum at a given
+//     offset for a field of up to 8 bytes that the application rewrote; the
+//     descriptor carries the old value and the new one is read from the frame.
+//     The checksum and the field must lie in the first beat (bytes 0 to 63)
+//     and the field length be at most 8; a request outside these bounds is
+//     ignored and the frame forwarded as it is.
+//
+// Checksum operations only look at the first beat of the frame. The descriptor
+// is forwarded with its frame length updated, packets without a descriptor
+// are forwarded untouched, and so are the frames the top flags with
+// s_axis_desc_ok low (they entered the pipeline with the descriptor magic).
+// m_axis_desc_ok is s_axis_desc_ok passed through for the blocks behind.
+//
+// Registers (offsets inside the block window):
+//   0x00 encapsulated packets     0x04 packets with checksum operations
+//   0x08 gateway MAC bytes 0-3    0x0C gateway MAC bytes 4-5 (bits 31:16)
+//   0x10, 0x14, 0x18  bytes 0-3, 4-7, 8-11 of the IPv6 outer source prefix
+//--------------------------------------------------------------------------------
+`timescale 1 ps / 1 ps
+
+module nanonic_encap #(
+    parameter         ENABLE        = 0,
+    parameter [47:0]  GW_MAC        = 48'h000000000000,
+    parameter [95:0]  V6_SRC_PREFIX = 96'h010000000000000000000000
+  ) (
+    input              clk,
+    input              rst_n,
+
+    input              s_axis_tvalid,
+    input      [511:0] s_axis_tdata,
+    input      [63:0]  s_axis_tkeep,
+    input              s_axis_tlast,
+    input      [47:0]  s_axis_tuser,
+    input              s_axis_desc_ok,
+    output             s_axis_tready,
+
+    output             m_axis_tvalid,
+    output reg [511:0] m_axis_tdata,
+    output reg [63:0]  m_axis_tkeep,
+    output             m_axis_tlast,
+    output     [47:0]  m_axis_tuser,
+    output             m_axis_desc_ok,
+    input              m_axis_tready,
+
+    input              wr_en,
+    input      [11:0]  wr_addr,
+    input      [31:0]  wr_data,
+    input      [11:0]  rd_addr,
+    output reg [31:0]  rd_data
+  );
+
+  localparam [7:0] ENCAP_NONE = 8'd0;
+  localparam [7:0] ENCAP_IPIP = 8'd1;
+  localparam [7:0] ENCAP_IP6  = 8'd2;
+
+  localparam CSUM_IP4    = 0;
+  localparam CSUM_L4     = 1;
+  localparam CSUM_L4_UDP = 2;
+
+  localparam [1:0] ST_HEAD  = 2'd0;   // next beat starts a packet
+  localparam [1:0] ST_FIRST = 2'd1;   // next beat is the first one after the descriptor
+  localparam [1:0] ST_BODY  = 2'd2;   // rest of the frame, shifted when encapsulating
+  localparam [1:0] ST_TAIL  = 2'd3;   // extra beat with the end of a grown frame
+
+  reg [1:0]   state;
+  reg         enc;          // encapsulating the current packet
+  reg         enc_v6;       // outer header is IPv6 (40 bytes), else IPv4 (20)
+  reg [7:0]   ops;
+  reg [5:0]   l4_csum_off;
+  reg [5:0]   l4_fld_off;
+  reg [3:0]   l4_fld_len;
+  reg         l4_ok;        // L4 fix-up within the first beat
+  reg [63:0]  l4_old;
+  reg [319:0] outer;        // outer header, byte j in outer[8*j +: 8]
+  reg [511:0] carry;
+  reg [63:0]  carry_keep;
+
+  reg [47:0]  gw_mac;
+  reg [95:0]  v6_prefix;
+  reg [31:0]  encap_pkts;
+  reg [31:0]  csum_pkts;
+
+  wire [511:0] d = s_axis_tdata;
+
+  //----------------------------------------------------------------------------
+  // Descriptor beat
+  //----------------------------------------------------------------------------
+  wire magic     = (d[7:0] == 8'h4E) && (d[15:8] == 8'h54) && (d[23:16] == 8'd1) &&
+                   s_axis_desc_ok;
+  wire desc_here = ENABLE && state == ST_HEAD && magic && !s_axis_tlast;
+
+  wire [7:0]  d_encap     = d[63:56];
+  wire [15:0] d_len       = {d[151:144], d[159:152]};
+  wire [7:0]  d_ops       = d[167:160];
+  wire [7:0]  d_tos       = d[263:256];
+  wire [7:0]  d_ttl       = d[271:264];
+  wire [7:0]  d_proto     = d[279:272];
+  wire [31:0] d_src       = {d[295:288], d[303:296], d[311:304], d[319:312]};
+  wire [15:0] d_id        = {d[455:448], d[463:456]};
+  wire [19:0] d_flow      = {d[459:456], d[471:464], d[479:472]};
+  wire [15:0] d_inner_len = {d[487:480], d[495:488]};
+
+  wire        d_enc    = d_encap == ENCAP_IPIP || d_encap == ENCAP_IP6;
+  wire        d_enc_v6 = d_encap == ENCAP_IP6;
+  wire [15:0] d_grow   = !d_enc ? 16'd0 : (d_enc_v6 ? 16'd40 : 16'd20);
+
+  // L4 fix-up bounds: the checksum (2 bytes) and the field, rounded up to
+  // whole 16-bit words, must both end inside the 64-byte first beat
+  wire [7:0]  d_l4_csum_off = d[175:168];
+  wire [7:0]  d_l4_fld_off  = d[183:176];
+  wire [7:0]  d_l4_fld_len  = d[191:184];
+  wire [8:0]  d_l4_fld_end  = d_l4_fld_off + {d_l4_fld_len[3:1] + d_l4_fld_len[0], 1'b0};
+  wire        d_l4_ok       = d_l4_csum_off <= 8'd62 && d_l4_fld_len <= 8'd8 &&
+                              d_l4_fld_end <= 9'd64;
+
+  // Outer IPv4 header and its checksum
+  wire [15:0] v4_totlen = d_inner_len + 16'd20;
+  wire [19:0] v4_sum = {8'h45, d_tos} + v4_totlen + d_id + {d_ttl, d_proto} +
+                       d_src[31:16] + d_src[15:0] +
+                       {d[327:320], d[335:328]} + {d[343:336], d[351:344]};
+  wire [16:0] v4_fold1 = v4_sum[15:0] + v4_sum[19:16];
+  wire [15:0] v4_csum  = ~(v4_fold1[15:0] + v4_fold1[16]);
+
+  wire [159:0] v4_hdr = {d[351:320], d_src[7:0], d_src[15:8], d_src[23:16], d_src[31:24],
+                         v4_csum[7:0], v4_csum[15:8], d_proto, d_ttl, 16'd0,
+                         d_id[7:0], d_id[15:8], v4_totlen[7:0], v4_totlen[15:8],
+                         d_tos, 8'h45};
+
+  wire [319:0] v6_hdr = {d[447:320], d_src[7:0], d_src[15:8], d_src[23:16], d_src[31:24],
+                         v6_prefix[7:0],   v6_prefix[15:8],  v6_prefix[23:16],
+                         v6_prefix[31:24], v6_prefix[39:32], v6_prefix[47:40],
+                         v6_prefix[55:48], v6_prefix[63:56], v6_prefix[71:64],
+                         v6_prefix[79:72], v6_prefix[87:80], v6_prefix[95:88],
+                         d_ttl, d_proto, d_inner_len[7:0], d_inner_len[15:8],
+                         d_flow[7:0], d_flow[15:8], d_tos[3:0], d_flow[19:16],
+                         4'h6, d_tos[7:4]};
+
+  // Descriptor forwarded with the length of the grown frame
+  wire [15:0] desc_len = d_len + d_grow;
+  wire [511:0] desc_out = {d[511:160], desc_len[7:0], desc_len[15:8], d[143:0]};
+
+  //----------------------------------------------------------------------------
+  // Checksum operations on the first beat of the frame
+  //----------------------------------------------------------------------------
+  wire ip4_ok = ops[CSUM_IP4] && {d[103:96], d[111:104]} == 16'h0800 &&
+                d[119:112] == 8'h45;
+
+  reg [19:0] ip4_sum;
+  reg [16:0] ip4_fold;
+  reg [15:0] ip4_csum;
+  reg [19:0] l4_sum;
+  reg [16:0] l4_fold;
+  reg [15:0] l4_old_csum;
+  reg [15:0] l4_csum;
+  reg [15:0] l4_new_w;
+  reg [15:0] l4_old_w;
+  reg [15:0] l4_inv_w;
+  reg [5:0]  l4_b;
+  reg [511:0] d_fixed;
+  integer i;
+
+  always @(*) begin
+    // IPv4 header at bytes 14..33, checksum at 24..25
+    ip4_sum = 20'd0;
+    for (i = 0; i < 10; i = i + 1)
+      if (i != 5)
+        ip4_sum = ip4_sum + {d[8*(14+2*i) +: 8], d[8*(15+2*i) +: 8]};
+    ip4_fold = ip4_sum[15:0] + ip4_sum[19:16];
+    ip4_csum = ~(ip4_fold[15:0] + ip4_fold[16]);
+
+    // HC' = ~(~HC + ~m + m') over the 16-bit words of the rewritten field
+    l4_old_csum = {d[{l4_csum_off, 3'd0} +: 8], d[{l4_csum_off + 6'd1, 3'd0} +: 8]};
+    l4_sum = {4'd0, ~l4_old_csum};
+    for (i = 0; i < 4; i = i + 1) begin
+      // Wraps only for words past the field, which are not summed
+      l4_b     = l4_fld_off + 2*i;
+      l4_new_w = {d[{l4_b, 3'd0} +: 8], d[{l4_b + 6'd1, 3'd0} +: 8]};
+      l4_old_w = l4_old[63 - 16*i -: 16];
+      l4_inv_w = ~l4_old_w;
+      if (2*i < l4_fld_len)
+        l4_sum = l4_sum + l4_inv_w + l4_new_w;
+    end
+    l4_fold = l4_sum[15:0] + l4_sum[19:16];
+    l4_csum = ~(l4_fold[15:0] + l4_fold[16]);
+    if (ops[CSUM_L4_UDP] && l4_old_csum == 16'd0)
+      l4_csum = 16'd0;
+    else if (ops[CSUM_L4_UDP] && l4_csum == 16'd0)
+      l4_csum = 16'hFFFF;
+
+    d_fixed = d;
+    if (ip4_ok) begin
+      d_fixed[8*24 +: 8] = ip4_csum[15:8];
+      d_fixed[8*25 +: 8] = ip4_csum[7:0];
+    end
+    if (ops[CSUM_L4] && l4_ok) begin
+      d_fixed[{l4_csum_off, 3'd0} +: 8]        = l4_csum[15:8];
+      d_fixed[{l4_csum_off + 6'd1, 3'd0} +: 8] = l4_csum[7:0];
+    end
+  end
+
+  //----------------------------------------------------------------------------
+  // Output beat
+  //----------------------------------------------------------------------------
+  wire frame_beat = state == ST_FIRST || state == ST_BODY;
+
+  // The end of the last beat does not fit once shifted by the outer header
+  wire overflow = enc && (enc_v6 ? |s_axis_tkeep[63:24] : |s_axis_tkeep[63:44]);
+
+  wire [511:0] src_beat  = state == ST_FIRST ? d_fixed : d;
+  wire [511:0] shifted   = enc_v6 ? (src_beat << 320) | (carry >> 192)
+                                  : (src_beat << 160) | (carry >> 352);
+  wire [63:0]  shift_keep = enc_v6 ? (s_axis_tkeep << 40) | (carry_keep >> 24)
+                                   : (s_axis_tkeep << 20) | (carry_keep >> 44);
+
+  // New Ethernet header, outer header, then the frame from its byte 14
+  wire [111:0] new_eth = {enc_v6 ? 16'hDD86 : 16'h0008, d[47:0],
+                          gw_mac[7:0], gw_mac[15:8], gw_mac[23:16],
+                          gw_mac[31:24], gw_mac[39:32], gw_mac[47:40]};
+  wire [511:0] first_v4 = {src_beat[511-160:112], outer[159:0], new_eth};
+  wire [511:0] first_v6 = {src_beat[511-320:112], outer[319:0], new_eth};
+
+  always @(*) begin
+    m_axis_tdata = d;
+    m_axis_tkeep = s_axis_tkeep;
+    case (state)
+      ST_HEAD:
+        if (desc_here)
+          m_axis_tdata = desc_out;
+      ST_FIRST: begin
+        if (enc) begin
+          m_axis_tdata = enc_v6 ? first_v6 : first_v4;
+          m_axis_tkeep = enc_v6 ? (s_axis_tkeep << 40) | 64'hFFFFFFFFFF
+                                : (s_axis_tkeep << 20) | 64'hFFFFF;
+        end
+        else begin
+          m_axis_tdata = d_fixed;
+        end
+      end
+      ST_BODY:
+        if (enc) begin
+          m_axis_tdata = shifted;
+          m_axis_tkeep = shift_keep;
+        end
+      ST_TAIL: begin
+        m_axis_tdata = enc_v6 ? carry >> 192 : carry >> 352;
+        m_axis_tkeep = enc_v6 ? carry_keep >> 24 : carry_keep >> 44;
+      end
+    endcase
+  end
+
+  wire [15:0] grow = !enc ? 16'd0 : (enc_v6 ? 16'd40 : 16'd20);
+
+  assign m_axis_tvalid = s_axis_tvalid || state == ST_TAIL;
+  assign m_axis_tlast  = state == ST_TAIL || (s_axis_tlast && !(frame_beat && overflow));
+  assign m_axis_desc_ok = s_axis_desc_ok;
+  assign m_axis_tuser  = {s_axis_tuser[47:16], s_axis_tuser[15:0] + (state == ST_HEAD ? (desc_here ? d_grow : 16'd0) : grow)};
+  assign s_axis_tready = m_axis_tready && state != ST_TAIL;
+
+  wire in_hs  = s_axis_tvalid && s_axis_tready;
+  wire out_hs = m_axis_tvalid && m_axis_tready;
+
+  always @(posedge clk) begin
+    if (!rst_n) begin
+      state       <= ST_HEAD;
+      enc         <= 1'b0;
+      enc_v6      <= 1'b0;
+      ops         <= 8'd0;
+      l4_csum_off <= 6'd0;
+      l4_fld_off  <= 6'd0;
+      l4_fld_len  <= 4'd0;
+      l4_ok       <= 1'b0;
+      l4_old      <= 64'd0;
+      encap_pkts  <= 32'd0;
+      csum_pkts   <= 32'd0;
+    end
+    else begin
+      case (state)
+        ST_HEAD:
+          if (in_hs) begin
+            enc <= desc_here && d_enc;
+            ops <= desc_here ? d_ops : 8'd0;
+            if (desc_here) begin
+              enc_v6      <= d_enc_v6;
+              l4_csum_off <= d_l4_csum_off[5:0];
+              l4_fld_off  <= d_l4_fld_off[5:0];
+              l4_fld_len  <= d_l4_fld_len[3:0];
+              l4_ok       <= d_l4_ok;
+              l4_old      <= {d[199:192], d[207:200], d[215:208], d[223:216],
+                              d[231:224], d[239:232], d[247:240], d[255:248]};
+              outer       <= d_enc_v6 ? v6_hdr : {160'd0, v4_hdr};
+              if (d_enc)
+                encap_pkts <= encap_pkts + 1;
+              if (d_ops[CSUM_IP4] || (d_ops[CSUM_L4] && d_l4_ok))
+                csum_pkts <= csum_pkts + 1;
+            end
+            if (!s_axis_tlast)
+              state <= desc_here ? ST_FIRST : ST_BODY;
+          end
+        ST_FIRST, ST_BODY:
+          if (in_hs) begin
+            carry      <= src_beat;
+            carry_keep <= s_axis_tkeep;
+            if (s_axis_tlast)
+              state <= overflow ? ST_TAIL : ST_HEAD;
+            else
+              state <= ST_BODY;
+          end
+        ST_TAIL:
+          if (out_hs)
+            state <= ST_HEAD;
+      endcase
+    end
+  end
+
+  //----------------------------------------------------------------------------
+  // Registers
+  //----------------------------------------------------------------------------
+  always @(posedge clk) begin
+    if (!rst_n) begin
+      gw_mac    <= GW_MAC;
+      v6_prefix <= V6_SRC_PREFIX;
+    end
+    else if (wr_en) begin
+      case (wr_addr)
+        12'h008: gw_mac[47:16]    <= wr_data;
+        12'h00C: gw_mac[15:0]     <= wr_data[31:16];
+        12'h010: v6_prefix[95:64] <= wr_data;
+        12'h014: v6_prefix[63:32] <= wr_data;
+        12'h018: v6_prefix[31:0]  <= wr_data;
+        default: ;
+      endcase
+    end
+  end
+
+  always @(posedge clk) begin
+    case (rd_addr)
+      12'h000: rd_data <= encap_pkts;
+      12'h004: rd_data <= csum_pkts;
+      12'h008: rd_data <= gw_mac[47:16];
+      12'h00C: rd_data <= {gw_mac[15:0], 16'd0};
+      12'h010: rd_data <= v6_prefix[95:64];
+      12'h014: rd_data <= v6_prefix[63:32];
+      12'h018: rd_data <= v6_prefix[31:0];
+      default: rd_data <= 32'd0;
+    endcase
+  end
+
+endmodule
@@ -0,0 +1,246 @@
+//--------------------------------------------------------------------------------
+// NanoNIC event tap
+//
+// Copies a sample of the packets leaving the Nanotube pipeline to the host as
+// compact event records, without touching the traffic itself:
+//
+//   - the tap observes the stream in front of the egress decoder (snoop_*), so
+//     it sees every packet, whether it is delivered, hairpinned or dropped on
+//     its verdict. A packet is eligible when its descriptor carries an event
+//     code (descriptor byte 6, see Custom_applications/common/nanonic_desc.h),
+//     or when it has a descriptor at all and the "sample all" bit is set.
+//     A frame with snoop_desc_ok low entered the pipeline with the descriptor
+//     magic already in place and is taken as one without a descriptor.
+//   - one eligible packet in PERIOD becomes a record: its descriptor beat with
+//     NANONIC_F_SAMPLE set in the flags, followed by the first beat of the
+//     frame (the first 64 bytes, i.e. the truncated headers). Records are
+//     queued in a FIFO of FIFO_BEATS beats. When the FIFO has no room for a
+//     full record the record is dropped and counted; the tap never
+//     back-pressures the pipeline.
+//   - records are merged into the host stream (s_axis to m_axis) at the lowest
+//     priority: a record only starts at a packet boundary of the host stream
+//     and when no host packet is waiting. Their tuser source field is set to
+//     EVENT_SRC so the shell, or the host, can steer them to their own queue.
+//
+// Registers (offsets inside the block window):
+//   0x00 control: bit 0 enable (default 1), bit 1 sample every packet with a
+//        descriptor, not only the ones with an event code
+//   0x04 sampling period N, one record every N eligible packets (0 and 1 both
+//        record every eligible packet)
+//   0x08 eligible packets seen    0x0C records queued
+//   0x10 records dropped because the FIFO was full
+//--------------------------------------------------------------------------------
+`timescale 1 ps / 1 ps
+
+module nanonic_event_tap #(
+    parameter         ENABLE     = 0,
+    parameter         FIFO_BEATS = 32,
+    parameter [31:0]  PERIOD     = 32'd1,
+    parameter [15:0]  EVENT_SRC  = 16'hEE00
+  ) (
+    input              clk,
+    input              rst_n,
+
+    input              snoop_tvalid,
+    input              snoop_tready,
+    input      [511:0] snoop_tdata,
+    input      [63:0]  snoop_tkeep,
+    input              snoop_tlast,
+    input              snoop_desc_ok,
+
+    input              s_axis_tvalid,
+    input      [511:0] s_axis_tdata,
+    input      [63:0]  s_axis_tkeep,
+    input              s_axis_tlast,
+    input      [47:0]  s_axis_tuser,
+    output             s_axis_tready,
+
+    output             m_axis_tvalid,
+    output     [511:0] m_axis_tdata,
+    output     [63:0]  m_axis_tkeep,
+    output             m_axis_tlast,
+    output     [47:0]  m_axis_tuser,
+    input              m_axis_tready,
+
+    input              wr_en,
+    input      [11:0]  wr_addr,
+    input      [31:0]  wr_data,
+    input      [11:0]  rd_addr,
+    output reg [31:0]  rd_data
+  );
+
+  localparam PTR_W = $clog2(FIFO_BEATS);
+
+  generate
+    if (!ENABLE) begin : g_bypass
+      assign m_axis_tvalid = s_axis_tvalid;
+      assign m_axis_tdata  = s_axis_tdata;
+      assign m_axis_tkeep  = s_axis_tkeep;
+      assign m_axis_tlast  = s_axis_tlast;
+      assign m_axis_tuser  = s_axis_tuser;
+      assign s_axis_tready = m_axis_tready;
+
+      always @(posedge clk)
+        rd_data <= 32'd0;
+    end
+    else begin : g_tap
+
+      reg         ctrl_en;
+      reg         ctrl_all;
+      reg  [31:0] period;
+      reg  [31:0] sample_cnt;
+      reg  [31:0] seen_cnt;
+      reg  [31:0] rec_cnt;
+      reg  [31:0] drop_cnt;
+
+      //------------------------------------------------------------------------
+      // Sampler on the snooped stream
+      //------------------------------------------------------------------------
+      wire [511:0] d = snoop_tdata;
+      wire snoop_hs = snoop_tvalid && snoop_tready;
+
+      reg  snoop_in_pkt;
+      reg  rec_hdr;        // next snooped beat is the header beat of a record
+
+      wire magic    = (d[7:0] == 8'h4E) && (d[15:8] == 8'h54) && (d[23:16] == 8'd1) &&
+                      snoop_desc_ok;
+      wire has_desc = !snoop_in_pkt && magic;
+      wire eligible = ctrl_en && has_desc && (d[55:48] != 8'd0 || ctrl_all);
+      wire pick     = sample_cnt == 32'd0;
+
+      // FIFO entries: data, keep, last, frame size
+      reg  [511:0] fifo_data [0:FIFO_BEATS-1];
+      reg  [63:0]  fifo_keep [0:FIFO_BEATS-1];
+      reg          fifo_last [0:FIFO_BEATS-1];
+      reg  [15:0]  fifo_size [0:FIFO_BEATS-1];
+      reg  [PTR_W:0] wr_ptr;
+      reg  [PTR_W:0] rd_ptr;
+
+      wire [PTR_W:0] fill = wr_ptr - rd_ptr;
+      wire room = fill <= FIFO_BEATS - 2;
+      wire fifo_empty = wr_ptr == rd_ptr;
+
+      // Descriptor frame length, the record holds at most one beat of it
+      wire [15:0] d_len   = {d[151:144], d[159:152]};
+      wire [15:0] rec_len = 16'd64 + (d_len > 16'd64 ? 16'd64 : d_len);
+      reg  [15:0] rec_len_r;
+
+      wire take_desc = eligible && pick && room && snoop_hs;
+      wire take_hdr  = rec_hdr && snoop_hs;
+
+      always @(posedge clk) begin
+        if (!rst_n) begin
+          snoop_in_pkt <= 1'b0;
+          rec_hdr      <= 1'b0;
+          wr_ptr       <= 0;
+          sample_cnt   <= 32'd0;
+          seen_cnt     <= 32'd0;
+          rec_cnt      <= 32'd0;
+          drop_cnt     <= 32'd0;
+          rec_len_r    <= 16'd0;
+        end
+        else begin
+          if (snoop_hs)
+            snoop_in_pkt <= ~snoop_tlast;
+
+          if (eligible && snoop_hs) begin
+            seen_cnt   <= seen_cnt + 1;
+            sample_cnt <= pick ? (period > 32'd1 ? period - 1 : 32'd0) : sample_cnt - 1;
+            if (pick && !room)
+              drop_cnt <= drop_cnt + 1;
+          end
+
+          if (take_desc) begin
+            fifo_data[wr_ptr[PTR_W-1:0]] <= {d[511:40], d[39:32] | 8'h80, d[31:0]};
+            fifo_keep[wr_ptr[PTR_W-1:0]] <= 64'hFFFFFFFFFFFFFFFF;
+            fifo_last[wr_ptr[PTR_W-1:0]] <= snoop_tlast;
+            fifo_size[wr_ptr[PTR_W-1:0]] <= snoop_tlast ? 16'd64 : rec_len;
+            wr_ptr    <= wr_ptr + 1;
+            rec_cnt   <= rec_cnt + 1;
+            rec_hdr   <= ~snoop_tlast;
+            rec_len_r <= rec_len;
+          end
+          else if (take_hdr) begin
+            // The slot was reserved with the descriptor beat
+            fifo_data[wr_ptr[PTR_W-1:0]] <= snoop_tdata;
+            fifo_keep[wr_ptr[PTR_W-1:0]] <= snoop_tkeep;
+            fifo_last[wr_ptr[PTR_W-1:0]] <= 1'b1;
+            fifo_size[wr_ptr[PTR_W-1:0]] <= rec_len_r;
+            wr_ptr  <= wr_ptr + 1;
+            rec_hdr <= 1'b0;
+          end
+        end
+      end
+
+      //------------------------------------------------------------------------
+      // Low-priority merge into the host stream
+      //------------------------------------------------------------------------
+      reg host_in_pkt;
+      reg ev_in_pkt;
+
+      // A record is only complete in the FIFO once its last beat is written.
+      // Once a record is offered it stays selected until its last beat, so
+      // the output never changes under a valid beat.
+      wire ev_ready_rec = !fifo_empty && !(rec_hdr && fill == 1);
+      wire ev_sel = ev_in_pkt || (!host_in_pkt && !s_axis_tvalid && ev_ready_rec);
+      wire ev_hs  = ev_sel && m_axis_tready;
+
+      wire [PTR_W-1:0] rd_idx = rd_ptr[PTR_W-1:0];
+
+      assign m_axis_tvalid = ev_sel ? 1'b1 : s_axis_tvalid;
+      assign m_axis_tdata  = ev_sel ? fifo_data[rd_idx] : s_axis_tdata;
+      assign m_axis_tkeep  = ev_sel ? fifo_keep[rd_idx] : s_axis_tkeep;
+      assign m_axis_tlast  = ev_sel ? fifo_last[rd_idx] : s_axis_tlast;
+      assign m_axis_tuser  = ev_sel ? {16'd0, EVENT_SRC, fifo_size[rd_idx]} : s_axis_tuser;
+      assign s_axis_tready = !ev_sel && m_axis_tready;
+
+      always @(posedge clk) begin
+        if (!rst_n) begin
+          rd_ptr      <= 0;
+          host_in_pkt <= 1'b0;
+          ev_in_pkt   <= 1'b0;
+        end
+        else if (ev_sel) begin
+          ev_in_pkt <= !(ev_hs && fifo_last[rd_idx]);
+          if (ev_hs)
+            rd_ptr <= rd_ptr + 1;
+        end
+        else if (s_axis_tvalid && m_axis_tready)
+          host_in_pkt <= ~s_axis_tlast;
+      end
+
+      //------------------------------------------------------------------------
+      // Registers
+      //------------------------------------------------------------------------
+      always @(posedge clk) begin
+        if (!rst_n) begin
+          ctrl_en  <= 1'b1;
+          ctrl_all <= 1'b0;
+          period   <= PERIOD;
+        end
+        else if (wr_en) begin
+          case (wr_addr)
+            12'h000: begin
+              ctrl_en  <= wr_data[0];
+              ctrl_all <= wr_data[1];
+            end
+            12'h004: period <= wr_data;
+            default: ;
+          endcase
+        end
+      end
+
+      always @(posedge clk) begin
+        case (rd_addr)
+          12'h000: rd_data <= {30'd0, ctrl_all, ctrl_en};
+          12'h004: rd_data <= period;
+          12'h008: rd_data <= seen_cnt;
+          12'h00C: rd_data <= rec_cnt;
+          12'h010: rd_data <= drop_cnt;
+          default: rd_data <= 32'd0;
+        endcase
+      end
+    end
+  endgenerate
+
+endmodule
@@ -0,0 +1,543 @@
+//--------------------------------------------------------------------------------
+// NanoNIC fast pipeline
+//
+// Runs nanonic_pipeline_top in its own clock domain, faster than the 250 MHz
+// AXIS clock of the shell, so that one pipeline can carry more than the ~128
+// Gb/s of a 512-bit bus at 250 MHz (200 Gb/s, or both CMAC ports at 100G).
+//
+//   ap_clk  : clock of the shell side, 250 MHz in the OpenNIC shell
+//   ppl_clk : clock of the pipeline, e.g. 450 MHz (230 Gb/s on 512 bits); the
+//             Nanotube stages must close timing at this clock
+//
+// The shell side has NUM_PORTS ports of BUS_W bits (512 or 1024), packed in
+// [i*BUS_W +: BUS_W]. Every port crosses to ppl_clk through an asynchronous
+// FIFO; 1024-bit beats are then split into two 512-bit beats for the Nanotube
+// stages, which keep the 512-bit open_nic bus. With two ports a packet arbiter
+// merges them in front of the pipeline and demultiplexers send the packets of
+// port1 and of the hairpin back to their port, keyed on the tuser field at
+// KEY_LSB as in the shared layout of scripts/gen_p2p_pipeline.py.
+//
+//   port0 -> async FIFO -> (downsize) -> (arb) -> nanonic_pipeline_top
+//   nanonic_pipeline_top port1/hairpin -> (demux) -> (upsize) -> async FIFO
+//
+// The AXI-Lite slave and early_drop_count belong to the ppl_clk domain: put the
+// slave behind an AXI clock converter. The cycle counter of the top and the
+// latency histogram count ppl_clk cycles, set CLK_PERIOD_PS accordingly. Both
+// resets must be asserted together.
+//--------------------------------------------------------------------------------
+`timescale 1 ps / 1 ps
+
+module nanonic_fast_pipeline #(
+    parameter                    BUS_W         = 1024,
+    parameter                    NUM_PORTS     = 1,
+    parameter                    FIFO_DEPTH    = 16,
+    parameter                    KEY_LSB       = 16,
+    parameter [NUM_PORTS*16-1:0] PORT_IDS      = 16'h0040,
+    parameter                    EARLY_DROP_EN = 0,
+    parameter                    META_EN       = 0,
+    parameter                    META_STRIP    = 0,
+    parameter                    HAIRPIN_EN    = 0,
+    parameter                    LATENCY_EN    = 0,
+    parameter                    CLK_PERIOD_PS = 2222,
+    parameter                    ENCAP_EN      = 0,
+    parameter                    EVENTS_EN     = 0,
+    parameter                    FLIGHT_EN     = 0
+  ) (
+    input                          ap_clk,
+    input                          ap_rst_n,
+    input                          ppl_clk,
+    input                          ppl_rst_n,
+
+    input  [NUM_PORTS*BUS_W-1:0]   port0_tdata,
+    input  [NUM_PORTS*BUS_W/8-1:0] port0_tkeep,
+    input  [NUM_PORTS-1:0]         port0_tlast,
+    output [NUM_PORTS-1:0]         port0_tready,
+    input  [NUM_PORTS*48-1:0]      port0_tuser,
+    input  [NUM_PORTS-1:0]         port0_tvalid,
+
+    output [NUM_PORTS*BUS_W-1:0]   port1_tdata,
+    output [NUM_PORTS*BUS_W/8-1:0] port1_tkeep,
+    output [NUM_PORTS-1:0]         port1_tlast,
+    input  [NUM_PORTS-1:0]         port1_tready,
+    output [NUM_PORTS*48-1:0]      port1_tuser,
+    output [NUM_PORTS-1:0]         port1_tvalid,
+
+    output [NUM_PORTS*BUS_W-1:0]   hairpin_tdata,
+    output [NUM_PORTS*BUS_W/8-1:0] hairpin_tkeep,
+    output [NUM_PORTS-1:0]         hairpin_tlast,
+    input  [NUM_PORTS-1:0]         hairpin_tready,
+    output [NUM_PORTS*48-1:0]      hairpin_tuser,
+    output [NUM_PORTS-1:0]         hairpin_tvalid,
+
+    input                          s_axil_awvalid,
+    input  [31:0]                  s_axil_awaddr,
+    output                         s_axil_awready,
+    input                          s_axil_wvalid,
+    input  [31:0]                  s_axil_wdata,
+    output                         s_axil_wready,
+    output                         s_axil_bvalid,
+    output [1:0]                   s_axil_bresp,
+    input                          s_axil_bready,
+    input                          s_axil_arvalid,
+    input  [31:0]                  s_axil_araddr,
+    output                         s_axil_arready,
+    output                         s_axil_rvalid,
+    output [31:0]                  s_axil_rdata,
+    output [1:0]                   s_axil_rresp,
+    input                          s_axil_rready,
+
+    output [31:0]                  early_drop_count
+  );
+
+  localparam KEEP_W = BUS_W / 8;
+  localparam WIDE   = BUS_W == 1024;
+
+  //----------------------------------------------------------------------------
+  // Ingress: shell ports to the 512-bit bus of the pipeline, at ppl_clk
+  //----------------------------------------------------------------------------
+  wire [NUM_PORTS-1:0]     in_tvalid;
+  wire [NUM_PORTS*512-1:0] in_tdata;
+  wire [NUM_PORTS*64-1:0]  in_tkeep;
+  wire [NUM_PORTS-1:0]     in_tlast;
+  wire [NUM_PORTS*48-1:0]  in_tuser;
+  wire [NUM_PORTS-1:0]     in_tready;
+
+  genvar g;
+  generate
+    for (g = 0; g < NUM_PORTS; g = g + 1) begin : g_in
+      wire              cdc_tvalid;
+      wire [BUS_W-1:0]  cdc_tdata;
+      wire [KEEP_W-1:0] cdc_tkeep;
+      wire              cdc_tlast;
+      wire [47:0]       cdc_tuser;
+      wire              cdc_tready;
+
+      nanonic_axis_async_fifo #(
+        .DATA_W (BUS_W),
+        .USER_W (48),
+        .DEPTH  (FIFO_DEPTH)
+      ) cdc_inst (
+        .s_clk         (ap_clk),
+        .s_rst_n       (ap_rst_n),
+        .s_axis_tvalid (port0_tvalid[g]),
+        .s_axis_tdata  (port0_tdata[g*BUS_W +: BUS_W]),
+        .s_axis_tkeep  (port0_tkeep[g*KEEP_W +: KEEP_W]),
+        .s_axis_tlast  (port0_tlast[g]),
+        .s_axis_tuser  (port0_tuser[g*48 +: 48]),
+        .s_axis_tready (port0_tready[g]),
+
+        .m_clk         (ppl_clk),
+        .m_rst_n       (ppl_rst_n),
+        .m_axis_tvalid (cdc_tvalid),
+        .m_axis_tdata  (cdc_tdata),
+        .m_axis_tkeep  (cdc_tkeep),
+        .m_axis_tlast  (cdc_tlast),
+        .m_axis_tuser  (cdc_tuser),
+        .m_axis_tready (cdc_tready)
+      );
+
+      if (WIDE) begin : g_down
+        nanonic_axis_downsize #(
+          .USER_W (48)
+        ) down_inst (
+          .clk           (ppl_clk),
+          .rst_n         (ppl_rst_n),
+
+          .s_axis_tvalid (cdc_tvalid),
+          .s_axis_tdata  (cdc_tdata),
+          .s_axis_tkeep  (cdc_tkeep),
+          .s_axis_tlast  (cdc_tlast),
+          .s_axis_tuser  (cdc_tuser),
+          .s_axis_tready (cdc_tready),
+
+          .m_axis_tvalid (in_tvalid[g]),
+          .m_axis_tdata  (in_tdata[g*512 +: 512]),
+          .m_axis_tkeep  (in_tkeep[g*64 +: 64]),
+          .m_axis_tlast  (in_tlast[g]),
+          .m_axis_tuser  (in_tuser[g*48 +: 48]),
+          .m_axis_tready (in_tready[g])
+        );
+      end
+      else begin : g_narrow
+        assign in_tvalid[g]           = cdc_tvalid;
+        assign in_tdata[g*512 +: 512] = cdc_tdata;
+        assign in_tkeep[g*64 +: 64]   = cdc_tkeep;
+        assign in_tlast[g]            = cdc_tlast;
+        assign in_tuser[g*48 +: 48]   = cdc_tuser;
+        assign cdc_tready             = in_tready[g];
+      end
+    end
+  endgenerate
+
+  wire         arb_tvalid;
+  wire [511:0] arb_tdata;
+  wire [63:0]  arb_tkeep;
+  wire         arb_tlast;
+  wire [47:0]  arb_tuser;
+  wire         arb_tready;
+
+  generate
+    if (NUM_PORTS > 1) begin : g_arb
+      nanonic_axis_arb #(
+        .NUM_IN (NUM_PORTS),
+        .USER_W (48)
+      ) arb_inst (
+        .clk           (ppl_clk),
+        .rst_n         (ppl_rst_n),
+
+        .s_axis_tvalid (in_tvalid),
+        .s_axis_tdata  (in_tdata),
+        .s_axis_tkeep  (in_tkeep),
+        .s_axis_tlast  (in_tlast),
+        .s_axis_tuser  (in_tuser),
+        .s_axis_tready (in_tready),
+
+        .m_axis_tvalid (arb_tvalid),
+        .m_axis_tdata  (arb_tdata),
+        .m_axis_tkeep  (arb_tkeep),
+        .m_axis_tlast  (arb_tlast),
+        .m_axis_tuser  (arb_tuser),
+        .m_axis_tready (arb_tready)
+      );
+    end
+    else begin : g_no_arb
+      assign arb_tvalid = in_tvalid;
+      assign arb_tdata  = in_tdata;
+      assign arb_tkeep  = in_tkeep;
+      assign arb_tlast  = in_tlast;
+      assign arb_tuser  = in_tuser;
+      assign in_tready  = arb_tready;
+    end
+  endgenerate
+
+  // The combinational paths of the arbiter and of the downsizer do not close
+  // timing at the pipeline clock on their own
+  wire         ppl_in_tvalid;
+  wire [511:0] ppl_in_tdata;
+  wire [63:0]  ppl_in_tkeep;
+  wire         ppl_in_tlast;
+  wire [47:0]  ppl_in_tuser;
+  wire         ppl_in_tready;
+
+  nanonic_axis_reg #(
+    .USER_W (48)
+  ) in_rs_inst (
+    .clk           (ppl_clk),
+    .rst_n         (ppl_rst_n),
+
+    .s_axis_tvalid (arb_tvalid),
+    .s_axis_tdata  (arb_tdata),
+    .s_axis_tkeep  (arb_tkeep),
+    .s_axis_tlast  (arb_tlast),
+    .s_axis_tuser  (arb_tuser),
+    .s_axis_tready (arb_tready),
+
+    .m_axis_tvalid (ppl_in_tvalid),
+    .m_axis_tdata  (ppl_in_tdata),
+    .m_axis_tkeep  (ppl_in_tkeep),
+    .m_axis_tlast  (ppl_in_tlast),
+    .m_axis_tuser  (ppl_in_tuser),
+    .m_axis_tready (ppl_in_tready)
+  );
+
+  //----------------------------------------------------------------------------
+  // Pipeline
+  //----------------------------------------------------------------------------
+  wire         ppl_out_tvalid;
+  wire [511:0] ppl_out_tdata;
+  wire [63:0]  ppl_out_tkeep;
+  wire         ppl_out_tlast;
+  wire [47:0]  ppl_out_tuser;
+  wire         ppl_out_tready;
+
+  wire         ppl_hp_tvalid;
+  wire [511:0] ppl_hp_tdata;
+  wire [63:0]  ppl_hp_tkeep;
+  wire         ppl_hp_tlast;
+  wire [47:0]  ppl_hp_tuser;
+  wire         ppl_hp_tready;
+
+  nanonic_pipeline_top #(
+    .EARLY_DROP_EN (EARLY_DROP_EN),
+    .META_EN       (META_EN),
+    .META_STRIP    (META_STRIP),
+    .HAIRPIN_EN    (HAIRPIN_EN),
+    .LATENCY_EN    (LATENCY_EN),
+    .CLK_PERIOD_PS (CLK_PERIOD_PS),
+    .ENCAP_EN      (ENCAP_EN),
+    .EVENTS_EN     (EVENTS_EN),
+    .FLIGHT_EN     (FLIGHT_EN)
+  ) top_inst (
+    .ap_clk_0         (ppl_clk),
+    .ap_rst_n_0       (ppl_rst_n),
+
+    .port0_0_tdata    (ppl_in_tdata),
+    .port0_0_tkeep    (ppl_in_tkeep),
+    .port0_0_tlast    (ppl_in_tlast),
+    .port0_0_tready   (ppl_in_tready),
+    .port0_0_tuser    (ppl_in_tuser),
+    .port0_0_tvalid   (ppl_in_tvalid),
+
+    .port1_0_tdata    (ppl_out_tdata),
+    .port1_0_tkeep    (ppl_out_tkeep),
+    .port1_0_tlast    (ppl_out_tlast),
+    .port1_0_tready   (ppl_out_tready),
+    .port1_0_tuser    (ppl_out_tuser),
+    .port1_0_tvalid   (ppl_out_tvalid),
+
+    .hairpin_tdata    (ppl_hp_tdata),
+    .hairpin_tkeep    (ppl_hp_tkeep),
+    .hairpin_tlast    (ppl_hp_tlast),
+    .hairpin_tready   (ppl_hp_tready),
+    .hairpin_tuser    (ppl_hp_tuser),
+    .hairpin_tvalid   (ppl_hp_tvalid),
+
+    .s_axil_awvalid   (s_axil_awvalid),
+    .s_axil_awaddr    (s_axil_awaddr),
+    .s_axil_awready   (s_axil_awready),
+    .s_axil_wvalid    (s_axil_wvalid),
+    .s_axil_wdata     (s_axil_wdata),
+    .s_axil_wready    (s_axil_wready),
+    .s_axil_bvalid    (s_axil_bvalid),
+    .s_axil_bresp     (s_axil_bresp),
+    .s_axil_bready    (s_axil_bready),
+    .s_axil_arvalid   (s_axil_arvalid),
+    .s_axil_araddr    (s_axil_araddr),
+    .s_axil_arready   (s_axil_arready),
+    .s_axil_rvalid    (s_axil_rvalid),
+    .s_axil_rdata     (s_axil_rdata),
+    .s_axil_rresp     (s_axil_rresp),
+    .s_axil_rready    (s_axil_rready),
+
+    .early_drop_count (early_drop_count)
+  );
+
+  //----------------------------------------------------------------------------
+  // Egress: port1 and hairpin back to the shell ports, at ap_clk
+  //----------------------------------------------------------------------------
+  nanonic_fast_egress #(
+    .BUS_W      (BUS_W),
+    .NUM_PORTS  (NUM_PORTS),
+    .FIFO_DEPTH (FIFO_DEPTH),
+    .KEY_LSB    (KEY_LSB),
+    .PORT_IDS   (PORT_IDS)
+  ) port1_out_inst (
+    .ap_clk        (ap_clk),
+    .ap_rst_n      (ap_rst_n),
+    .ppl_clk       (ppl_clk),
+    .ppl_rst_n     (ppl_rst_n),
+
+    .s_axis_tvalid (ppl_out_tvalid),
+    .s_axis_tdata  (ppl_out_tdata),
+    .s_axis_tkeep  (ppl_out_tkeep),
+    .s_axis_tlast  (ppl_out_tlast),
+    .s_axis_tuser  (ppl_out_tuser),
+    .s_axis_tready (ppl_out_tready),
+
+    .m_axis_tvalid (port1_tvalid),
+    .m_axis_tdata  (port1_tdata),
+    .m_axis_tkeep  (port1_tkeep),
+    .m_axis_tlast  (port1_tlast),
+    .m_axis_tuser  (port1_tuser),
+    .m_axis_tready (port1_tready)
+  );
+
+  generate
+    if (HAIRPIN_EN) begin : g_hairpin
+      // Hairpinned packets leave on the port they arrived from
+      nanonic_fast_egress #(
+        .BUS_W      (BUS_W),
+        .NUM_PORTS  (NUM_PORTS),
+        .FIFO_DEPTH (FIFO_DEPTH),
+        .KEY_LSB    (16),
+        .PORT_IDS   (PORT_IDS)
+      ) hairpin_out_inst (
+        .ap_clk        (ap_clk),
+        .ap_rst_n      (ap_rst_n),
+        .ppl_clk       (ppl_clk),
+        .ppl_rst_n     (ppl_rst_n),
+
+        .s_axis_tvalid (ppl_hp_tvalid),
+        .s_axis_tdata  (ppl_hp_tdata),
+        .s_axis_tkeep  (ppl_hp_tkeep),
+        .s_axis_tlast  (ppl_hp_tlast),
+        .s_axis_tuser  (ppl_hp_tuser),
+        .s_axis_tready (ppl_hp_tready),
+
+        .m_axis_tvalid (hairpin_tvalid),
+        .m_axis_tdata  (hairpin_tdata),
+        .m_axis_tkeep  (hairpin_tkeep),
+        .m_axis_tlast  (hairpin_tlast),
+        .m_axis_tuser  (hairpin_tuser),
+        .m_axis_tready (hairpin_tready)
+      );
+    end
+    else begin : g_no_hairpin
+      assign ppl_hp_tready  = 1'b1;
+      assign hairpin_tvalid = {NUM_PORTS{1'b0}};
+      assign hairpin_tdata  = {NUM_PORTS*BUS_W{1'b0}};
+      assign hairpin_tkeep  = {NUM_PORTS*KEEP_W{1'b0}};
+      assign hairpin_tlast  = {NUM_PORTS{1'b0}};
+      assign hairpin_tuser  = {NUM_PORTS*48{1'b0}};
+    end
+  endgenerate
+
+endmodule
+
+// One output of the pipeline back to the shell: demultiplexer on the port of
+// the packet, upsizer to the bus of the shell and asynchronous FIFO to ap_clk
+module nanonic_fast_egress #(
+    parameter                    BUS_W      = 1024,
+    parameter                    NUM_PORTS  = 1,
+    parameter                    FIFO_DEPTH = 16,
+    parameter                    KEY_LSB    = 16,
+    parameter [NUM_PORTS*16-1:0] PORT_IDS   = 16'h0040
+  ) (
+    input                          ap_clk,
+    input                          ap_rst_n,
+    input                          ppl_clk,
+    input                          ppl_rst_n,
+
+    input                          s_axis_tvalid,
+    input  [511:0]                 s_axis_tdata,
+    input  [63:0]                  s_axis_tkeep,
+    input                          s_axis_tlast,
+    input  [47:0]                  s_axis_tuser,
+    output                         s_axis_tready,
+
+    output [NUM_PORTS-1:0]         m_axis_tvalid,
+    output [NUM_PORTS*BUS_W-1:0]   m_axis_tdata,
+    output [NUM_PORTS*BUS_W/8-1:0] m_axis_tkeep,
+    output [NUM_PORTS-1:0]         m_axis_tlast,
+    output [NUM_PORTS*48-1:0]      m_axis_tuser,
+    input  [NUM_PORTS-1:0]         m_axis_tready
+  );
+
+  localparam KEEP_W = BUS_W / 8;
+  localparam WIDE   = BUS_W == 1024;
+
+  wire [NUM_PORTS-1:0]     dmx_tvalid;
+  wire [NUM_PORTS*512-1:0] dmx_tdata;
+  wire [NUM_PORTS*64-1:0]  dmx_tkeep;
+  wire [NUM_PORTS-1:0]     dmx_tlast;
+  wire [NUM_PORTS*48-1:0]  dmx_tuser;
+  wire [NUM_PORTS-1:0]     dmx_tready;
+
+  generate
+    if (NUM_PORTS > 1) begin : g_demux
+      nanonic_axis_demux #(
+        .NUM_OUT  (NUM_PORTS),
+        .USER_W   (48),
+        .KEY_LSB  (KEY_LSB),
+        .PORT_IDS (PORT_IDS)
+      ) demux_inst (
+        .clk           (ppl_clk),
+        .rst_n         (ppl_rst_n),
+
+        .s_axis_tvalid (s_axis_tvalid),
+        .s_axis_tdata  (s_axis_tdata),
+        .s_axis_tkeep  (s_axis_tkeep),
+        .s_axis_tlast  (s_axis_tlast),
+        .s_axis_tuser  (s_axis_tuser),
+        .s_axis_tready (s_axis_tready),
+
+        .m_axis_tvalid (dmx_tvalid),
+        .m_axis_tdata  (dmx_tdata),
+        .m_axis_tkeep  (dmx_tkeep),
+        .m_axis_tlast  (dmx_tlast),
+        .m_axis_tuser  (dmx_tuser),
+        .m_axis_tready (dmx_tready)
+      );
+    end
+    else begin : g_no_demux
+      assign dmx_tvalid    = s_axis_tvalid;
+      assign dmx_tdata     = s_axis_tdata;
+      assign dmx_tkeep     = s_axis_tkeep;
+      assign dmx_tlast     = s_axis_tlast;
+      assign dmx_tuser     = s_axis_tuser;
+      assign s_axis_tready = dmx_tready;
+    end
+  endgenerate
+
+  genvar g;
+  generate
+    for (g = 0; g < NUM_PORTS; g = g + 1) begin : g_out
+      wire              cdc_tvalid;
+      wire [BUS_W-1:0]  cdc_tdata;
+      wire [KEEP_W-1:0] cdc_tkeep;
+      wire              cdc_tlast;
+      wire [47:0]       cdc_tuser;
+      wire              cdc_tready;
+
+      if (WIDE) begin : g_up
+        nanonic_axis_upsize #(
+          .USER_W (48)
+        ) up_inst (
+          .clk           (ppl_clk),
+          .rst_n         (ppl_rst_n),
+
+          .s_axis_tvalid (dmx_tvalid[g]),
+          .s_axis_tdata  (dmx_tdata[g*512 +: 512]),
+          .s_axis_tkeep  (dmx_tkeep[g*64 +: 64]),
+          .s_axis_tlast  (dmx_tlast[g]),
+          .s_axis_tuser  (dmx_tuser[g*48 +: 48]),
+          .s_axis_tready (dmx_tready[g]),
+
+          .m_axis_tvalid (cdc_tvalid),
+          .m_axis_tdata  (cdc_tdata),
+          .m_axis_tkeep  (cdc_tkeep),
+          .m_axis_tlast  (cdc_tlast),
+          .m_axis_tuser  (cdc_tuser),
+          .m_axis_tready (cdc_tready)
+        );
+      end
+      else begin : g_narrow
+        nanonic_axis_reg #(
+          .USER_W (48)
+        ) rs_inst (
+          .clk           (ppl_clk),
+          .rst_n         (ppl_rst_n),
+
+          .s_axis_tvalid (dmx_tvalid[g]),
+          .s_axis_tdata  (dmx_tdata[g*512 +: 512]),
+          .s_axis_tkeep  (dmx_tkeep[g*64 +: 64]),
+          .s_axis_tlast  (dmx_tlast[g]),
+          .s_axis_tuser  (dmx_tuser[g*48 +: 48]),
+          .s_axis_tready (dmx_tready[g]),
+
+          .m_axis_tvalid (cdc_tvalid),
+          .m_axis_tdata  (cdc_tdata),
+          .m_axis_tkeep  (cdc_tkeep),
+          .m_axis_tlast  (cdc_tlast),
+          .m_axis_tuser  (cdc_tuser),
+          .m_axis_tready (cdc_tready)
+        );
+      end
+
+      nanonic_axis_async_fifo #(
+        .DATA_W (BUS_W),
+        .USER_W (48),
+        .DEPTH  (FIFO_DEPTH)
+      ) cdc_inst (
+        .s_clk         (ppl_clk),
+        .s_rst_n       (ppl_rst_n),
+        .s_axis_tvalid (cdc_tvalid),
+        .s_axis_tdata  (cdc_tdata),
+        .s_axis_tkeep  (cdc_tkeep),
+        .s_axis_tlast  (cdc_tlast),
+        .s_axis_tuser  (cdc_tuser),
+        .s_axis_tready (cdc_tready),
+
+        .m_clk         (ap_clk),
+        .m_rst_n       (ap_rst_n),
+        .m_axis_tvalid (m_axis_tvalid[g]),
+        .m_axis_tdata  (m_axis_tdata[g*BUS_W +: BUS_W]),
+        .m_axis_tkeep  (m_axis_tkeep[g*KEEP_W +: KEEP_W]),
+        .m_axis_tlast  (m_axis_tlast[g]),
+        .m_axis_tuser  (m_axis_tuser[g*48 +: 48]),
+        .m_axis_tready (m_axis_tready[g])
+      );
+    end
+  endgenerate
+
+endmodule
@@ -0,0 +1,267 @@
+//--------------------------------------------------------------------------------
+// NanoNIC flight recorder
+//
+// Always-on ring of the last DEPTH packets seen in front of the egress decoder.
+// Every packet takes one entry, written in a single cycle on its header beat:
+//
+//   - the first HDR_BYTES bytes of the frame (the beat after the NanoNIC
+//     descriptor when the packet has one); the header is taken from a single
+//     beat, so HDR_BYTES is 4 to 64
+//   - the tuser of the packet (frame size, source and destination)
+//   - the verdict of the descriptor and a flag telling whether there was one
+//     (a frame with snoop_desc_ok low entered the pipeline with the
+//     descriptor magic already in place and is recorded as one without)
+//   - the value of the cycle counter on the first beat of the packet
+//
+// The recorder only observes the stream (snoop_*), so it has no effect on the
+// datapath throughput. It can be frozen by the host, or by a trigger on the
+// verdict and/or on a 32-bit pattern of the header; after a trigger POST more
+// packets are recorded before the ring freezes, so the packets that follow
+// the trigger are kept too. scripts/nanonic_flightrec.py dumps the ring to a
+// pcap.
+//
+// Registers (offsets inside the block window):
+//   0x00 control, write only: bit 0 trigger now, bit 1 re-arm (unfreeze and
+//        clear the trigger)
+//   0x04 status: bit 0 frozen, bit 1 triggered, bits 31:16 next write index
+//   0x08 trigger: bit 0 on verdict, bit 1 on pattern, bits 15:8 verdict
+//   0x0C packets recorded after the trigger before freezing
+//   0x10 pattern byte offset in the header (0 to 60)
+//   0x14 pattern value (network order)    0x18 pattern mask
+//   0x1C packets recorded (total)         0x20 depth   0x24 header bytes
+//   0x28 entry to read                    0x2C entry of the trigger
+//   0x100 + 4*i  header word i of the entry (bytes 4i..4i+3, first in bits 7:0)
+//   0x180 tuser bits 31:0   0x184 {verdict, flags, tuser bits 47:32}
+//   0x188 timestamp bits 31:0   0x18C timestamp bits 63:32
+//--------------------------------------------------------------------------------
+`timescale 1 ps / 1 ps
+
+module nanonic_flight_rec #(
+    parameter ENABLE    = 0,
+    parameter DEPTH     = 512,
+    parameter HDR_BYTES = 64,
+    parameter POST      = 16,
+    parameter RAM_STYLE = "block"
+  ) (
+    input              clk,
+    input              rst_n,
+
+    input              snoop_tvalid,
+    input              snoop_tready,
+    input      [511:0] snoop_tdata,
+    input              snoop_tlast,
+    input      [47:0]  snoop_tuser,
+    input              snoop_desc_ok,
+
+    input      [63:0]  now,
+
+    input              wr_en,
+    input      [11:0]  wr_addr,
+    input      [31:0]  wr_data,
+    input      [11:0]  rd_addr,
+    output reg [31:0]  rd_data
+  );
+
+  localparam HDR_W   = 8 * HDR_BYTES;
+  localparam ENTRY_W = HDR_W + 48 + 8 + 8 + 64;
+  localparam IDX_W   = $clog2(DEPTH);
+
+  // The header words are decoded from rd_addr[5:2] and come from one 64-byte
+  // beat; a larger HDR_BYTES would alias the words above 64
+  initial
+    if (HDR_BYTES < 4 || HDR_BYTES > 64) begin
+      $display("nanonic_flight_rec: HDR_BYTES = %0d, must be 4 to 64", HDR_BYTES);
+      $finish;
+    end
+
+  generate
+    if (!ENABLE) begin : g_off
+      always @(posedge clk)
+        rd_data <= 32'd0;
+    end
+    else begin : g_rec
+
+      (* ram_style = RAM_STYLE *) reg [ENTRY_W-1:0] mem [0:DEPTH-1];
+
+      reg  [IDX_W-1:0] wr_idx;
+      reg  [31:0]      rec_total;
+      reg              frozen;
+      reg              triggered;
+      reg  [31:0]      post_left;
+      reg  [IDX_W-1:0] trig_idx;
+
+      reg              trig_verdict_en;
+      reg              trig_pattern_en;
+      reg  [7:0]       trig_verdict;
+      reg  [31:0]      post;
+      reg  [5:0]       pat_off;
+      reg  [31:0]      pat_value;
+      reg  [31:0]      pat_mask;
+      reg  [IDX_W-1:0] rd_idx;
+
+      //------------------------------------------------------------------------
+      // Entry capture
+      //------------------------------------------------------------------------
+      wire [511:0] d = snoop_tdata;
+      wire snoop_hs = snoop_tvalid && snoop_tready;
+
+      reg         in_pkt;
+      reg         wait_hdr;
+      reg  [7:0]  verdict_r;
+      reg  [63:0] ts_r;
+      reg  [47:0] tuser_r;
+
+      wire magic = (d[7:0] == 8'h4E) && (d[15:8] == 8'h54) && (d[23:16] == 8'd1) &&
+                   snoop_desc_ok;
+      wire first = snoop_hs && !in_pkt;
+
+      // One entry per packet: on the beat after the descriptor, on the first
+      // beat without one, or on the descriptor itself when nothing follows
+      wire        rec_now     = (first && (!magic || snoop_tlast)) || (snoop_hs && wait_hdr);
+      wire        rec_desc    = wait_hdr || (first && magic);
+      wire [7:0]  rec_verdict = wait_hdr ? verdict_r : (magic ? d[31:24] : 8'd0);
+      wire [63:0] rec_ts      = wait_hdr ? ts_r : now;
+      wire [47:0] rec_tuser   = wait_hdr ? tuser_r : snoop_tuser;
+      wire [HDR_W-1:0] rec_hdr = (first && magic) ? {HDR_W{1'b0}} : d[HDR_W-1:0];
+
+      wire [31:0] pat_word = {d[8*pat_off +: 8], d[8*(pat_off+1) +: 8],
+                              d[8*(pat_off+2) +: 8], d[8*(pat_off+3) +: 8]};
+      wire hit_verdict = trig_verdict_en && rec_desc && rec_verdict == trig_verdict;
+      wire hit_pattern = trig_pattern_en && !(first && magic) &&
+                         ((pat_word ^ pat_value) & pat_mask) == 32'd0;
+
+      // Register writes to the control word take the cycle, the packet is lost
+      wire manual = wr_en && wr_addr == 12'h000 && wr_data[0];
+      wire rearm  = wr_en && wr_addr == 12'h000 && wr_data[1];
+      wire write  = rec_now && !frozen && !manual && !rearm;
+
+      always @(posedge clk) begin
+        if (write)
+          mem[wr_idx] <= {rec_ts, 7'd0, rec_desc, rec_verdict, rec_tuser, rec_hdr};
+      end
+
+      always @(posedge clk) begin
+        if (!rst_n) begin
+          in_pkt    <= 1'b0;
+          wait_hdr  <= 1'b0;
+          verdict_r <= 8'd0;
+          ts_r      <= 64'd0;
+          tuser_r   <= 48'd0;
+        end
+        else if (snoop_hs) begin
+          in_pkt   <= ~snoop_tlast;
+          wait_hdr <= first && magic && !snoop_tlast;
+          if (first) begin
+            verdict_r <= d[31:24];
+            ts_r      <= now;
+            tuser_r   <= snoop_tuser;
+          end
+        end
+      end
+
+      //------------------------------------------------------------------------
+      // Ring pointer, triggers and registers
+      //------------------------------------------------------------------------
+      always @(posedge clk) begin
+        if (!rst_n) begin
+          wr_idx    <= {IDX_W{1'b0}};
+          rec_total <= 32'd0;
+          frozen    <= 1'b0;
+          triggered <= 1'b0;
+          post_left <= 32'd0;
+          trig_idx  <= {IDX_W{1'b0}};
+        end
+        else if (rearm) begin
+          frozen    <= 1'b0;
+          triggered <= 1'b0;
+        end
+        else if (manual && !triggered) begin
+          // The host wants the ring as it is now
+          triggered <= 1'b1;
+          frozen    <= 1'b1;
+          trig_idx  <= wr_idx - 1;
+        end
+        else if (write) begin
+          wr_idx    <= wr_idx == DEPTH - 1 ? {IDX_W{1'b0}} : wr_idx + 1;
+          rec_total <= rec_total + 1;
+          if (!triggered && (hit_verdict || hit_pattern)) begin
+            triggered <= 1'b1;
+            trig_idx  <= wr_idx;
+            post_left <= post;
+            frozen    <= post == 32'd0;
+          end
+          else if (triggered) begin
+            post_left <= post_left - 1;
+            frozen    <= post_left == 32'd1;
+          end
+        end
+      end
+
+      always @(posedge clk) begin
+        if (!rst_n) begin
+          trig_verdict_en <= 1'b0;
+          trig_pattern_en <= 1'b0;
+          trig_verdict    <= 8'd0;
+          post            <= POST;
+          pat_off         <= 6'd0;
+          pat_value       <= 32'd0;
+          pat_mask        <= 32'd0;
+          rd_idx          <= {IDX_W{1'b0}};
+        end
+        else if (wr_en) begin
+          case (wr_addr)
+            12'h008: begin
+              trig_verdict_en <= wr_data[0];
+              trig_pattern_en <= wr_data[1];
+              trig_verdict    <= wr_data[15:8];
+            end
+            12'h00C: post      <= wr_data;
+            12'h010: pat_off   <= wr_data[5:0] > 6'd60 ? 6'd60 : wr_data[5:0];
+            12'h014: pat_value <= wr_data;
+            12'h018: pat_mask  <= wr_data;
+            12'h028: rd_idx    <= wr_data[IDX_W-1:0];
+            default: ;
+          endcase
+        end
+      end
+
+      // Read port of the ring, one cycle behind the entry index
+      reg [ENTRY_W-1:0] rd_entry;
+
+      always @(posedge clk)
+        rd_entry <= mem[rd_idx];
+
+      wire [HDR_W-1:0] rd_hdr   = rd_entry[HDR_W-1:0];
+      wire [47:0]      rd_tuser = rd_entry[HDR_W +: 48];
+      wire [15:0]      rd_vf    = rd_entry[HDR_W + 48 +: 16];
+      wire [63:0]      rd_ts    = rd_entry[HDR_W + 64 +: 64];
+      wire [31:0]      rd_word  = rd_hdr >> (32 * rd_addr[5:2]);
+
+      always @(posedge clk) begin
+        if (rd_addr[11:8] == 4'h1 && !rd_addr[7])
+          rd_data <= rd_addr[6:2] < HDR_BYTES / 4 ? rd_word : 32'd0;
+        else begin
+          case (rd_addr)
+            12'h004: rd_data <= {{(16-IDX_W){1'b0}}, wr_idx, 14'd0, triggered, frozen};
+            12'h008: rd_data <= {16'd0, trig_verdict, 6'd0, trig_pattern_en, trig_verdict_en};
+            12'h00C: rd_data <= post;
+            12'h010: rd_data <= {26'd0, pat_off};
+            12'h014: rd_data <= pat_value;
+            12'h018: rd_data <= pat_mask;
+            12'h01C: rd_data <= rec_total;
+            12'h020: rd_data <= DEPTH;
+            12'h024: rd_data <= HDR_BYTES;
+            12'h028: rd_data <= rd_idx;
+            12'h02C: rd_data <= trig_idx;
+            12'h180: rd_data <= rd_tuser[31:0];
+            12'h184: rd_data <= {rd_vf[7:0], rd_vf[15:8], rd_tuser[47:32]};
+            12'h188: rd_data <= rd_ts[31:0];
+            12'h18C: rd_data <= rd_ts[63:32];
+            default: rd_data <= 32'd0;
+          endcase
+        end
+      end
+    end
+  endgenerate
+
+endmodule
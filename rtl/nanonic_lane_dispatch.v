@@ -0,0 +1,116 @@
+//--------------------------------------------------------------------------------
+// NanoNIC lane dispatcher
+//
+// Spreads the packets of one stream over NUM_OUT pipeline lanes, selecting the
+// lane on the first beat and holding it until tlast.
+//
+//   BY_FLOW = 0 : round-robin over the lanes that can take a beat, starting
+//                 after the last one used. The lanes are kept equally busy but
+//                 two packets of a flow may leave the lanes out of order.
+//   BY_FLOW = 1 : the lane is given by a hash of the IPv4 protocol, addresses
+//                 and ports (bytes 23 and 26 to 37 of the frame), so the packets
+//                 of a flow stay in order; other frames go to lane 0. A busy
+//                 lane stalls the dispatcher.
+//
+// The lane inputs must drive tready independently of tvalid (put a
+// nanonic_axis_reg in front of each lane). Outputs are packed vectors, lane i
+// uses the slices [i*W +: W].
+//--------------------------------------------------------------------------------
+`timescale 1 ps / 1 ps
+
+module nanonic_lane_dispatch #(
+    parameter NUM_OUT = 2,
+    parameter USER_W  = 48,
+    parameter BY_FLOW = 0
+  ) (
+    input                       clk,
+    input                       rst_n,
+
+    input                       s_axis_tvalid,
+    input  [511:0]              s_axis_tdata,
+    input  [63:0]               s_axis_tkeep,
+    input                       s_axis_tlast,
+    input  [USER_W-1:0]         s_axis_tuser,
+    output                      s_axis_tready,
+
+    output [NUM_OUT-1:0]        m_axis_tvalid,
+    output [NUM_OUT*512-1:0]    m_axis_tdata,
+    output [NUM_OUT*64-1:0]     m_axis_tkeep,
+    output [NUM_OUT-1:0]        m_axis_tlast,
+    output [NUM_OUT*USER_W-1:0] m_axis_tuser,
+    input  [NUM_OUT-1:0]        m_axis_tready
+  );
+
+  localparam SEL_W = (NUM_OUT > 1) ? $clog2(NUM_OUT) : 1;
+
+  reg             in_pkt;
+  reg [SEL_W-1:0] held;
+  reg [SEL_W-1:0] last;
+  reg [SEL_W-1:0] pick;
+  reg             pick_valid;
+
+  wire [511:0] d = s_axis_tdata;
+
+  // Flow hash: XOR of the 13 bytes of the 5-tuple
+  wire       ipv4 = d[103:96] == 8'h08 && d[111:104] == 8'h00;
+  wire [7:0] fold = d[8*23 +: 8] ^ d[8*26 +: 8] ^ d[8*27 +: 8] ^ d[8*28 +: 8] ^
+                    d[8*29 +: 8] ^ d[8*30 +: 8] ^ d[8*31 +: 8] ^ d[8*32 +: 8] ^
+                    d[8*33 +: 8] ^ d[8*34 +: 8] ^ d[8*35 +: 8] ^ d[8*36 +: 8] ^
+                    d[8*37 +: 8];
+  wire [7:0] flow_lane = ipv4 ? fold % NUM_OUT : 8'd0;
+
+  // Round-robin pick among the lanes that are ready, starting after the last one
+  integer i;
+  reg [SEL_W:0] cand;
+  always @(*) begin
+    if (BY_FLOW) begin
+      pick       = flow_lane[SEL_W-1:0];
+      pick_valid = 1'b1;
+    end
+    else begin
+      pick       = last;
+      pick_valid = 1'b0;
+      for (i = NUM_OUT; i >= 1; i = i - 1) begin
+        cand = last + i;
+        if (cand >= NUM_OUT)
+          cand = cand - NUM_OUT;
+        if (m_axis_tready[cand]) begin
+          pick       = cand[SEL_W-1:0];
+          pick_valid = 1'b1;
+        end
+      end
+    end
+  end
+
+  wire [SEL_W-1:0] sel = in_pkt ? held : pick;
+  wire             act = in_pkt | pick_valid;
+
+  genvar g;
+  generate
+    for (g = 0; g < NUM_OUT; g = g + 1) begin : g_out
+      assign m_axis_tvalid[g]                  = s_axis_tvalid && act && (sel == g);
+      assign m_axis_tdata[g*512 +: 512]        = s_axis_tdata;
+      assign m_axis_tkeep[g*64 +: 64]          = s_axis_tkeep;
+      assign m_axis_tlast[g]                   = s_axis_tlast;
+      assign m_axis_tuser[g*USER_W +: USER_W]  = s_axis_tuser;
+    end
+  endgenerate
+
+  assign s_axis_tready = act && m_axis_tready[sel];
+
+  always @(posedge clk) begin
+    if (!rst_n) begin
+      in_pkt <= 1'b0;
+      held   <= {SEL_W{1'b0}};
+      last   <= NUM_OUT - 1;
+    end
+    else if (s_axis_tvalid && s_axis_tready) begin
+      in_pkt <= ~s_axis_tlast;
+      if (!in_pkt) begin
+        held <= sel;
+        last <= sel;
+      end
+    end
+  end
+
+endmodule
@@ -0,0 +1,149 @@
+//--------------------------------------------------------------------------------
+// NanoNIC pipeline latency histogram
+//
+// Accumulates per-packet latency samples (in clock cycles) into a log2
+// histogram and keeps count, sum, min and max. Bucket 0 counts samples equal to
+// 0, bucket b (1..16) counts samples in [2^(b-1), 2^b). nanonic_pipeline_top
+// only gives bucket 16 the samples it saturates at 32768 (see LATENCY_EN). A background scan over
+// the buckets keeps an estimate of the 99th percentile, reported as the upper
+// bound of the bucket that contains it.
+//
+// Registers (offsets inside the block window, read-only unless stated):
+//   0x00 control     W: bit 0 clears the histogram
+//   0x04 count       number of samples
+//   0x08 min         smallest sample
+//   0x0C max         largest sample
+//   0x10 p99         upper bound of the p99 bucket
+//   0x14 sum_lo      sum of the samples, bits 31:0; reading it latches the
+//                    whole sum, so read sum_lo first
+//   0x18 sum_hi      bits 63:32 of the sum latched by the last sum_lo read
+//   0x1C clk_ps      clock period in ps, to convert cycles to time
+//   0x40 + 4*b       bucket b
+//--------------------------------------------------------------------------------
+`timescale 1 ps / 1 ps
+
+module nanonic_latency_hist #(
+    parameter CLK_PERIOD_PS = 4000
+  ) (
+    input             clk,
+    input             rst_n,
+
+    input             sample_valid,
+    input      [15:0] sample,
+
+    input             wr_en,
+    input      [11:0] wr_addr,
+    input      [31:0] wr_data,
+    input             rd_en,
+    input      [11:0] rd_addr,
+    output reg [31:0] rd_data
+  );
+
+  localparam NUM_BUCKETS = 17;
+
+  reg [31:0] bucket [0:NUM_BUCKETS-1];
+  reg [31:0] count;
+  reg [63:0] sum;
+  reg [63:0] sum_snap;
+  reg [15:0] min_v;
+  reg [15:0] max_v;
+  reg [16:0] p99;
+
+  // p99 scan state
+  reg [4:0]  scan_idx;
+  reg [31:0] scan_total;
+  reg [31:0] scan_cum;
+  reg        scan_found;
+
+  wire clear = wr_en && (wr_addr == 12'h000) && wr_data[0];
+
+  // Bucket index: position of the most significant set bit plus one
+  reg [4:0] idx;
+  integer i;
+  always @(*) begin
+    idx = 5'd0;
+    for (i = 0; i < 16; i = i + 1)
+      if (sample[i])
+        idx = i + 1;
+  end
+
+  always @(posedge clk) begin
+    if (!rst_n || clear) begin
+      for (i = 0; i < NUM_BUCKETS; i = i + 1)
+        bucket[i] <= 32'd0;
+      count <= 32'd0;
+      sum   <= 64'd0;
+      min_v <= 16'hFFFF;
+      max_v <= 16'd0;
+    end
+    else if (sample_valid) begin
+      bucket[idx] <= bucket[idx] + 1;
+      count <= count + 1;
+      sum   <= sum + sample;
+      if (sample < min_v)
+        min_v <= sample;
+      if (sample > max_v)
+        max_v <= sample;
+    end
+  end
+
+  // Walk the buckets continuously; the first bucket where the cumulative count
+  // reaches 99% of the total holds the p99.
+  wire [31:0] scan_next = scan_cum + bucket[scan_idx];
+  wire        scan_hit  = ({7'd0, scan_next} * 39'd100) >= ({7'd0, scan_total} * 39'd99);
+
+  always @(posedge clk) begin
+    if (!rst_n || clear) begin
+      scan_idx   <= 5'd0;
+      scan_total <= 32'd0;
+      scan_cum   <= 32'd0;
+      scan_found <= 1'b0;
+      p99        <= 17'd0;
+    end
+    else begin
+      if (!scan_found && scan_total != 0 && scan_hit) begin
+        scan_found <= 1'b1;
+        // Upper bound of bucket b is 2^b - 1 (bucket 0 holds only 0)
+        p99 <= (17'd1 << scan_idx) - 1;
+      end
+      if (scan_idx == NUM_BUCKETS - 1) begin
+        scan_idx   <= 5'd0;
+        scan_total <= count;
+        scan_cum   <= 32'd0;
+        scan_found <= 1'b0;
+      end
+      else begin
+        scan_idx <= scan_idx + 1;
+        scan_cum <= scan_next;
+      end
+    end
+  end
+
+  // A 64-bit read is two AXI-Lite reads; the snapshot keeps both halves from
+  // the same instant.
+  always @(posedge clk) begin
+    if (!rst_n)
+      sum_snap <= 64'd0;
+    else if (rd_en && rd_addr == 12'h014)
+      sum_snap <= sum;
+  end
+
+  always @(posedge clk) begin
+    case (rd_addr)
+      12'h004: rd_data <= count;
+      12'h008: rd_data <= {16'd0, (count == 0) ? 16'd0 : min_v};
+      12'h00C: rd_data <= {16'd0, max_v};
+      12'h010: rd_data <= {15'd0, p99};
+      12'h014: rd_data <= sum_snap[31:0];
+      12'h018: rd_data <= sum_snap[63:32];
+      12'h01C: rd_data <= CLK_PERIOD_PS;
+      default: begin
+        if (rd_addr >= 12'h040 && rd_addr < 12'h040 + 4*NUM_BUCKETS)
+          rd_data <= bucket[(rd_addr - 12'h040) >> 2];
+        else
+          rd_data <= 32'd0;
+      end
+    endcase
+  end
+
+endmodule
@@ -0,0 +1,430 @@
+//--------------------------------------------------------------------------------
+// NanoNIC bulk map transfer engine
+//
+// Runs batches of register accesses sent by the host as QDMA H2C frames, so
+// maps are loaded and read back at the speed of the on-card register bus
+// instead of one PCIe round trip per 32-bit access. It takes the place of the
+// TX pass-through of p2p_250mhz: command frames (EtherType ETHERTYPE, magic
+// 'M', version 1) are consumed, every other H2C frame goes on to m_axis
+// unchanged. The engine is an AXI-Lite master on the slave of
+// nanonic_pipeline_top and forwards the AXI-Lite of the shell (s_axil_*) when
+// it is idle; each command frame is answered by one response frame on m_rsp,
+// to be merged with the C2H traffic.
+//
+// Command frame (multi-byte fields little-endian):
+//   0..11   MAC addresses, swapped in the response
+//   12..13  EtherType (big-endian)
+//   14      'M' (0x4D)         15      version (1)
+//   16..19  sequence number, echoed
+//   20..21  number of ops      22..23  length of the response in bytes
+//   24..    ops, 8 bytes each: op[7:0], 0, addr[15:0], data[31:0]
+//             0 NOP
+//             1 WRITE   addr <- data
+//             2 READ    addr, 4-byte result
+//             3 POLL    read addr until (value & data[15:0]) == data[31:16],
+//                       at most POLL_MAX reads, 4-byte result (last value)
+//             4 LOCK    keep the shell AXI-Lite off after this frame
+//             5 UNLOCK  give it back at the end of this frame
+//
+// Response frame: the same 24-byte header, the results of the READ and POLL
+// ops in order, then an 8-byte trailer: status[7:0] (0 ok, 1 poll timeout,
+// 2 unknown op, 3 frame ended before its last op), three zero bytes and the
+// number of ops executed. After an error the remaining ops are skipped but
+// their results are still written, as zeros, so the layout of the response
+// only depends on the command; the host computes its length for the size
+// field of tuser. Only a frame that ends before its last op is answered
+// without the results of the ops it does not hold.
+//
+// The shell AXI-Lite is held off for the whole frame, and from a LOCK to the
+// end of the frame that holds the UNLOCK: a dump sent as several frames
+// between LOCK and UNLOCK sees no other control-plane write.
+//--------------------------------------------------------------------------------
+`timescale 1 ps / 1 ps
+
+module nanonic_map_dma #(
+    parameter ETHERTYPE = 16'h88B5,
+    parameter POLL_MAX  = 1024
+  ) (
+    input                clk,
+    input                rst_n,
+
+    // H2C frames in
+    input                s_axis_tvalid,
+    input  [511:0]       s_axis_tdata,
+    input  [63:0]        s_axis_tkeep,
+    input                s_axis_tlast,
+    input  [47:0]        s_axis_tuser,
+    output               s_axis_tready,
+
+    // H2C frames that are not commands
+    output               m_axis_tvalid,
+    output [511:0]       m_axis_tdata,
+    output [63:0]        m_axis_tkeep,
+    output               m_axis_tlast,
+    output [47:0]        m_axis_tuser,
+    input                m_axis_tready,
+
+    // Responses, toward C2H
+    output               m_rsp_tvalid,
+    output reg [511:0]   m_rsp_tdata,
+    output reg [63:0]    m_rsp_tkeep,
+    output               m_rsp_tlast,
+    output [47:0]        m_rsp_tuser,
+    input                m_rsp_tready,
+
+    // AXI-Lite of the shell
+    input                s_axil_awvalid,
+    input  [31:0]        s_axil_awaddr,
+    output               s_axil_awready,
+    input                s_axil_wvalid,
+    input  [31:0]        s_axil_wdata,
+    output               s_axil_wready,
+    output               s_axil_bvalid,
+    output [1:0]         s_axil_bresp,
+    input                s_axil_bready,
+    input                s_axil_arvalid,
+    input  [31:0]        s_axil_araddr,
+    output               s_axil_arready,
+    output               s_axil_rvalid,
+    output [31:0]        s_axil_rdata,
+    output [1:0]         s_axil_rresp,
+    input                s_axil_rready,
+
+    // AXI-Lite to nanonic_pipeline_top
+    output               m_axil_awvalid,
+    output [31:0]        m_axil_awaddr,
+    input                m_axil_awready,
+    output               m_axil_wvalid,
+    output [31:0]        m_axil_wdata,
+    input                m_axil_wready,
+    input                m_axil_bvalid,
+    input  [1:0]         m_axil_bresp,
+    output               m_axil_bready,
+    output               m_axil_arvalid,
+    output [31:0]        m_axil_araddr,
+    input                m_axil_arready,
+    input                m_axil_rvalid,
+    input  [31:0]        m_axil_rdata,
+    input  [1:0]         m_axil_rresp,
+    output               m_axil_rready,
+
+    output reg [31:0]    frames,
+    output reg [31:0]    ops_done
+  );
+
+  localparam OP_NOP    = 8'd0;
+  localparam OP_WRITE  = 8'd1;
+  localparam OP_READ   = 8'd2;
+  localparam OP_POLL   = 8'd3;
+  localparam OP_LOCK   = 8'd4;
+  localparam OP_UNLOCK = 8'd5;
+
+  localparam ST_OK      = 8'd0;
+  localparam ST_TIMEOUT = 8'd1;
+  localparam ST_BAD_OP  = 8'd2;
+  localparam ST_SHORT   = 8'd3;
+
+  // Frame states
+  localparam F_IDLE = 3'd0;
+  localparam F_PASS = 3'd1;
+  localparam F_OP   = 3'd2;
+  localparam F_BUS  = 3'd3;
+  localparam F_PUSH = 3'd4;
+  localparam F_NEXT = 3'd5;
+  localparam F_END  = 3'd6;
+  localparam F_SEND = 3'd7;
+
+  wire [511:0] d = s_axis_tdata;
+
+  wire is_cmd = d[8*12 +: 8] == ETHERTYPE[15:8] && d[8*13 +: 8] == ETHERTYPE[7:0] &&
+                d[8*14 +: 8] == 8'h4D && d[8*15 +: 8] == 8'h01;
+
+  reg [2:0]  fstate;
+  reg [2:0]  opi;          // op of the current beat
+  reg [15:0] ops_left;
+  reg [31:0] executed;
+  reg [7:0]  status;
+  reg        locked;
+  reg        unlock_at_end;
+
+  // Current op
+  wire [63:0] op_word = d[64*opi +: 64];
+  wire [7:0]  op_code = op_word[7:0];
+  wire [15:0] op_addr = op_word[31:16];
+  wire [31:0] op_data = op_word[63:32];
+
+  //------------------------------------------------------------------------
+  // AXI-Lite: the engine owns the bus from the first beat of a command frame
+  // to its end, and between LOCK and UNLOCK; the shell gets it otherwise
+  //------------------------------------------------------------------------
+  localparam OWN_NONE   = 2'd0;
+  localparam OWN_SHELL  = 2'd1;
+  localparam OWN_ENGINE = 2'd2;
+
+  reg [1:0] owner;
+  wire      eng_want = fstate != F_IDLE && fstate != F_PASS || locked;
+
+  always @(posedge clk) begin
+    if (!rst_n)
+      owner <= OWN_NONE;
+    else begin
+      case (owner)
+        OWN_NONE:
+          if (eng_want)
+            owner <= OWN_ENGINE;
+          else if ((s_axil_awvalid && s_axil_wvalid) || s_axil_arvalid)
+            owner <= OWN_SHELL;
+        OWN_SHELL:
+          if ((s_axil_bvalid && s_axil_bready) || (s_axil_rvalid && s_axil_rready))
+            owner <= OWN_NONE;
+        default:
+          if (!eng_want)
+            owner <= OWN_NONE;
+      endcase
+    end
+  end
+
+  wire shell = owner == OWN_SHELL;
+
+  reg        e_awvalid;
+  reg        e_arvalid;
+  reg [31:0] e_addr;
+  reg [31:0] e_wdata;
+
+  assign m_axil_awvalid = shell ? s_axil_awvalid : e_awvalid;
+  assign m_axil_awaddr  = shell ? s_axil_awaddr  : e_addr;
+  assign m_axil_wvalid  = shell ? s_axil_wvalid  : e_awvalid;
+  assign m_axil_wdata   = shell ? s_axil_wdata   : e_wdata;
+  assign m_axil_bready  = shell ? s_axil_bready  : 1'b1;
+  assign m_axil_arvalid = shell ? s_axil_arvalid : e_arvalid;
+  assign m_axil_araddr  = shell ? s_axil_araddr  : e_addr;
+  assign m_axil_rready  = shell ? s_axil_rready  : 1'b1;
+
+  assign s_axil_awready = shell && m_axil_awready;
+  assign s_axil_wready  = shell && m_axil_wready;
+  assign s_axil_bvalid  = shell && m_axil_bvalid;
+  assign s_axil_bresp   = m_axil_bresp;
+  assign s_axil_arready = shell && m_axil_arready;
+  assign s_axil_rvalid  = shell && m_axil_rvalid;
+  assign s_axil_rdata   = m_axil_rdata;
+  assign s_axil_rresp   = m_axil_rresp;
+
+  //------------------------------------------------------------------------
+  // Response builder: 4-byte words appended to a beat, sent when the beat is
+  // full or the trailer is in
+  //------------------------------------------------------------------------
+  reg [6:0]  rsp_pos;
+  reg        rsp_full;
+  reg        rsp_last;
+  reg [47:0] rsp_user;
+
+  assign m_rsp_tvalid = rsp_full;
+  assign m_rsp_tlast  = rsp_last;
+  assign m_rsp_tuser  = rsp_user;
+
+  //------------------------------------------------------------------------
+  // Frames
+  //------------------------------------------------------------------------
+  wire pass_first = fstate == F_IDLE && s_axis_tvalid && !is_cmd;
+  wire passing    = pass_first || fstate == F_PASS;
+
+  assign m_axis_tvalid = passing && s_axis_tvalid;
+  assign m_axis_tdata  = s_axis_tdata;
+  assign m_axis_tkeep  = s_axis_tkeep;
+  assign m_axis_tlast  = s_axis_tlast;
+  assign m_axis_tuser  = s_axis_tuser;
+
+  // A command beat is consumed in F_NEXT once its last op is done
+  wire beat_done = opi == 3'd7 || ops_left == 16'd0;
+  wire cmd_take  = fstate == F_NEXT && beat_done;
+  assign s_axis_tready = passing ? m_axis_tready : cmd_take;
+
+  reg [31:0] result;
+  reg [15:0] polls;
+  reg        push_trailer;
+
+  always @(posedge clk) begin
+    if (!rst_n) begin
+      fstate        <= F_IDLE;
+      opi           <= 3'd0;
+      ops_left      <= 16'd0;
+      executed      <= 32'd0;
+      status        <= ST_OK;
+      locked        <= 1'b0;
+      unlock_at_end <= 1'b0;
+      e_awvalid     <= 1'b0;
+      e_arvalid     <= 1'b0;
+      rsp_pos       <= 7'd0;
+      rsp_full      <= 1'b0;
+      rsp_last      <= 1'b0;
+      push_trailer  <= 1'b0;
+      frames        <= 32'd0;
+      ops_done      <= 32'd0;
+    end
+    else begin
+      // Response beat accepted
+      if (rsp_full && m_rsp_tready) begin
+        rsp_full <= 1'b0;
+        rsp_last <= 1'b0;
+        rsp_pos  <= 7'd0;
+      end
+
+      case (fstate)
+        F_IDLE: begin
+          if (s_axis_tvalid && is_cmd && !rsp_full) begin
+            // Header of the response: swapped MACs, same EtherType, magic,
+            // version, sequence, op count and length
+            m_rsp_tdata <= {d[511:8*24], d[8*12 +: 96], d[0 +: 48], d[48 +: 48]};
+            m_rsp_tkeep <= {64{1'b1}};
+            rsp_user    <= {s_axis_tuser[47:16], d[8*22 +: 16]};
+            rsp_pos     <= 7'd24;
+            ops_left    <= d[8*20 +: 16];
+            executed    <= 32'd0;
+            status      <= ST_OK;
+            opi         <= 3'd3;
+            fstate      <= F_OP;
+          end
+          else if (s_axis_tvalid && !is_cmd && m_axis_tready && !s_axis_tlast)
+            fstate <= F_PASS;
+        end
+
+        F_PASS:
+          if (s_axis_tvalid && m_axis_tready && s_axis_tlast)
+            fstate <= F_IDLE;
+
+        F_OP: begin
+          // Wait for the engine to own the bus before the first access
+          if (ops_left == 16'd0)
+            fstate <= F_NEXT;
+          else if (owner == OWN_ENGINE) begin
+            polls <= 16'd0;
+            case (op_code)
+              OP_NOP:
+                fstate <= F_NEXT;
+              OP_WRITE: begin
+                if (status == ST_OK) begin
+                  e_addr    <= {16'd0, op_addr};
+                  e_wdata   <= op_data;
+                  e_awvalid <= 1'b1;
+                  fstate    <= F_BUS;
+                end
+                else
+                  fstate <= F_NEXT;
+              end
+              OP_READ, OP_POLL: begin
+                if (status == ST_OK) begin
+                  e_addr    <= {16'd0, op_addr};
+                  e_arvalid <= 1'b1;
+                  fstate    <= F_BUS;
+                end
+                else begin
+                  result <= 32'd0;
+                  fstate <= F_PUSH;
+                end
+              end
+              OP_LOCK: begin
+                if (status == ST_OK)
+                  locked <= 1'b1;
+                fstate <= F_NEXT;
+              end
+              OP_UNLOCK: begin
+                if (status == ST_OK)
+                  unlock_at_end <= 1'b1;
+                fstate <= F_NEXT;
+              end
+              default: begin
+                status <= ST_BAD_OP;
+                fstate <= F_NEXT;
+              end
+            endcase
+          end
+        end
+
+        F_BUS: begin
+          if (e_awvalid && m_axil_awready)
+            e_awvalid <= 1'b0;
+          if (e_arvalid && m_axil_arready)
+            e_arvalid <= 1'b0;
+          if (m_axil_bvalid)
+            fstate <= F_NEXT;
+          if (m_axil_rvalid) begin
+            result <= m_axil_rdata;
+            if (op_code == OP_POLL &&
+                (m_axil_rdata[15:0] & op_data[15:0]) != op_data[31:16]) begin
+              if (polls == POLL_MAX - 1) begin
+                status <= ST_TIMEOUT;
+                fstate <= F_PUSH;
+              end
+              else begin
+                polls     <= polls + 1;
+                e_arvalid <= 1'b1;
+              end
+            end
+            else
+              fstate <= F_PUSH;
+          end
+        end
+
+        F_PUSH: begin
+          // Append the result once the beat has room
+          if (!rsp_full) begin
+            m_rsp_tdata[8*rsp_pos +: 32] <= result;
+            rsp_pos <= rsp_pos + 7'd4;
+            if (rsp_pos == 7'd60)
+              rsp_full <= 1'b1;
+            fstate <= push_trailer ? F_SEND : F_NEXT;
+          end
+        end
+
+        F_NEXT: begin
+          if (ops_left != 16'd0) begin
+            ops_left <= ops_left - 1;
+            if (status == ST_OK)
+              executed <= executed + 1;
+          end
+          if (beat_done) begin
+            // s_axis_tready is high in this cycle
+            opi <= 3'd0;
+            if (s_axis_tlast) begin
+              if (ops_left > 16'd1 && status == ST_OK)
+                status <= ST_SHORT;
+              fstate <= F_END;
+            end
+            else
+              fstate <= F_OP;
+          end
+          else begin
+            opi    <= opi + 1;
+            fstate <= F_OP;
+          end
+        end
+
+        F_END: begin
+          // First word of the trailer
+          result       <= {24'd0, status};
+          push_trailer <= 1'b1;
+          fstate       <= F_PUSH;
+        end
+
+        F_SEND: begin
+          // Number of ops executed, then the beat goes out with tlast
+          if (!rsp_full) begin
+            m_rsp_tdata[8*rsp_pos +: 32] <= executed;
+            m_rsp_tkeep  <= {64{1'b1}} >> (60 - rsp_pos);
+            rsp_full     <= 1'b1;
+            rsp_last     <= 1'b1;
+            push_trailer <= 1'b0;
+            frames       <= frames + 1;
+            ops_done     <= ops_done + executed;
+            if (unlock_at_end) begin
+              locked        <= 1'b0;
+              unlock_at_end <= 1'b0;
+            end
+            fstate <= F_IDLE;
+          end
+        end
+      endcase
+    end
+  end
+
+endmodule
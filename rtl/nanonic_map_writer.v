@@ -0,0 +1,228 @@
+//--------------------------------------------------------------------------------
+// NanoNIC map writer
+//
+// The maps of an application live inside the Nanotube stages that use them and
+// have no port the host can reach. The writer turns register writes into
+// update messages, frames of two beats sent into the pipeline between packets,
+// which the application applies with bpf_map_update_elem() and drops (see
+// Custom_applications/common/nanonic_mapwr.h). A message goes to every lane
+// (NUM_OUT outputs) and is retired once all of them took it, so the copies of
+// the maps of every lane receive the same updates in the same order.
+//
+// Every map the application exposes gets a 4 KB window; the window number
+// (wr_map/rd_map) is the map id carried by the message. The staging registers
+// are shared by the windows, so the host stages and sends one message at a
+// time. Messages wait in a FIFO of FIFO_DEPTH entries; a message written while
+// the FIFO is full is counted and lost.
+//
+// Message (byte offsets, multi-byte fields as the host staged them):
+//   0..11   zero               12..13  ETHERTYPE (big-endian)
+//   14      op: 1 update, 2 delete, 3 commit    15  map id
+//   16..63  key (KEY_W bits, zero padded)
+//   64..127 value (VAL_W bits, zero padded)
+//
+// Registers (offsets inside the window of a map):
+//   0x00 control     W: bit 0 sends a commit message for the map
+//                    R: bit 0 messages waiting, bit 1 FIFO full
+//   0x04 version     commit messages sent for the map
+//   0x08 index       W: sends an update of the entry with this 32-bit key and
+//                    the staged value (array maps)
+//   0x0C geometry    {VAL_W[15:0], KEY_W[15:0]}
+//   0x14 command     W: 1 sends an update of the staged key with the staged
+//                    value, 2 a delete of the staged key (hash maps)
+//   0x18 messages    messages sent into the pipeline (all maps)
+//   0x1C id          "MAPW"
+//   0x20 lost        messages lost on a full FIFO (all maps)
+//   0x40 + 4*w       staged value, bits [32*w +: 32]
+//   0x100 + 4*w      staged key, bits [32*w +: 32]
+//--------------------------------------------------------------------------------
+`timescale 1 ps / 1 ps
+
+module nanonic_map_writer #(
+    parameter         ENABLE     = 0,
+    parameter         NUM_OUT    = 1,
+    parameter [15:0]  ETHERTYPE  = 16'h88B6,
+    parameter         KEY_W      = 384,
+    parameter         VAL_W      = 256,
+    parameter         FIFO_DEPTH = 16
+  ) (
+    input                      clk,
+    input                      rst_n,
+
+    output [NUM_OUT-1:0]       m_axis_tvalid,
+    output [NUM_OUT*512-1:0]   m_axis_tdata,
+    output [NUM_OUT*64-1:0]    m_axis_tkeep,
+    output [NUM_OUT-1:0]       m_axis_tlast,
+    output [NUM_OUT*48-1:0]    m_axis_tuser,
+    input  [NUM_OUT-1:0]       m_axis_tready,
+
+    input                      wr_en,
+    input      [2:0]           wr_map,
+    input      [11:0]          wr_addr,
+    input      [31:0]          wr_data,
+    input      [2:0]           rd_map,
+    input      [11:0]          rd_addr,
+    output reg [31:0]          rd_data
+  );
+
+  localparam [1:0]  OP_UPDATE = 2'd1;
+  localparam [1:0]  OP_DELETE = 2'd2;
+  localparam [1:0]  OP_COMMIT = 2'd3;
+  localparam        KWORDS    = (KEY_W + 31) / 32;
+  localparam        VWORDS    = (VAL_W + 31) / 32;
+  localparam        PTR_W     = $clog2(FIFO_DEPTH);
+  localparam        MSG_W     = 2 + 3 + KEY_W + VAL_W;
+  localparam [31:0] GEOMETRY  = (VAL_W << 16) | KEY_W;
+  localparam [31:0] WRITER_ID = 32'h4D415057;
+
+  // The key and the value each have a fixed area of the message
+  initial
+    if (KEY_W < 32 || KEY_W > 384 || VAL_W > 512) begin
+      $display("nanonic_map_writer: KEY_W = %0d, VAL_W = %0d, need 32..384 and at most 512",
+               KEY_W, VAL_W);
+      $finish;
+    end
+
+  generate
+    if (!ENABLE) begin : g_off
+      assign m_axis_tvalid = {NUM_OUT{1'b0}};
+      assign m_axis_tdata  = {NUM_OUT*512{1'b0}};
+      assign m_axis_tkeep  = {NUM_OUT*64{1'b0}};
+      assign m_axis_tlast  = {NUM_OUT{1'b0}};
+      assign m_axis_tuser  = {NUM_OUT*48{1'b0}};
+
+      always @(posedge clk)
+        rd_data <= 32'd0;
+    end
+    else begin : g_writer
+
+      reg  [KWORDS*32-1:0] staged_key;
+      reg  [VWORDS*32-1:0] staged_value;
+      reg  [31:0]          version [0:7];
+      reg  [31:0]          sent;
+      reg  [31:0]          lost;
+
+      //------------------------------------------------------------------------
+      // Message FIFO
+      //------------------------------------------------------------------------
+      reg  [MSG_W-1:0] fifo [0:FIFO_DEPTH-1];
+      reg  [PTR_W:0]   wr_ptr;
+      reg  [PTR_W:0]   rd_ptr;
+
+      wire fifo_empty = wr_ptr == rd_ptr;
+      wire fifo_full  = wr_ptr == {~rd_ptr[PTR_W], rd_ptr[PTR_W-1:0]};
+
+      wire wr_commit = wr_en && wr_addr == 12'h000 && wr_data[0];
+      wire wr_index  = wr_en && wr_addr == 12'h008;
+      wire wr_update = wr_en && wr_addr == 12'h014 && wr_data[1:0] == 2'd1;
+      wire wr_delete = wr_en && wr_addr == 12'h014 && wr_data[1:0] == 2'd2;
+      wire push      = wr_commit || wr_index || wr_update || wr_delete;
+
+      wire [1:0]       push_op  = wr_commit ? OP_COMMIT : (wr_delete ? OP_DELETE : OP_UPDATE);
+      wire [KEY_W-1:0] push_key = wr_index ? {{KEY_W-32{1'b0}}, wr_data}
+                                           : staged_key[KEY_W-1:0];
+
+      wire wr_value = wr_en && wr_addr >= 12'h040 && wr_addr < 12'h040 + 4*VWORDS;
+      wire wr_key   = wr_en && wr_addr >= 12'h100 && wr_addr < 12'h100 + 4*KWORDS;
+
+      integer i;
+      always @(posedge clk) begin
+        if (!rst_n) begin
+          staged_key   <= {KWORDS*32{1'b0}};
+          staged_value <= {VWORDS*32{1'b0}};
+        end
+        else begin
+          if (wr_value)
+            staged_value[((wr_addr - 12'h040) >> 2)*32 +: 32] <= wr_data;
+          if (wr_key)
+            staged_key[((wr_addr - 12'h100) >> 2)*32 +: 32] <= wr_data;
+        end
+      end
+
+      always @(posedge clk)
+        if (push && !fifo_full)
+          fifo[wr_ptr[PTR_W-1:0]] <= {push_op, wr_map, push_key, staged_value[VAL_W-1:0]};
+
+      //------------------------------------------------------------------------
+      // Broadcast of the head message, two beats on every output
+      //------------------------------------------------------------------------
+      wire [MSG_W-1:0] head = fifo[rd_ptr[PTR_W-1:0]];
+      wire [1:0]       h_op    = head[MSG_W-1 -: 2];
+      wire [2:0]       h_map   = head[MSG_W-3 -: 3];
+      wire [KEY_W-1:0] h_key   = head[VAL_W +: KEY_W];
+      wire [VAL_W-1:0] h_value = head[VAL_W-1:0];
+
+      wire [511:0] beat0 = {{384-KEY_W{1'b0}}, h_key, 5'd0, h_map, 6'd0, h_op,
+                            ETHERTYPE[7:0], ETHERTYPE[15:8], 96'd0};
+      wire [511:0] beat1 = {{512-VAL_W{1'b0}}, h_value};
+
+      reg  [NUM_OUT-1:0] beat;   // output sent the first beat
+      reg  [NUM_OUT-1:0] done;   // output took the whole message
+
+      wire [NUM_OUT-1:0] take     = m_axis_tvalid & m_axis_tready;
+      wire [NUM_OUT-1:0] done_nxt = done | (take & beat);
+      wire               pop      = !fifo_empty && &done_nxt;
+
+      genvar g;
+      for (g = 0; g < NUM_OUT; g = g + 1) begin : g_out
+        assign m_axis_tvalid[g]            = !fifo_empty && !done[g];
+        assign m_axis_tdata[g*512 +: 512]  = beat[g] ? beat1 : beat0;
+        assign m_axis_tkeep[g*64 +: 64]    = {64{1'b1}};
+        assign m_axis_tlast[g]             = beat[g];
+        assign m_axis_tuser[g*48 +: 48]    = {32'd0, 16'd128};
+      end
+
+      always @(posedge clk) begin
+        if (!rst_n) begin
+          wr_ptr <= {PTR_W+1{1'b0}};
+          rd_ptr <= {PTR_W+1{1'b0}};
+          beat   <= {NUM_OUT{1'b0}};
+          done   <= {NUM_OUT{1'b0}};
+          sent   <= 32'd0;
+          lost   <= 32'd0;
+          for (i = 0; i < 8; i = i + 1)
+            version[i] <= 32'd0;
+        end
+        else begin
+          if (push && !fifo_full)
+            wr_ptr <= wr_ptr + 1;
+          if (push && fifo_full)
+            lost <= lost + 1;
+          if (wr_commit && !fifo_full)
+            version[wr_map] <= version[wr_map] + 1;
+
+          if (pop) begin
+            rd_ptr <= rd_ptr + 1;
+            beat   <= {NUM_OUT{1'b0}};
+            done   <= {NUM_OUT{1'b0}};
+            sent   <= sent + 1;
+          end
+          else begin
+            beat <= beat ^ take;
+            done <= done_nxt;
+          end
+        end
+      end
+
+      always @(posedge clk) begin
+        case (rd_addr)
+          12'h000: rd_data <= {30'd0, fifo_full, !fifo_empty};
+          12'h004: rd_data <= version[rd_map];
+          12'h00C: rd_data <= GEOMETRY;
+          12'h018: rd_data <= sent;
+          12'h01C: rd_data <= WRITER_ID;
+          12'h020: rd_data <= lost;
+          default: begin
+            if (rd_addr >= 12'h040 && rd_addr < 12'h040 + 4*VWORDS)
+              rd_data <= staged_value[((rd_addr - 12'h040) >> 2)*32 +: 32];
+            else if (rd_addr >= 12'h100 && rd_addr < 12'h100 + 4*KWORDS)
+              rd_data <= staged_key[((rd_addr - 12'h100) >> 2)*32 +: 32];
+            else
+              rd_data <= 32'd0;
+          end
+        endcase
+      end
+    end
+  endgenerate
+
+endmodule
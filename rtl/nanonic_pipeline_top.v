@@ -0,0 +1,928 @@
+//--------------------------------------------------------------------------------
+// NanoNIC pipeline top
+//
+// Drop-in replacement for Nanotube_pipeline_wrapper inside p2p_250mhz.sv. It keeps
+// the same port0/port1 interface and wraps the Nanotube pipeline with the NanoNIC
+// datapath services, each one selected with a parameter. With every parameter at
+// its default value the top is equivalent to the plain wrapper, except that
+// frames of MAPWR_ETHERTYPE from the network are dropped (MAPWR_GUARD_EN).
+//
+//   EARLY_DROP_* : drop rules evaluated before stage_0, on the first beat and
+//                  on a per-source count mirroring the ICMP limiter (see
+//                  nanonic_early_drop.v, the limiter needs LANES = 1 since each
+//                  lane has its own copy of the maps, and adds a register slice
+//                  in front of the block); scripts/gen_early_drop.py derives
+//                  the parameters from the application
+//   META_*       : NanoNIC descriptor decoding at the pipeline egress
+//                  (see nanonic_egress.v); a frame that already starts with
+//                  the descriptor magic when it enters the pipeline is flagged
+//                  in tuser[63] of the block design, and the egress blocks
+//                  ignore the descriptor of a flagged frame
+//   HAIRPIN_EN   : verdict routing at the egress, XDP_TX packets leave on the
+//                  hairpin_* output towards the CMAC TX path (needs META_EN)
+//   LATENCY_EN   : ingress timestamp carried in tuser[62:48] of the block
+//                  design through the pipeline and latency histogram (see
+//                  nanonic_latency_hist.v); port0/port1 keep the 48-bit tuser
+//                  of the shell. The 15-bit stamp wraps after 32768 cycles:
+//                  a packet can only stay that long when the egress held the
+//                  pipeline for 32768 - LATENCY_FREE_CYCLES of the last 32768
+//                  cycles (LATENCY_FREE_CYCLES bounds the latency without
+//                  backpressure), and the samples taken then go to the top
+//                  bucket (32768) instead of a wrapped value
+//   ENCAP_*      : checksum and IPIP/IPv6 encapsulation engine in front of the
+//                  egress decoder (see nanonic_encap.v, needs META_EN)
+//   EVENTS_*     : event tap, samples the packets whose descriptor carries an
+//                  event code and sends a truncated copy to the host on port1
+//                  (see nanonic_event_tap.v, needs META_EN)
+//   FLIGHT_*     : flight recorder, ring of the headers, tuser, verdict and
+//                  timestamp of the last packets (see nanonic_flight_rec.v)
+//   LANES*       : number of copies of the Nanotube pipeline the packets are
+//                  spread over, to reach one packet per cycle with minimum-size
+//                  frames (see nanonic_lane_dispatch.v)
+//   MAPWR_*      : map writer, sends the map updates written by the host into
+//                  every lane as messages the application applies to its maps
+//                  (see nanonic_map_writer.v); frames of MAPWR_ETHERTYPE coming
+//                  from port0 are dropped before the pipeline, with or without
+//                  the writer unless MAPWR_GUARD_EN = 0, so that an application
+//                  built to apply map updates never takes one from the wire
+//
+// The blocks are controlled through the AXI-Lite slave, one 4 KB window each:
+//   0x0000 top       0x00 id ("NNIC")  0x04 version  0x08 early_drop_count
+//                    0x0C cycle counter bits 31:0    0x10 bits 63:32
+//                    0x14 hairpin packets  0x18 hairpin bytes 31:0  0x1C 63:32
+//                    (reading bits 31:0 of a 64-bit counter latches it, the
+//                    high word read next comes from the same value)
+//                    0x20 packets dropped on their verdict at the egress
+//                    0x24 packets delivered on port1 (to the host, event
+//                         records included)
+//                    0x28 frames of MAPWR_ETHERTYPE dropped at the ingress
+//   0x1000 latency histogram
+//   0x2000 encapsulation engine
+//   0x3000 event tap
+//   0x4000 flight recorder
+//   0x8000 map writer, one window per map id: 0x8000 + 0x1000 * id
+//--------------------------------------------------------------------------------
+`timescale 1 ps / 1 ps
+
+module nanonic_pipeline_top #(
+    parameter         EARLY_DROP_EN            = 0,
+    parameter         EARLY_DROP_ETYPE_EN      = 1,
+    parameter [15:0]  EARLY_DROP_ETYPE         = 16'h0800,
+    parameter [15:0]  EARLY_DROP_ETYPE_MASK    = 16'hFFFF,
+    parameter         EARLY_DROP_KEEP_EN       = 1,
+    parameter [31:0]  EARLY_DROP_KEEP_SADDR    = 32'h6401A8C0,
+    parameter [7:0]   EARLY_DROP_KEEP_PROTO    = 8'd1,
+    parameter         EARLY_DROP_LIMIT_EN      = 0,
+    parameter [7:0]   EARLY_DROP_LIMIT_THRESH  = 8'd21,
+    parameter         EARLY_DROP_LIMIT_ADDR_W  = 10,
+    parameter [31:0]  EARLY_DROP_LIMIT_ENTRIES = 32'd1024,
+    parameter         META_EN                  = 0,
+    parameter         META_STRIP               = 0,
+    parameter         HAIRPIN_EN               = 0,
+    parameter         LATENCY_EN               = 0,
+    parameter         CLK_PERIOD_PS            = 4000,
+    parameter         LATENCY_FREE_CYCLES      = 4096,
+    parameter         ENCAP_EN                 = 0,
+    parameter [47:0]  ENCAP_GW_MAC             = 48'h000000000000,
+    parameter [95:0]  ENCAP_V6_SRC_PREFIX      = 96'h010000000000000000000000,
+    parameter         EVENTS_EN                = 0,
+    parameter         EVENTS_FIFO_BEATS        = 32,
+    parameter [31:0]  EVENTS_PERIOD            = 32'd1,
+    parameter [15:0]  EVENTS_SRC               = 16'hEE00,
+    parameter         FLIGHT_EN                = 0,
+    parameter         FLIGHT_DEPTH             = 512,
+    parameter         FLIGHT_HDR_BYTES         = 64,
+    parameter         FLIGHT_POST              = 16,
+    parameter         LANES                    = 1,
+    parameter         LANES_BY_FLOW            = 0,
+    parameter         MAPWR_EN                 = 0,
+    parameter         MAPWR_GUARD_EN           = 1,
+    parameter [15:0]  MAPWR_ETHERTYPE          = 16'h88B6,
+    parameter         MAPWR_KEY_W              = 384,
+    parameter         MAPWR_VAL_W              = 256,
+    parameter         MAPWR_FIFO_DEPTH         = 16
+  ) (
+    input          ap_clk_0,
+    input          ap_rst_n_0,
+
+    input  [511:0] port0_0_tdata,
+    input  [63:0]  port0_0_tkeep,
+    input  [0:0]   port0_0_tlast,
+    output         port0_0_tready,
+    input  [47:0]  port0_0_tuser,
+    input          port0_0_tvalid,
+
+    output [511:0] port1_0_tdata,
+    output [63:0]  port1_0_tkeep,
+    output [0:0]   port1_0_tlast,
+    input          port1_0_tready,
+    output [47:0]  port1_0_tuser,
+    output         port1_0_tvalid,
+
+    output [511:0] hairpin_tdata,
+    output [63:0]  hairpin_tkeep,
+    output [0:0]   hairpin_tlast,
+    input          hairpin_tready,
+    output [47:0]  hairpin_tuser,
+    output         hairpin_tvalid,
+
+    input          s_axil_awvalid,
+    input  [31:0]  s_axil_awaddr,
+    output         s_axil_awready,
+    input          s_axil_wvalid,
+    input  [31:0]  s_axil_wdata,
+    output         s_axil_wready,
+    output         s_axil_bvalid,
+    output [1:0]   s_axil_bresp,
+    input          s_axil_bready,
+    input          s_axil_arvalid,
+    input  [31:0]  s_axil_araddr,
+    output         s_axil_arready,
+    output         s_axil_rvalid,
+    output [31:0]  s_axil_rdata,
+    output [1:0]   s_axil_rresp,
+    input          s_axil_rready,
+
+    output [31:0]  early_drop_count
+  );
+
+  localparam [31:0] NANONIC_ID      = 32'h4E4E4943;
+  localparam [31:0] NANONIC_VERSION = 32'd1;
+
+  reg  [63:0]  cycle_cnt;
+  reg  [31:0]  hairpin_pkts;
+  reg  [63:0]  hairpin_bytes;
+  reg  [31:0]  verdict_drop_pkts;
+  reg  [31:0]  port1_pkts;
+  wire [31:0]  mapwr_guard_count;
+
+  always @(posedge ap_clk_0) begin
+    if (!ap_rst_n_0)
+      cycle_cnt <= 64'd0;
+    else
+      cycle_cnt <= cycle_cnt + 1;
+  end
+
+  //----------------------------------------------------------------------------
+  // Register bus
+  //----------------------------------------------------------------------------
+  wire         reg_wr_en;
+  wire [15:0]  reg_wr_addr;
+  wire [31:0]  reg_wr_data;
+  wire         reg_rd_en;
+  wire [15:0]  reg_rd_addr;
+  reg  [31:0]  reg_rd_data;
+
+  reg  [31:0]  top_rd_data;
+  wire [31:0]  lat_rd_data;
+  wire [31:0]  encap_rd_data;
+  wire [31:0]  events_rd_data;
+  wire [31:0]  flight_rd_data;
+  wire [31:0]  mapwr_rd_data;
+
+  nanonic_axil_slave #(
+    .ADDR_W (16)
+  ) axil_inst (
+    .clk            (ap_clk_0),
+    .rst_n          (ap_rst_n_0),
+
+    .s_axil_awvalid (s_axil_awvalid),
+    .s_axil_awaddr  (s_axil_awaddr),
+    .s_axil_awready (s_axil_awready),
+    .s_axil_wvalid  (s_axil_wvalid),
+    .s_axil_wdata   (s_axil_wdata),
+    .s_axil_wready  (s_axil_wready),
+    .s_axil_bvalid  (s_axil_bvalid),
+    .s_axil_bresp   (s_axil_bresp),
+    .s_axil_bready  (s_axil_bready),
+    .s_axil_arvalid (s_axil_arvalid),
+    .s_axil_araddr  (s_axil_araddr),
+    .s_axil_arready (s_axil_arready),
+    .s_axil_rvalid  (s_axil_rvalid),
+    .s_axil_rdata   (s_axil_rdata),
+    .s_axil_rresp   (s_axil_rresp),
+    .s_axil_rready  (s_axil_rready),
+
+    .wr_en          (reg_wr_en),
+    .wr_addr        (reg_wr_addr),
+    .wr_data        (reg_wr_data),
+    .rd_en          (reg_rd_en),
+    .rd_addr        (reg_rd_addr),
+    .rd_data        (reg_rd_data)
+  );
+
+  // Reading the low word of a 64-bit counter latches the whole counter, so the
+  // high word read next belongs to the same value.
+  reg  [63:0]  cycle_snap;
+  reg  [63:0]  hairpin_bytes_snap;
+
+  always @(posedge ap_clk_0) begin
+    if (!ap_rst_n_0) begin
+      cycle_snap         <= 64'd0;
+      hairpin_bytes_snap <= 64'd0;
+    end
+    else if (reg_rd_en && reg_rd_addr[15:12] == 4'h0) begin
+      if (reg_rd_addr[11:0] == 12'h00C)
+        cycle_snap <= cycle_cnt;
+      if (reg_rd_addr[11:0] == 12'h018)
+        hairpin_bytes_snap <= hairpin_bytes;
+    end
+  end
+
+  always @(posedge ap_clk_0) begin
+    case (reg_rd_addr[11:0])
+      12'h000: top_rd_data <= NANONIC_ID;
+      12'h004: top_rd_data <= NANONIC_VERSION;
+      12'h008: top_rd_data <= early_drop_count;
+      12'h00C: top_rd_data <= cycle_snap[31:0];
+      12'h010: top_rd_data <= cycle_snap[63:32];
+      12'h014: top_rd_data <= hairpin_pkts;
+      12'h018: top_rd_data <= hairpin_bytes_snap[31:0];
+      12'h01C: top_rd_data <= hairpin_bytes_snap[63:32];
+      12'h020: top_rd_data <= verdict_drop_pkts;
+      12'h024: top_rd_data <= port1_pkts;
+      12'h028: top_rd_data <= mapwr_guard_count;
+      default: top_rd_data <= 32'd0;
+    endcase
+  end
+
+  always @(*) begin
+    casez (reg_rd_addr[15:12])
+      4'h0:    reg_rd_data = top_rd_data;
+      4'h1:    reg_rd_data = lat_rd_data;
+      4'h2:    reg_rd_data = encap_rd_data;
+      4'h3:    reg_rd_data = events_rd_data;
+      4'h4:    reg_rd_data = flight_rd_data;
+      4'b1???: reg_rd_data = mapwr_rd_data;
+      default: reg_rd_data = 32'd0;
+    endcase
+  end
+
+  //----------------------------------------------------------------------------
+  // Datapath
+  //----------------------------------------------------------------------------
+
+  wire [511:0] ppl_in_tdata;
+  wire [63:0]  ppl_in_tkeep;
+  wire         ppl_in_tlast;
+  wire         ppl_in_tready;
+  wire [47:0]  ppl_in_tuser;
+  wire         ppl_in_tvalid;
+
+  wire [511:0] ppl_out_tdata;
+  wire [63:0]  ppl_out_tkeep;
+  wire         ppl_out_tlast;
+  wire         ppl_out_tready;
+  wire [47:0]  ppl_out_tuser;
+  wire         ppl_out_tvalid;
+
+  // tuser of the Nanotube open_nic bus is 64 bits wide; the shell only uses
+  // the low 48 bits, bits 62:48 carry the ingress timestamp and bit 63 flags
+  // a frame that entered the pipeline with the descriptor magic in its first
+  // bytes, so the egress never takes such a frame for one the application
+  // pushed a descriptor on
+  wire         ppl_in_lookalike;
+  wire [15:0]  ppl_in_ts = {ppl_in_lookalike, LATENCY_EN ? cycle_cnt[14:0] : 15'd0};
+  wire [15:0]  ppl_out_ts;
+  wire         ppl_out_desc_ok = !ppl_out_ts[15];
+
+  wire [511:0] guard_in_tdata;
+  wire [63:0]  guard_in_tkeep;
+  wire         guard_in_tlast;
+  wire         guard_in_tready;
+  wire [47:0]  guard_in_tuser;
+  wire         guard_in_tvalid;
+
+  wire [511:0] drop_in_tdata;
+  wire [63:0]  drop_in_tkeep;
+  wire         drop_in_tlast;
+  wire         drop_in_tready;
+  wire [47:0]  drop_in_tuser;
+  wire         drop_in_tvalid;
+
+  // The tready of the limiter depends on the first beat through its table
+  // read and compares; a register slice keeps that path off port0_0_tready
+  generate
+    if (EARLY_DROP_EN && EARLY_DROP_LIMIT_EN && LANES == 1) begin : g_drop_rs
+      nanonic_axis_reg #(
+        .USER_W (48)
+      ) drop_rs_inst (
+        .clk           (ap_clk_0),
+        .rst_n         (ap_rst_n_0),
+
+        .s_axis_tvalid (port0_0_tvalid),
+        .s_axis_tdata  (port0_0_tdata),
+        .s_axis_tkeep  (port0_0_tkeep),
+        .s_axis_tlast  (port0_0_tlast),
+        .s_axis_tuser  (port0_0_tuser),
+        .s_axis_tready (port0_0_tready),
+
+        .m_axis_tvalid (drop_in_tvalid),
+        .m_axis_tdata  (drop_in_tdata),
+        .m_axis_tkeep  (drop_in_tkeep),
+        .m_axis_tlast  (drop_in_tlast),
+        .m_axis_tuser  (drop_in_tuser),
+        .m_axis_tready (drop_in_tready)
+      );
+    end
+    else begin : g_no_drop_rs
+      assign drop_in_tvalid = port0_0_tvalid;
+      assign drop_in_tdata  = port0_0_tdata;
+      assign drop_in_tkeep  = port0_0_tkeep;
+      assign drop_in_tlast  = port0_0_tlast;
+      assign drop_in_tuser  = port0_0_tuser;
+      assign port0_0_tready = drop_in_tready;
+    end
+  endgenerate
+
+  nanonic_early_drop #(
+    .ENABLE        (EARLY_DROP_EN),
+    .ETYPE_EN      (EARLY_DROP_ETYPE_EN),
+    .ETYPE         (EARLY_DROP_ETYPE),
+    .ETYPE_MASK    (EARLY_DROP_ETYPE_MASK),
+    .KEEP_EN       (EARLY_DROP_KEEP_EN),
+    .KEEP_SADDR    (EARLY_DROP_KEEP_SADDR),
+    .KEEP_PROTO    (EARLY_DROP_KEEP_PROTO),
+    .LIMIT_EN      (EARLY_DROP_LIMIT_EN && LANES == 1),
+    .LIMIT_THRESH  (EARLY_DROP_LIMIT_THRESH),
+    .LIMIT_ADDR_W  (EARLY_DROP_LIMIT_ADDR_W),
+    .LIMIT_ENTRIES (EARLY_DROP_LIMIT_ENTRIES)
+  ) early_drop_inst (
+    .clk           (ap_clk_0),
+    .rst_n         (ap_rst_n_0),
+
+    .s_axis_tvalid (drop_in_tvalid),
+    .s_axis_tdata  (drop_in_tdata),
+    .s_axis_tkeep  (drop_in_tkeep),
+    .s_axis_tlast  (drop_in_tlast),
+    .s_axis_tuser  (drop_in_tuser),
+    .s_axis_tready (drop_in_tready),
+
+    .m_axis_tvalid (guard_in_tvalid),
+    .m_axis_tdata  (guard_in_tdata),
+    .m_axis_tkeep  (guard_in_tkeep),
+    .m_axis_tlast  (guard_in_tlast),
+    .m_axis_tuser  (guard_in_tuser),
+    .m_axis_tready (guard_in_tready),
+
+    .drop_count    (early_drop_count)
+  );
+
+  // Only the map writer may send map updates into the pipeline; the guard
+  // stays on without the writer, the application may still apply them
+  nanonic_early_drop #(
+    .ENABLE     (MAPWR_EN || MAPWR_GUARD_EN),
+    .ETYPE      (MAPWR_ETHERTYPE),
+    .ETYPE_MASK (16'hFFFF),
+    .KEEP_EN    (0)
+  ) mapwr_guard_inst (
+    .clk           (ap_clk_0),
+    .rst_n         (ap_rst_n_0),
+
+    .s_axis_tvalid (guard_in_tvalid),
+    .s_axis_tdata  (guard_in_tdata),
+    .s_axis_tkeep  (guard_in_tkeep),
+    .s_axis_tlast  (guard_in_tlast),
+    .s_axis_tuser  (guard_in_tuser),
+    .s_axis_tready (guard_in_tready),
+
+    .m_axis_tvalid (ppl_in_tvalid),
+    .m_axis_tdata  (ppl_in_tdata),
+    .m_axis_tkeep  (ppl_in_tkeep),
+    .m_axis_tlast  (ppl_in_tlast),
+    .m_axis_tuser  (ppl_in_tuser),
+    .m_axis_tready (ppl_in_tready),
+
+    .drop_count    (mapwr_guard_count)
+  );
+
+  // Descriptor lookalike flag, taken on the first beat and held for the packet
+  reg  ppl_in_in_pkt;
+  reg  ppl_in_flag;
+
+  wire ppl_in_magic = ppl_in_tdata[7:0] == 8'h4E && ppl_in_tdata[15:8] == 8'h54 &&
+                      ppl_in_tdata[23:16] == 8'd1;
+
+  assign ppl_in_lookalike = META_EN && (ppl_in_in_pkt ? ppl_in_flag : ppl_in_magic);
+
+  always @(posedge ap_clk_0) begin
+    if (!ap_rst_n_0) begin
+      ppl_in_in_pkt <= 1'b0;
+      ppl_in_flag   <= 1'b0;
+    end
+    else if (ppl_in_tvalid && ppl_in_tready) begin
+      ppl_in_in_pkt <= ~ppl_in_tlast;
+      ppl_in_flag   <= ppl_in_lookalike;
+    end
+  end
+
+  // With LANES > 1 the packets are spread over copies of the pipeline and the
+  // lanes are merged again at packet boundaries. Each lane has its own copy of
+  // the maps, like the partitioned layout of gen_p2p_pipeline.py.
+  wire [LANES-1:0]     lane_in_tvalid;
+  wire [LANES*512-1:0] lane_in_tdata;
+  wire [LANES*64-1:0]  lane_in_tkeep;
+  wire [LANES-1:0]     lane_in_tlast;
+  wire [LANES*64-1:0]  lane_in_tuser;
+  wire [LANES-1:0]     lane_in_tready;
+
+  wire [LANES-1:0]     lane_out_tvalid;
+  wire [LANES*512-1:0] lane_out_tdata;
+  wire [LANES*64-1:0]  lane_out_tkeep;
+  wire [LANES-1:0]     lane_out_tlast;
+  wire [LANES*64-1:0]  lane_out_tuser;
+  wire [LANES-1:0]     lane_out_tready;
+
+  wire [LANES-1:0]     mapwr_tvalid;
+  wire [LANES*512-1:0] mapwr_tdata;
+  wire [LANES*64-1:0]  mapwr_tkeep;
+  wire [LANES-1:0]     mapwr_tlast;
+  wire [LANES*48-1:0]  mapwr_tuser;
+  wire [LANES-1:0]     mapwr_tready;
+
+  nanonic_map_writer #(
+    .ENABLE     (MAPWR_EN),
+    .NUM_OUT    (LANES),
+    .ETHERTYPE  (MAPWR_ETHERTYPE),
+    .KEY_W      (MAPWR_KEY_W),
+    .VAL_W      (MAPWR_VAL_W),
+    .FIFO_DEPTH (MAPWR_FIFO_DEPTH)
+  ) mapwr_inst (
+    .clk           (ap_clk_0),
+    .rst_n         (ap_rst_n_0),
+
+    .m_axis_tvalid (mapwr_tvalid),
+    .m_axis_tdata  (mapwr_tdata),
+    .m_axis_tkeep  (mapwr_tkeep),
+    .m_axis_tlast  (mapwr_tlast),
+    .m_axis_tuser  (mapwr_tuser),
+    .m_axis_tready (mapwr_tready),
+
+    .wr_en         (reg_wr_en && reg_wr_addr[15]),
+    .wr_map        (reg_wr_addr[14:12]),
+    .wr_addr       (reg_wr_addr[11:0]),
+    .wr_data       (reg_wr_data),
+    .rd_map        (reg_rd_addr[14:12]),
+    .rd_addr       (reg_rd_addr[11:0]),
+    .rd_data       (mapwr_rd_data)
+  );
+
+  genvar g;
+  generate
+    if (LANES == 1) begin : g_one_lane
+      assign lane_in_tvalid  = ppl_in_tvalid;
+      assign lane_in_tdata   = ppl_in_tdata;
+      assign lane_in_tkeep   = ppl_in_tkeep;
+      assign lane_in_tlast   = ppl_in_tlast;
+      assign lane_in_tuser   = {ppl_in_ts, ppl_in_tuser};
+      assign ppl_in_tready   = lane_in_tready;
+
+      assign ppl_out_tvalid  = lane_out_tvalid;
+      assign ppl_out_tdata   = lane_out_tdata;
+      assign ppl_out_tkeep   = lane_out_tkeep;
+      assign ppl_out_tlast   = lane_out_tlast;
+      assign {ppl_out_ts, ppl_out_tuser} = lane_out_tuser;
+      assign lane_out_tready = ppl_out_tready;
+    end
+    else begin : g_lanes
+      wire [LANES-1:0]     dsp_tvalid;
+      wire [LANES*512-1:0] dsp_tdata;
+      wire [LANES*64-1:0]  dsp_tkeep;
+      wire [LANES-1:0]     dsp_tlast;
+      wire [LANES*64-1:0]  dsp_tuser;
+      wire [LANES-1:0]     dsp_tready;
+
+      nanonic_lane_dispatch #(
+        .NUM_OUT (LANES),
+        .USER_W  (64),
+        .BY_FLOW (LANES_BY_FLOW)
+      ) dispatch_inst (
+        .clk           (ap_clk_0),
+        .rst_n         (ap_rst_n_0),
+
+        .s_axis_tvalid (ppl_in_tvalid),
+        .s_axis_tdata  (ppl_in_tdata),
+        .s_axis_tkeep  (ppl_in_tkeep),
+        .s_axis_tlast  (ppl_in_tlast),
+        .s_axis_tuser  ({ppl_in_ts, ppl_in_tuser}),
+        .s_axis_tready (ppl_in_tready),
+
+        .m_axis_tvalid (dsp_tvalid),
+        .m_axis_tdata  (dsp_tdata),
+        .m_axis_tkeep  (dsp_tkeep),
+        .m_axis_tlast  (dsp_tlast),
+        .m_axis_tuser  (dsp_tuser),
+        .m_axis_tready (dsp_tready)
+      );
+
+      // The dispatcher needs a tready that does not wait for tvalid
+      for (g = 0; g < LANES; g = g + 1) begin : g_lane_rs
+        nanonic_axis_reg #(
+          .USER_W (64)
+        ) lane_rs_inst (
+          .clk           (ap_clk_0),
+          .rst_n         (ap_rst_n_0),
+
+          .s_axis_tvalid (dsp_tvalid[g]),
+          .s_axis_tdata  (dsp_tdata[g*512 +: 512]),
+          .s_axis_tkeep  (dsp_tkeep[g*64 +: 64]),
+          .s_axis_tlast  (dsp_tlast[g]),
+          .s_axis_tuser  (dsp_tuser[g*64 +: 64]),
+          .s_axis_tready (dsp_tready[g]),
+
+          .m_axis_tvalid (lane_in_tvalid[g]),
+          .m_axis_tdata  (lane_in_tdata[g*512 +: 512]),
+          .m_axis_tkeep  (lane_in_tkeep[g*64 +: 64]),
+          .m_axis_tlast  (lane_in_tlast[g]),
+          .m_axis_tuser  (lane_in_tuser[g*64 +: 64]),
+          .m_axis_tready (lane_in_tready[g])
+        );
+      end
+
+      wire         mrg_tvalid;
+      wire [511:0] mrg_tdata;
+      wire [63:0]  mrg_tkeep;
+      wire         mrg_tlast;
+      wire [63:0]  mrg_tuser;
+      wire         mrg_tready;
+
+      nanonic_axis_arb #(
+        .NUM_IN (LANES),
+        .USER_W (64)
+      ) merge_inst (
+        .clk           (ap_clk_0),
+        .rst_n         (ap_rst_n_0),
+
+        .s_axis_tvalid (lane_out_tvalid),
+        .s_axis_tdata  (lane_out_tdata),
+        .s_axis_tkeep  (lane_out_tkeep),
+        .s_axis_tlast  (lane_out_tlast),
+        .s_axis_tuser  (lane_out_tuser),
+        .s_axis_tready (lane_out_tready),
+
+        .m_axis_tvalid (mrg_tvalid),
+        .m_axis_tdata  (mrg_tdata),
+        .m_axis_tkeep  (mrg_tkeep),
+        .m_axis_tlast  (mrg_tlast),
+        .m_axis_tuser  (mrg_tuser),
+        .m_axis_tready (mrg_tready)
+      );
+
+      nanonic_axis_reg #(
+        .USER_W (64)
+      ) merge_rs_inst (
+        .clk           (ap_clk_0),
+        .rst_n         (ap_rst_n_0),
+
+        .s_axis_tvalid (mrg_tvalid),
+        .s_axis_tdata  (mrg_tdata),
+        .s_axis_tkeep  (mrg_tkeep),
+        .s_axis_tlast  (mrg_tlast),
+        .s_axis_tuser  (mrg_tuser),
+        .s_axis_tready (mrg_tready),
+
+        .m_axis_tvalid (ppl_out_tvalid),
+        .m_axis_tdata  (ppl_out_tdata),
+        .m_axis_tkeep  (ppl_out_tkeep),
+        .m_axis_tlast  (ppl_out_tlast),
+        .m_axis_tuser  ({ppl_out_ts, ppl_out_tuser}),
+        .m_axis_tready (ppl_out_tready)
+      );
+    end
+
+    // The block design is instantiated directly rather than through
+    // Nanotube_pipeline_wrapper: its tuser is 64 bits wide and the upper 16 bits
+    // carry the ingress timestamp, while the wrapper keeps the 48-bit tuser of
+    // the shell. tstrb is tied off as in the wrapper.
+    for (g = 0; g < LANES; g = g + 1) begin : g_lane
+      wire [63:0] lane_in_tstrb  = 64'hFFFFFFFFFFFFFFFF;
+      wire [63:0] lane_out_tstrb = 64'hFFFFFFFFFFFFFFFF;
+
+      wire         bd_in_tvalid;
+      wire [511:0] bd_in_tdata;
+      wire [63:0]  bd_in_tkeep;
+      wire         bd_in_tlast;
+      wire [63:0]  bd_in_tuser;
+      wire         bd_in_tready;
+
+      // Map writer messages enter the lane between packets
+      if (MAPWR_EN) begin : g_mapwr
+        wire         mw_tvalid;
+        wire [511:0] mw_tdata;
+        wire [63:0]  mw_tkeep;
+        wire         mw_tlast;
+        wire [63:0]  mw_tuser;
+        wire         mw_tready;
+
+        nanonic_axis_arb #(
+          .NUM_IN (2),
+          .USER_W (64)
+        ) mapwr_arb_inst (
+          .clk           (ap_clk_0),
+          .rst_n         (ap_rst_n_0),
+
+          .s_axis_tvalid ({mapwr_tvalid[g], lane_in_tvalid[g]}),
+          .s_axis_tdata  ({mapwr_tdata[g*512 +: 512], lane_in_tdata[g*512 +: 512]}),
+          .s_axis_tkeep  ({mapwr_tkeep[g*64 +: 64], lane_in_tkeep[g*64 +: 64]}),
+          .s_axis_tlast  ({mapwr_tlast[g], lane_in_tlast[g]}),
+          .s_axis_tuser  ({16'd0, mapwr_tuser[g*48 +: 48], lane_in_tuser[g*64 +: 64]}),
+          .s_axis_tready ({mapwr_tready[g], lane_in_tready[g]}),
+
+          .m_axis_tvalid (mw_tvalid),
+          .m_axis_tdata  (mw_tdata),
+          .m_axis_tkeep  (mw_tkeep),
+          .m_axis_tlast  (mw_tlast),
+          .m_axis_tuser  (mw_tuser),
+          .m_axis_tready (mw_tready)
+        );
+
+        nanonic_axis_reg #(
+          .USER_W (64)
+        ) mapwr_rs_inst (
+          .clk           (ap_clk_0),
+          .rst_n         (ap_rst_n_0),
+
+          .s_axis_tvalid (mw_tvalid),
+          .s_axis_tdata  (mw_tdata),
+          .s_axis_tkeep  (mw_tkeep),
+          .s_axis_tlast  (mw_tlast),
+          .s_axis_tuser  (mw_tuser),
+          .s_axis_tready (mw_tready),
+
+          .m_axis_tvalid (bd_in_tvalid),
+          .m_axis_tdata  (bd_in_tdata),
+          .m_axis_tkeep  (bd_in_tkeep),
+          .m_axis_tlast  (bd_in_tlast),
+          .m_axis_tuser  (bd_in_tuser),
+          .m_axis_tready (bd_in_tready)
+        );
+      end
+      else begin : g_no_mapwr
+        assign bd_in_tvalid      = lane_in_tvalid[g];
+        assign bd_in_tdata       = lane_in_tdata[g*512 +: 512];
+        assign bd_in_tkeep       = lane_in_tkeep[g*64 +: 64];
+        assign bd_in_tlast       = lane_in_tlast[g];
+        assign bd_in_tuser       = lane_in_tuser[g*64 +: 64];
+        assign lane_in_tready[g] = bd_in_tready;
+        assign mapwr_tready[g]   = 1'b1;
+      end
+
+      Nanotube_pipeline ppl_inst (
+        .ap_clk_0       (ap_clk_0),
+        .ap_rst_n_0     (ap_rst_n_0),
+
+        .port0_0_tdata  (bd_in_tdata),
+        .port0_0_tkeep  (bd_in_tkeep),
+        .port0_0_tlast  (bd_in_tlast),
+        .port0_0_tready (bd_in_tready),
+        .port0_0_tstrb  (lane_in_tstrb),
+        .port0_0_tuser  (bd_in_tuser),
+        .port0_0_tvalid (bd_in_tvalid),
+
+        .port1_0_tdata  (lane_out_tdata[g*512 +: 512]),
+        .port1_0_tkeep  (lane_out_tkeep[g*64 +: 64]),
+        .port1_0_tlast  (lane_out_tlast[g]),
+        .port1_0_tready (lane_out_tready[g]),
+        .port1_0_tstrb  (lane_out_tstrb),
+        .port1_0_tuser  (lane_out_tuser[g*64 +: 64]),
+        .port1_0_tvalid (lane_out_tvalid[g])
+      );
+    end
+  endgenerate
+
+  // Latency sample taken on the first beat of every packet leaving the pipeline
+  reg ppl_out_in_pkt;
+
+  always @(posedge ap_clk_0) begin
+    if (!ap_rst_n_0)
+      ppl_out_in_pkt <= 1'b0;
+    else if (ppl_out_tvalid && ppl_out_tready)
+      ppl_out_in_pkt <= ~ppl_out_tlast;
+  end
+
+  generate
+    if (LATENCY_EN) begin : g_latency
+      wire        lat_valid = ppl_out_tvalid && ppl_out_tready && !ppl_out_in_pkt;
+
+      // Egress stall cycles of the current and the previous 32768-cycle lap,
+      // together at least those of the last 32768 cycles
+      reg  [15:0] lat_stall_cur;
+      reg  [15:0] lat_stall_prev;
+      wire        lat_stall = ppl_out_tvalid && !ppl_out_tready;
+
+      always @(posedge ap_clk_0) begin
+        if (!ap_rst_n_0) begin
+          lat_stall_cur  <= 16'd0;
+          lat_stall_prev <= 16'd0;
+        end
+        else if (&cycle_cnt[14:0]) begin
+          lat_stall_cur  <= 16'd0;
+          lat_stall_prev <= lat_stall_cur + lat_stall;
+        end
+        else if (lat_stall)
+          lat_stall_cur <= lat_stall_cur + 1;
+      end
+
+      // A stamp that may have wrapped saturates into the top bucket
+      wire        lat_wrap  = {1'b0, lat_stall_cur} + lat_stall_prev >= 17'd32768 - LATENCY_FREE_CYCLES;
+      wire [15:0] lat_delta = lat_wrap ? 16'h8000 : {1'b0, cycle_cnt[14:0] - ppl_out_ts[14:0]};
+
+      nanonic_latency_hist #(
+        .CLK_PERIOD_PS (CLK_PERIOD_PS)
+      ) latency_inst (
+        .clk          (ap_clk_0),
+        .rst_n        (ap_rst_n_0),
+        .sample_valid (lat_valid),
+        .sample       (lat_delta),
+        .wr_en        (reg_wr_en && reg_wr_addr[15:12] == 4'h1),
+        .wr_addr      (reg_wr_addr[11:0]),
+        .wr_data      (reg_wr_data),
+        .rd_en        (reg_rd_en && reg_rd_addr[15:12] == 4'h1),
+        .rd_addr      (reg_rd_addr[11:0]),
+        .rd_data      (lat_rd_data)
+      );
+    end
+    else begin : g_no_latency
+      assign lat_rd_data = 32'd0;
+    end
+  endgenerate
+
+  wire [511:0] enc_out_tdata;
+  wire [63:0]  enc_out_tkeep;
+  wire         enc_out_tlast;
+  wire         enc_out_tready;
+  wire [47:0]  enc_out_tuser;
+  wire         enc_out_tvalid;
+  wire         enc_out_desc_ok;
+
+  nanonic_encap #(
+    .ENABLE        (ENCAP_EN && META_EN),
+    .GW_MAC        (ENCAP_GW_MAC),
+    .V6_SRC_PREFIX (ENCAP_V6_SRC_PREFIX)
+  ) encap_inst (
+    .clk           (ap_clk_0),
+    .rst_n         (ap_rst_n_0),
+
+    .s_axis_tvalid (ppl_out_tvalid),
+    .s_axis_tdata  (ppl_out_tdata),
+    .s_axis_tkeep  (ppl_out_tkeep),
+    .s_axis_tlast  (ppl_out_tlast),
+    .s_axis_tuser  (ppl_out_tuser),
+    .s_axis_desc_ok (ppl_out_desc_ok),
+    .s_axis_tready (ppl_out_tready),
+
+    .m_axis_tvalid (enc_out_tvalid),
+    .m_axis_tdata  (enc_out_tdata),
+    .m_axis_tkeep  (enc_out_tkeep),
+    .m_axis_tlast  (enc_out_tlast),
+    .m_axis_tuser  (enc_out_tuser),
+    .m_axis_desc_ok (enc_out_desc_ok),
+    .m_axis_tready (enc_out_tready),
+
+    .wr_en         (reg_wr_en && reg_wr_addr[15:12] == 4'h2),
+    .wr_addr       (reg_wr_addr[11:0]),
+    .wr_data       (reg_wr_data),
+    .rd_addr       (reg_rd_addr[11:0]),
+    .rd_data       (encap_rd_data)
+  );
+
+  nanonic_flight_rec #(
+    .ENABLE    (FLIGHT_EN),
+    .DEPTH     (FLIGHT_DEPTH),
+    .HDR_BYTES (FLIGHT_HDR_BYTES),
+    .POST      (FLIGHT_POST)
+  ) flight_inst (
+    .clk          (ap_clk_0),
+    .rst_n        (ap_rst_n_0),
+
+    .snoop_tvalid (enc_out_tvalid),
+    .snoop_tready (enc_out_tready),
+    .snoop_tdata  (enc_out_tdata),
+    .snoop_tlast  (enc_out_tlast),
+    .snoop_tuser  (enc_out_tuser),
+    .snoop_desc_ok (enc_out_desc_ok),
+
+    .now          (cycle_cnt),
+
+    .wr_en        (reg_wr_en && reg_wr_addr[15:12] == 4'h4),
+    .wr_addr      (reg_wr_addr[11:0]),
+    .wr_data      (reg_wr_data),
+    .rd_addr      (reg_rd_addr[11:0]),
+    .rd_data      (flight_rd_data)
+  );
+
+  wire         egress_first;
+  wire [7:0]   egress_verdict;
+
+  // Egress counters, used to measure the traffic kept off PCIe by the hairpin
+  wire egress_hs   = enc_out_tvalid && enc_out_tready && egress_first;
+  wire egress_drop = HAIRPIN_EN && (egress_verdict == 8'd0 || egress_verdict == 8'd1);
+
+  always @(posedge ap_clk_0) begin
+    if (!ap_rst_n_0) begin
+      hairpin_pkts      <= 32'd0;
+      hairpin_bytes     <= 64'd0;
+      verdict_drop_pkts <= 32'd0;
+      port1_pkts        <= 32'd0;
+    end
+    else begin
+      // tuser[15:0] holds the frame size on every beat
+      if (hairpin_tvalid && hairpin_tready && hairpin_tlast) begin
+        hairpin_pkts  <= hairpin_pkts + 1;
+        hairpin_bytes <= hairpin_bytes + hairpin_tuser[15:0];
+      end
+      if (egress_hs && egress_drop)
+        verdict_drop_pkts <= verdict_drop_pkts + 1;
+      if (port1_0_tvalid && port1_0_tready && port1_0_tlast)
+        port1_pkts <= port1_pkts + 1;
+    end
+  end
+
+  wire [511:0] host_tdata;
+  wire [63:0]  host_tkeep;
+  wire         host_tlast;
+  wire         host_tready;
+  wire [47:0]  host_tuser;
+  wire         host_tvalid;
+
+  nanonic_egress #(
+    .ENABLE     (META_EN),
+    .STRIP_DESC (META_STRIP),
+    .HAIRPIN_EN (HAIRPIN_EN)
+  ) egress_inst (
+    .clk           (ap_clk_0),
+    .rst_n         (ap_rst_n_0),
+
+    .s_axis_tvalid (enc_out_tvalid),
+    .s_axis_tdata  (enc_out_tdata),
+    .s_axis_tkeep  (enc_out_tkeep),
+    .s_axis_tlast  (enc_out_tlast),
+    .s_axis_tuser  (enc_out_tuser),
+    .s_axis_desc_ok (enc_out_desc_ok),
+    .s_axis_tready (enc_out_tready),
+
+    .m_axis_tvalid (host_tvalid),
+    .m_axis_tdata  (host_tdata),
+    .m_axis_tkeep  (host_tkeep),
+    .m_axis_tlast  (host_tlast),
+    .m_axis_tuser  (host_tuser),
+    .m_axis_tready (host_tready),
+
+    .h_axis_tvalid (hairpin_tvalid),
+    .h_axis_tdata  (hairpin_tdata),
+    .h_axis_tkeep  (hairpin_tkeep),
+    .h_axis_tlast  (hairpin_tlast),
+    .h_axis_tuser  (hairpin_tuser),
+    .h_axis_tready (hairpin_tready),
+
+    .pkt_first     (egress_first),
+    .pkt_has_desc  (),
+    .pkt_verdict   (egress_verdict),
+    .pkt_flags     (),
+    .pkt_class     (),
+    .pkt_event     (),
+    .pkt_encap     (),
+    .pkt_hash      (),
+    .pkt_real      (),
+    .pkt_vip       ()
+  );
+
+  // Event records share port1 with the host traffic, at the lowest priority
+  nanonic_event_tap #(
+    .ENABLE     (EVENTS_EN && META_EN),
+    .FIFO_BEATS (EVENTS_FIFO_BEATS),
+    .PERIOD     (EVENTS_PERIOD),
+    .EVENT_SRC  (EVENTS_SRC)
+  ) events_inst (
+    .clk           (ap_clk_0),
+    .rst_n         (ap_rst_n_0),
+
+    .snoop_tvalid  (enc_out_tvalid),
+    .snoop_tready  (enc_out_tready),
+    .snoop_tdata   (enc_out_tdata),
+    .snoop_tkeep   (enc_out_tkeep),
+    .snoop_tlast   (enc_out_tlast),
+    .snoop_desc_ok (enc_out_desc_ok),
+
+    .s_axis_tvalid (host_tvalid),
+    .s_axis_tdata  (host_tdata),
+    .s_axis_tkeep  (host_tkeep),
+    .s_axis_tlast  (host_tlast),
+    .s_axis_tuser  (host_tuser),
+    .s_axis_tready (host_tready),
+
+    .m_axis_tvalid (port1_0_tvalid),
+    .m_axis_tdata  (port1_0_tdata),
+    .m_axis_tkeep  (port1_0_tkeep),
+    .m_axis_tlast  (port1_0_tlast),
+    .m_axis_tuser  (port1_0_tuser),
+    .m_axis_tready (port1_0_tready),
+
+    .wr_en         (reg_wr_en && reg_wr_addr[15:12] == 4'h3),
+    .wr_addr       (reg_wr_addr[11:0]),
+    .wr_data       (reg_wr_data),
+    .rd_addr       (reg_rd_addr[11:0]),
+    .rd_data       (events_rd_data)
+  );
+
+endmodule
@@ -0,0 +1,256 @@
+#!/usr/bin/env python3
+"""
+CPU baseline of the Custom_applications: run the XDP programs in the kernel
+with BPF_PROG_TEST_RUN and report the cost per packet.
+
+For every application the script compiles the program for the BPF target,
+loads it with bpftool and runs it with `bpftool prog run ... repeat N`, which
+executes the program N times on the same input in the kernel and returns the
+average duration. Inputs are the packets of the pcap.IN test files (one
+measurement per packet) and a sweep of frame sizes built from the first IPv4
+packet of the test file. The sweep is repeated on 1..N cores in parallel, one
+bpftool process pinned per core, to get the scaling with shared maps. The
+FPGA column is the rate of one pipeline at 250 MHz and II=1, limited by the
+512-bit bus (one frame beat per cycle).
+
+The Nanotube variants of some applications skip the bounds checks that the
+kernel verifier requires (Nanotube does not need them); they are reported as
+rejected, together with the last line of the verifier log. Programs that
+declare their maps in the legacy "maps" section are converted to BTF-defined
+maps on the fly, since libbpf 1.0 no longer loads them.
+
+Needs clang, bpftool and root (or CAP_BPF + CAP_SYS_ADMIN), and the Katran
+headers for the applications that include them (--katran, as in
+nanotube_steps.sh).
+
+  sudo python3 scripts/cpu_xdp_bench.py --cores 1,2,4 xdp_drop_count_ICMP xdp_katran
+"""
+import argparse
+import json
+import os
+import re
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+
+from nanonic_pcap import read_pcap
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+APPS_DIR = os.path.join(ROOT, "Custom_applications")
+BPFFS = "/sys/fs/bpf/nanonic_bench"
+
+VERDICTS = {0: "ABORTED", 1: "DROP", 2: "PASS", 3: "TX", 4: "REDIRECT"}
+FPGA_CLOCK_MHZ = 250.0
+
+# Directory, source and build flags of each application; the CPU build of
+# Katran leaves NANOTUBE_SIMPLE out so the kernel runs the stock code paths
+APPS = {
+    "xdp_pass_all": ("xdp_pass_all", "xdp_pass_all_counter.c", []),
+    "xdp_drop_all": ("xdp_drop_all", "xdp_drop_all.c", []),
+    "xdp_drop_IPv4": ("xdp_drop_IPv4", "xdp_drop_IPv4.c", []),
+    "xdp_dec_ttl": ("xdp_dec_ttl", "xdp_dec_ttl.c", []),
+    "xdp_swap_mac": ("xdp_swap_mac", "xdp_swap_mac.c", []),
+    "xdp_drop_count_ICMP": ("xdp_drop_count_ICMP", "xdp_drop_count_ICMP_original.c", []),
+    "xdp_drop_count_ICMP_nanotube": ("xdp_drop_count_ICMP", "xdp_drop_count_ICMP_nanotube.c", []),
+    "xdp_katran": ("xdp_katran", "xdp_katran.c", []),
+}
+
+LEGACY_MAP = re.compile(
+    r"struct\s+bpf_map_def\s+__attribute__\s*\(\(\s*section\s*\(\s*\"maps\"\s*\)"
+    r"\s*,\s*used\s*\)\)\s+(\w+)\s*=\s*\{(.*?)\}\s*;", re.S)
+LEGACY_FIELD = re.compile(r"\.(\w+)\s*=\s*([^,]+?)\s*(?:,|$)", re.S)
+
+
+def app_dir(app):
+    return os.path.join(APPS_DIR, APPS[app][0])
+
+
+def btf_maps(src):
+    """Rewrite legacy bpf_map_def maps of a preprocessed source as BTF maps."""
+    def repl(m):
+        fields = dict(LEGACY_FIELD.findall(m.group(2)))
+        if "inner_map_idx" in fields:
+            raise RuntimeError(f"map {m.group(1)}: map-in-map definitions are not converted")
+        body = "".join(f" int (*{k})[{v}];" for k, v in fields.items() if k != "pinning")
+        return f"struct {{{body} }} {m.group(1)} __attribute__((section(\".maps\"), used));"
+    return LEGACY_MAP.sub(repl, src)
+
+
+def compile_app(app, args, workdir):
+    _, src, flags = APPS[app]
+    path = os.path.join(app_dir(app), src)
+    inc = ["-I", os.path.join(APPS_DIR, "common"),
+           "-I", os.path.join(args.katran, "katran", "lib", "linux_includes"),
+           "-I", os.path.join(args.katran, "katran", "lib", "bpf")]
+    cflags = ["-O2", "-g", "-target", "bpf", "-Wno-unused-value", "-Wno-pointer-sign",
+              "-Wno-compare-distinct-pointer-types"] + flags + args.cflags
+    pre = os.path.join(workdir, app + ".i")
+    obj = os.path.join(workdir, app + ".o")
+    subprocess.run([args.clang, "-E", "-P"] + cflags + inc + [path, "-o", pre],
+                   check=True)
+    with open(pre) as fh:
+        text = btf_maps(fh.read())
+    with open(pre, "w") as fh:
+        fh.write(text)
+    subprocess.run([args.clang] + cflags + ["-c", pre, "-o", obj], check=True)
+    return obj
+
+
+def bpftool(args, *cmd, cpu=None):
+    full = [args.bpftool, "-j"] + list(cmd)
+    if cpu is not None:
+        full = ["taskset", "-c", str(cpu)] + full
+    return subprocess.Popen(full, stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+                            text=True)
+
+
+def load(app, obj, args):
+    pindir = os.path.join(BPFFS, app, "prog")
+    mapdir = os.path.join(BPFFS, app, "maps")
+    shutil.rmtree(os.path.join(BPFFS, app), ignore_errors=True)
+    p = bpftool(args, "prog", "loadall", obj, pindir, "type", "xdp", "pinmaps", mapdir)
+    out, err = p.communicate()
+    if p.returncode:
+        # The verifier log ends with the reason of the rejection
+        lines = [l.strip() for l in err.splitlines() if l.strip()]
+        log = [l for l in lines if not l.startswith(("libbpf:", "Error:", "-- END"))]
+        raise RuntimeError("not loaded: " + (log[-1] if log else " ".join(lines[-1:])))
+    progs = [os.path.join(pindir, n) for n in os.listdir(pindir)]
+    if len(progs) != 1:
+        raise RuntimeError(f"expected one program, found {len(progs)}")
+    if args.setup:
+        # bpftool batch file, {maps} is the directory of the pinned maps
+        with open(args.setup) as fh:
+            batch = fh.read().replace("{maps}", mapdir)
+        with tempfile.NamedTemporaryFile("w", suffix=".batch") as fh:
+            fh.write(batch)
+            fh.flush()
+            subprocess.run([args.bpftool, "batch", "file", fh.name], check=True,
+                           stdout=subprocess.DEVNULL)
+    return progs[0]
+
+
+def run(prog, data, args, cores=1):
+    """Average ns per run of data on `cores` cores in parallel, and the verdict."""
+    with tempfile.NamedTemporaryFile(suffix=".bin") as fh:
+        fh.write(data)
+        fh.flush()
+        procs = [bpftool(args, "prog", "run", "pinned", prog, "data_in", fh.name,
+                         "repeat", str(args.repeat), cpu=c) for c in range(cores)]
+        res = []
+        for p in procs:
+            out, err = p.communicate()
+            if p.returncode:
+                raise RuntimeError(f"test run failed: {err.strip()}")
+            res.append(json.loads(out))
+    return [r["duration"] for r in res], res[0]["retval"]
+
+
+def sized(frame, size):
+    """frame grown (or cut) to size bytes, IPv4 lengths and checksum fixed."""
+    data = bytearray(frame[:size] + bytes(max(0, size - len(frame))))
+    if len(data) >= 34 and data[12:14] == b"\x08\x00":
+        struct.pack_into("!H", data, 16, size - 14)
+        struct.pack_into("!H", data, 24, 0)
+        s = sum(struct.unpack("!10H", bytes(data[14:34])))
+        while s >> 16:
+            s = (s & 0xFFFF) + (s >> 16)
+        struct.pack_into("!H", data, 24, ~s & 0xFFFF)
+    return bytes(data)
+
+
+def pcaps(app):
+    d = os.path.join(app_dir(app), "pcap_test_files")
+    if not os.path.isdir(d):
+        return []
+    return sorted(os.path.join(d, f) for f in os.listdir(d) if f.endswith(".pcap.IN"))
+
+
+def bench_app(app, args, workdir):
+    print(f"== {app}")
+    try:
+        prog = load(app, compile_app(app, args, workdir), args)
+    except (RuntimeError, subprocess.CalledProcessError) as e:
+        print(f"   {e}\n")
+        return None
+
+    template = None
+    for path in pcaps(app):
+        packets = [d for _, d in read_pcap(path) if len(d) >= 14]
+        total = 0.0
+        verdicts = {}
+        for data in packets:
+            ns, ret = run(prog, data, args)
+            total += ns[0]
+            verdicts[VERDICTS.get(ret, ret)] = verdicts.get(VERDICTS.get(ret, ret), 0) + 1
+            if template is None and data[12:14] == b"\x08\x00":
+                template = data
+        avg = total / len(packets)
+        mix = " ".join(f"{k} {v}" for k, v in sorted(verdicts.items()))
+        print(f"   {os.path.basename(path)}: {len(packets)} packets, {avg:.1f} ns/pkt, "
+              f"{1e3 / avg:.2f} Mpps/core ({mix})")
+
+    if template is None:
+        print("")
+        return None
+    print(f"   {'Size':>5} {'Cores':>5} {'ns/pkt':>8} {'Mpps':>8} {'Mpps/core':>9} "
+          f"{'Verdict':>8} {'FPGA Mpps':>9}")
+    rows = []
+    for size in args.sizes:
+        data = sized(template, size)
+        for cores in args.cores:
+            ns, ret = run(prog, data, args, cores)
+            mpps = sum(1e3 / n for n in ns)
+            fpga = FPGA_CLOCK_MHZ / ((size + 63) // 64)
+            rows.append((size, cores, sum(ns) / len(ns), mpps))
+            print(f"   {size:>5} {cores:>5} {sum(ns) / len(ns):>8.1f} {mpps:>8.2f} "
+                  f"{mpps / cores:>9.2f} {VERDICTS.get(ret, ret):>8} {fpga:>9.1f}")
+    print("")
+    return rows
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__,
+                                formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument("apps", nargs="*", default=list(APPS),
+                   help=f"Applications (default: all of {', '.join(APPS)}).")
+    p.add_argument("--katran", default=os.environ.get("KATRAN", os.path.join(ROOT, "external", "katran")),
+                   help="Katran checkout (default: $KATRAN or external/katran).")
+    p.add_argument("--repeat", type=int, default=1000000,
+                   help="Runs of each input in the kernel (default: %(default)s).")
+    p.add_argument("--sizes", type=lambda s: [int(x) for x in s.split(",")],
+                   default=[64, 128, 256, 512, 1024, 1518],
+                   help="Frame sizes of the sweep (default: 64,...,1518).")
+    p.add_argument("--cores", type=lambda s: [int(x) for x in s.split(",")], default=[1],
+                   help="Core counts of the sweep, e.g. 1,2,4,8 (default: 1).")
+    p.add_argument("--cflags", nargs="*", default=[],
+                   help="Extra clang flags, e.g. -DNANONIC_META.")
+    p.add_argument("--setup",
+                   help="bpftool batch file run after loading, e.g. to fill the maps of "
+                        "Katran ({maps} is replaced by the directory of the pinned maps).")
+    p.add_argument("--clang", default="clang")
+    p.add_argument("--bpftool", default="bpftool")
+    p.add_argument("--keep", action="store_true",
+                   help="Leave the programs pinned under " + BPFFS + ".")
+    args = p.parse_args()
+
+    for app in args.apps:
+        if app not in APPS:
+            p.error(f"unknown application {app}")
+    if max(args.cores) > os.cpu_count():
+        p.error(f"only {os.cpu_count()} cores")
+
+    with tempfile.TemporaryDirectory() as workdir:
+        try:
+            for app in args.apps:
+                bench_app(app, args, workdir)
+        finally:
+            if not args.keep:
+                shutil.rmtree(BPFFS, ignore_errors=True)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
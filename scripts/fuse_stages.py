@@ -0,0 +1,498 @@
+#!/usr/bin/env python3
+"""
+Fuse adjacent Nanotube pipeline stages into a single HLS stage.
+
+Even small applications come out of the Nanotube pipeline pass as a chain of
+stages linked by 16-deep FIFOs. Every stage boundary costs the latency of the
+stage block, a FIFO and its BRAM. This script works on the .hls directory
+written by Nanotube, before scripts/hls_build, and merges groups of adjacent
+stages into one stage whose top function is an HLS dataflow region calling the
+original stage functions. The links inside a group become 2-deep local streams
+(registers instead of BRAM FIFOs) and the group is built, placed and linked in
+the block design as a single IP.
+
+  plan    : propose groups from a baseline build. Only stages that already meet
+            II=1 and timing are merged, consecutive in the pipeline and at most
+            --max-group at a time.
+  fuse    : write a copy of the .hls directory with the groups fused, the
+            vitis_opts.ini links renumbered and nanotube_hls_build.json updated.
+            After building it, run fuse again with --reject FUSED_BUILD: groups
+            whose fused stage lost II=1 or timing closure are split back.
+  compare : print stage count, latency, II, timing, FIFO count and BRAM of two
+            builds side by side.
+
+Typical flow:
+
+  fuse_stages.py plan APP.hls HLS_build/app
+  fuse_stages.py fuse APP.hls APP.fused.hls --auto HLS_build/app
+  hls_build ... APP.fused.hls HLS_build/app_fused
+  fuse_stages.py fuse APP.hls APP.fused.hls --reject HLS_build/app_fused
+  hls_build ... APP.fused.hls HLS_build/app_fused
+  fuse_stages.py compare HLS_build/app HLS_build/app_fused \\
+      --ini-before APP.hls/vitis_opts.ini --ini-after APP.fused.hls/vitis_opts.ini
+"""
+import argparse
+import json
+import os
+import re
+import shutil
+import sys
+import xml.etree.ElementTree as etree
+
+VITIS_OPTS = "vitis_opts.ini"
+BUILD_JSON = "nanotube_hls_build.json"
+GROUPS_JSON = "fused_stages.json"
+SYN_REPORT = "solution1/syn/report/csynth.xml"
+IMPL_REPORT = "solution1/impl/report/verilog/export_syn.xml"
+LINK_DEPTH = 2
+
+# The shell side of the pipeline, not Nanotube stages
+EXTERNAL_KERNELS = ("mae2p_kernel0", "p2vnr_kernel0")
+
+STAGE_RE = re.compile(r"^stage_(\d+)$")
+ENDPOINT_RE = re.compile(r"^(stage_\d+)\.(\w+)$")
+FUNC_RE = r"\bvoid\s+{name}\s*\(([^)]*)\)\s*\{{"
+INCLUDE_RE = re.compile(r"^\s*#\s*include\b.*$", re.M)
+INTERFACE_RE = re.compile(r"^\s*#\s*pragma\s+HLS\s+interface\b.*$", re.M | re.I)
+PORT_ARG_RE = re.compile(r"\bport\s*=\s*(\w+)", re.I)
+
+
+def stage_num(name):
+    return int(STAGE_RE.match(name).group(1))
+
+
+# ---------------------------------------------------------------------------
+# vitis_opts.ini
+
+
+class Link:
+    def __init__(self, src, dst, depth):
+        self.src = src
+        self.dst = dst
+        self.depth = depth
+
+    def stages(self):
+        return [ENDPOINT_RE.match(e).group(1) for e in (self.src, self.dst)
+                if ENDPOINT_RE.match(e)]
+
+    def format(self):
+        if self.depth is None:
+            return f"sc={self.src}:{self.dst}"
+        return f"sc={self.src}:{self.dst}:{self.depth}"
+
+
+def read_vitis_opts(path):
+    """Return the lines of the file and the parsed sc= links."""
+    with open(path) as fh:
+        lines = fh.read().splitlines()
+    links = []
+    for line in lines:
+        if not line.startswith("sc="):
+            continue
+        parts = line[3:].split(":")
+        if len(parts) < 2:
+            continue
+        depth = int(parts[2]) if len(parts) > 2 else None
+        links.append(Link(parts[0], parts[1], depth))
+    return lines, links
+
+
+def is_fifo(link):
+    return not any(k in (link.src, link.dst) for k in EXTERNAL_KERNELS)
+
+
+# ---------------------------------------------------------------------------
+# HLS reports
+
+
+def read_stage_report(dirname):
+    """II, worst-case latency, WNS and BRAM of one stage_N HLS project."""
+    rep = {"ii": None, "latency": None, "wns": None, "bram": None}
+    try:
+        et = etree.parse(os.path.join(dirname, SYN_REPORT))
+        summary = et.find("./PerformanceEstimates/SummaryOfOverallLatency")
+        rep["ii"] = int(summary.find("Interval-max").text)
+        rep["latency"] = int(summary.find("Worst-caseLatency").text)
+    except (OSError, etree.ParseError, AttributeError, ValueError):
+        pass
+    try:
+        et = etree.parse(os.path.join(dirname, IMPL_REPORT))
+        rep["wns"] = float(et.find("./TimingReport/WNS_FINAL").text)
+        rep["bram"] = int(et.find("./AreaReport/Resources/BRAM").text)
+    except (OSError, etree.ParseError, AttributeError, ValueError):
+        pass
+    return rep
+
+
+def read_build(path):
+    """Map stage_N -> report for every stage listed in the build json."""
+    with open(os.path.join(path, BUILD_JSON)) as fh:
+        top = json.load(fh)
+    reports = {}
+    for e in top["stages"]:
+        name = "stage_" + str(e["thread_id"])
+        reports[name] = read_stage_report(os.path.join(path, name))
+    return reports
+
+
+def meets_target(rep):
+    return rep["ii"] == 1 and rep["wns"] is not None and rep["wns"] >= 0
+
+
+# ---------------------------------------------------------------------------
+# Stage sources
+
+
+def split_params(text):
+    """Split a parameter list on the commas outside template brackets."""
+    params, depth, cur = [], 0, ""
+    for c in text:
+        if c in "<([":
+            depth += 1
+        elif c in ">)]":
+            depth -= 1
+        if c == "," and depth == 0:
+            params.append(cur.strip())
+            cur = ""
+        else:
+            cur += c
+    if cur.strip():
+        params.append(cur.strip())
+    return params
+
+
+class StageSource:
+    def __init__(self, name, path):
+        self.name = name
+        self.path = path
+        with open(path) as fh:
+            self.text = fh.read()
+        m = re.search(FUNC_RE.format(name=re.escape(name)), self.text)
+        if not m:
+            raise ValueError(f"{path}: no definition of {name}()")
+        # (type, port name) of each parameter
+        self.params = []
+        for p in split_params(m.group(1)):
+            pm = re.match(r"^(.*?)(\w+)\s*$", p, re.S)
+            self.params.append((pm.group(1).strip(), pm.group(2)))
+        self.includes = INCLUDE_RE.findall(self.text)
+        self.interfaces = INTERFACE_RE.findall(self.text)
+
+    def body(self):
+        """The source without its includes and interface pragmas."""
+        text = INCLUDE_RE.sub(lambda m: "// " + m.group(0).strip(), self.text)
+        return INTERFACE_RE.sub(lambda m: "// " + m.group(0).strip(), text)
+
+    def port_pragmas(self, port, new_name):
+        out = []
+        for p in self.interfaces:
+            m = PORT_ARG_RE.search(p)
+            if m and m.group(1) == port:
+                out.append(PORT_ARG_RE.sub("port=" + new_name, p.strip()))
+        return out
+
+
+def find_sources(hls_dir):
+    sources = {}
+    for f in sorted(os.listdir(hls_dir)):
+        base, ext = os.path.splitext(f)
+        if STAGE_RE.match(base) and ext in (".cpp", ".cc"):
+            sources[base] = os.path.join(hls_dir, f)
+    return sources
+
+
+# ---------------------------------------------------------------------------
+# Grouping
+
+
+def parse_groups(text):
+    groups = []
+    for g in text.split(","):
+        lo, _, hi = g.partition("-")
+        lo, hi = int(lo), int(hi or lo)
+        if hi > lo:
+            groups.append([f"stage_{i}" for i in range(lo, hi + 1)])
+    return groups
+
+
+def format_groups(groups):
+    return ",".join(f"{stage_num(g[0])}-{stage_num(g[-1])}" for g in groups)
+
+
+def adjacent(links, a, b):
+    return any(set(l.stages()) == {a, b} for l in links)
+
+
+def plan_groups(stages, links, reports, max_group):
+    groups, cur = [], []
+    for s in sorted(stages, key=stage_num):
+        rep = reports.get(s)
+        ok = rep is not None and meets_target(rep)
+        if ok and cur and len(cur) < max_group and adjacent(links, cur[-1], s):
+            cur.append(s)
+            continue
+        if len(cur) > 1:
+            groups.append(cur)
+        cur = [s] if ok else []
+    if len(cur) > 1:
+        groups.append(cur)
+    return groups
+
+
+# ---------------------------------------------------------------------------
+# Fusion
+
+
+def fuse_group(group, sources, links):
+    """
+    Write the fused source of one group. Returns the endpoint renames of the
+    external links and the internal links removed from vitis_opts.ini.
+    """
+    head = group[0]
+    members = [StageSource(s, sources[s]) for s in group]
+    internal = [l for l in links if set(l.stages()) <= set(group)
+                and len(l.stages()) == 2]
+    internal_ends = {e for l in internal for e in (l.src, l.dst)}
+
+    # The head stage keeps its port numbers, the others follow
+    next_port = 1 + max([int(n[4:]) for _, n in members[0].params
+                         if re.match(r"^port\d+$", n)] + [-1])
+    renames, ext_params, pragmas, calls, locals_ = {}, [], [], [], []
+    for m in members:
+        args = []
+        for t, port in m.params:
+            ep = f"{m.name}.{port}"
+            if ep in internal_ends:
+                link = next(l for l in internal if ep in (l.src, l.dst))
+                var = "link_" + link.src.replace(".", "_")
+                if ep == link.src:
+                    locals_.append((t.rstrip("& ").strip(), var))
+                args.append(var)
+                continue
+            if m is members[0]:
+                new = port
+            else:
+                new = f"port{next_port}"
+                next_port += 1
+                renames[ep] = f"{head}.{new}"
+            ext_params.append(f"{t}{new}" if t.endswith("&") else f"{t} {new}")
+            pragmas += m.port_pragmas(port, new)
+            args.append(new)
+        calls.append(f"  {ns_of(m.name)}::{m.name}({', '.join(args)});")
+
+    includes = []
+    for m in members:
+        includes += [i.strip() for i in m.includes if i.strip() not in includes]
+
+    out = [f"// Stages {', '.join(group)} fused by scripts/fuse_stages.py.",
+           "// The original stage sources are included from the .inc files.", ""]
+    out += includes + [""]
+    for m in members:
+        out += [f"namespace {ns_of(m.name)} {{",
+                f"#include \"{m.name}.inc\"",
+                f"}} // namespace {ns_of(m.name)}", ""]
+    out.append(f"void {head}({', '.join(ext_params)})")
+    out.append("{")
+    out += pragmas
+    out.append("#pragma HLS interface ap_ctrl_none port=return")
+    out.append("#pragma HLS dataflow")
+    for t, var in locals_:
+        out.append(f"  {t} {var};")
+        out.append(f"#pragma HLS stream variable={var} depth={LINK_DEPTH}")
+    out += calls
+    out.append("}")
+
+    hls_dir = os.path.dirname(sources[head])
+    for m in members:
+        with open(os.path.join(hls_dir, m.name + ".inc"), "w") as fh:
+            fh.write(m.body())
+        os.remove(m.path)
+    with open(os.path.join(hls_dir, os.path.basename(sources[head])), "w") as fh:
+        fh.write("\n".join(out) + "\n")
+    return renames, internal
+
+
+def ns_of(stage):
+    return "fused_" + stage
+
+
+def rename_endpoint(ep, renames):
+    return renames.get(ep, ep)
+
+
+def write_fused(hls_dir, out_dir, groups):
+    if os.path.exists(out_dir):
+        if not os.path.exists(os.path.join(out_dir, GROUPS_JSON)):
+            sys.exit(f"{out_dir}: exists and was not written by this script")
+        shutil.rmtree(out_dir)
+    shutil.copytree(hls_dir, out_dir)
+
+    sources = find_sources(out_dir)
+    ini = os.path.join(out_dir, VITIS_OPTS)
+    lines, links = read_vitis_opts(ini)
+    renames, removed, absorbed = {}, set(), set()
+    for g in groups:
+        missing = [s for s in g if s not in sources]
+        if missing:
+            sys.exit(f"{hls_dir}: no source for {', '.join(missing)}")
+        r, internal = fuse_group(g, sources, links)
+        renames.update(r)
+        removed.update(l.format() for l in internal)
+        absorbed.update(g[1:])
+
+    out = []
+    for line in lines:
+        if line in removed:
+            continue
+        if line.startswith("nk=") and line[3:].split(":")[0] in absorbed:
+            continue
+        if line.startswith("sc="):
+            parts = line[3:].split(":")
+            parts[0] = rename_endpoint(parts[0], renames)
+            parts[1] = rename_endpoint(parts[1], renames)
+            line = "sc=" + ":".join(parts)
+        out.append(line)
+    with open(ini, "w") as fh:
+        fh.write("\n".join(out) + "\n")
+
+    jpath = os.path.join(out_dir, BUILD_JSON)
+    if os.path.exists(jpath):
+        with open(jpath) as fh:
+            top = json.load(fh)
+        top["stages"] = [e for e in top["stages"]
+                         if "stage_" + str(e["thread_id"]) not in absorbed]
+        with open(jpath, "w") as fh:
+            json.dump(top, fh, indent=2)
+
+    with open(os.path.join(out_dir, GROUPS_JSON), "w") as fh:
+        json.dump({"source": os.path.abspath(hls_dir), "groups": groups}, fh, indent=2)
+
+
+# ---------------------------------------------------------------------------
+# Commands
+
+
+def pipeline_stages(links, sources):
+    stages = set(sources)
+    for l in links:
+        stages.update(l.stages())
+    return stages
+
+
+def cmd_plan(args):
+    _, links = read_vitis_opts(os.path.join(args.hls_dir, VITIS_OPTS))
+    reports = read_build(args.build_dir)
+    stages = pipeline_stages(links, find_sources(args.hls_dir))
+    groups = plan_groups(stages, links, reports, args.max_group)
+
+    print(f"{'Stage':<10} {'II':>4} {'Latency':>8} {'WNS':>8}  Fusable")
+    for s in sorted(stages, key=stage_num):
+        rep = reports.get(s, {})
+        fmt = lambda k, f: "-" if rep.get(k) is None else f % rep[k]
+        print(f"{s:<10} {fmt('ii', '%d'):>4} {fmt('latency', '%d'):>8} "
+              f"{fmt('wns', '%.3f'):>8}  {'yes' if rep and meets_target(rep) else 'no'}")
+    print("")
+    if groups:
+        print(f"Groups: {format_groups(groups)}")
+    else:
+        print("No adjacent stages meet II=1 and timing, nothing to fuse.")
+    return 0
+
+
+def cmd_fuse(args):
+    if args.reject:
+        with open(os.path.join(args.out_dir, GROUPS_JSON)) as fh:
+            groups = json.load(fh)["groups"]
+        reports = read_build(args.reject)
+        kept = []
+        for g in groups:
+            rep = reports.get(g[0])
+            if rep is not None and meets_target(rep):
+                kept.append(g)
+            else:
+                print(f"Splitting {g[0]}..{g[-1]}: II {rep and rep['ii']}, "
+                      f"WNS {rep and rep['wns']}")
+        groups = kept
+    elif args.auto:
+        _, links = read_vitis_opts(os.path.join(args.hls_dir, VITIS_OPTS))
+        stages = pipeline_stages(links, find_sources(args.hls_dir))
+        groups = plan_groups(stages, links, read_build(args.auto), args.max_group)
+    elif args.groups:
+        groups = parse_groups(args.groups)
+    else:
+        sys.exit("fuse: give --groups, --auto or --reject")
+
+    write_fused(args.hls_dir, args.out_dir, groups)
+    print(f"Wrote {args.out_dir} with groups: {format_groups(groups) or 'none'}")
+    return 0
+
+
+def summarize(build_dir, ini):
+    reports = read_build(build_dir)
+    if ini is None:
+        ini = os.path.join(build_dir, VITIS_OPTS)
+    fifos = []
+    if os.path.exists(ini):
+        fifos = [l for l in read_vitis_opts(ini)[1] if is_fifo(l)]
+    vals = lambda k: [r[k] for r in reports.values() if r[k] is not None]
+    return {
+        "Stages": len(reports),
+        "Pipeline latency (cycles)": sum(vals("latency")),
+        "Max II": max(vals("ii"), default=0),
+        "Worst WNS (ns)": min(vals("wns"), default=0.0),
+        "Inter-stage FIFOs": len(fifos) if os.path.exists(ini) else None,
+        "FIFO depth (entries)": sum(l.depth or 0 for l in fifos) if os.path.exists(ini) else None,
+        "Stage BRAM_18k": sum(vals("bram")),
+    }
+
+
+def cmd_compare(args):
+    before = summarize(args.before, args.ini_before)
+    after = summarize(args.after, args.ini_after)
+    print(f"{'':<28} {'Before':>10} {'After':>10} {'Delta':>10}")
+    for k in before:
+        b, a = before[k], after[k]
+        fmt = lambda v: "-" if v is None else (f"{v:.3f}" if isinstance(v, float) else str(v))
+        d = "-" if a is None or b is None else fmt(a - b)
+        print(f"{k:<28} {fmt(b):>10} {fmt(a):>10} {d:>10}")
+    return 0
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__,
+                                formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = p.add_subparsers(dest="cmd", required=True)
+
+    sp = sub.add_parser("plan", help="Propose groups from a baseline build.")
+    sp.add_argument("hls_dir", help="The .hls directory written by Nanotube.")
+    sp.add_argument("build_dir", help="The hls_build output of that directory.")
+    sp.add_argument("--max-group", type=int, default=4,
+                    help="Largest number of stages in a group (default: %(default)s).")
+    sp.set_defaults(func=cmd_plan)
+
+    sp = sub.add_parser("fuse", help="Write a copy of the .hls directory with fused stages.")
+    sp.add_argument("hls_dir", help="The .hls directory written by Nanotube.")
+    sp.add_argument("out_dir", help="The fused .hls directory to write.")
+    sp.add_argument("--groups", help="Stage ranges to fuse, e.g. 0-2,4-6.")
+    sp.add_argument("--auto", metavar="BUILD_DIR",
+                    help="Fuse the groups proposed by plan for this baseline build.")
+    sp.add_argument("--reject", metavar="FUSED_BUILD",
+                    help="Rewrite out_dir without the groups that fail II=1 or timing "
+                         "in this build of it.")
+    sp.add_argument("--max-group", type=int, default=4,
+                    help="Largest number of stages in a group with --auto (default: %(default)s).")
+    sp.set_defaults(func=cmd_fuse)
+
+    sp = sub.add_parser("compare", help="Compare two builds.")
+    sp.add_argument("before", help="hls_build output before fusion.")
+    sp.add_argument("after", help="hls_build output after fusion.")
+    sp.add_argument("--ini-before", help="vitis_opts.ini of the first build.")
+    sp.add_argument("--ini-after", help="vitis_opts.ini of the second build.")
+    sp.set_defaults(func=cmd_compare)
+
+    args = p.parse_args()
+    return args.func(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,162 @@
+#!/usr/bin/env python3
+"""
+Derive the early-drop parameters of nanonic_pipeline_top from the source of an
+application, so the rules of rtl/nanonic_early_drop.v always match the
+program that runs in the stages.
+
+The script recognises the drop rules of the Custom_applications:
+
+  keep      : a branch on `ip->saddr == MONITOR_IP && ip->protocol == IPPROTO_*`
+              (KEEP_SADDR is the value of the MONITOR_IP define)
+  ethertype : `if (eth->h_proto == htons(ETH_P_*)) return XDP_DROP;`
+              (xdp_drop_IPv4), or a program whose last statement is
+              `return XDP_DROP;` (xdp_drop_all, every frame that is not kept)
+  limiter   : a per-source count kept in a hash map keyed on ip->saddr,
+              `if (COUNT >= N) return XDP_DROP;` (xdp_drop_count_ICMP); the
+              threshold is N and the table stops taking sources at the
+              max_entries of the map, like the map itself
+
+A program without any of these rules gets EARLY_DROP_EN=0. The output is the
+list of parameters for gen_p2p_pipeline.py --params (or --early-drop, which
+calls this script), or with --verilog the parameter overrides of an instance:
+
+  scripts/gen_early_drop.py Custom_applications/xdp_drop_count_ICMP/xdp_drop_count_ICMP_nanotube.c
+  scripts/gen_early_drop.py --verilog Custom_applications/xdp_drop_IPv4/xdp_drop_IPv4.c
+
+The limiter is only mirrored with LANES = 1 (every lane counts in its own copy
+of the map); nanonic_pipeline_top turns it off otherwise.
+"""
+import argparse
+import re
+import sys
+
+ETH_P = {"ETH_P_IP": 0x0800, "ETH_P_ARP": 0x0806, "ETH_P_IPV6": 0x86DD,
+         "ETH_P_8021Q": 0x8100}
+IPPROTO = {"IPPROTO_ICMP": 1, "IPPROTO_TCP": 6, "IPPROTO_UDP": 17,
+           "IPPROTO_ICMPV6": 58}
+# Index of the limiter table: a 16-bit fold of the source address
+MAX_ADDR_W = 16
+
+
+def strip_comments(src):
+    src = re.sub(r"/\*.*?\*/", " ", src, flags=re.S)
+    return re.sub(r"//[^\n]*", "", src)
+
+
+def program_body(src):
+    """Body of the function placed in an XDP section (the SEC() other than maps)."""
+    for m in re.finditer(r'SEC\("([^"]+)"\)\s*(?:static\s+)?int\s+\w+\s*\([^)]*\)\s*{', src):
+        if m.group(1) in ("maps", "license"):
+            continue
+        depth, i = 1, m.end()
+        while depth and i < len(src):
+            depth += {"{": 1, "}": -1}.get(src[i], 0)
+            i += 1
+        return src[m.end():i - 1]
+    raise ValueError("no XDP program found")
+
+
+def map_entries(src, name):
+    m = re.search(r'SEC\("maps"\)\s*' + re.escape(name) + r'\s*=\s*{(.*?)}', src, re.S)
+    if not m:
+        raise ValueError(f"map {name} not found")
+    t = re.search(r"\.type\s*=\s*(\w+)", m.group(1))
+    n = re.search(r"\.max_entries\s*=\s*(\d+)", m.group(1))
+    if not t or not n:
+        raise ValueError(f"map {name}: type or max_entries missing")
+    return t.group(1), int(n.group(1))
+
+
+def derive(src):
+    """Returns (params, notes): the parameters in nanonic_pipeline_top order."""
+    src = strip_comments(src)
+    body = program_body(src)
+    params, notes = [], []
+
+    keep = re.search(r"ip->saddr\s*==\s*MONITOR_IP\s*&&\s*ip->protocol\s*==\s*(IPPROTO_\w+)", body)
+    if keep:
+        addr = re.search(r"#define\s+MONITOR_IP\s+(0x[0-9A-Fa-f]+|\d+)", src)
+        if not addr or keep.group(1) not in IPPROTO:
+            raise ValueError("keep branch on MONITOR_IP without a known address or protocol")
+        saddr, proto = int(addr.group(1), 0), IPPROTO[keep.group(1)]
+        notes.append(f"keep saddr 0x{saddr:08X} protocol {proto}")
+
+    etype = None
+    m = re.search(r"if\s*\(\s*eth->h_proto\s*==\s*htons\s*\(\s*(ETH_P_\w+)\s*\)\s*\)\s*"
+                  r"(?:{\s*)?return\s+XDP_DROP\s*;", body)
+    if m:
+        if m.group(1) not in ETH_P:
+            raise ValueError(f"unknown ethertype {m.group(1)}")
+        etype = (ETH_P[m.group(1)], 0xFFFF)
+        notes.append(f"drop ethertype 0x{etype[0]:04X}")
+    elif re.search(r"return\s+XDP_DROP\s*;\s*$", body):
+        etype = (0x0800, 0x0000)
+        notes.append("drop every frame")
+
+    limit = None
+    m = re.search(r"if\s*\(\s*(\w+)\s*>=\s*(\d+)\s*\)\s*(?:{\s*)?return\s+XDP_DROP\s*;", body)
+    if m:
+        count, thresh = m.group(1), int(m.group(2))
+        key = re.search(r"(\w+)\s*=\s*ip->saddr\s*;", body)
+        upd = key and re.search(r"bpf_map_update_elem\s*\(\s*&(\w+)\s*,\s*&" + key.group(1) +
+                                r"\s*,\s*&" + count + r"\b", body)
+        if not upd:
+            raise ValueError(f"'{count} >= {thresh}' is not a count kept per source address")
+        mtype, entries = map_entries(src, upd.group(1))
+        if mtype != "BPF_MAP_TYPE_HASH":
+            raise ValueError(f"map {upd.group(1)} of the limiter is a {mtype}")
+        if thresh > 255:
+            raise ValueError(f"limiter threshold {thresh} above 255")
+        limit = (thresh, entries, min(MAX_ADDR_W, max(1, (entries - 1).bit_length())))
+        notes.append(f"limit {thresh} packets per source, {upd.group(1)} of {entries} entries")
+
+    if not etype and not limit:
+        return [("EARLY_DROP_EN", "0")], notes or ["no drop rule found"]
+
+    params.append(("EARLY_DROP_EN", "1"))
+    params.append(("EARLY_DROP_ETYPE_EN", "1" if etype else "0"))
+    if etype:
+        params.append(("EARLY_DROP_ETYPE", f"16'h{etype[0]:04X}"))
+        params.append(("EARLY_DROP_ETYPE_MASK", f"16'h{etype[1]:04X}"))
+    params.append(("EARLY_DROP_KEEP_EN", "1" if keep else "0"))
+    if keep:
+        params.append(("EARLY_DROP_KEEP_SADDR", f"32'h{saddr:08X}"))
+        params.append(("EARLY_DROP_KEEP_PROTO", f"8'd{proto}"))
+    params.append(("EARLY_DROP_LIMIT_EN", "1" if limit else "0"))
+    if limit:
+        params.append(("EARLY_DROP_LIMIT_THRESH", f"8'd{limit[0]}"))
+        params.append(("EARLY_DROP_LIMIT_ENTRIES", f"32'd{limit[1]}"))
+        params.append(("EARLY_DROP_LIMIT_ADDR_W", str(limit[2])))
+    return params, notes
+
+
+def early_drop_params(path):
+    with open(path) as fh:
+        return derive(fh.read())
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__,
+                                formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument("source", help="C source of the application.")
+    p.add_argument("--verilog", action="store_true",
+                   help="Print the parameter overrides of a nanonic_pipeline_top instance.")
+    args = p.parse_args()
+
+    try:
+        params, notes = early_drop_params(args.source)
+    except (OSError, ValueError) as e:
+        raise SystemExit(f"{args.source}: {e}")
+
+    for n in notes:
+        print(f"// {n}", file=sys.stderr)
+    if args.verilog:
+        width = max(len(k) for k, _ in params)
+        print(",\n".join(f"   .{k.ljust(width)} ({v})" for k, v in params))
+    else:
+        print(",".join(f"{k}={v}" for k, v in params))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+"""
+Write a capture of C2H traffic as a pipeline built with -D NANONIC_META
+delivers it: every packet starts with a NanoNIC descriptor
+(Custom_applications/common/nanonic_desc.h) followed by the frame.
+
+The descriptors follow a Katran-like mix: a share of the packets is
+forwarded to one of --reals reals picked with a Zipf distribution, the rest
+is passed to the kernel or dropped. Replay the file with the net_pcap vdev
+of DPDK to benchmark host/nanonic_rx without the card, and check its counts
+against scripts/nanonic_meta.py on the same file.
+"""
+import argparse
+import random
+import struct
+import sys
+
+from nanonic_pcap import write_pcap
+
+XDP_DROP = 1
+XDP_PASS = 2
+XDP_TX = 3
+
+F_HASH = 1 << 0
+F_REAL = 1 << 1
+F_VIP = 1 << 2
+F_CLASS = 1 << 3
+
+CLASS_NONE = 0
+CLASS_LB_FORWARD = 3
+
+SRC_MAC = bytes.fromhex("020000000101")
+DST_MAC = bytes.fromhex("020000000103")
+
+
+def frame(size, flow):
+    """IPv4/UDP frame of size bytes for flow number flow."""
+    udp_len = size - 14 - 20
+    ip = struct.pack("!BBHHHBBH4s4s", 0x45, 0, 20 + udp_len, 0, 0x4000, 64, 17, 0,
+                     bytes([192, 168, (flow >> 8) & 0xFF, flow & 0xFF]),
+                     bytes([10, 200, 1, 1]))
+    udp = struct.pack("!HHHH", 1024 + (flow & 0x7FFF), 80, udp_len, 0)
+    return DST_MAC + SRC_MAC + b"\x08\x00" + ip + udp + bytes(udp_len - 8)
+
+
+def desc(verdict, flags, class_tag, flow_hash, real, vip, frame_len):
+    d = bytearray(64)
+    d[0:3] = b"NT\x01"
+    d[3] = verdict
+    d[4] = flags
+    d[5] = class_tag
+    struct.pack_into(">IIHH", d, 8, flow_hash, real, vip, frame_len)
+    return bytes(d)
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__,
+                                formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument("out", help="Output pcap.")
+    p.add_argument("--count", type=int, default=10000,
+                   help="Packets to write (default: %(default)s).")
+    p.add_argument("--size", type=int, default=64,
+                   help="Frame size in bytes, without the descriptor (default: %(default)s).")
+    p.add_argument("--reals", type=int, default=64,
+                   help="Number of reals (default: %(default)s).")
+    p.add_argument("--zipf", type=float, default=1.1,
+                   help="Skew of the real popularity (default: %(default)s).")
+    p.add_argument("--forward", type=float, default=0.9,
+                   help="Share of forwarded (XDP_TX) packets (default: %(default)s).")
+    p.add_argument("--drop", type=float, default=0.05,
+                   help="Share of dropped packets, the rest is passed (default: %(default)s).")
+    p.add_argument("--seed", type=int, default=1)
+    args = p.parse_args()
+
+    if args.size < 60:
+        p.error("--size must be at least 60")
+    rng = random.Random(args.seed)
+    weights = [1.0 / (r + 1) ** args.zipf for r in range(args.reals)]
+
+    packets = []
+    per_verdict = {XDP_TX: 0, XDP_PASS: 0, XDP_DROP: 0}
+    for i in range(args.count):
+        flow = rng.randrange(1 << 16)
+        data = frame(args.size, flow)
+        x = rng.random()
+        if x < args.forward:
+            real = rng.choices(range(args.reals), weights)[0]
+            d = desc(XDP_TX, F_HASH | F_REAL | F_VIP | F_CLASS, CLASS_LB_FORWARD,
+                     flow * 2654435761 & 0xFFFFFFFF, real, 0, len(data))
+            verdict = XDP_TX
+        else:
+            verdict = XDP_DROP if x < args.forward + args.drop else XDP_PASS
+            d = desc(verdict, 0, CLASS_NONE, 0, 0, 0, len(data))
+        per_verdict[verdict] += 1
+        packets.append((i * 1e-6, d + data))
+
+    write_pcap(args.out, packets)
+    print(f"{args.out}: {args.count} packets of {64 + args.size} bytes, "
+          f"tx {per_verdict[XDP_TX]} pass {per_verdict[XDP_PASS]} "
+          f"drop {per_verdict[XDP_DROP]}, {args.reals} reals")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
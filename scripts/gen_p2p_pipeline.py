@@ -0,0 +1,491 @@
+#!/usr/bin/env python3
+"""
+Generate the NanoNIC datapath that replaces the per-port loop of p2p_250mhz.sv.
+
+The plain integration only swaps rx_ppl_inst of CMAC port 0 for the Nanotube
+pipeline. This script writes a module, nanonic_p2p_datapath, that takes every
+AXI4-Stream interface of the p2p box (CMAC RX/TX and QDMA H2C/C2H of each port)
+and places a nanonic_pipeline_top on each RX path and, optionally, on each TX
+path (H2C -> CMAC). Paths without an application are plain register slices,
+like the axi_stream_pipeline instances of the original box.
+
+Maps live inside the Nanotube stages, so instances never share a map. Two
+layouts are available:
+
+  partitioned : one pipeline per port and direction. Each instance has its own
+                copy of the maps, holding the state of its port only.
+  shared      : the ports of a direction are merged by a packet arbiter into a
+                single pipeline, so all ports see the same maps; the packets are
+                sent back to their port by a demultiplexer keyed on the tuser
+                src (RX) or dst (TX) field. One pipeline runs at most at one beat
+                per cycle (~128 Gb/s at 250 MHz), less than two 100G ports;
+                rtl/nanonic_fast_pipeline.v runs it on a faster clock instead.
+
+Register slices are placed around each pipeline to keep the paths between the
+shell and the pipeline short at 250 MHz; add more with --reg-slices when the
+instances land in a different SLR from the shell. The AXI-Lite windows of the
+instances are 64 KB apart, in the order printed in the header of the output.
+
+Different applications need different block designs: pass the name of the
+wrapper of each block design (e.g. Katran_wrapper) and the script emits a copy
+of nanonic_pipeline_top that instantiates the block design itself (Katran),
+since the top carries a 64-bit tuser through the Nanotube stages while the
+wrappers keep the 48-bit tuser of the shell.
+"""
+import argparse
+import os
+import re
+import sys
+
+from gen_early_drop import early_drop_params
+
+RTL_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "rtl")
+DEFAULT_WRAPPER = "Nanotube_pipeline_wrapper"
+WINDOW = 0x10000
+HAIRPIN_PARAMS = [("META_EN", "1"), ("HAIRPIN_EN", "1")]
+
+SIGNALS = [
+    # name, width expression, direction seen from the source of the bundle
+    ("tvalid", None, "out"),
+    ("tdata", "511:0", "out"),
+    ("tkeep", "63:0", "out"),
+    ("tlast", None, "out"),
+    ("tuser", "47:0", "out"),
+    ("tready", None, "in"),
+]
+
+
+class Emitter:
+    def __init__(self):
+        self.decls = []
+        self.body = []
+        self.wires = set()
+
+    def bundle(self, name):
+        """Declare the wires of a stream bundle once."""
+        if name in self.wires:
+            return
+        self.wires.add(name)
+        self.decls.append("")
+        for sig, width, _ in SIGNALS:
+            w = f"[{width}]".ljust(10) if width else " " * 10
+            self.decls.append(f"  wire {w} {name}_{sig};")
+
+    def line(self, text=""):
+        self.body.append(text)
+
+    def text(self):
+        return "\n".join(self.decls + [""] + self.body)
+
+
+def axis_ports(prefix_s, prefix_m):
+    """Port list connecting s_axis_* to bundle prefix_s and m_axis_* to prefix_m."""
+    ports = []
+    for sig, _, _ in SIGNALS:
+        ports.append((f"s_axis_{sig}", f"{prefix_s}_{sig}"))
+    for sig, _, _ in SIGNALS:
+        ports.append((f"m_axis_{sig}", f"{prefix_m}_{sig}"))
+    return ports
+
+
+def emit_inst(em, module, name, ports, params=None):
+    head = f"  {module}"
+    if params:
+        head += " #(\n"
+        width = max(len(k) for k, _ in params)
+        head += ",\n".join(f"    .{k.ljust(width)} ({v})" for k, v in params)
+        head += "\n  )"
+    em.line(f"{head} {name} (")
+    width = max(len(p) for p, _ in ports)
+    em.line(",\n".join(f"    .{p.ljust(width)} ({s})" if p else "" for p, s in ports))
+    em.line("  );")
+    em.line()
+
+
+def emit_slices(em, src, dst, count, name):
+    """Connect bundle src to bundle dst through count register slices."""
+    em.bundle(src)
+    em.bundle(dst)
+    if count == 0:
+        for sig, _, direction in SIGNALS:
+            if direction == "out":
+                em.line(f"  assign {dst}_{sig} = {src}_{sig};")
+            else:
+                em.line(f"  assign {src}_{sig} = {dst}_{sig};")
+        em.line()
+        return
+    prev = src
+    for k in range(count):
+        nxt = dst if k == count - 1 else f"{name}_rs{k}"
+        em.bundle(nxt)
+        ports = [("clk", "axis_aclk"), ("rst_n", "axil_aresetn")] + axis_ports(prev, nxt)
+        emit_inst(em, "nanonic_axis_reg", f"{name}_rs{k}_inst", ports)
+        prev = nxt
+
+
+def top_module(wrapper):
+    return "nanonic_pipeline_top" if wrapper == DEFAULT_WRAPPER else f"nanonic_pipeline_top_{wrapper}"
+
+
+def emit_top(em, wrapper, name, src, dst, hairpin, axil_idx, params):
+    em.bundle(src)
+    em.bundle(dst)
+    if hairpin:
+        em.bundle(hairpin)
+    ports = [("ap_clk_0", "axis_aclk"), ("ap_rst_n_0", "axil_aresetn"), ("", "")]
+    for sig, _, _ in SIGNALS:
+        ports.append((f"port0_0_{sig}", f"{src}_{sig}"))
+    ports.append(("", ""))
+    for sig, _, _ in SIGNALS:
+        ports.append((f"port1_0_{sig}", f"{dst}_{sig}"))
+    ports.append(("", ""))
+    for sig, _, _ in SIGNALS:
+        if hairpin:
+            ports.append((f"hairpin_{sig}", f"{hairpin}_{sig}"))
+        else:
+            ports.append((f"hairpin_{sig}", "1'b1" if sig == "tready" else ""))
+    ports.append(("", ""))
+    for sig, width in (("awvalid", None), ("awaddr", 32), ("awready", None),
+                       ("wvalid", None), ("wdata", 32), ("wready", None),
+                       ("bvalid", None), ("bresp", None), ("bready", None),
+                       ("arvalid", None), ("araddr", 32), ("arready", None),
+                       ("rvalid", None), ("rdata", 32), ("rresp", None), ("rready", None)):
+        if sig in ("bresp", "rresp"):
+            ports.append((f"s_axil_{sig}", ""))
+        elif width:
+            ports.append((f"s_axil_{sig}", f"ppl_axil_{sig}[{axil_idx}*32 +: 32]"))
+        else:
+            ports.append((f"s_axil_{sig}", f"ppl_axil_{sig}[{axil_idx}]"))
+    ports.append(("", ""))
+    ports.append(("early_drop_count", ""))
+    # Blank entries only separate groups in the output
+    lines = []
+    width = max(len(p) for p, _ in ports)
+    for p, s in ports:
+        lines.append(f"    .{p.ljust(width)} ({s})" if p else None)
+    body = []
+    for entry in lines:
+        if entry is None:
+            if body:
+                body[-1] += ",\n"
+        else:
+            if body and not body[-1].endswith("\n"):
+                body[-1] += ","
+            body.append(entry)
+    params = list(dict(params).items())
+    head = f"  {top_module(wrapper)}"
+    if params:
+        width_p = max(len(k) for k, _ in params)
+        head += " #(\n" + ",\n".join(f"    .{k.ljust(width_p)} ({v})" for k, v in params) + "\n  )"
+    em.line(f"{head} {name} (")
+    em.line("\n".join(body))
+    em.line("  );")
+    em.line()
+
+
+def emit_port_bundles(em, ports):
+    """Bundles that map the vectors of the p2p box to one stream per port."""
+    for i in range(ports):
+        for bundle, vec, inbound in ((f"rx{i}", "s_axis_adap_rx_250mhz", True),
+                                     (f"h2c{i}", "s_axis_qdma_h2c", True),
+                                     (f"c2h{i}", "m_axis_qdma_c2h", False),
+                                     (f"tx{i}", "m_axis_adap_tx_250mhz", False)):
+            em.bundle(bundle)
+            user = (f"{{{vec}_tuser_dst[`getvec(16, {i})], {vec}_tuser_src[`getvec(16, {i})], "
+                    f"{vec}_tuser_size[`getvec(16, {i})]}}")
+            if inbound:
+                em.line(f"  assign {bundle}_tvalid = {vec}_tvalid[{i}];")
+                em.line(f"  assign {bundle}_tdata  = {vec}_tdata[`getvec(512, {i})];")
+                em.line(f"  assign {bundle}_tkeep  = {vec}_tkeep[`getvec(64, {i})];")
+                em.line(f"  assign {bundle}_tlast  = {vec}_tlast[{i}];")
+                em.line(f"  assign {bundle}_tuser  = {user};")
+                em.line(f"  assign {vec}_tready[{i}] = {bundle}_tready;")
+            else:
+                em.line(f"  assign {vec}_tvalid[{i}] = {bundle}_tvalid;")
+                em.line(f"  assign {vec}_tdata[`getvec(512, {i})] = {bundle}_tdata;")
+                em.line(f"  assign {vec}_tkeep[`getvec(64, {i})] = {bundle}_tkeep;")
+                em.line(f"  assign {vec}_tlast[{i}] = {bundle}_tlast;")
+                em.line(f"  assign {user} = {bundle}_tuser;")
+                em.line(f"  assign {bundle}_tready = {vec}_tready[{i}];")
+            em.line()
+
+
+def emit_arb(em, name, srcs, dst):
+    """Merge the bundles srcs into dst with a packet arbiter."""
+    for b in srcs + [dst]:
+        em.bundle(b)
+    cat = lambda sig: "{" + ", ".join(f"{b}_{sig}" for b in reversed(srcs)) + "}"
+    ports = [("clk", "axis_aclk"), ("rst_n", "axil_aresetn")]
+    ports += [(f"s_axis_{sig}", cat(sig)) for sig, _, _ in SIGNALS]
+    ports += [(f"m_axis_{sig}", f"{dst}_{sig}") for sig, _, _ in SIGNALS]
+    emit_inst(em, "nanonic_axis_arb", f"{name}_inst", ports, [("NUM_IN", str(len(srcs)))])
+
+
+def emit_demux(em, args, name, src, dsts, key_lsb):
+    """Send every packet of src to the bundle of dsts of its port."""
+    for b in [src] + dsts:
+        em.bundle(b)
+    n = len(dsts)
+    cat = lambda sig: "{" + ", ".join(f"{b}_{sig}" for b in reversed(dsts)) + "}"
+    ports = [("clk", "axis_aclk"), ("rst_n", "axil_aresetn")]
+    ports += [(f"s_axis_{sig}", f"{src}_{sig}") for sig, _, _ in SIGNALS]
+    ports += [(f"m_axis_{sig}", cat(sig)) for sig, _, _ in SIGNALS]
+    ids = "{" + ", ".join(f"16'h{args.port_ids[i]:04X}" for i in reversed(range(n))) + "}"
+    emit_inst(em, "nanonic_axis_demux", f"{name}_inst", ports,
+              [("NUM_OUT", str(n)), ("KEY_LSB", str(key_lsb)), ("PORT_IDS", ids)])
+
+
+def emit_direction(em, args, direction, apps, instances):
+    """Emit the RX (CMAC -> C2H) or TX (H2C -> CMAC) paths of every port.
+
+    With --hairpin, the XDP_TX packets of the RX pipelines come out on the
+    rx<i>_hp bundles and the TX paths end on tx<i>_main, merged later.
+    """
+    src, dst = ("rx", "c2h") if direction == "rx" else ("h2c", "tx")
+    if direction == "tx" and args.hairpin:
+        dst = "tx_main"
+    key_lsb = 16 if direction == "rx" else 32
+    hairpin = args.hairpin and direction == "rx"
+    params = args.params + (HAIRPIN_PARAMS if hairpin else [])
+    n = args.ports
+
+    if args.maps == "shared" and apps[0] is not None:
+        emit_arb(em, f"{direction}_arb", [f"{src}{i}" for i in range(n)], f"{direction}_arb")
+        emit_slices(em, f"{direction}_arb", f"{direction}_ppl_in", args.reg_slices, f"{direction}_in")
+        name = f"{direction}_ppl_inst"
+        instances.append((name, apps[0]))
+        emit_top(em, apps[0], name, f"{direction}_ppl_in", f"{direction}_ppl_out",
+                 f"{direction}_ppl_hp" if hairpin else None, len(instances) - 1, params)
+        emit_slices(em, f"{direction}_ppl_out", f"{direction}_dmx", args.reg_slices, f"{direction}_out")
+        emit_demux(em, args, f"{direction}_dmx", f"{direction}_dmx",
+                   [f"{direction}_dmx{i}" for i in range(n)], key_lsb)
+        for i in range(n):
+            emit_slices(em, f"{direction}_dmx{i}", f"{dst}{i}", 1, f"{direction}_dmx{i}")
+        if hairpin:
+            # Hairpinned packets leave on the port they arrived from
+            emit_slices(em, f"{direction}_ppl_hp", f"{direction}_hp", args.reg_slices, f"{direction}_hp")
+            emit_demux(em, args, f"{direction}_hp_dmx", f"{direction}_hp",
+                       [f"rx{i}_hp" for i in range(n)], 16)
+        return
+
+    for i in range(n):
+        app = apps[i]
+        if app is None:
+            emit_slices(em, f"{src}{i}", f"{dst}{i}", 1, f"{direction}{i}")
+            if hairpin:
+                em.bundle(f"rx{i}_hp")
+                em.line(f"  assign rx{i}_hp_tvalid = 1'b0;")
+                em.line()
+            continue
+        emit_slices(em, f"{src}{i}", f"{direction}{i}_ppl_in", args.reg_slices, f"{direction}{i}_in")
+        name = f"{direction}{i}_ppl_inst"
+        instances.append((name, app))
+        emit_top(em, app, name, f"{direction}{i}_ppl_in", f"{direction}{i}_ppl_out",
+                 f"{direction}{i}_ppl_hp" if hairpin else None, len(instances) - 1, params)
+        emit_slices(em, f"{direction}{i}_ppl_out", f"{dst}{i}", args.reg_slices, f"{direction}{i}_out")
+        if hairpin:
+            emit_slices(em, f"{direction}{i}_ppl_hp", f"rx{i}_hp", args.reg_slices, f"{direction}{i}_hp")
+
+
+def emit_hairpin_merge(em, args):
+    """Merge the hairpin traffic of each port with its H2C -> CMAC path."""
+    for i in range(args.ports):
+        emit_arb(em, f"tx{i}_hp_arb", [f"tx_main{i}", f"rx{i}_hp"], f"tx{i}_merge")
+        emit_slices(em, f"tx{i}_merge", f"tx{i}", 1, f"tx{i}_merge")
+
+
+def emit_axil(em, count):
+    em.decls.append("")
+    for sig, width in (("awvalid", 1), ("awaddr", 32), ("awready", 1), ("wvalid", 1),
+                       ("wdata", 32), ("wready", 1), ("bvalid", 1), ("bready", 1),
+                       ("arvalid", 1), ("araddr", 32), ("arready", 1), ("rvalid", 1),
+                       ("rdata", 32), ("rready", 1)):
+        w = f"[{count * width - 1}:0]".ljust(10)
+        em.decls.append(f"  wire {w} ppl_axil_{sig};")
+    ports = [("clk", "axis_aclk"), ("rst_n", "axil_aresetn")]
+    for sig in ("awvalid", "awaddr", "awready", "wvalid", "wdata", "wready", "bvalid",
+                "bresp", "bready", "arvalid", "araddr", "arready", "rvalid", "rdata",
+                "rresp", "rready"):
+        ports.append((f"s_axil_{sig}", f"s_axil_{sig}"))
+    for sig in ("awvalid", "awaddr", "awready", "wvalid", "wdata", "wready", "bvalid",
+                "bready", "arvalid", "araddr", "arready", "rvalid", "rdata", "rready"):
+        ports.append((f"m_axil_{sig}", f"ppl_axil_{sig}"))
+    emit_inst(em, "nanonic_axil_split", "axil_split_inst", ports,
+              [("NUM_OUT", str(count)), ("WIN_LSB", "16")])
+
+
+def block_design(wrapper):
+    """Vivado names the wrapper of block design X X_wrapper."""
+    return wrapper[:-len("_wrapper")] if wrapper.endswith("_wrapper") else wrapper
+
+
+def specialized_top(wrapper):
+    """Copy of nanonic_pipeline_top that instantiates another block design."""
+    with open(os.path.join(RTL_DIR, "nanonic_pipeline_top.v")) as fh:
+        src = fh.read()
+    src = src.replace("module nanonic_pipeline_top ", f"module {top_module(wrapper)} ", 1)
+    src, n = re.subn(rf"\b{block_design(DEFAULT_WRAPPER)}(\s+ppl_inst)",
+                     rf"{block_design(wrapper)}\1", src)
+    if n != 1:
+        raise RuntimeError("cannot find the block design instance in nanonic_pipeline_top.v")
+    return src
+
+
+def parse_apps(value, ports):
+    apps = [None if a in ("", "none") else a for a in value.split(",")]
+    if len(apps) == 1:
+        apps *= ports
+    if len(apps) != ports:
+        raise SystemExit(f"expected 1 or {ports} applications, got '{value}'")
+    return apps
+
+
+def parse_params(value):
+    params = []
+    for item in filter(None, value.split(",")):
+        key, _, val = item.partition("=")
+        params.append((key.strip(), val.strip()))
+    return params
+
+
+def generate(args):
+    rx_apps = parse_apps(args.rx, args.ports)
+    tx_apps = parse_apps(args.tx, args.ports)
+    if args.maps == "shared":
+        for apps, d in ((rx_apps, "rx"), (tx_apps, "tx")):
+            if len(set(apps)) != 1:
+                raise SystemExit(f"shared maps need the same application on every {d} path")
+
+    em = Emitter()
+    instances = []
+    emit_port_bundles(em, args.ports)
+    emit_direction(em, args, "rx", rx_apps, instances)
+    emit_direction(em, args, "tx", tx_apps, instances)
+    if args.hairpin:
+        emit_hairpin_merge(em, args)
+    if instances:
+        emit_axil(em, len(instances))
+
+    out = []
+    out.append("//" + "-" * 80)
+    out.append("// NanoNIC p2p datapath, generated by scripts/gen_p2p_pipeline.py")
+    out.append("//")
+    out.append(f"//   {' '.join(sys.argv[1:]) or '(default options)'}")
+    out.append("//")
+    out.append(f"// Ports: {args.ports}, maps: {args.maps}, register slices: {args.reg_slices}, "
+               f"hairpin: {'on' if args.hairpin else 'off'}")
+    out.append("// AXI-Lite windows (offset from the s_axil_* base):")
+    for k, (name, app) in enumerate(instances):
+        out.append(f"//   0x{k * WINDOW:05X} {name} ({app})")
+    if not instances:
+        out.append("//   none")
+    out.append("//" + "-" * 80)
+    out.append("`timescale 1 ps / 1 ps")
+    out.append("`include \"open_nic_shell_macros.vh\"")
+    out.append("")
+    for app in sorted({a for _, a in instances if a != DEFAULT_WRAPPER}):
+        out.append(specialized_top(app))
+        out.append("")
+
+    n = args.ports
+    out.append("module nanonic_p2p_datapath #(")
+    out.append(f"    parameter NUM_CMAC_PORT = {n}")
+    out.append("  ) (")
+    for vec, inbound in (("s_axis_qdma_h2c", True), ("m_axis_qdma_c2h", False),
+                         ("m_axis_adap_tx_250mhz", False), ("s_axis_adap_rx_250mhz", True)):
+        d_in, d_out = ("input ", "output") if inbound else ("output", "input ")
+        out.append(f"    {d_in} [NUM_CMAC_PORT-1:0]     {vec}_tvalid,")
+        out.append(f"    {d_in} [512*NUM_CMAC_PORT-1:0] {vec}_tdata,")
+        out.append(f"    {d_in} [64*NUM_CMAC_PORT-1:0]  {vec}_tkeep,")
+        out.append(f"    {d_in} [NUM_CMAC_PORT-1:0]     {vec}_tlast,")
+        for f in ("size", "src", "dst"):
+            out.append(f"    {d_in} [16*NUM_CMAC_PORT-1:0]  {vec}_tuser_{f},")
+        out.append(f"    {d_out} [NUM_CMAC_PORT-1:0]     {vec}_tready,")
+        out.append("")
+    for sig, d, width in (("awvalid", "input ", None), ("awaddr", "input ", 32),
+                          ("awready", "output", None), ("wvalid", "input ", None),
+                          ("wdata", "input ", 32), ("wready", "output", None),
+                          ("bvalid", "output", None), ("bresp", "output", 2),
+                          ("bready", "input ", None), ("arvalid", "input ", None),
+                          ("araddr", "input ", 32), ("arready", "output", None),
+                          ("rvalid", "output", None), ("rdata", "output", 32),
+                          ("rresp", "output", 2), ("rready", "input ", None)):
+        w = f"[{width - 1}:0]".ljust(23) if width else " " * 23
+        out.append(f"    {d} {w} s_axil_{sig},")
+    out.append("")
+    out.append("    input " + " " * 25 + "axis_aclk,")
+    out.append("    input " + " " * 25 + "axil_aresetn")
+    out.append("  );")
+    body = em.text()
+    if not instances:
+        body += "\n  assign s_axil_awready = 1'b1;\n  assign s_axil_wready  = 1'b1;\n"
+        body += "  assign s_axil_bvalid  = 1'b1;\n  assign s_axil_bresp   = 2'b00;\n"
+        body += "  assign s_axil_arready = 1'b1;\n  assign s_axil_rvalid  = 1'b1;\n"
+        body += "  assign s_axil_rdata   = 32'd0;\n  assign s_axil_rresp   = 2'b00;\n"
+    out.append(body.rstrip("\n"))
+    out.append("")
+    out.append("endmodule")
+    return "\n".join(out) + "\n", instances
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__,
+                                formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument("--ports", type=int, default=2,
+                   help="Number of CMAC ports of the shell (default: %(default)s).")
+    p.add_argument("--rx", default=DEFAULT_WRAPPER,
+                   help="Wrapper of the pipeline on the RX path, one for all ports or a "
+                        "comma-separated list per port; 'none' leaves a port unprocessed "
+                        "(default: %(default)s).")
+    p.add_argument("--tx", default="none",
+                   help="Same as --rx for the TX path, H2C -> CMAC (default: %(default)s).")
+    p.add_argument("--maps", choices=("partitioned", "shared"), default="partitioned",
+                   help="One pipeline per port, or one pipeline per direction shared by "
+                        "all ports (default: %(default)s).")
+    p.add_argument("--hairpin", action="store_true",
+                   help="Send the XDP_TX packets of the RX pipelines back to the CMAC TX "
+                        "path of their port instead of QDMA C2H (enables META_EN and "
+                        "HAIRPIN_EN on the RX instances).")
+    p.add_argument("--reg-slices", type=int, default=1,
+                   help="Register slices on each side of a pipeline (default: %(default)s).")
+    p.add_argument("--port-ids", default="",
+                   help="Comma-separated tuser src/dst identifiers of the CMAC ports used "
+                        "by the shared demultiplexers (default: 0x40 << port).")
+    p.add_argument("--params", default="",
+                   help="nanonic_pipeline_top parameters for every instance, e.g. "
+                        "'EARLY_DROP_EN=1,LATENCY_EN=1'.")
+    p.add_argument("--early-drop", metavar="SOURCE",
+                   help="C source of the application; adds the EARLY_DROP_* parameters "
+                        "derived from its drop rules by gen_early_drop.py (--params wins).")
+    p.add_argument("--output", "-o", default="nanonic_p2p_datapath.sv",
+                   help="Output file (default: %(default)s).")
+    args = p.parse_args()
+
+    if args.port_ids:
+        args.port_ids = [int(v, 0) for v in args.port_ids.split(",")]
+    else:
+        args.port_ids = [0x40 << i for i in range(args.ports)]
+    if len(args.port_ids) != args.ports:
+        raise SystemExit("--port-ids needs one identifier per port")
+    args.params = parse_params(args.params)
+    if args.early_drop:
+        try:
+            early, _ = early_drop_params(args.early_drop)
+        except (OSError, ValueError) as e:
+            raise SystemExit(f"{args.early_drop}: {e}")
+        args.params = early + args.params
+
+    text, instances = generate(args)
+    with open(args.output, "w") as fh:
+        fh.write(text)
+
+    print(f"Wrote {args.output} with {len(instances)} pipeline instance(s)")
+    for k, (name, app) in enumerate(instances):
+        print(f"  0x{k * WINDOW:05X} {name:<16} {app}")
+    if args.maps == "shared" and args.ports > 1 and instances:
+        print("Note: a shared pipeline takes at most one beat per cycle for all ports.")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,154 @@
+#!/usr/bin/env python3
+"""
+Write the QUIC test vectors of xdp_katran.
+
+The vectors cover the connection-id routing of parse_quic_nt: short headers,
+long handshake headers with DCIDs from the minimum to the maximum length,
+client initial and 0-RTT packets (consistent hashing fallback), DCIDs that are
+too short or too long, connection ids of an unknown schema version, truncated
+headers and IPv6. For every packet the script prints the host id the parser
+must return (-1 means consistent hashing).
+
+With empty maps the VIP lookup misses and Katran passes every packet to the
+kernel, so the expected output is the input; fill vip_map (with F_QUIC_VIP),
+quic_mapping and reals to exercise the routing itself.
+"""
+import argparse
+import os
+import struct
+import sys
+
+from nanonic_pcap import write_pcap
+
+OUT_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..",
+                       "Custom_applications", "xdp_katran", "pcap_test_files")
+# Same start time as test_xdp_katran.pcap.IN
+TS0 = 1632391200
+
+SRC_MAC = bytes.fromhex("020000000101")
+DST_MAC = bytes.fromhex("020000000103")
+CLIENT4 = bytes([192, 168, 1, 1])
+VIP4 = bytes([10, 200, 1, 1])
+CLIENT6 = bytes.fromhex("fc000000000000000000000000000001")
+VIP6 = bytes.fromhex("fc000000000000000000000000000100")
+QUIC_PORT = 443
+
+QUIC_LONG = 0x80
+QUIC_INITIAL = 0x00
+QUIC_0RTT = 0x10
+QUIC_HANDSHAKE = 0x20
+QUIC_RETRY = 0x30
+MIN_CID = 8
+MAX_CID = 20
+
+
+def csum(data):
+    if len(data) % 2:
+        data += b"\0"
+    s = sum(struct.unpack(f"!{len(data) // 2}H", data))
+    while s >> 16:
+        s = (s & 0xFFFF) + (s >> 16)
+    return ~s & 0xFFFF
+
+
+def udp_packet(payload, ipv6=False, sport=40000):
+    udp = struct.pack("!HHHH", sport, QUIC_PORT, 8 + len(payload), 0) + payload
+    if ipv6:
+        ip = struct.pack("!IHBB", 0x60000000, len(udp), 17, 64) + CLIENT6 + VIP6
+        return DST_MAC + SRC_MAC + b"\x86\xdd" + ip + udp
+    ip = struct.pack("!BBHHHBBH4s4s", 0x45, 0, 20 + len(udp), 0x1234, 0x4000,
+                     64, 17, 0, CLIENT4, VIP4)
+    ip = ip[:10] + struct.pack("!H", csum(ip)) + ip[12:]
+    return DST_MAC + SRC_MAC + b"\x08\x00" + ip + udp
+
+
+def conn_id(host_id, length, version=1):
+    """Connection id of schema v1 carrying a 16-bit host id."""
+    b0 = (version << 6) | ((host_id >> 10) & 0x3F)
+    b1 = (host_id >> 2) & 0xFF
+    b2 = (host_id & 0x3) << 6
+    cid = bytes([b0, b1, b2]) + bytes(range(0xa0, 0xa0 + MAX_CID))
+    return cid[:length]
+
+
+def short_header(cid):
+    return bytes([0x40 | 0x01]) + cid + bytes(16)
+
+
+def long_header(ptype, cid, dcid_len=None):
+    dcid_len = len(cid) if dcid_len is None else dcid_len
+    scid = bytes(range(0x50, 0x58))
+    return (bytes([QUIC_LONG | 0x40 | ptype]) + struct.pack("!I", 1) +
+            bytes([dcid_len]) + cid + bytes([len(scid)]) + scid + bytes(16))
+
+
+def host_id(frame):
+    """Reference of parse_quic_nt on a whole frame."""
+    ipv6 = frame[12:14] == b"\x86\xdd"
+    q = frame[14 + (40 if ipv6 else 20) + 8:]
+    if len(q) < 1 + MIN_CID:
+        return -1
+
+    def server_id(cid):
+        if cid[0] >> 6 != 1:
+            return -1
+        return ((cid[0] & 0x3F) << 10) | (cid[1] << 2) | (cid[2] >> 6)
+
+    if not q[0] & QUIC_LONG:
+        return server_id(q[1:])
+    if (len(q) < 6 + MIN_CID or (q[0] & 0x30) < QUIC_HANDSHAKE or
+            q[5] < MIN_CID or q[5] > MAX_CID):
+        return -1
+    return server_id(q[6:])
+
+
+def vectors():
+    return [
+        ("short header, host 5", udp_packet(short_header(conn_id(5, MIN_CID)))),
+        ("short header, host 0xABCD", udp_packet(short_header(conn_id(0xABCD, MIN_CID)))),
+        ("handshake, 8-byte DCID, host 7", udp_packet(long_header(QUIC_HANDSHAKE, conn_id(7, 8)))),
+        ("handshake, 20-byte DCID, host 0x1234", udp_packet(long_header(QUIC_HANDSHAKE, conn_id(0x1234, 20)))),
+        ("retry, 12-byte DCID, host 9", udp_packet(long_header(QUIC_RETRY, conn_id(9, 12)))),
+        ("initial (hash fallback)", udp_packet(long_header(QUIC_INITIAL, conn_id(3, 8)))),
+        ("0-RTT (hash fallback)", udp_packet(long_header(QUIC_0RTT, conn_id(3, 8)))),
+        ("handshake, 4-byte DCID (too short)", udp_packet(long_header(QUIC_HANDSHAKE, conn_id(3, 4)))),
+        ("handshake, DCID length 21 (too long)", udp_packet(long_header(QUIC_HANDSHAKE, conn_id(3, 20), 21))),
+        ("short header, CID version 2", udp_packet(short_header(conn_id(5, MIN_CID, version=2)))),
+        ("truncated short header", udp_packet(bytes([0x41, 0x40, 0x01]))),
+        ("IPv6 short header, host 11", udp_packet(short_header(conn_id(11, MIN_CID)), ipv6=True)),
+        ("IPv6 handshake, 16-byte DCID, host 12", udp_packet(long_header(QUIC_HANDSHAKE, conn_id(12, 16)), ipv6=True)),
+    ]
+
+
+def write_text(path, packets):
+    with open(path, "w") as fh:
+        for ts, data in packets:
+            fh.write("2021-09-23 10:00:%02d.000000\n" % (ts - TS0))
+            for off in range(0, len(data), 16):
+                row = " ".join("%02x" % b for b in data[off:off + 16])
+                fh.write("%04x  %s\n" % (off, row))
+            fh.write("\n")
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__,
+                                formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument("-o", "--out-dir", default=OUT_DIR,
+                   help="Directory of the test files (default: xdp_katran/pcap_test_files).")
+    args = p.parse_args()
+
+    vecs = vectors()
+    packets = [(TS0 + i, data) for i, (_, data) in enumerate(vecs)]
+    base = os.path.join(args.out_dir, "test_xdp_katran_quic")
+    for suffix in ("IN", "OUT"):
+        write_pcap(f"{base}.pcap.{suffix}", packets)
+        write_text(f"{base}.text.{suffix}", packets)
+
+    print(f"{'#':>2}  {'Len':>4}  {'Host id':>7}  Vector")
+    for i, (name, data) in enumerate(vecs):
+        print(f"{i:>2}  {len(data):>4}  {host_id(data):>7}  {name}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -2,7 +2,9 @@
 
 CUSTOM_APPS_DIR=Custom_applications
 HLS_BUILD_DIR=HLS_build
-JOBS=6
+JOBS=${JOBS:-6}
+# Clock period in ns, e.g. CLOCK=3.1 ./scripts/launch_hls_build.sh
+CLOCK=${CLOCK:-4.0}
 LIB_PATHS=(/usr/lib/x86_64-linux-gnu /usr/lib/gcc/x86_64-linux-gnu/9)
 
 # Find all directories matching the pattern inside Custom_applications
@@ -16,7 +18,7 @@ find "$CUSTOM_APPS_DIR" -type d -name "*.hls" | while read -r hls_dir; do
     output_dir="$HLS_BUILD_DIR/$app_name"
     
     # Construct the command
-    cmd="scripts/hls_build -j$JOBS --clock 4.0,0.0 -p xcu250-figd2104-2L-e $hls_dir/ $output_dir/"
+    cmd="scripts/hls_build -j$JOBS --clock $CLOCK,0.0 -p xcu250-figd2104-2L-e $hls_dir/ $output_dir/"
     
     # Append library paths
     for lib in "${LIB_PATHS[@]}"; do
@@ -0,0 +1,443 @@
+#!/usr/bin/env python3
+"""
+Control plane and benchmark of the NanoNIC cuckoo hash map
+(rtl/nanonic_cuckoo.v).
+
+The map is a standalone block for designs that keep a hash map outside the
+Nanotube stages; nanonic_pipeline_top does not instantiate it, the maps of the
+pipeline are written with nanonic_maps.py update. --base and --window give
+the register window of the block in the BAR.
+
+A key can be stored in one of the slots of its bucket in each way of the map,
+or in the small stash. The datapath probes all of them in parallel; inserting
+a key whose buckets are full means moving entries to their other way, which
+is done here: a breadth-first search over the buckets finds the shortest
+chain of moves to a free slot, and the moves are written from the free end
+back, so a lookup finds every key at any time.
+
+  insert  insert or update KEY=VALUE entries on the card
+  delete  remove keys from the card, then move stash entries back to a way
+  drain   insert the keys the datapath queued because it did not find them
+  bench   fill a software model of the map with random keys and compare its
+          occupancy with a single-hash table of the same size
+
+  python3 scripts/nanonic_cuckoo.py --base $CUCKOO_BASE insert 0x0a000001=1
+  python3 scripts/nanonic_cuckoo.py bench --sizes 65536,262144,1048576
+
+The buckets are read from the card the first time an insertion visits them,
+so a control plane can be restarted at any time.
+"""
+import argparse
+import random
+import sys
+import time
+from collections import deque
+from math import ceil
+
+import nanonic_regs
+from nanonic_maps import bram18
+from nanonic_regs import Regs
+
+REG_STATUS = 0x00
+REG_WIDTHS = 0x04
+REG_GEOMETRY = 0x08
+REG_COMMAND = 0x0C
+REG_VALID = 0x10
+REG_LOOKUPS = 0x14
+REG_HITS = 0x18
+REG_QUEUED = 0x1C
+REG_DROPPED = 0x20
+REG_KEY = 0x40
+REG_VALUE = 0x80
+
+STATUS_BUSY = 1 << 0
+CMD_WRITE = 1 << 31
+STASH_WAY = 7
+
+# Buckets a search may visit before the key goes to the stash
+MAX_VISITS = 500
+
+
+def h3_row(way, b):
+    """Row b of the H3 matrix of a way, as h3_row() of the RTL."""
+    x = (((way + 1) & 0xFF) << 24) | (b & 0xFFFF)
+    x ^= x >> 16
+    x = (x * 0x85EBCA6B) & 0xFFFFFFFF
+    x ^= x >> 13
+    x = (x * 0xC2B2AE35) & 0xFFFFFFFF
+    x ^= x >> 16
+    return x
+
+
+def location(way, slot, index):
+    return (way << 28) | (slot << 24) | index
+
+
+class Cuckoo:
+    """Cuckoo map with the geometry and the hash of nanonic_cuckoo."""
+
+    def __init__(self, ways=2, slots=4, stash=4, addr_w=12, key_w=32):
+        self.ways, self.slots, self.addr_w, self.key_w = ways, slots, addr_w, key_w
+        self.stash = [None] * stash
+        self.buckets = {}
+        self.count = 0
+        self.moves = 0
+        # H3 rows folded per key byte, so a hash is one lookup per byte
+        mask = (1 << addr_w) - 1
+        self._tables = []
+        for w in range(ways):
+            rows = [h3_row(w, b) & mask for b in range(key_w)]
+            per_byte = []
+            for base in range(0, key_w, 8):
+                t = [0] * 256
+                for v in range(256):
+                    h = 0
+                    for i in range(8):
+                        if v >> i & 1 and base + i < key_w:
+                            h ^= rows[base + i]
+                    t[v] = h
+                per_byte.append(t)
+            self._tables.append(per_byte)
+
+    @property
+    def capacity(self):
+        return self.ways * self.slots << self.addr_w
+
+    def index(self, way, key):
+        h = 0
+        for t in self._tables[way]:
+            h ^= t[key & 0xFF]
+            key >>= 8
+        return h
+
+    # Storage: entries are (key, value) or None. The card subclass reads the
+    # buckets on first use and writes every change through.
+    def bucket(self, way, index):
+        b = self.buckets.get((way, index))
+        if b is None:
+            b = self.buckets[(way, index)] = [None] * self.slots
+        return b
+
+    def write(self, loc, entry):
+        way, slot, index = loc >> 28, (loc >> 24) & 0xF, loc & 0xFFFFFF
+        if way == STASH_WAY:
+            self.stash[index] = entry
+        else:
+            self.bucket(way, index)[slot] = entry
+
+    def find(self, key):
+        for w in range(self.ways):
+            i = self.index(w, key)
+            for s, e in enumerate(self.bucket(w, i)):
+                if e is not None and e[0] == key:
+                    return location(w, s, i)
+        for s, e in enumerate(self.stash):
+            if e is not None and e[0] == key:
+                return location(STASH_WAY, 0, s)
+        return None
+
+    def _free_path(self, key):
+        """Shortest chain of moves that frees a slot for key, or None.
+
+        Returns the slot the key goes to and the moves (from, to, entry) in
+        the order they must be written.
+        """
+        start = [(w, self.index(w, key)) for w in range(self.ways)]
+        parent = {}
+        queue = deque()
+        for node in start:
+            parent[node] = None
+            queue.append(node)
+        visits = 0
+        while queue and visits < MAX_VISITS:
+            w, i = queue.popleft()
+            visits += 1
+            b = self.bucket(w, i)
+            if None in b:
+                # Walk back to the key: each hop moves an entry into the slot
+                # freed by the previous one
+                dst = location(w, b.index(None), i)
+                node = (w, i)
+                moves = []
+                while parent[node] is not None:
+                    pw, pi, ps = parent[node]
+                    src = location(pw, ps, pi)
+                    moves.append((src, dst, self.bucket(pw, pi)[ps]))
+                    node, dst = (pw, pi), src
+                return dst, moves
+            for s, e in enumerate(b):
+                for w2 in range(self.ways):
+                    if w2 == w:
+                        continue
+                    nxt = (w2, self.index(w2, e[0]))
+                    if nxt not in parent:
+                        parent[nxt] = (w, i, s)
+                        queue.append(nxt)
+        return None
+
+    def insert(self, key, value=0):
+        """Insert or update a key; False when the ways and the stash are full."""
+        loc = self.find(key)
+        if loc is not None:
+            self.write(loc, (key, value))
+            return True
+        found = self._free_path(key)
+        if found is None:
+            if None not in self.stash:
+                return False
+            loc = location(STASH_WAY, 0, self.stash.index(None))
+        else:
+            loc, moves = found
+            for src, dst, entry in moves:
+                self.write(dst, entry)
+                self.moves += 1
+        self.write(loc, (key, value))
+        self.count += 1
+        return True
+
+    def delete(self, key):
+        loc = self.find(key)
+        if loc is None:
+            return False
+        self.write(loc, None)
+        self.count -= 1
+        # A slot was freed, try to empty the stash into the ways
+        for s, e in enumerate(self.stash):
+            if e is not None:
+                found = self._free_path(e[0])
+                if found is not None:
+                    dst, moves = found
+                    for src, to, entry in moves:
+                        self.write(to, entry)
+                    self.write(dst, e)
+                    self.write(location(STASH_WAY, 0, s), None)
+        return True
+
+
+class CardCuckoo(Cuckoo):
+    """A nanonic_cuckoo block on the card."""
+
+    def __init__(self, regs, window):
+        self.regs = regs
+        self.window = window
+        geo = self.read(REG_GEOMETRY)
+        widths = self.read(REG_WIDTHS)
+        self.val_w = widths >> 16
+        if geo == 0:
+            raise RuntimeError(f"No cuckoo map at window 0x{window:x}")
+        super().__init__(ways=(geo >> 8) & 0xFF, slots=(geo >> 16) & 0xFF,
+                         stash=geo >> 24, addr_w=geo & 0xFF, key_w=widths & 0xFFFF)
+        for s in range(len(self.stash)):
+            self.stash[s] = self._read_entry(location(STASH_WAY, 0, s))
+
+    def read(self, off):
+        return self.regs.read32(self.window + off)
+
+    def _wait(self):
+        while self.read(REG_STATUS) & STATUS_BUSY:
+            pass
+
+    def _staged(self):
+        key = value = 0
+        for w in range(ceil(self.key_w / 32)):
+            key |= self.read(REG_KEY + 4 * w) << (32 * w)
+        for w in range(ceil(self.val_w / 32)):
+            value |= self.read(REG_VALUE + 4 * w) << (32 * w)
+        return key, value
+
+    def _read_entry(self, loc):
+        self.regs.write32(self.window + REG_COMMAND, loc)
+        self._wait()
+        if not self.read(REG_VALID) & 1:
+            return None
+        return self._staged()
+
+    def bucket(self, way, index):
+        b = self.buckets.get((way, index))
+        if b is None:
+            b = [self._read_entry(location(way, s, index)) for s in range(self.slots)]
+            self.buckets[(way, index)] = b
+        return b
+
+    def write(self, loc, entry):
+        key, value = entry if entry is not None else (0, 0)
+        if key >> self.key_w or value >> self.val_w:
+            raise ValueError(f"Entry 0x{key:x}=0x{value:x} does not fit the map")
+        w32 = lambda off, v: self.regs.write32(self.window + off, v)
+        for w in range(ceil(self.key_w / 32)):
+            w32(REG_KEY + 4 * w, (key >> (32 * w)) & 0xFFFFFFFF)
+        for w in range(ceil(self.val_w / 32)):
+            w32(REG_VALUE + 4 * w, (value >> (32 * w)) & 0xFFFFFFFF)
+        w32(REG_VALID, int(entry is not None))
+        w32(REG_COMMAND, CMD_WRITE | loc)
+        self._wait()
+        super().write(loc, entry)
+
+    def pop_request(self):
+        """Oldest key queued by the datapath, or None."""
+        if self.read(REG_QUEUED) == 0:
+            return None
+        self.regs.write32(self.window + REG_QUEUED, 1)
+        return self._staged()
+
+
+def parse_pair(s):
+    key, sep, value = s.partition("=")
+    return int(key, 0), int(value, 0) if sep else 0
+
+
+def cmd_card(args):
+    with Regs.from_args(args) as regs:
+        m = CardCuckoo(regs, args.window)
+        failed = 0
+        if args.cmd == "insert":
+            for key, value in map(parse_pair, args.entries):
+                failed += not m.insert(key, value)
+        elif args.cmd == "delete":
+            for key, _ in map(parse_pair, args.entries):
+                if not m.delete(key):
+                    print(f"0x{key:x}: not in the map")
+        else:
+            n = 0
+            while True:
+                req = m.pop_request()
+                if req is None:
+                    break
+                failed += not m.insert(*req)
+                n += 1
+            print(f"{n} queued keys, {m.read(REG_DROPPED)} dropped on a full queue")
+        lookups, hits = m.read(REG_LOOKUPS), m.read(REG_HITS)
+    print(f"Map at 0x{args.window:x} ({m.ways} ways x {m.slots} slots x {1 << m.addr_w} "
+          f"buckets, stash {len(m.stash)}): {m.moves} entries moved, {failed} keys "
+          f"did not fit, {hits}/{lookups} lookups hit")
+    return 1 if failed else 0
+
+
+class SingleHash:
+    """Table with one bucket per key, as a map probed with a single read."""
+
+    def __init__(self, entries, slots=1, key_w=32):
+        self.model = Cuckoo(ways=1, slots=slots, stash=0,
+                            addr_w=(entries // slots).bit_length() - 1, key_w=key_w)
+        self.count = 0
+
+    def insert(self, key, value=0):
+        b = self.model.bucket(0, self.model.index(0, key))
+        if None not in b:
+            return False
+        b[b.index(None)] = (key, value)
+        self.count += 1
+        return True
+
+
+def fill(m, keys, capacity):
+    """Insert keys; load at the first failure and load when all were offered."""
+    first = None
+    for n, k in enumerate(keys):
+        if not m.insert(k) and first is None:
+            first = n / capacity
+    return (first if first is not None else len(keys) / capacity), m.count / capacity
+
+
+def cmd_bench(args):
+    rng = random.Random(args.seed)
+    for size in args.sizes:
+        if size < args.ways * args.slots:
+            raise SystemExit(f"size {size} is smaller than one bucket per way")
+    entry_w = 1 + args.key_bits + args.value_bits
+    print(f"{args.ways} ways x {args.slots} slots, stash {args.stash}, "
+          f"{args.key_bits}-bit keys, offered {args.offered:.0%} of the entries")
+    print("")
+    print(f"{'Entries':>9} {'Map':<24} {'First miss':>10} {'Stored':>8} "
+          f"{'Moves/ins':>9} {'BRAM18':>7} {'Clock rate':>10} {'Insert s':>9}")
+    for size in args.sizes:
+        keys = rng.sample(range(1 << args.key_bits), int(size * args.offered))
+        single = SingleHash(size, args.baseline_slots, args.key_bits)
+        t = time.time()
+        first, stored = fill(single, keys, size)
+        t_single = time.time() - t
+        label = "single hash" + (f" x{args.baseline_slots}" if args.baseline_slots > 1 else "")
+        # One memory of the full depth, one read per lookup
+        print(f"{size:>9} {label:<24} {first:>10.1%} {stored:>8.1%} {0:>9.2f} "
+              f"{bram18(entry_w * args.baseline_slots, size // args.baseline_slots):>7} "
+              f"{args.clock:>8.0f} M {t_single:>9.1f}")
+
+        cuckoo = Cuckoo(args.ways, args.slots, args.stash,
+                        (size // (args.ways * args.slots)).bit_length() - 1, args.key_bits)
+        t = time.time()
+        first, stored = fill(cuckoo, keys, size)
+        t_cuckoo = time.time() - t
+        # WAYS x SLOTS memories, all read by every lookup
+        mems = args.ways * args.slots * bram18(entry_w, size // (args.ways * args.slots))
+        print(f"{'':>9} {f'cuckoo {args.ways}x{args.slots}+{args.stash}':<24} {first:>10.1%} "
+              f"{stored:>8.1%} {cuckoo.moves / max(cuckoo.count, 1):>9.2f} {mems:>7} "
+              f"{args.clock:>8.0f} M {t_cuckoo:>9.1f}")
+    print("")
+    print("First miss: load when the first key could not be stored")
+    print("Stored: load after all the keys were offered (failed keys are dropped)")
+    print(f"Clock rate: lookups/s derived from --clock, not measured: both maps take one "
+          f"lookup per cycle at {args.clock:.0f} MHz, the cuckoo map in 3 cycles")
+    print("Insert s: time of the software model, moves are extra card writes per insert")
+    return 0
+
+
+def sizes(s):
+    """Comma-separated map sizes; k/K and M suffixes are binary (64K = 65536)."""
+    out = []
+    for x in s.split(","):
+        x = x.strip()
+        scale = {"k": 1 << 10, "K": 1 << 10, "M": 1 << 20}.get(x[-1:], 1)
+        try:
+            n = int(x[:-1] if scale > 1 else x, 0) * scale
+        except ValueError:
+            raise argparse.ArgumentTypeError(f"invalid size '{x}'")
+        if n <= 0 or n & (n - 1):
+            raise argparse.ArgumentTypeError(f"size {x} is not a power of two")
+        out.append(n)
+    return out
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__,
+                                formatter_class=argparse.RawDescriptionHelpFormatter)
+    nanonic_regs.add_arguments(p)
+    p.add_argument("--window", type=lambda s: int(s, 0), default=0,
+                   help="Offset of the map block from --base (default: 0x%(default)x).")
+    sub = p.add_subparsers(dest="cmd", required=True)
+
+    for name, text in (("insert", "KEY=VALUE entries to insert or update."),
+                       ("delete", "Keys to remove.")):
+        sp = sub.add_parser(name, help=text)
+        sp.add_argument("entries", nargs="+", help=text)
+        sp.set_defaults(func=cmd_card)
+    sp = sub.add_parser("drain", help="Insert the keys queued by the datapath.")
+    sp.set_defaults(func=cmd_card)
+
+    sp = sub.add_parser("bench", help="Occupancy against a single-hash table.")
+    sp.add_argument("--sizes", type=sizes, default=[65536, 262144, 1048576],
+                    help="Map sizes in entries, powers of two with optional k or M suffix "
+                         "(default: 64K,256K,1M).")
+    sp.add_argument("--ways", type=int, default=2, help="Ways (default: %(default)s).")
+    sp.add_argument("--slots", type=int, default=4,
+                    help="Slots per bucket (default: %(default)s).")
+    sp.add_argument("--stash", type=int, default=4,
+                    help="Stash entries (default: %(default)s).")
+    sp.add_argument("--baseline-slots", type=int, default=1,
+                    help="Slots per bucket of the single-hash table (default: %(default)s).")
+    sp.add_argument("--key-bits", type=int, default=32,
+                    help="Key width (default: %(default)s).")
+    sp.add_argument("--value-bits", type=int, default=64,
+                    help="Value width, for the BRAM count (default: %(default)s).")
+    sp.add_argument("--offered", type=float, default=1.0,
+                    help="Keys offered as a fraction of the entries (default: %(default)s).")
+    sp.add_argument("--clock", type=float, default=250.0,
+                    help="Pipeline clock in MHz (default: %(default)s).")
+    sp.add_argument("--seed", type=int, default=1, help="Random seed (default: %(default)s).")
+    sp.set_defaults(func=cmd_bench)
+
+    args = p.parse_args()
+    return args.func(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,271 @@
+#!/usr/bin/env python3
+"""
+Design-space exploration of an application: sweep the HLS clock target and
+the options of the Nanotube passes, build every point and report the Pareto
+front of throughput against LUT and BRAM.
+
+A variant is a set of Nanotube options, given as NAME[:KEY=VALUE[;KEY=VALUE]]
+where KEY is one of
+
+  FLAGS     NANONIC_FLAGS of nanotube_steps.sh (application build flags)
+  OPTREQ    NANONIC_OPTREQ_OPTS, options of the packet access optimisation
+  CONVERGE  NANONIC_CONVERGE_OPTS, options of the control flow convergence
+
+and "base" is the stock nanotube_steps.sh. Every variant is compiled once
+with nanotube_steps.sh (one after the other, since the script works inside
+the application directory) and its .hls directory is copied to the output
+directory. The HLS builds of all (variant, clock) points then run in
+parallel, at most --parallel at a time and no more than the memory available
+at start allows with --mem-per-build GB each. Points already built are kept,
+so an interrupted sweep resumes where it stopped.
+
+Each build is read with report_hls_synth --json. The throughput of a point is
+the clock it runs at (the target, or the achieved one when timing fails)
+divided by the II of the slowest stage and by the bus beats of a --frame-size
+frame; the Pareto front keeps the points that no other point beats on Mpps,
+LUT and BRAM at once.
+
+  scripts/nanonic_dse.py xdp_katran --hls-build ../nanotube/scripts/hls_build \\
+      --clocks 4.0,3.5,3.1 \\
+      --variant base \\
+      --variant "no-unroll:OPTREQ=-mergereturn -optreq -always-inline -instsimplify -simplifycfg" \\
+      --variant "parallel:FLAGS=-D NANONIC_PARALLEL_LOOKUP"
+"""
+import argparse
+import csv
+import json
+import math
+import os
+import shutil
+import subprocess
+import sys
+import time
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+APPS_DIR = os.path.join(ROOT, "Custom_applications")
+REPORT = os.path.join(ROOT, "scripts", "report_hls_synth")
+
+VARIANT_KEYS = {
+    "FLAGS": "NANONIC_FLAGS",
+    "OPTREQ": "NANONIC_OPTREQ_OPTS",
+    "CONVERGE": "NANONIC_CONVERGE_OPTS",
+}
+BUS_BYTES = 64
+
+
+def variant(s):
+    name, _, rest = s.partition(":")
+    env = {}
+    for item in filter(None, rest.split(";")):
+        key, sep, value = item.partition("=")
+        if not sep or key.strip() not in VARIANT_KEYS:
+            raise argparse.ArgumentTypeError(
+                f"{item!r}: expected KEY=VALUE with KEY in {', '.join(VARIANT_KEYS)}")
+        env[VARIANT_KEYS[key.strip()]] = value.strip()
+    return name, env
+
+
+def mem_available_gb():
+    with open("/proc/meminfo") as fh:
+        for line in fh:
+            if line.startswith("MemAvailable:"):
+                return int(line.split()[1]) / (1 << 20)
+    return float("inf")
+
+
+def compile_variant(app, name, env, out):
+    """Run nanotube_steps.sh with the options of a variant, return its .hls copy."""
+    dest = os.path.join(out, name, app + ".hls")
+    if os.path.isdir(dest):
+        return dest
+    app_dir = os.path.join(APPS_DIR, app)
+    os.makedirs(os.path.dirname(dest), exist_ok=True)
+    start = time.time()
+    log = os.path.join(out, name, "nanotube.log")
+    print(f"[{name}] nanotube_steps.sh, log in {log}")
+    with open(log, "w") as fh:
+        subprocess.run(["./nanotube_steps.sh"], cwd=app_dir, env=dict(os.environ, **env),
+                       stdout=fh, stderr=subprocess.STDOUT, check=True)
+    # The back end writes the newest .hls directory of the application
+    hls = [os.path.join(app_dir, d) for d in os.listdir(app_dir) if d.endswith(".hls")]
+    hls = [d for d in hls if os.path.getmtime(d) >= start - 1]
+    if not hls:
+        raise RuntimeError(f"{app}: nanotube_steps.sh wrote no .hls directory")
+    shutil.copytree(max(hls, key=os.path.getmtime), dest)
+    with open(os.path.join(out, name, "variant.json"), "w") as fh:
+        json.dump(env, fh, indent=2)
+    return dest
+
+
+def build_cmd(args, hls, build_dir, clock):
+    cmd = [args.hls_build, f"-j{args.jobs}", "--clock", f"{clock},0.0", "-p", args.part,
+           hls + "/", build_dir + "/"]
+    return cmd + [f"-L{lib}" for lib in args.lib]
+
+
+def run_builds(points, args):
+    """Run the HLS builds of the points not built yet, bounded in number and memory."""
+    todo = [p for p in points if not os.path.exists(p["metrics_path"])]
+    slots = min(args.parallel, max(1, int(mem_available_gb() // args.mem_per_build)))
+    print(f"{len(todo)} builds to run, {slots} at a time "
+          f"({args.mem_per_build} GB each, {mem_available_gb():.0f} GB available)")
+    running = []
+    while todo or running:
+        while todo and len(running) < slots:
+            p = todo.pop(0)
+            shutil.rmtree(p["build_dir"], ignore_errors=True)
+            os.makedirs(p["build_dir"])
+            log = open(os.path.join(p["build_dir"], "hls_build.log"), "w")
+            print(f"[{p['variant']} {p['clock']} ns] hls_build")
+            proc = subprocess.Popen(build_cmd(args, p["hls"], p["build_dir"], p["clock"]),
+                                    stdout=log, stderr=subprocess.STDOUT)
+            running.append((p, proc, log))
+        time.sleep(5)
+        for entry in list(running):
+            p, proc, log = entry
+            if proc.poll() is None:
+                continue
+            log.close()
+            running.remove(entry)
+            status = "done" if proc.returncode == 0 else f"failed ({proc.returncode})"
+            print(f"[{p['variant']} {p['clock']} ns] hls_build {status}")
+            collect(p)
+
+
+def collect(p):
+    """Read the build of a point with report_hls_synth and store its metrics."""
+    res = subprocess.run([sys.executable, REPORT, "-s", "--json", p["metrics_path"],
+                          p["build_dir"]], stdout=subprocess.DEVNULL, stderr=subprocess.PIPE,
+                         text=True)
+    if res.returncode or not os.path.exists(p["metrics_path"]):
+        with open(p["metrics_path"], "w") as fh:
+            json.dump({"top": {"Errors": 1}, "error": res.stderr.strip()}, fh)
+
+
+def evaluate(p, frame_size):
+    with open(p["metrics_path"]) as fh:
+        top = json.load(fh)["top"]
+    target = 1000.0 / p["clock"]
+    achieved = top.get("Clock Rate (MHz)") or 0.0
+    ii = max(1, int(top.get("Interval", 1)))
+    run_mhz = min(target, achieved)
+    beats = math.ceil(frame_size / BUS_BYTES)
+    return dict(p, **{
+        "target_mhz": target,
+        "achieved_mhz": achieved,
+        "timing_met": achieved >= target and float(top.get("TNS", 0)) >= 0,
+        "ii": ii,
+        "latency": int(top.get("Latency", 0)),
+        "lut": int(top.get("LUT", 0)),
+        "ff": int(top.get("FF", 0)),
+        "bram": int(top.get("BRAM_18k", 0)),
+        "uram": int(top.get("URAM", 0)),
+        "errors": int(top.get("Errors", 0)),
+        "mpps": run_mhz / (ii * beats) if achieved else 0.0,
+    })
+
+
+def dominates(a, b):
+    better = a["mpps"] >= b["mpps"] and a["lut"] <= b["lut"] and a["bram"] <= b["bram"]
+    strictly = a["mpps"] > b["mpps"] or a["lut"] < b["lut"] or a["bram"] < b["bram"]
+    return better and strictly
+
+
+def pareto(results):
+    valid = [r for r in results if not r["errors"] and r["mpps"] > 0]
+    return [r for r in valid if not any(dominates(o, r) for o in valid)]
+
+
+def report(results, front, args):
+    on_front = {id(r) for r in front}
+    print("")
+    print(f"{'Variant':<16} {'Clock':>6} {'Target':>7} {'Fmax':>7} {'II':>3} {'Lat':>5} "
+          f"{'LUT':>8} {'FF':>8} {'BRAM':>5} {'URAM':>5} {'Mpps':>7}  ")
+    for r in sorted(results, key=lambda r: (-r["mpps"], r["lut"])):
+        flag = "*" if id(r) in on_front else ("!" if r["errors"] else " ")
+        timing = "" if r["timing_met"] else " (timing)"
+        print(f"{r['variant']:<16} {r['clock']:>6.2f} {r['target_mhz']:>7.1f} "
+              f"{r['achieved_mhz']:>7.1f} {r['ii']:>3} {r['latency']:>5} {r['lut']:>8} "
+              f"{r['ff']:>8} {r['bram']:>5} {r['uram']:>5} {r['mpps']:>7.1f} {flag}{timing}")
+    print("")
+    print(f"* Pareto front on Mpps ({args.frame_size}-byte frames) against LUT and BRAM, "
+          f"! build or report errors")
+    for r in sorted(front, key=lambda r: r["lut"]):
+        print(f"  {r['variant']} at {r['clock']} ns: {r['mpps']:.1f} Mpps, "
+              f"{r['lut']} LUT, {r['bram']} BRAM_18k")
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__,
+                                formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument("app", help="Application directory in Custom_applications.")
+    p.add_argument("--clocks", type=lambda s: [float(x) for x in s.split(",")],
+                   default=[4.0], help="Clock periods in ns (default: 4.0).")
+    p.add_argument("--variant", type=variant, action="append",
+                   help="Nanotube options, NAME[:KEY=VALUE[;KEY=VALUE]] (default: base).")
+    p.add_argument("--out", help="Output directory (default: DSE/APP).")
+    p.add_argument("--hls-build", default="scripts/hls_build",
+                   help="hls_build script of Nanotube (default: %(default)s).")
+    p.add_argument("--part", default="xcu250-figd2104-2L-e",
+                   help="FPGA part (default: %(default)s).")
+    p.add_argument("--lib", action="append",
+                   default=["/usr/lib/x86_64-linux-gnu", "/usr/lib/gcc/x86_64-linux-gnu/9"],
+                   help="Library path passed to hls_build, added to the defaults (repeatable).")
+    p.add_argument("--jobs", type=int, default=2,
+                   help="Stages built in parallel by each hls_build (default: %(default)s).")
+    p.add_argument("--parallel", type=int, default=4,
+                   help="hls_build runs in parallel at most (default: %(default)s).")
+    p.add_argument("--mem-per-build", type=float, default=16,
+                   help="GB of memory to count per hls_build run (default: %(default)s).")
+    p.add_argument("--frame-size", type=int, default=64,
+                   help="Frame size in bytes of the throughput (default: %(default)s).")
+    p.add_argument("--report-only", action="store_true",
+                   help="Do not build, report the points already built.")
+    args = p.parse_args()
+
+    if not os.path.isdir(os.path.join(APPS_DIR, args.app)):
+        p.error(f"no application {args.app} in {APPS_DIR}")
+    variants = args.variant or [("base", {})]
+    if len({name for name, _ in variants}) != len(variants):
+        p.error("variant names must be unique")
+    out = os.path.abspath(args.out or os.path.join("DSE", args.app))
+    args.hls_build = os.path.abspath(args.hls_build)
+
+    points = []
+    for name, env in variants:
+        hls = os.path.join(out, name, args.app + ".hls")
+        if not args.report_only:
+            hls = compile_variant(args.app, name, env, out)
+        for clock in args.clocks:
+            build_dir = os.path.join(out, name, f"clk_{clock:g}")
+            points.append({"variant": name, "clock": clock, "hls": hls,
+                           "build_dir": build_dir,
+                           "metrics_path": os.path.join(build_dir, "metrics.json")})
+
+    if not args.report_only:
+        run_builds(points, args)
+    for pt in points:
+        if not os.path.exists(pt["metrics_path"]) and os.path.isdir(pt["build_dir"]):
+            collect(pt)
+    results = [evaluate(pt, args.frame_size) for pt in points
+               if os.path.exists(pt["metrics_path"])]
+    if not results:
+        print("No point built yet.")
+        return 1
+
+    front = pareto(results)
+    report(results, front, args)
+
+    fields = ["variant", "clock", "target_mhz", "achieved_mhz", "timing_met", "ii", "latency",
+              "lut", "ff", "bram", "uram", "mpps", "errors"]
+    with open(os.path.join(out, "dse.csv"), "w", newline="") as fh:
+        w = csv.DictWriter(fh, fieldnames=fields + ["pareto"], extrasaction="ignore")
+        w.writeheader()
+        for r in results:
+            w.writerow(dict(r, pareto=int(r in front)))
+    print(f"\nAll points in {os.path.join(out, 'dse.csv')}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
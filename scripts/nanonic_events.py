@@ -0,0 +1,197 @@
+#!/usr/bin/env python3
+"""
+Host side of the NanoNIC event tap (rtl/nanonic_event_tap.v, EVENTS_EN=1).
+
+The tap copies one in N of the packets whose descriptor carries an event code
+(xdp_katran built with -D NANONIC_META -D KATRAN_INTROSPECTION tags LRU misses
+of non-SYN TCP packets and QUIC packets whose server id has no mapping, and
+with -D NANONIC_WARM_RESTART the new LRU entries) to the host: a record is the descriptor, with NANONIC_F_SAMPLE set in its flags,
+followed by the first 64 bytes of the frame.
+
+  config   set the sampling period and the event filter of the tap
+  stats    print the counters of the tap (eligible, recorded, dropped records)
+  report   aggregate the records of a C2H capture per event, VIP, real and
+           flow; counts are scaled by the sampling period to estimate the
+           number of events on the wire
+
+  python3 scripts/nanonic_events.py config --period 64
+  python3 scripts/nanonic_events.py report c2h.pcap --period 64
+"""
+import argparse
+from collections import Counter
+import ipaddress
+import struct
+import sys
+
+import nanonic_regs
+from nanonic_meta import parse_desc
+from nanonic_pcap import read_pcap
+from nanonic_regs import BLOCK_EVENTS, Regs
+
+F_SAMPLE = 1 << 7
+
+EVENTS = {0: "none", 1: "tcp_nonsyn_lrumiss", 2: "quic_no_real", 3: "lru_insert"}
+PROTOS = {6: "tcp", 17: "udp", 1: "icmp", 58: "icmp6"}
+
+REG_CTRL = 0x00
+REG_PERIOD = 0x04
+REG_SEEN = 0x08
+REG_RECORDS = 0x0C
+REG_DROPPED = 0x10
+
+CTRL_EN = 1 << 0
+CTRL_ALL = 1 << 1
+
+
+def event_name(e):
+    return EVENTS.get(e, str(e))
+
+
+def parse_ip(hdr, off, etype):
+    """Return (proto, src, dst, l4 offset) of the IP header at off, or None."""
+    if etype == 0x0800 and len(hdr) >= off + 20:
+        ihl = (hdr[off] & 0x0F) * 4
+        return (hdr[off + 9], ipaddress.IPv4Address(hdr[off + 12:off + 16]),
+                ipaddress.IPv4Address(hdr[off + 16:off + 20]), off + ihl)
+    if etype == 0x86DD and len(hdr) >= off + 40:
+        return (hdr[off + 6], ipaddress.IPv6Address(hdr[off + 8:off + 24]),
+                ipaddress.IPv6Address(hdr[off + 24:off + 40]), off + 40)
+    return None
+
+
+def parse_flow(hdr):
+    """5-tuple of the truncated headers of a record, inner one when encapsulated."""
+    if len(hdr) < 14:
+        return None
+    etype = struct.unpack_from("!H", hdr, 12)[0]
+    ip = parse_ip(hdr, 14, etype)
+    # IPIP (4) and IPv6-in-IP (41) outer headers added by the encap engine
+    while ip is not None and ip[0] in (4, 41):
+        ip = parse_ip(hdr, ip[3], 0x0800 if ip[0] == 4 else 0x86DD)
+    if ip is None:
+        return None
+    proto, src, dst, l4 = ip
+    sport = dport = 0
+    if proto in (6, 17) and len(hdr) >= l4 + 4:
+        sport, dport = struct.unpack_from("!HH", hdr, l4)
+    return proto, src, sport, dst, dport
+
+
+def flow_str(flow):
+    proto, src, sport, dst, dport = flow
+    name = PROTOS.get(proto, str(proto))
+    if isinstance(src, ipaddress.IPv6Address):
+        return f"{name} [{src}]:{sport} -> [{dst}]:{dport}"
+    return f"{name} {src}:{sport} -> {dst}:{dport}"
+
+
+def print_top(title, counter, scale, top, fmt=str):
+    if not counter:
+        return
+    print(title)
+    print("-" * len(title))
+    for key, count in counter.most_common(top):
+        print(f"  {fmt(key):>48} : {count:8d} records  ~{count * scale} events")
+    print("")
+
+
+def cmd_config(args):
+    with Regs.from_args(args) as regs:
+        regs.check_id()
+        if args.period is not None:
+            regs.write32(BLOCK_EVENTS + REG_PERIOD, args.period)
+        ctrl = 0 if args.disable else CTRL_EN
+        if args.all:
+            ctrl |= CTRL_ALL
+        regs.write32(BLOCK_EVENTS + REG_CTRL, ctrl)
+        print(f"event tap {'disabled' if args.disable else 'enabled'}, "
+              f"period {regs.read32(BLOCK_EVENTS + REG_PERIOD)}, "
+              f"{'every packet with a descriptor' if args.all else 'event codes only'}")
+    return 0
+
+
+def cmd_stats(args):
+    with Regs.from_args(args) as regs:
+        regs.check_id()
+        rd = lambda off: regs.read32(BLOCK_EVENTS + off)
+        ctrl = rd(REG_CTRL)
+        seen, records, dropped = rd(REG_SEEN), rd(REG_RECORDS), rd(REG_DROPPED)
+        print(f"event tap {'enabled' if ctrl & CTRL_EN else 'disabled'}, "
+              f"period {rd(REG_PERIOD)}, {'all' if ctrl & CTRL_ALL else 'events only'}")
+        print(f"  eligible packets : {seen}")
+        print(f"  records queued   : {records}")
+        print(f"  records dropped  : {dropped}"
+              + (f" ({100.0 * dropped / (records + dropped):.2f} %)" if records + dropped else ""))
+    return 0
+
+
+def cmd_report(args):
+    scale = max(1, args.period)
+    total = 0
+    events = Counter()
+    vips = Counter()
+    reals = Counter()
+    flows = Counter()
+    first = last = None
+
+    for ts, data in read_pcap(args.pcap):
+        desc = parse_desc(data)
+        if desc is None or not desc["flags"] & F_SAMPLE:
+            continue
+        total += 1
+        first = ts if first is None else first
+        last = ts
+        events[desc["event"]] += 1
+        if desc["vip"] is not None:
+            vips[(desc["event"], desc["vip"])] += 1
+        if desc["real"] is not None:
+            reals[(desc["event"], desc["real"])] += 1
+        flow = parse_flow(data[64:])
+        if flow is not None:
+            flows[(desc["event"], flow)] += 1
+
+    print(f"Event records: {total}, sampling period {scale}")
+    if total == 0:
+        return 0
+    if last > first:
+        print(f"  over {last - first:.3f} s, ~{total * scale / (last - first):.1f} events/s")
+    print("")
+    print_top("Per event", events, scale, args.top, event_name)
+    print_top("Per event and VIP number", vips, scale, args.top,
+              lambda k: f"{event_name(k[0])} vip {k[1]}")
+    print_top("Per event and real index", reals, scale, args.top,
+              lambda k: f"{event_name(k[0])} real {k[1]}")
+    print_top("Top flows", flows, scale, args.top,
+              lambda k: f"{event_name(k[0])} {flow_str(k[1])}")
+    return 0
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__,
+                                formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = p.add_subparsers(dest="cmd", required=True)
+
+    c = sub.add_parser("config", help="Configure the tap.")
+    nanonic_regs.add_arguments(c)
+    c.add_argument("--period", type=int,
+                   help="Record one eligible packet in PERIOD.")
+    c.add_argument("--all", action="store_true",
+                   help="Sample every packet with a descriptor, not only events.")
+    c.add_argument("--disable", action="store_true", help="Stop recording.")
+
+    s = sub.add_parser("stats", help="Print the counters of the tap.")
+    nanonic_regs.add_arguments(s)
+
+    r = sub.add_parser("report", help="Aggregate the records of a C2H capture.")
+    r.add_argument("pcap", help="Capture of the C2H traffic.")
+    r.add_argument("--period", type=int, default=1,
+                   help="Sampling period the capture was taken with (default: %(default)s).")
+    r.add_argument("--top", type=int, default=10,
+                   help="Entries per table (default: %(default)s).")
+
+    args = p.parse_args()
+    return {"config": cmd_config, "stats": cmd_stats, "report": cmd_report}[args.cmd](args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
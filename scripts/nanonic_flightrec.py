@@ -0,0 +1,239 @@
+#!/usr/bin/env python3
+"""
+Host side of the NanoNIC flight recorder (rtl/nanonic_flight_rec.v,
+FLIGHT_EN=1), the always-on ring of the last packets seen in front of the
+egress decoder.
+
+  status   print the state of the ring and of its trigger
+  arm      set the trigger (verdict and/or header pattern, packets kept after
+           the trigger) and restart recording
+  trigger  freeze the ring now
+  dump     freeze the ring if it is still recording and write its entries,
+           oldest first, to a pcap: the recorded header bytes of each packet,
+           with its original length and a wall-clock timestamp derived from
+           the cycle counter of the top
+
+  python3 scripts/nanonic_flightrec.py arm --verdict DROP --post 32
+  python3 scripts/nanonic_flightrec.py arm --match 26:c0a80164
+  python3 scripts/nanonic_flightrec.py dump ring.pcap -v
+
+With --desc every packet of the dump starts with a NanoNIC descriptor holding
+the recorded verdict, so scripts/nanonic_meta.py can read the file.
+"""
+import argparse
+import struct
+import sys
+import time
+
+import nanonic_regs
+from nanonic_pcap import write_pcap
+from nanonic_regs import BLOCK_FLIGHT, BLOCK_TOP, Regs
+
+VERDICTS = {0: "ABORTED", 1: "DROP", 2: "PASS", 3: "TX", 4: "REDIRECT"}
+
+REG_CTRL = 0x00
+REG_STATUS = 0x04
+REG_TRIGGER = 0x08
+REG_POST = 0x0C
+REG_PAT_OFF = 0x10
+REG_PAT_VALUE = 0x14
+REG_PAT_MASK = 0x18
+REG_TOTAL = 0x1C
+REG_DEPTH = 0x20
+REG_HDR_BYTES = 0x24
+REG_RD_IDX = 0x28
+REG_TRIG_IDX = 0x2C
+REG_HDR = 0x100
+REG_TUSER = 0x180
+REG_VERDICT = 0x184
+REG_TS = 0x188
+
+CTRL_TRIGGER = 1 << 0
+CTRL_REARM = 1 << 1
+
+TOP_CYCLES = 0x0C
+
+
+def verdict_value(s):
+    for k, v in VERDICTS.items():
+        if s.upper() == v:
+            return k
+    return int(s, 0)
+
+
+def pattern(s):
+    """OFF:VALUE[/MASK], VALUE and MASK in hex, network order."""
+    off, _, rest = s.partition(":")
+    value, _, mask = rest.partition("/")
+    off = int(off, 0)
+    if not 0 <= off <= 60 or not rest:
+        raise argparse.ArgumentTypeError("expected OFF:VALUE[/MASK] with OFF from 0 to 60")
+    return off, int(value, 16), int(mask, 16) if mask else 0xFFFFFFFF
+
+
+def read_state(regs):
+    rd = lambda off: regs.read32(BLOCK_FLIGHT + off)
+    status = rd(REG_STATUS)
+    trig = rd(REG_TRIGGER)
+    return {
+        "frozen": bool(status & 1),
+        "triggered": bool(status & 2),
+        "wr_idx": status >> 16,
+        "on_verdict": bool(trig & 1),
+        "on_pattern": bool(trig & 2),
+        "verdict": (trig >> 8) & 0xFF,
+        "post": rd(REG_POST),
+        "pat_off": rd(REG_PAT_OFF),
+        "pat_value": rd(REG_PAT_VALUE),
+        "pat_mask": rd(REG_PAT_MASK),
+        "total": rd(REG_TOTAL),
+        "depth": rd(REG_DEPTH),
+        "hdr_bytes": rd(REG_HDR_BYTES),
+        "trig_idx": rd(REG_TRIG_IDX),
+    }
+
+
+def read_entry(regs, idx, hdr_bytes):
+    regs.write32(BLOCK_FLIGHT + REG_RD_IDX, idx)
+    # The ring has one cycle of read latency, far less than a BAR access
+    hdr = b"".join(struct.pack("<I", regs.read32(BLOCK_FLIGHT + REG_HDR + 4 * w))
+                   for w in range(hdr_bytes // 4))
+    tuser_lo = regs.read32(BLOCK_FLIGHT + REG_TUSER)
+    word = regs.read32(BLOCK_FLIGHT + REG_VERDICT)
+    tuser = ((word & 0xFFFF) << 32) | tuser_lo
+    return {
+        "hdr": hdr,
+        "size": tuser & 0xFFFF,
+        "src": (tuser >> 16) & 0xFFFF,
+        "dst": (tuser >> 32) & 0xFFFF,
+        "has_desc": bool((word >> 16) & 1),
+        "verdict": word >> 24,
+        "cycles": regs.read64(BLOCK_FLIGHT + REG_TS),
+    }
+
+
+def print_state(st):
+    state = "frozen" if st["frozen"] else ("triggered" if st["triggered"] else "recording")
+    print(f"flight recorder: {state}, {min(st['total'], st['depth'])}/{st['depth']} entries "
+          f"of {st['hdr_bytes']} bytes, {st['total']} packets recorded")
+    on = []
+    if st["on_verdict"]:
+        on.append(f"verdict {VERDICTS.get(st['verdict'], st['verdict'])}")
+    if st["on_pattern"]:
+        on.append(f"bytes {st['pat_off']}..{st['pat_off'] + 3} = "
+                  f"{st['pat_value']:08x}/{st['pat_mask']:08x}")
+    print(f"  trigger: {' or '.join(on) if on else 'host only'}, "
+          f"{st['post']} packets kept after it")
+    if st["triggered"]:
+        print(f"  triggered on entry {st['trig_idx']}")
+
+
+def cmd_status(args, regs):
+    print_state(read_state(regs))
+    return 0
+
+
+def cmd_arm(args, regs):
+    trig = 0
+    if args.verdict is not None:
+        trig |= 1 | (args.verdict << 8)
+    if args.match is not None:
+        off, value, mask = args.match
+        regs.write32(BLOCK_FLIGHT + REG_PAT_OFF, off)
+        regs.write32(BLOCK_FLIGHT + REG_PAT_VALUE, value)
+        regs.write32(BLOCK_FLIGHT + REG_PAT_MASK, mask)
+        trig |= 2
+    regs.write32(BLOCK_FLIGHT + REG_TRIGGER, trig)
+    if args.post is not None:
+        regs.write32(BLOCK_FLIGHT + REG_POST, args.post)
+    regs.write32(BLOCK_FLIGHT + REG_CTRL, CTRL_REARM)
+    print_state(read_state(regs))
+    return 0
+
+
+def cmd_trigger(args, regs):
+    regs.write32(BLOCK_FLIGHT + REG_CTRL, CTRL_TRIGGER)
+    print_state(read_state(regs))
+    return 0
+
+
+def cmd_dump(args, regs):
+    st = read_state(regs)
+    if not st["frozen"]:
+        regs.write32(BLOCK_FLIGHT + REG_CTRL, CTRL_TRIGGER)
+        st = read_state(regs)
+    # Wall clock of the cycle counter, to date the entries
+    now = time.time()
+    now_cycles = regs.read64(BLOCK_TOP + TOP_CYCLES)
+
+    count = min(st["total"], st["depth"])
+    first = (st["wr_idx"] - count) % st["depth"]
+    packets = []
+    for n in range(count):
+        idx = (first + n) % st["depth"]
+        e = read_entry(regs, idx, st["hdr_bytes"])
+        frame_len = e["size"] - 64 if e["has_desc"] and e["size"] >= 64 else e["size"]
+        ts = now - ((now_cycles - e["cycles"]) & ((1 << 64) - 1)) * args.clk_ps * 1e-12
+        data = e["hdr"][:max(0, min(st["hdr_bytes"], frame_len))]
+        if args.desc:
+            desc = bytearray(64)
+            desc[0:4] = bytes([0x4E, 0x54, 1, e["verdict"] if e["has_desc"] else 2])
+            struct.pack_into(">H", desc, 18, frame_len)
+            packets.append((ts, bytes(desc) + data, 64 + frame_len))
+        else:
+            packets.append((ts, data, frame_len))
+        if args.verbose:
+            mark = " <- trigger" if st["triggered"] and idx == st["trig_idx"] else ""
+            verdict = VERDICTS.get(e["verdict"], e["verdict"]) if e["has_desc"] else "-"
+            print(f"{idx:5d} {time.strftime('%H:%M:%S', time.localtime(ts))}"
+                  f".{int(ts * 1e6) % 1000000:06d} {verdict:>8} {frame_len:5d} bytes "
+                  f"src 0x{e['src']:04x} dst 0x{e['dst']:04x}{mark}")
+
+    write_pcap(args.out, packets)
+    print(f"{args.out}: {count} packets")
+    if args.rearm:
+        regs.write32(BLOCK_FLIGHT + REG_CTRL, CTRL_REARM)
+    return 0
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__,
+                                formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = p.add_subparsers(dest="cmd", required=True)
+
+    sub.add_parser("status", help="Print the state of the ring.")
+
+    a = sub.add_parser("arm", help="Set the trigger and restart recording.")
+    a.add_argument("--verdict", type=verdict_value,
+                   help="Trigger on a verdict (name or number).")
+    a.add_argument("--match", type=pattern,
+                   help="Trigger on 4 bytes of the header, OFF:VALUE[/MASK] in hex, "
+                        "e.g. 26:c0a80164 for IPv4 source 192.168.1.100.")
+    a.add_argument("--post", type=int,
+                   help="Packets recorded after the trigger before freezing.")
+
+    sub.add_parser("trigger", help="Freeze the ring now.")
+
+    d = sub.add_parser("dump", help="Write the ring to a pcap.")
+    d.add_argument("out", help="Output pcap.")
+    d.add_argument("--desc", action="store_true",
+                   help="Prepend a NanoNIC descriptor with the recorded verdict.")
+    d.add_argument("--rearm", action="store_true",
+                   help="Restart recording after the dump.")
+    d.add_argument("--clk-ps", type=int, default=4000,
+                   help="Period of the pipeline clock in ps (default: %(default)s, 250 MHz).")
+    d.add_argument("--verbose", "-v", action="store_true",
+                   help="List the entries.")
+
+    for s in sub.choices.values():
+        nanonic_regs.add_arguments(s)
+    args = p.parse_args()
+
+    cmds = {"status": cmd_status, "arm": cmd_arm, "trigger": cmd_trigger, "dump": cmd_dump}
+    with Regs.from_args(args) as regs:
+        regs.check_id()
+        return cmds[args.cmd](args, regs)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
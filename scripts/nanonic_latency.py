@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+"""
+Read the pipeline latency histogram of a NanoNIC pipeline top built with
+LATENCY_EN=1 and print the latency distribution.
+
+Latency is measured in clock cycles from the first beat of a packet entering
+the Nanotube pipeline to its first beat leaving it, and converted to ns with
+the clock period reported by the hardware. Buckets are log2 wide, so the
+percentiles are interpolated linearly inside a bucket.
+
+The ingress timestamp has 15 bits and wraps after 32768 cycles (131 us at
+250 MHz). The top counts a packet in the last bucket, at 32768 cycles, when
+the egress held the pipeline long enough for its stamp to wrap (see
+LATENCY_FREE_CYCLES of nanonic_pipeline_top); that bucket means "at least
+32768 cycles", and min, max and the sum take those samples as 32768.
+"""
+import argparse
+import sys
+
+import nanonic_regs
+from nanonic_regs import BLOCK_LATENCY, Regs
+
+NUM_BUCKETS = 17
+# Bucket of the samples the top saturates, the stamp wraps above it
+WRAP_BUCKET = 16
+WRAP_CYCLES = 1 << 15
+
+REG_CTRL = 0x00
+REG_COUNT = 0x04
+REG_MIN = 0x08
+REG_MAX = 0x0C
+REG_P99 = 0x10
+REG_SUM = 0x14
+REG_CLK_PS = 0x1C
+REG_BUCKET = 0x40
+
+
+def bucket_range(b):
+    """Return the [low, high] range of cycles counted by bucket b."""
+    if b == 0:
+        return 0, 0
+    if b == WRAP_BUCKET:
+        return WRAP_CYCLES, WRAP_CYCLES
+    return 1 << (b - 1), (1 << b) - 1
+
+
+def percentile(buckets, total, q):
+    """Estimate the q-quantile (0..1) in cycles from the bucket counts."""
+    if total == 0:
+        return 0.0
+    target = q * total
+    cum = 0
+    for b, count in enumerate(buckets):
+        if count and cum + count >= target:
+            low, high = bucket_range(b)
+            return low + (high - low) * (target - cum) / count
+        cum += count
+    return float(bucket_range(len(buckets) - 1)[1])
+
+
+def read_hist(regs):
+    rd = lambda off: regs.read32(BLOCK_LATENCY + off)
+    return {
+        "count": rd(REG_COUNT),
+        "min": rd(REG_MIN),
+        "max": rd(REG_MAX),
+        "p99": rd(REG_P99),
+        "sum": regs.read64(BLOCK_LATENCY + REG_SUM),
+        "clk_ps": rd(REG_CLK_PS),
+        "buckets": [rd(REG_BUCKET + 4 * b) for b in range(NUM_BUCKETS)],
+    }
+
+
+def print_hist(h):
+    ns = h["clk_ps"] / 1000.0
+    total = h["count"]
+    print(f"Samples: {total}   clock period: {ns:.3f} ns")
+    if total == 0:
+        return
+    mean = h["sum"] / total
+    print(f"min  {h['min']:8d} cycles  {h['min'] * ns:10.1f} ns")
+    print(f"mean {mean:8.1f} cycles  {mean * ns:10.1f} ns")
+    print(f"max  {h['max']:8d} cycles  {h['max'] * ns:10.1f} ns")
+    print(f"p99 bucket bound (hw) {h['p99']} cycles, {h['p99'] * ns:.1f} ns")
+    print("")
+    for q in (0.5, 0.9, 0.99, 0.999):
+        c = percentile(h["buckets"], total, q)
+        print(f"p{q * 100:g}".ljust(7) + f"{c:10.1f} cycles  {c * ns:10.1f} ns")
+    print("")
+
+    peak = max(h["buckets"])
+    for b, count in enumerate(h["buckets"]):
+        if count == 0:
+            continue
+        low, high = bucket_range(b)
+        bar = "#" * max(1, int(50 * count / peak))
+        if b == WRAP_BUCKET:
+            print(f"{'>= ' + format(low * ns, '.1f'):>21} ns {count:10d} {bar}")
+        else:
+            print(f"{low * ns:9.1f} - {high * ns:9.1f} ns {count:10d} {bar}")
+    if h["buckets"][WRAP_BUCKET]:
+        print(f"{h['buckets'][WRAP_BUCKET]} sample(s) at or above the {WRAP_CYCLES}-cycle "
+              "limit of the timestamp, counted as 32768 cycles")
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__,
+                                formatter_class=argparse.RawDescriptionHelpFormatter)
+    nanonic_regs.add_arguments(p)
+    p.add_argument("--clear", action="store_true",
+                   help="Clear the histogram after reading it.")
+    args = p.parse_args()
+
+    with Regs.from_args(args) as regs:
+        regs.check_id()
+        print_hist(read_hist(regs))
+        if args.clear:
+            regs.write32(BLOCK_LATENCY + REG_CTRL, 1)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,785 @@
+#!/usr/bin/env python3
+"""
+Bulk map load and dump over QDMA (rtl/nanonic_map_dma.v).
+
+Instead of one PCIe access per 32-bit register, the host sends programs of
+register accesses as H2C frames; the engine on the card runs them on the
+AXI-Lite of the pipeline top at the speed of the on-card bus and answers every
+frame with the results of its reads. Writes are batched until a result is
+needed, so the maps load and dump in a few frames.
+
+  map-load      write and commit entries of a pipeline map through the map
+                writer of the top, waiting for room in its FIFO
+  cuckoo-insert insert or update KEY=VALUE entries of a nanonic_cuckoo map
+  cuckoo-delete remove keys
+  cuckoo-lookup print the value of keys, from a batched read of their buckets
+  cuckoo-dump   print every entry of a nanonic_cuckoo map
+  serve         software stand-in of the engine and the maps, over UDP
+  bench         accesses, frames and estimated time of MMIO against DMA
+
+The cuckoo commands are for standalone nanonic_cuckoo blocks that a design
+decodes behind the AXI-Lite master of the engine; nanonic_pipeline_top has
+none, so they take the --window of the block.
+
+The frames go out on the OpenNIC netdev (--iface, needs CAP_NET_RAW) or to a
+stand-in (--standin HOST:PORT), which runs the same programs on register
+models of the top, the map writer and the cuckoo blocks, so the
+library and the tools built on it can be tested without the card:
+
+  python3 scripts/nanonic_mapdma.py serve --writer --cuckoo 0x6000=12 &
+  python3 scripts/nanonic_mapdma.py --standin 127.0.0.1:5555 map-load \
+      --spec Custom_applications/xdp_katran/nanonic_maps.json --map reals 0=0x2a00000a
+  python3 scripts/nanonic_mapdma.py --standin 127.0.0.1:5555 cuckoo-dump --window 0x6000
+
+Dumps hold off the control-plane AXI-Lite of the shell between their first
+and last frame (LOCK, UNLOCK): a cuckoo dump has the set of keys of one point
+in time. The datapath still updates cuckoo values
+during the dump; each value is the one read.
+"""
+import argparse
+import random
+import socket
+import struct
+import sys
+from math import ceil
+
+import nanonic_cuckoo
+import nanonic_maps
+import nanonic_regs
+from nanonic_cuckoo import CardCuckoo, location, STASH_WAY
+from nanonic_maps import MapWriter
+
+ETHERTYPE = 0x88B5
+MAGIC = 0x4D
+VERSION = 1
+HEADER = 24
+TRAILER = 8
+
+OP_NOP = 0
+OP_WRITE = 1
+OP_READ = 2
+OP_POLL = 3
+OP_LOCK = 4
+OP_UNLOCK = 5
+
+ST_OK = 0
+ST_TIMEOUT = 1
+ST_BAD_OP = 2
+ST_SHORT = 3
+STATUS_TEXT = {ST_TIMEOUT: "poll timeout", ST_BAD_OP: "unknown op",
+               ST_SHORT: "frame ended before its last op"}
+
+# POLL_MAX of the engine
+POLL_MAX = 1024
+
+
+class DmaError(RuntimeError):
+    pass
+
+
+def encode(seq, ops, src=b"\x02\x00\x00\x00\x00\x01", dst=b"\x02\x00\x00\x00\x00\x00"):
+    """Command frame of a list of (op, addr, data), and its response length."""
+    results = sum(op in (OP_READ, OP_POLL) for op, _, _ in ops)
+    rsp_len = HEADER + 4 * results + TRAILER
+    frame = dst + src + struct.pack(">H", ETHERTYPE) + bytes([MAGIC, VERSION])
+    frame += struct.pack("<IHH", seq, len(ops), rsp_len)
+    frame += b"".join(struct.pack("<BBHI", op, 0, addr, data & 0xFFFFFFFF)
+                      for op, addr, data in ops)
+    return frame.ljust(60, b"\x00"), rsp_len
+
+
+def decode(frame):
+    """Sequence, results and (status, ops executed) of a response frame."""
+    seq, n_ops, rsp_len = struct.unpack_from("<IHH", frame, 16)
+    # A frame that ended early is answered without the results of the ops
+    # it did not hold
+    end = min(len(frame), rsp_len)
+    n = (end - HEADER - TRAILER) // 4
+    results = list(struct.unpack_from(f"<{n}I", frame, HEADER))
+    status, executed = struct.unpack_from("<B3xI", frame, end - TRAILER)
+    return seq, results, status, executed
+
+
+def is_frame(frame):
+    return (len(frame) >= HEADER and struct.unpack_from(">H", frame, 12)[0] == ETHERTYPE
+            and frame[14] == MAGIC and frame[15] == VERSION)
+
+
+#------------------------------------------------------------------------------
+# Transports
+#------------------------------------------------------------------------------
+class PacketTransport:
+    """Frames on the OpenNIC netdev: out through H2C, back through C2H."""
+
+    def __init__(self, iface, timeout=1.0):
+        self.sock = socket.socket(socket.AF_PACKET, socket.SOCK_RAW, socket.htons(ETHERTYPE))
+        self.sock.bind((iface, ETHERTYPE))
+        self.sock.settimeout(timeout)
+        self.mac = self.sock.getsockname()[4]
+
+    def send(self, frame):
+        # Our MAC as the source, the engine swaps them
+        self.sock.send(frame[:6] + self.mac + frame[12:])
+
+    def recv(self):
+        while True:
+            frame = self.sock.recv(65536)
+            if is_frame(frame) and frame[:6] == self.mac:
+                return frame
+
+    def close(self):
+        self.sock.close()
+
+
+class UdpTransport:
+    """Frames as UDP payloads, to the stand-in of the serve command."""
+
+    def __init__(self, addr, timeout=1.0):
+        host, _, port = addr.rpartition(":")
+        self.addr = (host or "127.0.0.1", int(port))
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.settimeout(timeout)
+
+    def send(self, frame):
+        self.sock.sendto(frame, self.addr)
+
+    def recv(self):
+        return self.sock.recv(65536)
+
+    def close(self):
+        self.sock.close()
+
+
+class LoopbackTransport:
+    """An in-process stand-in."""
+
+    def __init__(self, standin):
+        self.standin = standin
+        self.pending = []
+
+    def send(self, frame):
+        self.pending.append(self.standin.execute(frame))
+
+    def recv(self):
+        return self.pending.pop(0)
+
+    def close(self):
+        pass
+
+
+#------------------------------------------------------------------------------
+# Host library
+#------------------------------------------------------------------------------
+class DmaRegs:
+    """Register access through the engine, a drop-in for nanonic_regs.Regs.
+
+    write32() and poll() only queue ops; read32() sends the queued program
+    with the read at its end and returns the value. read_later() queues a read
+    whose value is filled by the next flush(), so a dump is a few frames.
+    """
+
+    def __init__(self, transport, frame_size=1514, window=8):
+        self.transport = transport
+        self.max_ops = min((frame_size - HEADER) // 8, (frame_size - HEADER - TRAILER) // 4)
+        self.window = window
+        self.ops = []
+        self.later = []
+        self.seq = 0
+        self.frames = 0
+        self.ops_sent = 0
+
+    @classmethod
+    def from_args(cls, args):
+        if args.standin:
+            transport = UdpTransport(args.standin, args.timeout)
+        elif args.iface:
+            transport = PacketTransport(args.iface, args.timeout)
+        else:
+            raise SystemExit("Give --iface or --standin")
+        return cls(transport, args.frame_size, args.frames_in_flight)
+
+    def close(self):
+        self.flush()
+        self.transport.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, exc, *rest):
+        if exc is None:
+            self.close()
+        else:
+            self.transport.close()
+
+    def write32(self, offset, value):
+        self.ops.append((OP_WRITE, offset, value))
+
+    def poll(self, offset, value, mask):
+        """Wait until (register & mask) == value, mask and value in [15:0]."""
+        self.ops.append((OP_POLL, offset, (value & 0xFFFF) << 16 | (mask & 0xFFFF)))
+        self.later.append(None)
+
+    def read_later(self, offset):
+        """Index of the read in the results of the next flush()."""
+        self.ops.append((OP_READ, offset, 0))
+        self.later.append(offset)
+        return len(self.later) - 1
+
+    def read32(self, offset):
+        i = self.read_later(offset)
+        return self.flush()[i]
+
+    def read64(self, offset):
+        lo = self.read_later(offset)
+        hi = self.read_later(offset + 4)
+        r = self.flush()
+        return (r[hi] << 32) | r[lo]
+
+    def lock(self):
+        self.ops.append((OP_LOCK, 0, 0))
+
+    def unlock(self):
+        self.ops.append((OP_UNLOCK, 0, 0))
+
+    def check_id(self):
+        ident = self.read32(nanonic_regs.BLOCK_TOP + 0x00)
+        if ident != nanonic_regs.NANONIC_ID:
+            raise RuntimeError(f"no NanoNIC pipeline behind the engine (id 0x{ident:08x})")
+        return self.read32(nanonic_regs.BLOCK_TOP + 0x04)
+
+    def flush(self):
+        """Run the queued ops; results of the reads and polls, in order."""
+        ops, self.ops, self.later = self.ops, [], []
+        if not ops:
+            return []
+        chunks = [ops[i:i + self.max_ops] for i in range(0, len(ops), self.max_ops)]
+        results = []
+        sent = done = 0
+        while done < len(chunks):
+            # Keep up to window frames in flight, the engine runs them in order
+            while sent < len(chunks) and sent - done < self.window:
+                frame, _ = encode(self.seq + sent, chunks[sent])
+                self.transport.send(frame)
+                sent += 1
+            try:
+                frame = self.transport.recv()
+            except socket.timeout:
+                raise DmaError(f"no response to frame {self.seq + done}")
+            seq, res, status, executed = decode(frame)
+            if seq != self.seq + done:
+                raise DmaError(f"response {seq}, expected {self.seq + done}")
+            if status != ST_OK:
+                raise DmaError(f"frame {seq}: {STATUS_TEXT.get(status, status)} "
+                               f"after {executed} of {len(chunks[done])} ops")
+            results += res
+            done += 1
+        self.seq += len(chunks)
+        self.frames += len(chunks)
+        self.ops_sent += len(ops)
+        return results
+
+
+class DmaMapWriter(MapWriter):
+    """The map writer driven through the engine.
+
+    Every message waits for room in the FIFO of the writer with a POLL, so
+    a load of any size loses no message however busy the pipeline is.
+    """
+
+    def _room(self):
+        self.regs.poll(self.window + nanonic_maps.REG_CONTROL, 0, 2)
+
+
+class DmaCuckoo(CardCuckoo):
+    """A nanonic_cuckoo block driven through the engine.
+
+    Writes and their waits are queued; the buckets of a batch of keys are read
+    in one program before the batch is inserted.
+    """
+
+    def _wait(self):
+        self.regs.poll(self.window + nanonic_cuckoo.REG_STATUS, 0,
+                       nanonic_cuckoo.STATUS_BUSY)
+
+    def fetch(self, locs):
+        """Entries at a list of locations, read in one program."""
+        cw, vw = ceil(self.key_w / 32), ceil(self.val_w / 32)
+        reads = []
+        for loc in locs:
+            self.regs.write32(self.window + nanonic_cuckoo.REG_COMMAND, loc)
+            self._wait()
+            valid = self.regs.read_later(self.window + nanonic_cuckoo.REG_VALID)
+            key = [self.regs.read_later(self.window + nanonic_cuckoo.REG_KEY + 4 * w)
+                   for w in range(cw)]
+            value = [self.regs.read_later(self.window + nanonic_cuckoo.REG_VALUE + 4 * w)
+                     for w in range(vw)]
+            reads.append((valid, key, value))
+        r = self.regs.flush()
+        word = lambda ix: sum(r[i] << (32 * w) for w, i in enumerate(ix))
+        return [(word(k), word(v)) if r[valid] & 1 else None for valid, k, v in reads]
+
+    def _read_entry(self, loc):
+        return self.fetch([loc])[0]
+
+    def prefetch(self, keys):
+        todo = sorted({(w, self.index(w, k)) for k in keys for w in range(self.ways)}
+                      - set(self.buckets))
+        locs = [location(w, s, i) for w, i in todo for s in range(self.slots)]
+        entries = self.fetch(locs)
+        for n, node in enumerate(todo):
+            self.buckets[node] = entries[n * self.slots:(n + 1) * self.slots]
+
+    def insert_many(self, entries):
+        self.prefetch([k for k, _ in entries])
+        failed = [k for k, v in entries if not self.insert(k, v)]
+        self.regs.flush()
+        return failed
+
+    def delete_many(self, keys):
+        self.prefetch(keys)
+        missing = [k for k in keys if not self.delete(k)]
+        self.regs.flush()
+        return missing
+
+    def lookup_many(self, keys):
+        self.prefetch(keys)
+        out = []
+        for k in keys:
+            loc = self.find(k)
+            if loc is None:
+                out.append(None)
+            elif loc >> 28 == STASH_WAY:
+                out.append(self.stash[loc & 0xFFFFFF][1])
+            else:
+                out.append(self.bucket(loc >> 28, loc & 0xFFFFFF)[(loc >> 24) & 0xF][1])
+        return out
+
+    def dump(self):
+        """Every entry as (location, key, value), keys consistent under LOCK."""
+        self.regs.lock()
+        locs = [location(w, s, i) for w in range(self.ways)
+                for i in range(1 << self.addr_w) for s in range(self.slots)]
+        locs += [location(STASH_WAY, 0, s) for s in range(len(self.stash))]
+        entries = self.fetch(locs)
+        self.regs.unlock()
+        self.regs.flush()
+        return [(loc, e[0], e[1]) for loc, e in zip(locs, entries) if e is not None]
+
+
+#------------------------------------------------------------------------------
+# Software stand-in
+#------------------------------------------------------------------------------
+class TopModel:
+    def read32(self, off):
+        return {0x00: nanonic_regs.NANONIC_ID, 0x04: 1}.get(off, 0)
+
+    def write32(self, off, value):
+        pass
+
+
+class MapWriterModel:
+    """Registers of nanonic_map_writer; messages reach the maps at once.
+
+    The windows of all the maps share the staging registers and the counters,
+    so every window is a view of one writer with its own map id.
+    """
+
+    class Writer:
+        def __init__(self, key_w, val_w):
+            self.key_w, self.val_w = key_w, val_w
+            self.key = [0] * ceil(key_w / 32)
+            self.value = [0] * ceil(val_w / 32)
+            self.maps = {}
+            self.versions = {}
+            self.sent = 0
+
+    def __init__(self, writer, map_id):
+        self.w, self.map_id = writer, map_id
+
+    def read32(self, off):
+        w = self.w
+        if off == 0x04:
+            return w.versions.get(self.map_id, 0)
+        if off == 0x0C:
+            return w.val_w << 16 | w.key_w
+        if off == 0x18:
+            return w.sent
+        if off == 0x1C:
+            return nanonic_maps.MAPWR_ID
+        if 0x40 <= off < 0x40 + 4 * len(w.value):
+            return w.value[(off - 0x40) >> 2]
+        if 0x100 <= off < 0x100 + 4 * len(w.key):
+            return w.key[(off - 0x100) >> 2]
+        return 0
+
+    def write32(self, off, value):
+        w = self.w
+        m = w.maps.setdefault(self.map_id, {})
+        word = lambda ws, bits: sum(x << (32 * i) for i, x in enumerate(ws)) & ((1 << bits) - 1)
+        if 0x40 <= off < 0x40 + 4 * len(w.value):
+            w.value[(off - 0x40) >> 2] = value
+            return
+        if 0x100 <= off < 0x100 + 4 * len(w.key):
+            w.key[(off - 0x100) >> 2] = value
+            return
+        if off == 0x00 and value & 1:
+            w.versions[self.map_id] = w.versions.get(self.map_id, 0) + 1
+        elif off == 0x08:
+            m[value] = word(w.value, w.val_w)
+        elif off == 0x14 and value & 3 == 1:
+            m[word(w.key, w.key_w)] = word(w.value, w.val_w)
+        elif off == 0x14 and value & 3 == 2:
+            m.pop(word(w.key, w.key_w), None)
+        else:
+            return
+        w.sent += 1
+
+
+class CuckooModel:
+    """Registers of nanonic_cuckoo; commands complete at once."""
+
+    def __init__(self, addr_w, ways=2, slots=4, stash=4, key_w=32, val_w=64):
+        self.addr_w, self.ways, self.slots, self.nstash = addr_w, ways, slots, stash
+        self.key_w, self.val_w = key_w, val_w
+        self.kw, self.vw = ceil(key_w / 32), ceil(val_w / 32)
+        self.entries = {}
+        self.key = [0] * self.kw
+        self.value = [0] * self.vw
+        self.valid = 0
+
+    def read32(self, off):
+        if off == 0x04:
+            return self.val_w << 16 | self.key_w
+        if off == 0x08:
+            return self.nstash << 24 | self.slots << 16 | self.ways << 8 | self.addr_w
+        if off == 0x10:
+            return self.valid
+        if 0x40 <= off < 0x40 + 4 * self.kw:
+            return self.key[(off - 0x40) >> 2]
+        if 0x80 <= off < 0x80 + 4 * self.vw:
+            return self.value[(off - 0x80) >> 2]
+        return 0
+
+    def write32(self, off, value):
+        if off == 0x0C:
+            loc = value & 0x7FFFFFFF
+            way, index = loc >> 28, loc & 0xFFFFFF
+            if way >= self.ways and not (way == STASH_WAY and index < self.nstash):
+                return
+            if way != STASH_WAY and index >> self.addr_w:
+                return
+            if value >> 31:
+                self.entries[loc] = (self.valid, list(self.key), list(self.value))
+            else:
+                self.valid, key, val = self.entries.get(loc, (0, [0] * self.kw, [0] * self.vw))
+                self.key, self.value = list(key), list(val)
+        elif off == 0x10:
+            self.valid = value & 1
+        elif 0x40 <= off < 0x40 + 4 * self.kw:
+            self.key[(off - 0x40) >> 2] = value
+        elif 0x80 <= off < 0x80 + 4 * self.vw:
+            self.value[(off - 0x80) >> 2] = value
+
+
+class StandIn:
+    """Runs command frames like nanonic_map_dma on register models."""
+
+    def __init__(self, blocks):
+        self.blocks = dict(blocks)
+        self.blocks.setdefault(nanonic_regs.BLOCK_TOP, TopModel())
+
+    def _block(self, addr):
+        return self.blocks.get(addr & 0xF000), addr & 0xFFF
+
+    def read32(self, addr):
+        block, off = self._block(addr)
+        return block.read32(off) if block else 0
+
+    def write32(self, addr, value):
+        block, off = self._block(addr)
+        if block:
+            block.write32(off, value)
+
+    def execute(self, frame):
+        seq, n_ops, rsp_len = struct.unpack_from("<IHH", frame, 16)
+        status, executed, results = ST_OK, 0, []
+        for i in range(n_ops):
+            pos = HEADER + 8 * i
+            if pos + 8 > len(frame):
+                status = status or ST_SHORT
+                break
+            op, _, addr, data = struct.unpack_from("<BBHI", frame, pos)
+            if status != ST_OK:
+                if op in (OP_READ, OP_POLL):
+                    results.append(0)
+                continue
+            if op == OP_WRITE:
+                self.write32(addr, data)
+            elif op == OP_READ:
+                results.append(self.read32(addr))
+            elif op == OP_POLL:
+                for _ in range(POLL_MAX):
+                    v = self.read32(addr)
+                    if v & data & 0xFFFF == data >> 16:
+                        break
+                else:
+                    status = ST_TIMEOUT
+                results.append(v)
+                if status != ST_OK:
+                    continue
+            elif op not in (OP_NOP, OP_LOCK, OP_UNLOCK):
+                status = ST_BAD_OP
+                continue
+            executed += 1
+        rsp = frame[6:12] + frame[0:6] + frame[12:HEADER]
+        rsp += b"".join(struct.pack("<I", r) for r in results)
+        rsp += struct.pack("<B3xI", status, executed)
+        return rsp
+
+
+def block_spec(s):
+    window, sep, geo = s.partition("=")
+    if not sep:
+        raise argparse.ArgumentTypeError("expected WINDOW=GEOMETRY")
+    return int(window, 0), geo
+
+
+def build_standin(cuckoos, writer=False, key_w=384, val_w=256):
+    blocks = {}
+    if writer:
+        w = MapWriterModel.Writer(key_w, val_w)
+        for map_id in range(8):
+            blocks[nanonic_maps.MAPWR_BASE + 0x1000 * map_id] = MapWriterModel(w, map_id)
+    for window, geo in cuckoos:
+        addr_w, key_w, val_w = (geo.split("x") + ["32", "64"])[:3]
+        blocks[window] = CuckooModel(int(addr_w, 0), key_w=int(key_w, 0), val_w=int(val_w, 0))
+    return StandIn(blocks)
+
+
+def cmd_serve(args):
+    standin = build_standin(args.cuckoo, args.writer)
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    host, _, port = args.listen.rpartition(":")
+    sock.bind((host or "127.0.0.1", int(port)))
+    blocks = [(w, b) for w, b in sorted(standin.blocks.items())
+              if not isinstance(b, MapWriterModel)]
+    print(f"Stand-in on {args.listen}: " + ", ".join(
+        [f"{type(b).__name__[:-5].lower()} at 0x{w:x}" for w, b in blocks]
+        + ["map writer at 0x8000-0xffff"] * args.writer), flush=True)
+    while True:
+        frame, peer = sock.recvfrom(65536)
+        if is_frame(frame):
+            sock.sendto(standin.execute(frame), peer)
+
+
+#------------------------------------------------------------------------------
+# Commands
+#------------------------------------------------------------------------------
+def parse_pair(s):
+    key, sep, value = s.partition("=")
+    return int(key, 0), int(value, 0) if sep else 0
+
+
+def map_load(regs, window, m, entries, delete=False):
+    """Write and commit entries of a pipeline map through the map writer."""
+    mw = DmaMapWriter(regs, window)
+    before = mw.version()
+    nanonic_maps.write_entries(mw, m, entries, delete)
+    regs.poll(window + nanonic_maps.REG_CONTROL, 0, 1)
+    return before, mw.version()
+
+
+def cmd_map_load(args):
+    entries = nanonic_maps.parse_entries(args)
+    window, m = nanonic_maps.writer_map(args)
+    with DmaRegs.from_args(args) as regs:
+        regs.check_id()
+        before, after = map_load(regs, window, m, entries, args.delete)
+    print(f"{m['name']}: {len(entries)} entries {'deleted' if args.delete else 'written'}, "
+          f"version {before} -> {after}, "
+          f"{regs.ops_sent} register accesses in {regs.frames} frames")
+    return 0
+
+
+def cmd_cuckoo(args):
+    with DmaRegs.from_args(args) as regs:
+        regs.check_id()
+        m = DmaCuckoo(regs, args.window)
+        if args.cmd == "cuckoo-dump":
+            for loc, key, value in m.dump():
+                print(f"0x{key:x}=0x{value:x}" + (f"  # way {loc >> 28} slot "
+                      f"{(loc >> 24) & 0xF} bucket {loc & 0xFFFFFF}" if args.locations else ""))
+            return 0
+        pairs = [parse_pair(e) for e in args.entries]
+        if args.cmd == "cuckoo-lookup":
+            for (key, _), value in zip(pairs, m.lookup_many([k for k, _ in pairs])):
+                print(f"0x{key:x}=" + ("-" if value is None else f"0x{value:x}"))
+            return 0
+        if args.cmd == "cuckoo-insert":
+            bad = m.insert_many(pairs)
+            what = "did not fit"
+        else:
+            bad = m.delete_many([k for k, _ in pairs])
+            what = "not in the map"
+    for key in bad:
+        print(f"0x{key:x}: {what}")
+    print(f"Map at 0x{args.window:x}: {len(pairs)} keys, {m.moves} entries moved, "
+          f"{regs.ops_sent} register accesses in {regs.frames} frames")
+    return 1 if bad and args.cmd == "cuckoo-insert" else 0
+
+
+class CountingRegs:
+    """Register models accessed one by one, as over MMIO."""
+
+    def __init__(self, standin):
+        self.standin = standin
+        self.reads = self.writes = 0
+
+    def read32(self, off):
+        self.reads += 1
+        return self.standin.read32(off)
+
+    def write32(self, off, value):
+        self.writes += 1
+        self.standin.write32(off, value)
+
+
+def cmd_bench(args):
+    rng = random.Random(args.seed)
+    map_w, cuckoo_w = nanonic_maps.MAPWR_BASE + 0x1000 * args.map_id, 0x6000
+    spec = [(cuckoo_w, str(args.cuckoo_addr_w))]
+    m = {"name": "map", "type": "array"}
+    map_entries = [(i, rng.getrandbits(args.map_bits)) for i in range(args.map_entries)]
+    slots = 2 * 4 << args.cuckoo_addr_w
+    keys = rng.sample(range(1, 1 << 32), int(slots * args.cuckoo_load))
+    cuckoo_entries = [(k, rng.getrandbits(64)) for k in keys]
+
+    jobs = []
+    # MMIO: the same library calls on nanonic_regs-style accesses
+    s = build_standin(spec, writer=True)
+    mm = CountingRegs(s)
+    nanonic_maps.write_entries(MapWriter(mm, map_w), m, map_entries)
+    jobs.append(("map load", mm.reads, mm.writes))
+    mm.reads = mm.writes = 0
+    c = CardCuckoo(mm, cuckoo_w)
+    for k, v in cuckoo_entries:
+        c.insert(k, v)
+    jobs.append(("cuckoo insert", mm.reads, mm.writes))
+    mm.reads = mm.writes = 0
+    c = CardCuckoo(mm, cuckoo_w)
+    for w in range(c.ways):
+        for i in range(1 << c.addr_w):
+            c.bucket(w, i)
+    jobs.append(("cuckoo dump", mm.reads, mm.writes))
+
+    # DMA: the same operations through the engine
+    s = build_standin(spec, writer=True)
+    regs = DmaRegs(LoopbackTransport(s), args.frame_size, args.frames_in_flight)
+    dma = []
+    for name, fn in (("map load", lambda: map_load(regs, map_w, m, map_entries)),
+                     ("cuckoo insert", lambda: DmaCuckoo(regs, cuckoo_w).insert_many(cuckoo_entries)),
+                     ("cuckoo dump", lambda: DmaCuckoo(regs, cuckoo_w).dump())):
+        f0, o0 = regs.frames, regs.ops_sent
+        fn()
+        regs.flush()
+        dma.append((regs.frames - f0, regs.ops_sent - o0))
+
+    print(f"map {args.map_id} {args.map_entries} x {args.map_bits} bits through the map writer, "
+          f"cuckoo 2x4 x {1 << args.cuckoo_addr_w} buckets with {len(keys)} keys "
+          f"({args.cuckoo_load:.0%} load), {args.frame_size}-byte frames")
+    print("")
+    print(f"{'':<14} {'MMIO rd':>9} {'MMIO wr':>9} {'MMIO ms':>9}   "
+          f"{'Frames':>7} {'Ops':>9} {'DMA ms':>8} {'Speedup':>8}")
+    for (name, reads, writes), (frames, ops) in zip(jobs, dma):
+        mmio = (reads * args.mmio_read_ns + writes * args.mmio_write_ns) / 1e6
+        # Frames in flight overlap the round trip; the engine is bus bound
+        trips = ceil(frames / args.frames_in_flight)
+        bus = ops * args.axil_cycles / (args.clock * 1e3)
+        t = trips * args.frame_us / 1e3 + max(bus, frames * args.frame_size * 8 / 100e6)
+        print(f"{name:<14} {reads:>9} {writes:>9} {mmio:>9.1f}   "
+              f"{frames:>7} {ops:>9} {t:>8.2f} {mmio / t:>7.0f}x")
+    print("")
+    print(f"MMIO: {args.mmio_read_ns:g} ns per read (non-posted round trip), "
+          f"{args.mmio_write_ns:g} ns per write")
+    print(f"DMA: {args.frame_us:g} us per round trip of {args.frames_in_flight} frames, "
+          f"{args.axil_cycles} cycles per register access at {args.clock:g} MHz")
+    return 0
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__,
+                                formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument("--iface", help="OpenNIC netdev the engine is behind.")
+    p.add_argument("--standin", metavar="HOST:PORT", help="Stand-in started with serve.")
+    p.add_argument("--timeout", type=float, default=1.0,
+                   help="Seconds to wait for a response (default: %(default)s).")
+    p.add_argument("--frame-size", type=int, default=1514,
+                   help="Largest command frame in bytes (default: %(default)s).")
+    p.add_argument("--frames-in-flight", type=int, default=8,
+                   help="Frames sent before waiting for a response (default: %(default)s).")
+    sub = p.add_subparsers(dest="cmd", required=True)
+
+    sp = sub.add_parser("map-load", help="Write and commit entries of a pipeline map.")
+    nanonic_maps.add_writer_arguments(sp)
+    sp.set_defaults(func=cmd_map_load)
+
+    for name, text in (("cuckoo-insert", "KEY=VALUE entries to insert or update."),
+                       ("cuckoo-delete", "Keys to remove."),
+                       ("cuckoo-lookup", "Keys to look up."),
+                       ("cuckoo-dump", None)):
+        sp = sub.add_parser(name, help=text or "Print every entry of a cuckoo map.")
+        sp.add_argument("--window", type=lambda s: int(s, 0), required=True,
+                        help="Offset of the nanonic_cuckoo block.")
+        if text:
+            sp.add_argument("entries", nargs="+", help=text)
+        else:
+            sp.add_argument("--locations", action="store_true",
+                            help="Print the location of every entry.")
+        sp.set_defaults(func=cmd_cuckoo)
+
+    sp = sub.add_parser("serve", help="Software stand-in of the engine, over UDP.")
+    sp.add_argument("--listen", default="127.0.0.1:5555",
+                    help="Address to listen on (default: %(default)s).")
+    sp.add_argument("--writer", action="store_true",
+                    help="The map writer of the top at 0x8000-0xFFFF, with the default "
+                         "MAPWR_KEY_W and MAPWR_VAL_W.")
+    sp.add_argument("--cuckoo", type=block_spec, action="append", default=[],
+                    metavar="WINDOW=ADDR_W[xKEY_BITSxVALUE_BITS]",
+                    help="A 2x4 cuckoo block with a stash of 4, 32-bit keys and 64-bit "
+                         "values unless given, e.g. 0x6000=12.")
+    sp.set_defaults(func=cmd_serve)
+
+    sp = sub.add_parser("bench", help="MMIO against DMA for loads and dumps.")
+    sp.add_argument("--map-id", type=int, default=4,
+                    help="Array map loaded through the map writer (default: %(default)s, "
+                         "reals of Katran).")
+    sp.add_argument("--map-entries", type=int, default=4096,
+                    help="Entries loaded into the map (default: %(default)s).")
+    sp.add_argument("--map-bits", type=int, default=64,
+                    help="Entry width of the map, at most MAPWR_VAL_W (default: %(default)s).")
+    sp.add_argument("--cuckoo-addr-w", type=int, default=10,
+                    help="Bucket index width of the cuckoo map (default: %(default)s).")
+    sp.add_argument("--cuckoo-load", type=float, default=0.9,
+                    help="Keys inserted as a fraction of the slots (default: %(default)s).")
+    sp.add_argument("--mmio-read-ns", type=float, default=1000.0,
+                    help="Time of an MMIO read (default: %(default)s).")
+    sp.add_argument("--mmio-write-ns", type=float, default=100.0,
+                    help="Time of an MMIO write (default: %(default)s).")
+    sp.add_argument("--frame-us", type=float, default=20.0,
+                    help="Round trip of a batch of frames through QDMA "
+                         "(default: %(default)s).")
+    sp.add_argument("--axil-cycles", type=int, default=4,
+                    help="Cycles of a register access of the engine (default: %(default)s).")
+    sp.add_argument("--clock", type=float, default=250.0,
+                    help="Clock in MHz (default: %(default)s).")
+    sp.add_argument("--seed", type=int, default=1, help="Random seed (default: %(default)s).")
+    sp.set_defaults(func=cmd_bench)
+
+    args = p.parse_args()
+    if args.frame_size < 60:
+        p.error("--frame-size must be at least 60")
+    return args.func(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,537 @@
+#!/usr/bin/env python3
+"""
+Plan and update the NanoNIC map tables of an application.
+
+The maps of an application are described in a nanonic_maps.json next to its
+source (see Custom_applications/xdp_katran/nanonic_maps.json): type, number of
+entries, key and value size, number of lookup sites (readers), attributes and,
+for the maps the host writes, the map id of the map writer. The tables
+themselves are built by the Nanotube back end.
+
+  report : BRAM cost of each map, with one table whose read port the lookup
+           sites of a packet share, and the lookup cycles they serialize.
+  place  : choose the memory of every map from its size, width and access
+           pattern (LUTRAM, BRAM, URAM, or DDR/HBM behind an on-chip cache)
+           and report the latency and resources of the placement. With --hls
+           it writes the choice into the stage sources of the .hls directory
+           written by Nanotube, before scripts/hls_build, as a bind_storage
+           pragma on the storage of every map.
+  update : write entries of a map of the pipeline on the card through the map
+           writer of nanonic_pipeline_top (rtl/nanonic_map_writer.v) and send a
+           commit message after them. Every message reaches every lane in
+           the order it was written and is applied on its own: the commit
+           marks the end of a batch but switches nothing, so the entries
+           are written in the order that keeps each step consistent.
+"""
+import argparse
+import json
+import re
+import sys
+from math import ceil
+
+import nanonic_regs
+from fuse_stages import FUNC_RE, find_sources
+from nanonic_regs import Regs
+
+# BRAM18 aspect ratios (width, depth) in simple dual-port mode
+BRAM18_SHAPES = [(1, 16384), (2, 8192), (4, 4096), (9, 2048), (18, 1024), (36, 512)]
+# BRAM18 blocks of the Alveo U250 (2688 BRAM36)
+DEVICE_BRAM18 = 5376
+# URAM288 blocks of the Alveo U250
+DEVICE_URAM = 1280
+
+# Memories a map can be placed in, with the read latency in cycles (for "ddr",
+# a hit in the on-chip cache)
+MEMORIES = ["lutram", "bram", "uram", "ddr"]
+READ_LATENCY = {"lutram": 1, "bram": 2, "uram": 3, "ddr": 2}
+# impl= of the HLS bind_storage pragma; a map in DDR needs an m_axi port that
+# the stages do not have, so place leaves it to the back end
+HLS_IMPL = {"lutram": "lutram", "bram": "bram", "uram": "uram"}
+# Marks the pragmas written by place, replaced when it runs again
+PLACE_TAG = "// nanonic_maps.py place"
+# Round trip of a DDR4/HBM read from the fabric, in cycles at 250 MHz
+DDR_MISS_LATENCY = 100
+# Deepest table still worth LUTRAM, and the BRAM18 count from which a table of
+# at least one URAM depth goes to URAM
+LUTRAM_MAX_ENTRIES = 64
+URAM_MIN_BRAM18 = 16
+
+REG_CONTROL = 0x00
+REG_VERSION = 0x04
+REG_INDEX = 0x08
+REG_GEOMETRY = 0x0C
+REG_DATA = 0x40
+
+# Map writer of nanonic_pipeline_top, one window per map id
+MAPWR_BASE = 0x8000
+MAPWR_ID = 0x4D415057
+MAPWR_COMMAND = 0x14
+MAPWR_SENT = 0x18
+MAPWR_REG_ID = 0x1C
+MAPWR_LOST = 0x20
+MAPWR_KEY = 0x100
+MAPWR_UPDATE = 1
+MAPWR_DELETE = 2
+
+
+def bram18(width, depth):
+    """Smallest number of BRAM18 blocks holding depth x width bits."""
+    return min(ceil(width / w) * ceil(depth / d) for w, d in BRAM18_SHAPES)
+
+
+def entry_bits(m):
+    bits = m["value_bytes"] * 8
+    if m["type"] != "array":
+        # Hash tables store the key and a valid bit next to the value
+        bits += m["key_bytes"] * 8 + 1
+    return bits
+
+
+def load_spec(path):
+    with open(path) as fh:
+        return json.load(fh)
+
+
+def map_cost(m, pipelines):
+    bits = entry_bits(m)
+    readers = m["readers"] * pipelines
+    shared = bram18(bits, m["entries"])
+    cost = {
+        "bits": bits,
+        "readers": readers,
+        "shared": shared,
+        # One read port left next to the host write port
+        "stall": readers - 1,
+    }
+    return cost
+
+
+def lutram_luts(width, depth):
+    """LUTs of a simple dual-port LUTRAM, 3 bits x 64 entries per RAM64M."""
+    return 4 * ceil(width / 3) * ceil(depth / 64)
+
+
+def uram288(width, depth):
+    return ceil(width / 72) * ceil(depth / 4096)
+
+
+def updated_per_packet(m):
+    """Maps read and written back by the packets (LRU, counters)."""
+    return m["type"] == "lru_hash" or "rmw" in m.get("attrs", [])
+
+
+def choose_memory(m, uram_max):
+    """Memory of a map from its size and access pattern, and the reason."""
+    if m.get("memory"):
+        return m["memory"], "override"
+    bits, entries = entry_bits(m), m["entries"]
+    if entries <= LUTRAM_MAX_ENTRIES:
+        return "lutram", "tiny"
+    if entries < 4096 or bram18(bits, entries) < URAM_MIN_BRAM18:
+        return "bram", "mid-sized"
+    if uram288(bits, entries) <= uram_max:
+        return "uram", "large"
+    return "ddr", f"over {uram_max} URAM"
+
+
+def placement(m, pipelines=1, uram_max=DEVICE_URAM // 10, cache_entries=4096):
+    """Memory of a map and what it costs for the given number of pipelines.
+
+    Every pipeline has its own table. A map in DDR keeps a direct-mapped
+    cache of cache_entries entries (with their key as tag) on chip.
+    """
+    memory, why = choose_memory(m, uram_max)
+    if memory not in MEMORIES:
+        raise ValueError(f"{m['name']}: unknown memory '{memory}'")
+    bits, entries = entry_bits(m), m["entries"]
+    copies, depth = pipelines, entries
+    cost = {"memory": memory, "why": why, "bits": bits, "copies": copies,
+            "lut": 0, "bram18": 0, "uram": 0, "ddr_bytes": 0,
+            "latency": READ_LATENCY[memory], "miss_latency": None}
+    if memory == "lutram":
+        cost["lut"] = copies * lutram_luts(bits, depth)
+    elif memory == "bram":
+        cost["bram18"] = copies * bram18(bits, depth)
+    elif memory == "uram":
+        cost["uram"] = copies * uram288(bits, depth)
+    else:
+        cache = min(cache_entries, entries)
+        tag = m["key_bytes"] * 8 if m["type"] == "array" else 0
+        cost["bram18"] = copies * bram18(bits + tag + 1, cache)
+        # Entries padded to 64-byte bursts in memory
+        cost["ddr_bytes"] = copies * depth * 64 * ceil(bits / 512)
+        cost["miss_latency"] = DDR_MISS_LATENCY
+    return cost
+
+
+def storage_vars(text, name):
+    """Array declarations of the storage of a map: (variable, end of it).
+
+    Nanotube keeps the name of the map in the variables of its table, alone
+    or with a prefix or suffix, e.g. `static ... vip_map_data[512];`.
+    """
+    decl = re.compile(r"\b(" + re.escape(name) + r"|\w+_" + re.escape(name) + r"|" +
+                      re.escape(name) + r"_\w+)\s*(?:\[[^\]]*\]\s*)+;")
+    return [(m.group(1), m.end()) for m in decl.finditer(text)]
+
+
+def bind_storage(text, stage, pragmas):
+    """The source with the pragmas, as (variable, impl), inserted in scope.
+
+    A variable declared in a function gets its pragma on the next line, a
+    global one at the top of the stage function.
+    """
+    text = "".join(l for l in text.splitlines(True) if PLACE_TAG not in l)
+    inserts = []
+    for var, impl in pragmas:
+        line = f"#pragma HLS bind_storage variable={var} type=ram_2p impl={impl} {PLACE_TAG}\n"
+        for v, end in storage_vars(text, var):
+            if v != var:
+                continue
+            depth = text.count("{", 0, end) - text.count("}", 0, end)
+            if depth > 0:
+                pos = text.index("\n", end) + 1
+            else:
+                f = re.search(FUNC_RE.format(name=re.escape(stage)), text)
+                if not f:
+                    raise ValueError(f"no definition of {stage}()")
+                pos = text.index("\n", f.end()) + 1
+            inserts.append((pos, line))
+            break
+    for pos, line in sorted(inserts, reverse=True):
+        text = text[:pos] + line + text[pos:]
+    return text
+
+
+def place_hls(hls_dir, maps, memories, variables):
+    """Write the bind_storage pragmas of the maps into the stage sources.
+
+    Returns the maps whose storage was found, with the stages holding it,
+    and the ones left to the back end with the reason.
+    """
+    sources = find_sources(hls_dir)
+    if not sources:
+        raise SystemExit(f"{hls_dir}: no stage sources")
+    texts = {}
+    for stage, path in sources.items():
+        with open(path) as fh:
+            texts[stage] = fh.read()
+    placed, skipped = {}, {}
+    per_stage = {stage: [] for stage in sources}
+    for m in maps:
+        memory = memories[m["name"]]
+        if memory not in HLS_IMPL:
+            skipped[m["name"]] = f"{memory} has no bind_storage implementation"
+            continue
+        names = [variables[m["name"]]] if m["name"] in variables else None
+        for stage, text in texts.items():
+            found = names or sorted({v for v, _ in storage_vars(text, m["name"])})
+            found = [v for v in found if any(x == v for x, _ in storage_vars(text, v))]
+            for v in found:
+                per_stage[stage].append((v, HLS_IMPL[memory]))
+                placed.setdefault(m["name"], []).append(f"{stage}:{v}")
+        if m["name"] not in placed:
+            skipped[m["name"]] = "no storage found, give it with --var"
+    for stage, pragmas in per_stage.items():
+        text = bind_storage(texts[stage], stage, pragmas)
+        if text != texts[stage]:
+            with open(sources[stage], "w") as fh:
+                fh.write(text)
+    return placed, skipped
+
+
+def cmd_place(args):
+    spec = load_spec(args.spec)
+    for name, value in args.memory + args.entries:
+        if not any(m["name"] == name for m in spec["maps"]):
+            raise SystemExit(f"no map {name} in {args.spec}")
+    for name, _ in args.var:
+        if not any(m["name"] == name for m in spec["maps"]):
+            raise SystemExit(f"no map {name} in {args.spec}")
+    overrides = dict(args.memory)
+    sizes = dict(args.entries)
+    maps = [dict(m, memory=overrides.get(m["name"], m.get("memory")),
+                 entries=sizes.get(m["name"], m["entries"])) for m in spec["maps"]]
+
+    print(f"{spec.get('app', args.spec)}: {args.pipelines} pipeline(s), "
+          f"{args.clock:.0f} MHz")
+    print("")
+    print(f"{'Map':<20} {'Entries':>9} {'Bits':>5} {'Copies':>6} {'Memory':<7} "
+          f"{'Why':<16} {'Latency':>8} {'LUT':>7} {'BRAM18':>7} {'URAM':>5} {'Off-chip':>9}")
+    tot = {"lut": 0, "bram18": 0, "uram": 0, "ddr_bytes": 0}
+    notes = []
+    memories = {}
+    for m in maps:
+        c = placement(m, args.pipelines, args.uram_max, args.cache_entries)
+        memories[m["name"]] = c["memory"]
+        for k in tot:
+            tot[k] += c[k]
+        lat = str(c["latency"])
+        if c["miss_latency"]:
+            lat += f"/{c['miss_latency']}"
+        ddr = f"{c['ddr_bytes'] / 2**20:.1f} MB" if c["ddr_bytes"] else "-"
+        print(f"{m['name']:<20} {m['entries']:>9} {c['bits']:>5} {c['copies']:>6} "
+              f"{c['memory']:<7} {c['why']:<16} {lat:>8} {c['lut']:>7} {c['bram18']:>7} "
+              f"{c['uram']:>5} {ddr:>9}")
+        if updated_per_packet(m):
+            # The next packet reads what the previous one wrote back
+            ii = c["latency"] + 1
+            worst = (c["miss_latency"] or c["latency"]) + 1
+            notes.append(f"{m['name']}: read-modify-write on every packet, II >= {ii}"
+                         + (f" on a cache hit, {worst} on a miss" if c["miss_latency"] else "")
+                         + f" ({args.clock / ii:.1f} Mpps)")
+    print("")
+    print(f"Total: {tot['lut']} LUT, {tot['bram18']} BRAM18 "
+          f"({100.0 * tot['bram18'] / args.device_bram:.2f}%), {tot['uram']} URAM "
+          f"({100.0 * tot['uram'] / args.device_uram:.2f}%), "
+          f"{tot['ddr_bytes'] / 2**20:.1f} MB off chip")
+    print("Latency: read latency in cycles, cache hit/miss for maps in DDR")
+    for n in notes:
+        print(f"  {n}")
+
+    if args.hls:
+        placed, skipped = place_hls(args.hls, maps, memories, dict(args.var))
+        print(f"\nbind_storage pragmas written in {args.hls}")
+        for m in maps:
+            if m["name"] in placed:
+                print(f"  {m['name']:<20} {memories[m['name']]:<7} "
+                      + ", ".join(placed[m["name"]]))
+            else:
+                print(f"  {m['name']:<20} not placed: {skipped[m['name']]}")
+    return 0
+
+
+def cmd_report(args):
+    spec = load_spec(args.spec)
+    print(f"{spec.get('app', args.spec)}: {args.pipelines} pipeline(s), "
+          f"{args.clock:.0f} MHz")
+    print("")
+    print(f"{'Map':<20} {'Type':<9} {'Entries':>8} {'Bits':>5} {'Readers':>7} "
+          f"{'BRAM18':>7} {'Stall':>6}")
+    tot = worst_stall = 0
+    for m in spec["maps"]:
+        c = map_cost(m, args.pipelines)
+        tot += c["shared"]
+        worst_stall = max(worst_stall, c["stall"])
+        print(f"{m['name']:<20} {m['type']:<9} {m['entries']:>8} {c['bits']:>5} "
+              f"{c['readers']:>7} {c['shared']:>7} {c['stall']:>6}")
+    print("")
+    print("BRAM18: one table per map, the lookups of a packet share its read port")
+    print("Stall : cycles a packet waits for the read port of the map")
+    print("")
+    print(f"BRAM18 total: {tot} ({100.0 * tot / args.device_bram:.2f}% of the device)")
+    print(f"Worst lookup stall per packet: {worst_stall} cycle(s), "
+          f"II {worst_stall + 1} ({args.clock / (worst_stall + 1):.1f} Mpps per pipeline)")
+    return 0
+
+
+class MapWriter:
+    """A map of the pipeline, written through the map writer of the top.
+
+    Array entries are sent with their index, hash entries with their key; the
+    key and the value are integers, bit 0 first, i.e. the little-endian bytes
+    of the C structure. A commit message follows a batch of writes.
+    """
+
+    def __init__(self, regs, window):
+        self.regs = regs
+        self.window = window
+        if self.read(MAPWR_REG_ID) != MAPWR_ID:
+            raise RuntimeError(f"No map writer at window 0x{window:x}, "
+                               "build the top with MAPWR_EN")
+        geo = self.read(REG_GEOMETRY)
+        self.key_w = geo & 0xFFFF
+        self.val_w = geo >> 16
+
+    def read(self, off):
+        return self.regs.read32(self.window + off)
+
+    def write(self, off, value):
+        self.regs.write32(self.window + off, value)
+
+    def version(self):
+        return self.read(REG_VERSION)
+
+    def lost(self):
+        return self.read(MAPWR_LOST)
+
+    def _room(self):
+        """Wait for room in the FIFO of the writer before a message.
+
+        MMIO writes are slower than the writer drains its FIFO into an idle
+        pipeline; a message lost behind a stalled one is counted (lost()).
+        """
+
+    def _stage(self, base, value, bits):
+        if value >> bits:
+            raise ValueError(f"0x{value:x} does not fit in {bits} bits")
+        for w in range(ceil(bits / 32)):
+            self.write(base + 4 * w, (value >> (32 * w)) & 0xFFFFFFFF)
+
+    def write_shadow(self, entries):
+        """Array entries, as (index, value)."""
+        for index, value in entries:
+            self._stage(REG_DATA, value, self.val_w)
+            self._room()
+            self.write(REG_INDEX, index)
+
+    def update(self, key, value):
+        self._stage(MAPWR_KEY, key, self.key_w)
+        self._stage(REG_DATA, value, self.val_w)
+        self._room()
+        self.write(MAPWR_COMMAND, MAPWR_UPDATE)
+
+    def delete(self, key):
+        self._stage(MAPWR_KEY, key, self.key_w)
+        self._room()
+        self.write(MAPWR_COMMAND, MAPWR_DELETE)
+
+    def commit(self, entries=()):
+        self.write_shadow(entries)
+        self._room()
+        self.write(REG_CONTROL, 1)
+
+
+def map_setting(s):
+    name, sep, value = s.partition("=")
+    if not sep or not value:
+        raise argparse.ArgumentTypeError("expected NAME=VALUE")
+    if value in MEMORIES:
+        return name, value
+    try:
+        return name, int(value, 0)
+    except ValueError:
+        raise argparse.ArgumentTypeError(f"expected a memory ({', '.join(MEMORIES)}) "
+                                         "or a number of entries")
+
+
+def var_setting(s):
+    name, sep, value = s.partition("=")
+    if not sep or not re.match(r"^[A-Za-z_]\w*$", value):
+        raise argparse.ArgumentTypeError("expected NAME=VARIABLE")
+    return name, value
+
+
+def parse_entries(args):
+    entries = []
+    lines = list(args.entries)
+    if args.file:
+        with open(args.file) as fh:
+            lines += [l.replace(" ", "=", 1) for l in fh.read().split("\n")
+                      if l.strip() and not l.startswith("#")]
+    for e in lines:
+        index, _, value = e.partition("=")
+        entries.append((int(index, 0), int(value or "0", 0)))
+    return entries
+
+
+def writer_map(args):
+    """Window of the map writer and description of the map of --window or
+    --spec/--map; a map given by its window is taken as an array."""
+    if not args.map:
+        if args.window is None:
+            raise SystemExit("give --window or --spec and --map")
+        return args.window, {"name": f"0x{args.window:x}", "type": "array"}
+    if not args.spec:
+        raise SystemExit("--map needs --spec")
+    m = next((x for x in load_spec(args.spec)["maps"] if x["name"] == args.map), None)
+    if m is None or "map_id" not in m:
+        raise SystemExit(f"{args.map} is not a map the host writes in {args.spec}")
+    return MAPWR_BASE + 0x1000 * m["map_id"], m
+
+
+def add_writer_arguments(parser):
+    parser.add_argument("--window", type=lambda s: int(s, 0),
+                        help="Window of the map in the map writer (0x8000 + 0x1000 * map id).")
+    parser.add_argument("--spec", help="nanonic_maps.json of the application.")
+    parser.add_argument("--map", help="Name of the map in --spec, in place of --window.")
+    parser.add_argument("--delete", action="store_true",
+                        help="Delete the keys of a hash map (values ignored).")
+    parser.add_argument("--file", help="File with one 'KEY VALUE' entry per line.")
+    parser.add_argument("entries", nargs="*", metavar="KEY=VALUE",
+                        help="Entry to write, the index of an array map or the key of a "
+                             "hash map and the value as integers (bit 0 first).")
+
+
+def write_entries(mw, m, entries, delete=False):
+    """Write entries through the map writer and commit them."""
+    for key, value in entries:
+        if delete:
+            mw.delete(key)
+        elif m["type"] == "array":
+            mw.write_shadow([(key, value)])
+        else:
+            mw.update(key, value)
+    mw.commit()
+
+
+def cmd_update(args):
+    entries = parse_entries(args)
+    args.window, m = writer_map(args)
+    with Regs.from_args(args) as regs:
+        regs.check_id()
+        mw = MapWriter(regs, args.window)
+        before, lost = mw.version(), mw.lost()
+        write_entries(mw, m, entries, args.delete)
+        after, lost = mw.version(), mw.lost() - lost
+    print(f"Map {m['name']} at 0x{args.window:x} (key {mw.key_w}, value {mw.val_w} bits): "
+          f"{len(entries)} entries, version {before} -> {after}")
+    if lost:
+        print(f"{lost} messages lost on a full FIFO, write them again", file=sys.stderr)
+        return 1
+    return 0
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__,
+                                formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = p.add_subparsers(dest="cmd", required=True)
+
+    sp = sub.add_parser("report", help="BRAM cost and lookup stalls of every map.")
+    sp.add_argument("spec", help="nanonic_maps.json of the application.")
+    sp.add_argument("--pipelines", type=int, default=1,
+                    help="Pipelines reading the same tables (default: %(default)s).")
+    sp.add_argument("--clock", type=float, default=250.0,
+                    help="Pipeline clock in MHz (default: %(default)s).")
+    sp.add_argument("--device-bram", type=int, default=DEVICE_BRAM18,
+                    help="BRAM18 blocks of the device (default: %(default)s, U250).")
+    sp.set_defaults(func=cmd_report)
+
+    sp = sub.add_parser("place", help="Memory of every map, its latency and cost.")
+    sp.add_argument("spec", help="nanonic_maps.json of the application.")
+    sp.add_argument("--memory", type=map_setting, action="append", default=[],
+                    metavar="NAME=MEMORY",
+                    help=f"Place a map in one of {', '.join(MEMORIES)} (repeatable).")
+    sp.add_argument("--entries", type=map_setting, action="append", default=[],
+                    metavar="NAME=ENTRIES", help="Size of a map (repeatable).")
+    sp.add_argument("--pipelines", type=int, default=1,
+                    help="Pipelines with their own copy of the maps (default: %(default)s).")
+    sp.add_argument("--clock", type=float, default=250.0,
+                    help="Pipeline clock in MHz (default: %(default)s).")
+    sp.add_argument("--uram-max", type=int, default=DEVICE_URAM // 10,
+                    help="URAM a map may take before going off chip (default: %(default)s).")
+    sp.add_argument("--cache-entries", type=int, default=4096,
+                    help="Entries of the on-chip cache of a map in DDR (default: %(default)s).")
+    sp.add_argument("--device-bram", type=int, default=DEVICE_BRAM18,
+                    help="BRAM18 blocks of the device (default: %(default)s, U250).")
+    sp.add_argument("--device-uram", type=int, default=DEVICE_URAM,
+                    help="URAM blocks of the device (default: %(default)s, U250).")
+    sp.add_argument("--hls", metavar="DIR",
+                    help="Write the placement into the stage sources of a .hls directory.")
+    sp.add_argument("--var", type=var_setting, action="append", default=[],
+                    metavar="NAME=VARIABLE",
+                    help="Storage variable of a map in the stage sources, when it "
+                         "does not carry the name of the map (repeatable).")
+    sp.set_defaults(func=cmd_place)
+
+    sp = sub.add_parser("update", help="Write and commit entries of a map of the pipeline.")
+    nanonic_regs.add_arguments(sp)
+    add_writer_arguments(sp)
+    sp.set_defaults(func=cmd_update)
+
+    args = p.parse_args()
+    return args.func(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
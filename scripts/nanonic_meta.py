@@ -0,0 +1,136 @@
+#!/usr/bin/env python3
+"""
+Decode the NanoNIC descriptors that a pipeline built with -D NANONIC_META
+prepends to the packets delivered to the host over QDMA C2H.
+
+The layout is defined in Custom_applications/common/nanonic_desc.h. Feed this
+script a capture taken on the host (e.g. with dpdk-pdump or tcpdump on the
+open-nic-driver interface) to get the per-packet metadata and the per-verdict,
+per-class, per-real and per-VIP packet counts.
+"""
+import argparse
+from collections import Counter
+import struct
+import sys
+
+from nanonic_pcap import read_pcap
+
+DESC_LEN = 64
+DESC_MAGIC = b"NT"
+DESC_VERSION = 1
+
+F_HASH = 1 << 0
+F_REAL = 1 << 1
+F_VIP = 1 << 2
+F_CLASS = 1 << 3
+F_PINNED = 1 << 4
+F_SAMPLE = 1 << 7
+
+VERDICTS = {0: "ABORTED", 1: "DROP", 2: "PASS", 3: "TX", 4: "REDIRECT"}
+CLASSES = {
+    0: "none",
+    1: "monitor",
+    2: "icmp_limited",
+    3: "lb_forward",
+    4: "lb_quic",
+    5: "reflect",
+}
+
+
+def parse_desc(data):
+    """Return the descriptor fields of a packet as a dict, or None."""
+    if len(data) < DESC_LEN or data[0:2] != DESC_MAGIC or data[2] != DESC_VERSION:
+        return None
+    verdict, flags, class_tag, event, encap = struct.unpack_from("BBBBB", data, 3)
+    flow_hash, real_index, vip_num, frame_len = struct.unpack_from(">IIHH", data, 8)
+    return {
+        "verdict": verdict,
+        "flags": flags,
+        "class": class_tag,
+        "event": event,
+        "encap": encap,
+        "hash": flow_hash if flags & F_HASH else None,
+        "real": real_index if flags & F_REAL else None,
+        "vip": vip_num if flags & F_VIP else None,
+        "frame_len": frame_len,
+        "params": data[20:DESC_LEN],
+    }
+
+
+def verdict_name(v):
+    return VERDICTS.get(v, str(v))
+
+
+def class_name(c):
+    return CLASSES.get(c, str(c))
+
+
+def print_counter(title, counter, fmt=str):
+    print(title)
+    print("-" * len(title))
+    for key, count in sorted(counter.items(), key=lambda e: -e[1]):
+        print(f"  {fmt(key):>16} : {count}")
+    print("")
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__,
+                                formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument("pcap", help="Capture of the C2H traffic.")
+    p.add_argument("--verbose", "-v", action="store_true",
+                   help="Print the descriptor of every packet.")
+    args = p.parse_args()
+
+    total = 0
+    without_desc = 0
+    event_records = 0
+    verdicts = Counter()
+    classes = Counter()
+    reals = Counter()
+    vips = Counter()
+
+    for idx, (ts, data) in enumerate(read_pcap(args.pcap)):
+        total += 1
+        desc = parse_desc(data)
+        if desc is None:
+            without_desc += 1
+            if args.verbose:
+                print(f"{idx:6d} {ts:.6f} no descriptor, {len(data)} bytes")
+            continue
+        if desc["flags"] & F_SAMPLE:
+            # Copy made by the event tap, see nanonic_events.py
+            event_records += 1
+            continue
+
+        verdicts[desc["verdict"]] += 1
+        classes[desc["class"]] += 1
+        if desc["real"] is not None:
+            reals[desc["real"]] += 1
+        if desc["vip"] is not None:
+            vips[desc["vip"]] += 1
+
+        if args.verbose:
+            fields = [f"verdict={verdict_name(desc['verdict'])}",
+                      f"class={class_name(desc['class'])}",
+                      f"len={desc['frame_len']}"]
+            for key in ("hash", "real", "vip"):
+                if desc[key] is not None:
+                    fields.append(f"{key}=0x{desc[key]:x}")
+            print(f"{idx:6d} {ts:.6f} " + " ".join(fields))
+
+    if args.verbose:
+        print("")
+    print(f"Packets: {total} ({without_desc} without descriptor, "
+          f"{event_records} event records)")
+    print("")
+    print_counter("Per verdict", verdicts, verdict_name)
+    print_counter("Per class", classes, class_name)
+    if reals:
+        print_counter("Per real index", reals)
+    if vips:
+        print_counter("Per VIP number", vips)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,56 @@
+#!/usr/bin/env python3
+"""
+Minimal pcap reader/writer shared by the NanoNIC scripts.
+
+Only the classic libpcap format is supported (microsecond and nanosecond
+variants, both byte orders), which is what the pcap_test_files use.
+"""
+import struct
+
+_MAGIC_US = 0xa1b2c3d4
+_MAGIC_NS = 0xa1b23c4d
+LINKTYPE_ETHERNET = 1
+
+
+def read_pcap(path):
+    """Yield (timestamp_seconds, packet_bytes) for each record of a pcap file."""
+    with open(path, "rb") as fh:
+        header = fh.read(24)
+        if len(header) < 24:
+            raise ValueError(f"{path}: truncated pcap header")
+
+        for endian in ("<", ">"):
+            magic = struct.unpack(endian + "I", header[:4])[0]
+            if magic in (_MAGIC_US, _MAGIC_NS):
+                break
+        else:
+            raise ValueError(f"{path}: not a pcap file")
+        scale = 1e-9 if magic == _MAGIC_NS else 1e-6
+
+        rec_fmt = endian + "IIII"
+        while True:
+            rec = fh.read(16)
+            if len(rec) < 16:
+                return
+            ts_sec, ts_frac, incl_len, _ = struct.unpack(rec_fmt, rec)
+            data = fh.read(incl_len)
+            if len(data) < incl_len:
+                raise ValueError(f"{path}: truncated packet record")
+            yield ts_sec + ts_frac * scale, data
+
+
+def write_pcap(path, packets, linktype=LINKTYPE_ETHERNET):
+    """Write an iterable of (timestamp_seconds, packet_bytes) to a pcap file.
+
+    A record may carry a third element, the original length of a packet that
+    was truncated to packet_bytes.
+    """
+    with open(path, "wb") as fh:
+        fh.write(struct.pack("<IHHiIII", _MAGIC_US, 2, 4, 0, 0, 0x40000, linktype))
+        for rec in packets:
+            ts, data = rec[0], rec[1]
+            orig_len = rec[2] if len(rec) > 2 else len(data)
+            sec = int(ts)
+            usec = int(round((ts - sec) * 1e6))
+            fh.write(struct.pack("<IIII", sec, usec, len(data), max(orig_len, len(data))))
+            fh.write(data)
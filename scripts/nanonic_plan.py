@@ -0,0 +1,273 @@
+#!/usr/bin/env python3
+"""
+Resource and capacity planner: how many copies of a pipeline, with which map
+sizes, fit on the card next to the OpenNIC shell, and at which throughput.
+
+Inputs:
+  - the HLS build of the application (the output directory of hls_build, read
+    with report_hls_synth --json), or a metrics file written by
+    report_hls_synth --json or nanonic_dse.py; its totals include the stages
+    and the inter-stage FIFOs (BRAM18 of 36 x 512 bits, as report_hls_synth
+    counts them)
+  - the utilization report of the shell (Vivado report_utilization of a build
+    without the pipeline), or nothing to plan against the bare device
+  - the nanonic_maps.json of the application, and --map NAME=ENTRIES for the
+    sizes to plan with; a resized map changes the BRAM of every pipeline by
+    the difference between the two sizes (see nanonic_maps.py report)
+
+The planner keeps every resource under --max-util percent of the device
+(placement and timing closure degrade above ~80%), gives the number of
+pipelines that fit and the resource that limits it, and the aggregate rate of
+1 to N pipelines for --frame-size frames, capped by the line rate of --ports
+ports. Pipelines are added as LANES of nanonic_pipeline_top or as one pipeline
+per port with gen_p2p_pipeline.py. --fit-map finds the largest power-of-two
+size of a map for a given number of pipelines.
+
+  scripts/nanonic_plan.py DSE/xdp_katran/base/clk_4/metrics.json \\
+      --maps Custom_applications/xdp_katran/nanonic_maps.json \\
+      --shell open-nic-shell/build/au250/utilization.rpt \\
+      --map single_lru_cache=65536 --fit-map single_lru_cache --pipelines 2
+"""
+import argparse
+import json
+import math
+import os
+import subprocess
+import sys
+import tempfile
+
+from nanonic_maps import bram18, entry_bits, load_spec, map_cost
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+REPORT = os.path.join(ROOT, "scripts", "report_hls_synth")
+BUS_BYTES = 64
+# Preamble, start of frame delimiter and inter-frame gap of Ethernet
+WIRE_OVERHEAD = 20
+
+RESOURCES = ["lut", "ff", "bram18", "uram", "dsp"]
+NAMES = {"lut": "LUT", "ff": "FF", "bram18": "BRAM18", "uram": "URAM", "dsp": "DSP"}
+
+DEVICES = {
+    # Alveo U250 (xcu250-figd2104-2L-e)
+    "u250": {"lut": 1728000, "ff": 3456000, "bram18": 5376, "uram": 1280, "dsp": 12288},
+    # Alveo U280 (xcu280-fsvh2892-2L-e)
+    "u280": {"lut": 1303680, "ff": 2607360, "bram18": 4032, "uram": 960, "dsp": 9024},
+}
+
+# Rows of report_utilization, and the factor to the unit of the planner
+UTIL_ROWS = {
+    "CLB LUTs": ("lut", 1),
+    "CLB Registers": ("ff", 1),
+    "Block RAM Tile": ("bram18", 2),
+    "URAM": ("uram", 1),
+    "DSPs": ("dsp", 1),
+}
+
+
+def read_metrics(path):
+    """Totals of a pipeline from a metrics file or an HLS build directory."""
+    if os.path.isdir(path):
+        with tempfile.TemporaryDirectory() as tmp:
+            out = os.path.join(tmp, "metrics.json")
+            res = subprocess.run([sys.executable, REPORT, "-s", "--json", out, path],
+                                 stdout=subprocess.DEVNULL, stderr=subprocess.PIPE,
+                                 text=True)
+            if res.returncode or not os.path.exists(out):
+                raise SystemExit(f"report_hls_synth failed on {path}: {res.stderr.strip()}")
+            with open(out) as fh:
+                metrics = json.load(fh)
+    else:
+        with open(path) as fh:
+            metrics = json.load(fh)
+    top = metrics["top"]
+    if top.get("Errors"):
+        print(f"Warning: {path} has {top['Errors']} stage(s) with errors, totals are partial")
+    return {
+        "lut": int(top.get("LUT", 0)),
+        "ff": int(top.get("FF", 0)),
+        "bram18": int(top.get("BRAM_18k", 0)),
+        "uram": int(top.get("URAM", 0)),
+        "dsp": int(top.get("DSP", 0)),
+        "fifo_bram18": int(metrics.get("fifos", {}).get("Num BRAMs", 0)),
+        "ii": max(1, int(top.get("Interval", 1))),
+        "fmax": float(top.get("Clock Rate (MHz)") or 0.0),
+    }
+
+
+def read_utilization(path):
+    """Used and available resources of a Vivado report_utilization file."""
+    used, avail = {}, {}
+    with open(path, errors="replace") as fh:
+        for line in fh:
+            cells = [c.strip() for c in line.strip().strip("|").split("|")]
+            if len(cells) < 4 or cells[0] not in UTIL_ROWS:
+                continue
+            key, factor = UTIL_ROWS[cells[0]]
+            if key in used:
+                continue
+            try:
+                # Site Type | Used | Fixed | [Prohibited |] Available | Util%
+                used[key] = math.ceil(float(cells[1]) * factor)
+                avail[key] = int(float(cells[-2]) * factor)
+            except ValueError:
+                continue
+    if not used:
+        raise SystemExit(f"{path}: no utilization table found")
+    return used, avail
+
+
+def parse_map_size(s):
+    name, sep, entries = s.partition("=")
+    if not sep:
+        raise argparse.ArgumentTypeError("expected NAME=ENTRIES")
+    return name, int(entries, 0)
+
+
+def maps_delta(spec, sizes):
+    """BRAM18 of one pipeline added by the map sizes, and the lines explaining it."""
+    delta, lines = 0, []
+    for m in spec.get("maps", []):
+        base = map_cost(m, 1)
+        new_m = dict(m, entries=sizes.get(m["name"], m["entries"]))
+        new = map_cost(new_m, 1)
+        # The build holds one table per map
+        d = new["shared"] - base["shared"]
+        delta += d
+        if d:
+            lines.append(f"  {m['name']:<20} {m['entries']:>8} -> {new_m['entries']:>8} "
+                         f"entries of {entry_bits(m)} bits: {d:+d} BRAM18")
+    unknown = set(sizes) - {m["name"] for m in spec.get("maps", [])}
+    if unknown:
+        raise SystemExit(f"no map {', '.join(sorted(unknown))} in the map description")
+    return delta, lines
+
+
+def fits(n, pipe, shell, budget):
+    return all(shell[r] + n * pipe[r] <= budget[r] for r in RESOURCES)
+
+
+def max_pipelines(pipe, shell, budget):
+    best, limit = None, None
+    for r in RESOURCES:
+        if pipe[r] == 0:
+            continue
+        n = max(0, (budget[r] - shell[r]) // pipe[r])
+        if best is None or n < best:
+            best, limit = n, r
+    return (best if best is not None else 0), limit
+
+
+def pct(v, total):
+    return 100.0 * v / total if total else 0.0
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__,
+                                formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument("build", help="HLS build directory or report_hls_synth --json metrics.")
+    p.add_argument("--maps", help="nanonic_maps.json of the application.")
+    p.add_argument("--map", type=parse_map_size, action="append", default=[],
+                   metavar="NAME=ENTRIES", help="Size of a map to plan with (repeatable).")
+    p.add_argument("--shell", help="report_utilization of the shell without the pipeline.")
+    p.add_argument("--device", choices=sorted(DEVICES), default="u250",
+                   help="Device when the shell report does not give it (default: %(default)s).")
+    p.add_argument("--max-util", type=float, default=80.0,
+                   help="Percentage of every resource the design may use (default: %(default)s).")
+    p.add_argument("--clock", type=float, default=250.0,
+                   help="Pipeline clock in MHz (default: %(default)s).")
+    p.add_argument("--frame-size", type=int, default=64,
+                   help="Frame size in bytes of the throughput (default: %(default)s).")
+    p.add_argument("--ports", type=int, default=2,
+                   help="Ports feeding the pipelines (default: %(default)s).")
+    p.add_argument("--port-gbps", type=float, default=100.0,
+                   help="Line rate of a port (default: %(default)s).")
+    p.add_argument("--pipelines", type=int, default=1,
+                   help="Pipelines for --fit-map (default: %(default)s).")
+    p.add_argument("--fit-map", metavar="NAME",
+                   help="Largest power-of-two size of this map that fits --pipelines pipelines.")
+    args = p.parse_args()
+
+    metrics = read_metrics(args.build)
+    spec = load_spec(args.maps) if args.maps else {"maps": []}
+    sizes = dict(args.map)
+
+    device = dict(DEVICES[args.device])
+    shell = dict.fromkeys(RESOURCES, 0)
+    if args.shell:
+        shell, avail = read_utilization(args.shell)
+        device.update(avail)
+        shell = dict(dict.fromkeys(RESOURCES, 0), **shell)
+    budget = {r: int(device[r] * args.max_util / 100) for r in RESOURCES}
+
+    delta, delta_lines = maps_delta(spec, sizes)
+    pipe = {r: metrics[r] for r in RESOURCES}
+    pipe["bram18"] += delta
+
+    run_mhz = min(args.clock, metrics["fmax"]) if metrics["fmax"] else args.clock
+    beats = math.ceil(args.frame_size / BUS_BYTES)
+    mpps = run_mhz / (metrics["ii"] * beats)
+    line_mpps = args.ports * args.port_gbps * 1e3 / ((args.frame_size + WIRE_OVERHEAD) * 8)
+
+    print(f"{spec.get('app', os.path.basename(os.path.normpath(args.build)))}: II "
+          f"{metrics['ii']}, {run_mhz:.1f} MHz, {mpps:.1f} Mpps per pipeline at "
+          f"{args.frame_size} B")
+    if metrics["fmax"] and metrics["fmax"] < args.clock:
+        print(f"  Fmax {metrics['fmax']:.1f} MHz is below the {args.clock:.1f} MHz clock")
+    if delta_lines:
+        print("Map sizes:")
+        for l in delta_lines:
+            print(l)
+    print("")
+    print(f"{'':<22}" + "".join(f"{NAMES[r]:>10}" for r in RESOURCES))
+    rows = [("Device", device), (f"Budget ({args.max_util:g}%)", budget),
+            ("Shell" if args.shell else "Shell (not given)", shell),
+            ("Pipeline", pipe)]
+    for name, v in rows:
+        print(f"{name:<22}" + "".join(f"{v[r]:>10}" for r in RESOURCES))
+    print(f"{'  of which FIFOs':<22}{'':>20}{metrics['fifo_bram18']:>10}")
+    print("")
+
+    n, limit = max_pipelines(pipe, shell, budget)
+    if n == 0:
+        over = [NAMES[r] for r in RESOURCES if shell[r] + pipe[r] > budget[r]]
+        print(f"No pipeline fits: {', '.join(over)} over the budget")
+    else:
+        print(f"Pipelines that fit: {n} (limited by {NAMES[limit]})")
+        print("")
+        print(f"{'Pipelines':>9}" + "".join(f"{NAMES[r] + '%':>9}" for r in RESOURCES)
+              + f"{'Mpps':>9}{'Gb/s':>9}")
+        for k in range(1, n + 1):
+            agg = min(k * mpps, line_mpps)
+            cap = " line rate" if k * mpps >= line_mpps else ""
+            print(f"{k:>9}"
+                  + "".join(f"{pct(shell[r] + k * pipe[r], device[r]):>9.1f}" for r in RESOURCES)
+                  + f"{agg:>9.1f}{agg * args.frame_size * 8 / 1e3:>9.1f}{cap}")
+            if cap:
+                break
+        print(f"\nLine rate of {args.ports} x {args.port_gbps:g}G at {args.frame_size} B: "
+              f"{line_mpps:.1f} Mpps, reached with {math.ceil(line_mpps / mpps)} pipeline(s)")
+
+    if args.fit_map:
+        m = next((m for m in spec.get("maps", []) if m["name"] == args.fit_map), None)
+        if m is None:
+            raise SystemExit(f"no map {args.fit_map} in the map description")
+        best = None
+        for shift in range(0, 27):
+            trial = dict(sizes, **{args.fit_map: 1 << shift})
+            d, _ = maps_delta(spec, trial)
+            trial_pipe = dict(pipe, bram18=metrics["bram18"] + d)
+            if not fits(args.pipelines, trial_pipe, shell, budget):
+                break
+            best = 1 << shift
+        print("")
+        if best is None:
+            print(f"{args.fit_map}: {args.pipelines} pipeline(s) do not fit at any size")
+        else:
+            bits = entry_bits(m)
+            print(f"{args.fit_map}: up to {best} entries with {args.pipelines} pipeline(s) "
+                  f"({bram18(bits, best)} BRAM18 per copy of {bits}-bit entries)")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
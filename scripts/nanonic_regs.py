@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+"""
+Register access to the NanoNIC pipeline top from the host.
+
+The AXI-Lite slave of nanonic_pipeline_top is reached through the OpenNIC
+shell register BAR (BAR2). The box250 user logic window starts at 0x100000 in
+that BAR; every NanoNIC block then takes a 4 KB window (see
+rtl/nanonic_pipeline_top.v).
+
+Registers are accessed by mmap'ing the PCIe resource file in sysfs, which
+needs root and the device to be bound to a driver that does not claim the BAR
+exclusively (open-nic-driver and vfio-pci both work).
+"""
+import mmap
+import os
+
+BOX250_BASE = 0x100000
+BLOCK_SIZE = 0x1000
+
+BLOCK_TOP = 0x0000
+BLOCK_LATENCY = 0x1000
+BLOCK_ENCAP = 0x2000
+BLOCK_EVENTS = 0x3000
+BLOCK_FLIGHT = 0x4000
+
+NANONIC_ID = 0x4E4E4943
+
+
+def add_arguments(parser):
+    """Add the options that select the device and the register window."""
+    parser.add_argument("--bdf", default="0000:d8:00.0",
+                        help="PCIe address of the OpenNIC physical function "
+                             "(default: %(default)s).")
+    parser.add_argument("--bar", type=int, default=2,
+                        help="BAR holding the shell registers (default: %(default)s).")
+    parser.add_argument("--base", type=lambda s: int(s, 0), default=BOX250_BASE,
+                        help="Offset of the NanoNIC registers in the BAR "
+                             "(default: 0x%(default)x).")
+
+
+class Regs:
+    """32-bit register window on a PCIe BAR."""
+
+    def __init__(self, bdf, bar=2, base=BOX250_BASE):
+        path = f"/sys/bus/pci/devices/{bdf}/resource{bar}"
+        self._fd = os.open(path, os.O_RDWR | os.O_SYNC)
+        size = os.fstat(self._fd).st_size
+        self._mm = mmap.mmap(self._fd, size, mmap.MAP_SHARED,
+                             mmap.PROT_READ | mmap.PROT_WRITE)
+        # Indexing a 32-bit view is one load or store of the whole register;
+        # a slice of the mmap is a memcpy, which may split it, and registers
+        # with side effects (a FIFO pop, a map writer message) act twice
+        self._words = memoryview(self._mm).cast("I")
+        self.base = base
+
+    @classmethod
+    def from_args(cls, args):
+        return cls(args.bdf, args.bar, args.base)
+
+    def close(self):
+        self._words.release()
+        self._mm.close()
+        os.close(self._fd)
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def read32(self, offset):
+        return self._words[(self.base + offset) >> 2]
+
+    def write32(self, offset, value):
+        self._words[(self.base + offset) >> 2] = value & 0xFFFFFFFF
+
+    def read64(self, offset):
+        # The card latches a 64-bit register when its low word is read, so the
+        # low word must come first.
+        lo = self.read32(offset)
+        hi = self.read32(offset + 4)
+        return (hi << 32) | lo
+
+    def check_id(self):
+        """Raise if the window does not hold a NanoNIC pipeline top."""
+        ident = self.read32(BLOCK_TOP + 0x00)
+        if ident != NANONIC_ID:
+            raise RuntimeError(f"no NanoNIC pipeline at 0x{self.base:x} "
+                               f"(id 0x{ident:08x})")
+        return self.read32(BLOCK_TOP + 0x04)
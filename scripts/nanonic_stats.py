@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+"""
+Print the global counters of a NanoNIC pipeline top: early drops, packets
+delivered to the host, packets dropped on their verdict and the XDP_TX traffic
+sent back to the wire by the hairpin.
+
+With --interval the counters are sampled twice and the rates are printed. Every
+hairpinned byte would otherwise cross PCIe twice (C2H to the host, then H2C
+when host software retransmits it), so the hairpin rate times two is the PCIe
+bandwidth kept on the card.
+"""
+import argparse
+import sys
+import time
+
+import nanonic_regs
+from nanonic_regs import BLOCK_TOP, Regs
+
+REG_EARLY_DROP = 0x08
+REG_CYCLES = 0x0C
+REG_HP_PKTS = 0x14
+REG_HP_BYTES = 0x18
+REG_VERDICT_DROP = 0x20
+REG_PORT1_PKTS = 0x24
+REG_MAPWR_GUARD = 0x28
+
+
+def read_counters(regs):
+    rd = lambda off: regs.read32(BLOCK_TOP + off)
+    return {
+        "cycles": regs.read64(BLOCK_TOP + REG_CYCLES),
+        "early_drop": rd(REG_EARLY_DROP),
+        "port1_pkts": rd(REG_PORT1_PKTS),
+        "mapwr_guard": rd(REG_MAPWR_GUARD),
+        "verdict_drop": rd(REG_VERDICT_DROP),
+        "hairpin_pkts": rd(REG_HP_PKTS),
+        "hairpin_bytes": regs.read64(BLOCK_TOP + REG_HP_BYTES),
+    }
+
+
+def delta(a, b, key):
+    # 32-bit counters wrap
+    mask = (1 << 64) - 1 if key in ("cycles", "hairpin_bytes") else (1 << 32) - 1
+    return (b[key] - a[key]) & mask
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__,
+                                formatter_class=argparse.RawDescriptionHelpFormatter)
+    nanonic_regs.add_arguments(p)
+    p.add_argument("--interval", type=float, default=0,
+                   help="Sample the counters twice, this many seconds apart, and print rates.")
+    p.add_argument("--clk-ps", type=int, default=4000,
+                   help="Period of the pipeline clock in ps (default: %(default)s, 250 MHz).")
+    args = p.parse_args()
+
+    with Regs.from_args(args) as regs:
+        version = regs.check_id()
+        first = read_counters(regs)
+        print(f"NanoNIC pipeline top v{version} at 0x{args.base:x}")
+        print(f"  early drops          : {first['early_drop']}")
+        print(f"  packets to the host  : {first['port1_pkts']}")
+        print(f"  verdict drops        : {first['verdict_drop']}")
+        print(f"  hairpin packets      : {first['hairpin_pkts']}")
+        print(f"  hairpin bytes        : {first['hairpin_bytes']}")
+        print(f"  map updates refused  : {first['mapwr_guard']}")
+        if args.interval <= 0:
+            return 0
+
+        time.sleep(args.interval)
+        second = read_counters(regs)
+
+    # Use the card clock for the interval, it is not affected by the host
+    cycles = delta(first, second, "cycles")
+    seconds = cycles * args.clk_ps * 1e-12 if cycles else args.interval
+    rate = lambda key: delta(first, second, key) / seconds
+    hp_bps = rate("hairpin_bytes") * 8
+    print("")
+    print(f"Over {seconds:.3f} s:")
+    print(f"  packets to the host  : {rate('port1_pkts') / 1e6:.3f} Mpps")
+    print(f"  hairpin              : {rate('hairpin_pkts') / 1e6:.3f} Mpps, {hp_bps / 1e9:.3f} Gb/s")
+    print(f"  PCIe traffic avoided : {2 * hp_bps / 1e9:.3f} Gb/s (C2H + H2C)")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
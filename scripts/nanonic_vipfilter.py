@@ -0,0 +1,234 @@
+#!/usr/bin/env python3
+"""
+Control plane and model of the VIP prefilter of xdp_katran
+(NANONIC_FLAGS="-D NANONIC_VIP_FILTER").
+
+vip_filter is a blocked Bloom filter of the (address, protocol) pairs of
+vip_map: a hash of the destination address and protocol of a packet selects
+one 64-bit word of the filter and three bits in it. When one of the bits is
+clear the address is not a VIP and the program passes the packet to the
+kernel right after process_l3_headers, without any vip_map lookup. A VIP never
+fails the test; another address passes it with a small probability and then
+takes the stock path. The map holds the complement of the Bloom bits, so the
+all-zero filter of a pipeline that was never loaded sends every packet down
+the stock path.
+
+  words  print the filter words for a list of VIPs, as stored in the map, as
+         INDEX=VALUE lines, the input of scripts/nanonic_maps.py update --file
+  load   write the filter of a list of VIPs through the map writer of the top
+         (vip_filter is map id 2, build with -D NANONIC_MAP_WRITER)
+  bench  map lookups per packet and map port utilization with and without the
+         filter for a traffic mix (95% non-VIP by default)
+
+A VIP is written ADDR[/PROTO], with PROTO tcp, udp or a number (both tcp and
+udp when left out). The filter cannot remove a VIP: load the filter of the
+new list. Add a VIP to the filter before adding it to vip_map, and remove it
+from vip_map before loading a filter without it. The program tests the
+filter after the L4 headers and the inline decapsulation, so tunnels and
+malformed packets are handled as without it.
+
+  python3 scripts/nanonic_vipfilter.py load 10.200.1.1/tcp fc00::100
+  python3 scripts/nanonic_vipfilter.py bench --vips 64 --frame-size 64
+"""
+import argparse
+import ipaddress
+import random
+import struct
+import sys
+
+import nanonic_regs
+from nanonic_maps import MAPWR_BASE, MapWriter
+from nanonic_regs import Regs
+
+# NANONIC_VIP_FILTER_WORDS of xdp_katran.c
+DEFAULT_WORDS = 512
+# Map id of vip_filter in xdp_katran/nanonic_maps.json
+MAP_ID = 2
+PROTOS = {"tcp": 6, "udp": 17}
+WIRE_OVERHEAD = 20
+
+
+def parse_vip(s):
+    addr, _, proto = s.partition("/")
+    ip = ipaddress.ip_address(addr)
+    if not proto:
+        return [(ip, PROTOS["tcp"]), (ip, PROTOS["udp"])]
+    return [(ip, PROTOS.get(proto.lower()) or int(proto, 0))]
+
+
+def filter_hash(ip, proto, words=DEFAULT_WORDS):
+    """Word and bit mask of an address, as vip_filter_may_match()."""
+    # The program reads the address as little-endian 32-bit words
+    w = struct.unpack(f"<{len(ip.packed) // 4}I", ip.packed)
+    h = 0
+    for x in w:
+        h ^= x
+    h = ((h ^ proto) * 0x9E3779B1) & 0xFFFFFFFF
+    h ^= h >> 16
+    h = (h * 0x85EBCA6B) & 0xFFFFFFFF
+    h ^= h >> 13
+    word = (h >> 18) & (words - 1)
+    mask = (1 << (h & 63)) | (1 << ((h >> 6) & 63)) | (1 << ((h >> 12) & 63))
+    return word, mask
+
+
+def build(vips, words=DEFAULT_WORDS):
+    table = [0] * words
+    for ip, proto in vips:
+        word, mask = filter_hash(ip, proto, words)
+        table[word] |= mask
+    return table
+
+
+def stored(table):
+    """Words of the map: the complement of the Bloom bits."""
+    return [~w & 0xFFFFFFFFFFFFFFFF for w in table]
+
+
+def may_match(table, ip, proto):
+    word, mask = filter_hash(ip, proto, len(table))
+    return table[word] & mask == mask
+
+
+def vip_list(args):
+    return [v for s in args.vips for v in parse_vip(s)]
+
+
+def cmd_words(args):
+    for i, w in enumerate(stored(build(vip_list(args), args.words))):
+        print(f"{i}=0x{w:016x}")
+    return 0
+
+
+def cmd_load(args):
+    vips = vip_list(args)
+    table = build(vips, args.words)
+    with Regs.from_args(args) as regs:
+        regs.check_id()
+        mw = MapWriter(regs, args.window)
+        if mw.val_w < 64:
+            raise SystemExit(f"Map writer values are {mw.val_w} bits, vip_filter needs 64")
+        before, lost = mw.version(), mw.lost()
+        mw.commit(list(enumerate(stored(table))))
+        after, lost = mw.version(), mw.lost() - lost
+    print(f"vip_filter at 0x{args.window:x}: {len(vips)} (address, protocol) pairs, "
+          f"{sum(bin(w).count('1') for w in table)} bits set, version {before} -> {after}")
+    if lost:
+        print(f"{lost} messages lost on a full FIFO, load the filter again")
+        return 1
+    return 0
+
+
+def random_ip(rng, v6):
+    if v6:
+        return ipaddress.IPv6Address(rng.getrandbits(128))
+    return ipaddress.IPv4Address(rng.getrandbits(32))
+
+
+def cmd_bench(args):
+    rng = random.Random(args.seed)
+    vips = [(random_ip(rng, rng.random() < args.ipv6), rng.choice([6, 17]))
+            for _ in range(args.vips)]
+    vip_set = set(vips)
+    table = build(vips, args.words)
+
+    # Stock program: a non-VIP packet misses both vip_map keys; a VIP packet
+    # hits the first one, or looks both up with NANONIC_PARALLEL_LOOKUP
+    vip_lookups = 2 if args.parallel else 1
+    stock = {"vip_map": 0, "large": 0}
+    filt = {"vip_filter": 0, "vip_map": 0, "large": 0}
+    false_pos = non_vip = 0
+    for _ in range(args.packets):
+        if rng.random() < args.vip_share:
+            ip, proto = rng.choice(vips)
+            is_vip = True
+        else:
+            ip, proto = random_ip(rng, rng.random() < args.ipv6), rng.choice([6, 17])
+            is_vip = (ip, proto) in vip_set
+        stock["vip_map"] += vip_lookups if is_vip else 2
+        stock["large"] += args.large_maps if is_vip else 0
+        filt["vip_filter"] += 1
+        if may_match(table, ip, proto):
+            filt["vip_map"] += vip_lookups if is_vip else 2
+            filt["large"] += args.large_maps if is_vip else 0
+            if not is_vip:
+                false_pos += 1
+        elif is_vip:
+            raise AssertionError(f"{ip}/{proto} is a VIP but fails the filter")
+        if not is_vip:
+            non_vip += 1
+
+    mpps = args.ports * args.port_gbps * 1000 / ((args.frame_size + WIRE_OVERHEAD) * 8)
+    per_cycle = mpps / args.clock
+    n = args.packets
+    print(f"{args.vips} VIPs, {1 - args.vip_share:.0%} non-VIP traffic, filter of "
+          f"{args.words} x 64 bits ({sum(bin(w).count('1') for w in table)} bits set)")
+    print(f"False positives: {false_pos} of {non_vip} non-VIP packets "
+          f"({100.0 * false_pos / max(non_vip, 1):.2f}%)")
+    print(f"{args.frame_size}-byte frames on {args.ports} x {args.port_gbps:g}G: "
+          f"{mpps:.1f} Mpps, {per_cycle:.2f} packets per cycle at {args.clock:.0f} MHz")
+    print("")
+    print(f"{'':<32} {'Lookups/pkt':>9} {'Port util':>10}")
+    for label, d in (("stock", stock), ("NANONIC_VIP_FILTER", filt)):
+        for name, count in d.items():
+            desc = f"{label} {name}" if name != "large" else f"{label} others (each)"
+            per_pkt = count / n / (args.large_maps if name == "large" else 1)
+            util = per_pkt * per_cycle
+            flag = "  (over one lookup per cycle)" if util > 1 else ""
+            print(f"{desc:<32} {per_pkt:>9.3f} {100 * util:>9.1f}%{flag}")
+    print("")
+    print(f"Port util: lookups per cycle on the map port (one lookup per cycle); "
+          f"others: the {args.large_maps} lookups of a VIP packet after vip_map, "
+          "one per map (ctl_array, LRU, ch_rings, reals)")
+    return 0
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__,
+                                formatter_class=argparse.RawDescriptionHelpFormatter)
+    nanonic_regs.add_arguments(p)
+    p.add_argument("--window", type=lambda s: int(s, 0), default=MAPWR_BASE + 0x1000 * MAP_ID,
+                   help="Window of vip_filter in the map writer (default: 0x%(default)x).")
+    p.add_argument("--words", type=int, default=DEFAULT_WORDS,
+                   help="NANONIC_VIP_FILTER_WORDS of the build (default: %(default)s).")
+    sub = p.add_subparsers(dest="cmd", required=True)
+
+    sp = sub.add_parser("words", help="Print the filter as INDEX=VALUE lines.")
+    sp.add_argument("vips", nargs="+", help="VIPs, ADDR[/PROTO].")
+    sp.set_defaults(func=cmd_words)
+
+    sp = sub.add_parser("load", help="Write and commit the filter on the card.")
+    sp.add_argument("vips", nargs="+", help="VIPs, ADDR[/PROTO].")
+    sp.set_defaults(func=cmd_load)
+
+    sp = sub.add_parser("bench", help="Map lookups and port utilization for a mix.")
+    sp.add_argument("--vips", type=int, default=64,
+                    help="Random VIPs in vip_map (default: %(default)s).")
+    sp.add_argument("--vip-share", type=float, default=0.05,
+                    help="Share of the packets sent to a VIP (default: %(default)s).")
+    sp.add_argument("--ipv6", type=float, default=0.1,
+                    help="Share of IPv6 addresses (default: %(default)s).")
+    sp.add_argument("--packets", type=int, default=200000,
+                    help="Packets of the mix (default: %(default)s).")
+    sp.add_argument("--parallel", action="store_true",
+                    help="Build with NANONIC_PARALLEL_LOOKUP (both vip_map keys looked up).")
+    sp.add_argument("--large-maps", type=int, default=4,
+                    help="Lookups of a VIP packet after vip_map (default: %(default)s).")
+    sp.add_argument("--frame-size", type=int, default=64,
+                    help="Frame size in bytes (default: %(default)s).")
+    sp.add_argument("--ports", type=int, default=1, help="Ports (default: %(default)s).")
+    sp.add_argument("--port-gbps", type=float, default=100.0,
+                    help="Port speed in Gb/s (default: %(default)s).")
+    sp.add_argument("--clock", type=float, default=250.0,
+                    help="Pipeline clock in MHz (default: %(default)s).")
+    sp.add_argument("--seed", type=int, default=1, help="Random seed (default: %(default)s).")
+    sp.set_defaults(func=cmd_bench)
+
+    args = p.parse_args()
+    if args.words & (args.words - 1):
+        p.error("--words must be a power of two")
+    return args.func(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
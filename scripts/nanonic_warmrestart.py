@@ -0,0 +1,299 @@
+#!/usr/bin/env python3
+"""
+Warm restart of the Katran connection table (xdp_katran built with
+-D NANONIC_META -D NANONIC_WARM_RESTART).
+
+A reload of the bitstream or a reset of the card empties single_lru_cache,
+and every established connection is hashed again on the ring. With
+NANONIC_WARM_RESTART the program marks each packet that pins a connection in
+the LRU (NANONIC_F_PINNED, event lru_insert unless it carries another one)
+and the event tap copies it to the host, so the host keeps a journal of the
+connection table: the last real of every flow, bounded like the LRU. After
+the reload the journal is written in bulk to lru_restore; an LRU miss of a
+non-SYN packet finds its saved real there and pins it in the LRU again.
+
+  record   follow the records of the tap, live on --iface or from captures
+           of the C2H traffic, and save the journal to a checkpoint file,
+           every --save-every seconds and on exit; on SIGINT or SIGTERM it
+           drains the records still queued before saving
+  show     print a checkpoint
+  restore  write a checkpoint to lru_restore, with the restore flag of
+           ctl_array set while the entries go in
+  clear    delete the connections of a checkpoint from lru_restore once they
+           are back in the LRU
+
+Both maps are written through the map writer of the top (MAPWR_EN, Katran
+built with -D NANONIC_MAP_WRITER as well): lru_restore is map id 3 and
+ctl_array map id 0. The messages reach the pipeline in the order they were
+written, so the flag is cleared after the last entry is in.
+
+While the flag is set, a non-SYN packet that misses both tables is routed on
+the ring without an LRU entry: its saved real takes over as soon as the entry
+is written, instead of being shadowed by a new LRU entry. SYN packets are not
+affected. Records the tap drops on a full FIFO (nanonic_events.py stats) are
+connections the journal misses; after the reload they are hashed on the ring
+as with the stock program. Run the tap with period 1.
+
+Planned reload:
+
+  python3 scripts/nanonic_events.py config --period 1
+  python3 scripts/nanonic_warmrestart.py record --iface ens4 conns.ckpt
+  (SIGINT when the card is to be reloaded, reload, start the program)
+  python3 scripts/nanonic_warmrestart.py --iface ens4 restore conns.ckpt
+  python3 scripts/nanonic_warmrestart.py --iface ens4 clear conns.ckpt
+
+restore and clear use the bulk transfer engine (scripts/nanonic_mapdma.py)
+with --iface or --standin, which waits for room in the FIFO of the writer
+before every entry, and the register BAR otherwise.
+"""
+import argparse
+import ipaddress
+import os
+import signal
+import socket
+import sys
+import time
+from collections import OrderedDict
+
+import nanonic_mapdma
+import nanonic_regs
+from nanonic_events import flow_str, parse_flow
+from nanonic_maps import MAPWR_BASE, MapWriter
+from nanonic_meta import F_PINNED, F_SAMPLE, parse_desc
+from nanonic_pcap import read_pcap
+from nanonic_regs import Regs
+
+# Defaults of the Katran build
+LRU_ENTRIES = 1000
+RESTORE_CTL_POS = 15
+# Map ids of xdp_katran/nanonic_maps.json
+CTL_ARRAY_ID = 0
+LRU_RESTORE_ID = 3
+
+ETH_P_ALL = 0x0003
+PROTOS = {"tcp": 6, "udp": 17}
+
+
+def flow_key(flow):
+    """struct flow_key of the headers, as the key of lru_restore."""
+    proto, src, sport, dst, dport = flow
+    b = src.packed.ljust(16, b"\x00") + dst.packed.ljust(16, b"\x00")
+    b += sport.to_bytes(2, "big") + dport.to_bytes(2, "big") + bytes([proto, 0, 0, 0])
+    return int.from_bytes(b, "little")
+
+
+class Journal:
+    """Last real of every pinned flow, the oldest dropped past entries."""
+
+    def __init__(self, entries):
+        self.entries = entries
+        self.conns = OrderedDict()
+        self.records = self.pinned = self.evicted = 0
+
+    def add(self, data, ts):
+        desc = parse_desc(data)
+        if desc is None or not desc["flags"] & F_SAMPLE:
+            return
+        self.records += 1
+        if not desc["flags"] & F_PINNED or desc["real"] is None:
+            return
+        flow = parse_flow(data[64:])
+        if flow is None:
+            return
+        self.pinned += 1
+        self.conns[flow] = (desc["real"], ts)
+        self.conns.move_to_end(flow)
+        while len(self.conns) > self.entries:
+            self.conns.popitem(last=False)
+            self.evicted += 1
+
+    def save(self, path):
+        tmp = path + ".tmp"
+        with open(tmp, "w") as fh:
+            fh.write(f"# nanonic warm restart checkpoint, {time.ctime()}\n")
+            fh.write("# proto src sport dst dport real pinned_at\n")
+            for (proto, src, sport, dst, dport), (real, ts) in self.conns.items():
+                fh.write(f"{proto} {src} {sport} {dst} {dport} {real} {ts:.3f}\n")
+        os.replace(tmp, path)
+
+
+def load_checkpoint(path):
+    conns = []
+    with open(path) as fh:
+        for line in fh:
+            if not line.strip() or line.startswith("#"):
+                continue
+            proto, src, sport, dst, dport, real, ts = line.split()
+            flow = (int(proto), ipaddress.ip_address(src), int(sport),
+                    ipaddress.ip_address(dst), int(dport))
+            conns.append((flow, int(real), float(ts)))
+    return conns
+
+
+def cmd_record(args):
+    journal = Journal(args.entries)
+    if args.pcap:
+        for path in args.pcap:
+            for ts, data in read_pcap(path):
+                journal.add(data, ts)
+        journal.save(args.checkpoint)
+    else:
+        if not args.iface:
+            raise SystemExit("Give --iface or --pcap")
+        sock = socket.socket(socket.AF_PACKET, socket.SOCK_RAW, socket.htons(ETH_P_ALL))
+        sock.bind((args.iface, ETH_P_ALL))
+        sock.settimeout(0.05)
+        stopping = []
+        for sig in (signal.SIGINT, signal.SIGTERM):
+            signal.signal(sig, lambda *_: stopping.append(time.time()))
+        end = time.time() + args.duration if args.duration else None
+        saved = quiet = time.time()
+        while True:
+            now = time.time()
+            if end and now >= end and not stopping:
+                stopping.append(now)
+            # Drain: the records queued before the stop keep coming for a
+            # while, stop once the tap has been quiet long enough
+            if stopping and now - quiet >= args.drain_ms / 1e3:
+                break
+            try:
+                data = sock.recv(65536)
+            except socket.timeout:
+                continue
+            except InterruptedError:
+                continue
+            quiet = time.time()
+            journal.add(data, quiet)
+            if args.save_every and quiet - saved >= args.save_every:
+                journal.save(args.checkpoint)
+                saved = quiet
+        sock.close()
+        journal.save(args.checkpoint)
+    print(f"{journal.records} records, {journal.pinned} pinned connections, "
+          f"{len(journal.conns)} saved to {args.checkpoint} "
+          f"({journal.evicted} evicted past {args.entries} entries)")
+    return 0
+
+
+def cmd_show(args):
+    now = time.time()
+    for flow, real, ts in load_checkpoint(args.checkpoint):
+        print(f"{flow_str(flow):<56} real {real:<6} pinned {now - ts:8.1f} s ago")
+    return 0
+
+
+def open_regs(args):
+    if args.iface or args.standin:
+        return nanonic_mapdma.DmaRegs.from_args(args)
+    return Regs.from_args(args)
+
+
+def open_maps(regs, args):
+    """Writers of lru_restore and ctl_array."""
+    cls = nanonic_mapdma.DmaMapWriter if isinstance(regs, nanonic_mapdma.DmaRegs) else MapWriter
+    restore = cls(regs, MAPWR_BASE + 0x1000 * LRU_RESTORE_ID)
+    if restore.key_w < 320 or restore.val_w < 32:
+        raise SystemExit(f"Map writer keys and values are {restore.key_w} and "
+                         f"{restore.val_w} bits, lru_restore needs 320 and 32")
+    return restore, cls(regs, MAPWR_BASE + 0x1000 * CTL_ARRAY_ID)
+
+
+def summary(regs, restore, lost):
+    lost = restore.lost() - lost
+    text = f", {lost} messages lost on a full FIFO" if lost else ""
+    if isinstance(regs, nanonic_mapdma.DmaRegs):
+        text += f", {regs.ops_sent} register accesses in {regs.frames} frames"
+    return lost, text
+
+
+def cmd_restore(args):
+    now = time.time()
+    conns = load_checkpoint(args.checkpoint)
+    entries = [(flow_key(flow), real) for flow, real, ts in conns
+               if flow[0] != PROTOS["udp"] or not args.udp_timeout
+               or now - ts <= args.udp_timeout]
+    expired = len(conns) - len(entries)
+    t0 = time.time()
+    with open_regs(args) as regs:
+        regs.check_id()
+        restore, ctl = open_maps(regs, args)
+        lost = restore.lost()
+        ctl.commit([(args.ctl_pos, 1)])
+        try:
+            for key, real in entries:
+                restore.update(key, real)
+            restore.commit()
+        finally:
+            ctl.commit([(args.ctl_pos, 0)])
+        lost, text = summary(regs, restore, lost)
+    print(f"{len(entries)} connections restored to lru_restore in {time.time() - t0:.3f} s "
+          f"({expired} UDP flows expired){text}")
+    return 1 if lost else 0
+
+
+def cmd_clear(args):
+    keys = [flow_key(flow) for flow, _, _ in load_checkpoint(args.checkpoint)]
+    with open_regs(args) as regs:
+        regs.check_id()
+        restore, _ = open_maps(regs, args)
+        lost = restore.lost()
+        for key in keys:
+            restore.delete(key)
+        restore.commit()
+        lost, text = summary(regs, restore, lost)
+    print(f"{len(keys)} connections deleted from lru_restore{text}")
+    return 1 if lost else 0
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__,
+                                formatter_class=argparse.RawDescriptionHelpFormatter)
+    nanonic_regs.add_arguments(p)
+    p.add_argument("--iface", help="OpenNIC netdev: tap records, and the bulk transfer engine.")
+    p.add_argument("--standin", metavar="HOST:PORT",
+                   help="Stand-in of the engine (nanonic_mapdma.py serve).")
+    p.add_argument("--timeout", type=float, default=1.0,
+                   help="Seconds to wait for a response of the engine (default: %(default)s).")
+    p.add_argument("--frame-size", type=int, default=1514,
+                   help="Largest command frame in bytes (default: %(default)s).")
+    p.add_argument("--frames-in-flight", type=int, default=8,
+                   help="Frames sent before waiting for a response (default: %(default)s).")
+    p.add_argument("--ctl-pos", type=int, default=RESTORE_CTL_POS,
+                   help="NANONIC_RESTORE_CTL_POS of the build (default: %(default)s).")
+    sub = p.add_subparsers(dest="cmd", required=True)
+
+    sp = sub.add_parser("record", help="Keep the journal of the pinned connections.")
+    sp.add_argument("checkpoint", help="Checkpoint file to write.")
+    sp.add_argument("--pcap", nargs="+", help="Captures of the C2H traffic instead of --iface.")
+    sp.add_argument("--entries", type=int, default=LRU_ENTRIES,
+                    help="Entries of single_lru_cache (default: %(default)s).")
+    sp.add_argument("--duration", type=float, help="Stop after this many seconds.")
+    sp.add_argument("--save-every", type=float, default=10.0,
+                    help="Seconds between checkpoints, 0 for on exit only "
+                         "(default: %(default)s).")
+    sp.add_argument("--drain-ms", type=float, default=200.0,
+                    help="Quiet time that ends the drain (default: %(default)s).")
+    sp.set_defaults(func=cmd_record)
+
+    sp = sub.add_parser("show", help="Print a checkpoint.")
+    sp.add_argument("checkpoint", help="Checkpoint file.")
+    sp.set_defaults(func=cmd_show)
+
+    sp = sub.add_parser("restore", help="Write a checkpoint to lru_restore.")
+    sp.add_argument("checkpoint", help="Checkpoint file.")
+    sp.add_argument("--udp-timeout", type=float, default=0.0,
+                    help="Leave out the UDP flows pinned more than this many seconds "
+                         "before, 0 to keep them all: the journal does not see the LRU "
+                         "hits that keep a UDP entry alive (default: %(default)s).")
+    sp.set_defaults(func=cmd_restore)
+
+    sp = sub.add_parser("clear", help="Delete the connections of a checkpoint from lru_restore.")
+    sp.add_argument("checkpoint", help="Checkpoint file given to restore.")
+    sp.set_defaults(func=cmd_clear)
+
+    args = p.parse_args()
+    return args.func(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())